@@ -25,6 +25,10 @@ Logger::Logger()
 
 Logger * Logger::getInstance()
 {
+    // The batch mode prints from several threads.
+#ifdef _OPENMP
+    #pragma omp critical( logger )
+#endif
     if ( NULL == m_pInstance )
     {
         m_pInstance = new Logger();
@@ -68,15 +72,20 @@ void Logger::print( const wxString &str, const LogLevel level )
     std::string message_string = std::string(str.mb_str());
     std::string prefix_string = std::string(prefix.mb_str());
     
-    m_oss << "[" << setw(2) << time.GetHour() << ":" << setw(2) << time.GetMinute() << ":" << setw(2) << time.GetSecond() << "]" << " " << prefix_string << message_string << "\n";
-    
-    if( LOGLEVEL_ERROR == level || LOGLEVEL_GLERROR == level )
+#ifdef _OPENMP
+    #pragma omp critical( logger )
+#endif
     {
-        m_lastError = str;
-    }
+        m_oss << "[" << setw(2) << time.GetHour() << ":" << setw(2) << time.GetMinute() << ":" << setw(2) << time.GetSecond() << "]" << " " << prefix_string << message_string << "\n";
+    
+        if( LOGLEVEL_ERROR == level || LOGLEVEL_GLERROR == level )
+        {
+            m_lastError = str;
+        }
 
-    printf( "%s", m_oss.str().c_str() );
-    m_oss.str( "" );
+        printf( "%s", m_oss.str().c_str() );
+        m_oss.str( "" );
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////
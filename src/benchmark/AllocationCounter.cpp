@@ -0,0 +1,65 @@
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+// The exception specifications of the replaced operators must match the
+// ones of the standard library.
+#if __cplusplus >= 201103L
+    #define FN_THROW_BAD_ALLOC
+    #define FN_THROW_NOTHING    noexcept
+#else
+    #define FN_THROW_BAD_ALLOC  throw( std::bad_alloc )
+    #define FN_THROW_NOTHING    throw()
+#endif
+
+namespace
+{
+unsigned long s_count = 0;
+
+void * allocate( std::size_t size )
+{
+#ifdef _OPENMP
+    #pragma omp atomic
+#endif
+    ++s_count;
+
+    void *pMemory = std::malloc( size > 0 ? size : 1 );
+    if( pMemory == NULL )
+    {
+        throw std::bad_alloc();
+    }
+    return pMemory;
+}
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+unsigned long AllocationCounter::getCount()
+{
+    return s_count;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Replacements of the global operators. The nothrow versions are left to
+// the runtime, they are not used by the navigator.
+///////////////////////////////////////////////////////////////////////////
+void * operator new( std::size_t size ) FN_THROW_BAD_ALLOC
+{
+    return allocate( size );
+}
+
+void * operator new[]( std::size_t size ) FN_THROW_BAD_ALLOC
+{
+    return allocate( size );
+}
+
+void operator delete( void *pMemory ) FN_THROW_NOTHING
+{
+    std::free( pMemory );
+}
+
+void operator delete[]( void *pMemory ) FN_THROW_NOTHING
+{
+    std::free( pMemory );
+}
@@ -0,0 +1,25 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            AllocationCounter.h
+//
+// Description: Counts the calls to the global operator new of the process.
+//
+// The global operators new and delete are replaced in AllocationCounter.cpp,
+// which is only part of the benchmark executable: the navigator itself
+// keeps the operators of the runtime.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef ALLOCATIONCOUNTER_H_
+#define ALLOCATIONCOUNTER_H_
+
+class AllocationCounter
+{
+private:
+    AllocationCounter(){};
+    ~AllocationCounter(){};
+
+public:
+    // Allocations since the process started, from every thread. To be read
+    // outside of the parallel regions.
+    static unsigned long getCount();
+};
+
+#endif /* ALLOCATIONCOUNTER_H_ */
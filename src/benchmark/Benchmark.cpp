@@ -0,0 +1,945 @@
+#include "Benchmark.h"
+
+#include "AllocationCounter.h"
+#include "SyntheticData.h"
+#include "../Logger.h"
+#include "../dataset/Anatomy.h"
+#include "../dataset/DatasetManager.h"
+#include "../dataset/FiberBitset.h"
+#include "../dataset/FiberBVH.h"
+#include "../dataset/Fibers.h"
+#include "../dataset/Maximas.h"
+#include "../dataset/Octree.h"
+#include "../dataset/RestingStateNetwork.h"
+#include "../dataset/RTTFibers.h"
+#include "../dataset/RTTrackingHelper.h"
+#include "../dataset/Tensors.h"
+#include "../dataset/VisibleLines.h"
+#include "../gui/SceneManager.h"
+#include "../gui/SelectionBox.h"
+#include "../gui/SelectionEllipsoid.h"
+#include "../gui/SelectionTree.h"
+#include "../gui/SelectionVOI.h"
+#include "../misc/IsoSurface/Vector.h"
+#include "../version/VersionString.h"
+
+#include <wx/filename.h>
+#include <wx/stopwatch.h>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __WXMSW__
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+namespace
+{
+// Positions visited by the moving boxes, in mm. The sweep goes through the
+// whole grid along its diagonal.
+Vector getSweepPosition( int step, int nbSteps, float extentX, float extentY, float extentZ )
+{
+    const float t = ( step + 0.5f ) / nbSteps;
+    return Vector( extentX * ( 0.15f + 0.7f * t ), extentY * ( 0.15f + 0.7f * t ), extentZ * ( 0.3f + 0.4f * t ) );
+}
+
+// Before wxWidgets 2.9.3, the stop watch only counts milliseconds.
+double getMs( wxStopWatch &watch )
+{
+#if wxCHECK_VERSION( 2, 9, 3 )
+    return watch.TimeInMicro().ToDouble() / 1000.0;
+#else
+    return static_cast< double >( watch.Time() );
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Anatomy::createOffset as it was before the exact distance transform, kept
+// to time it and to check the new one against it. The distances are in
+// voxels, so both only agree on isotropic grids of 1 mm.
+///////////////////////////////////////////////////////////////////////////
+void referenceOffset( std::vector< float > &io_dataset, int nbCols, int nbRows, int nbBands )
+{
+    const int nbPixels = nbBands * nbRows * nbCols;
+    const int sliceSize = nbRows * nbCols;
+    const float dmax( 999999999.0f );
+
+    std::vector< char > isBackground( nbPixels );
+    for( int i = 0; i < nbPixels; ++i )
+    {
+        isBackground[i] = io_dataset[i] < 0.01;
+    }
+
+    std::vector< float > &dist = io_dataset;
+    dist.assign( nbPixels, 0.0f );
+
+    // First pass: distance to the nearest background voxel along X. A line
+    // without background gets the width of the grid.
+    for( int b = 0; b < nbBands; ++b )
+    {
+        for( int r = 0; r < nbRows; ++r )
+        {
+            for( int c = 0; c < nbCols; ++c )
+            {
+                const int line = b * sliceSize + r * nbCols;
+                if( isBackground[line + c] )
+                {
+                    continue;
+                }
+
+                int cc1 = c;
+                while( cc1 < nbCols && !isBackground[line + cc1] )
+                {
+                    cc1++;
+                }
+                const int d1 = ( cc1 >= nbCols ? nbCols : ( cc1 - c ) );
+
+                int cc2 = c;
+                while( cc2 >= 0 && !isBackground[line + cc2] )
+                {
+                    cc2--;
+                }
+                const int d2 = ( cc2 <= 0 ? nbCols : ( c - cc2 ) );
+
+                const int d = std::min( d1, d2 );
+                dist[line + c] = (float)( d * d );
+            }
+        }
+    }
+
+    // Second pass, along Y.
+    std::vector< double > array( std::max( nbBands, nbRows ) );
+    for( int b = 0; b < nbBands; b++ )
+    {
+        for( int c = 0; c < nbCols; c++ )
+        {
+            for( int r = 0; r < nbRows; r++ )
+            {
+                array[r] = (double)dist[b * sliceSize + r * nbCols + c];
+            }
+
+            for( int r = 0; r < nbRows; r++ )
+            {
+                if( isBackground[b * sliceSize + r * nbCols + c] )
+                    continue;
+
+                float dmin = dmax;
+                const double g = sqrt( array[r] );
+                const int istart = std::max( 0, r - (int)g );
+                const int iend   = std::min( nbRows, r + (int)g + 1 );
+
+                for( int rr = istart; rr < iend; rr++ )
+                {
+                    const float u = array[rr] + ( r - rr ) * ( r - rr );
+                    dmin = std::min( dmin, u );
+                }
+
+                dist[b * sliceSize + r * nbCols + c] = dmin;
+            }
+        }
+    }
+
+    // Third pass, along Z.
+    for( int r = 0; r < nbRows; r++ )
+    {
+        for( int c = 0; c < nbCols; c++ )
+        {
+            for( int b = 0; b < nbBands; b++ )
+            {
+                array[b] = (double)dist[b * sliceSize + r * nbCols + c];
+            }
+
+            for( int b = 0; b < nbBands; b++ )
+            {
+                if( isBackground[b * sliceSize + r * nbCols + c] )
+                    continue;
+
+                float dmin = dmax;
+                const double g = sqrt( array[b] );
+                const int istart = std::max( 0, b - (int)g - 1 );
+                const int iend   = std::min( nbBands, b + (int)g + 1 );
+
+                for( int bb = istart; bb < iend; bb++ )
+                {
+                    const float u = array[bb] + ( b - bb ) * ( b - bb );
+                    dmin = std::min( dmin, u );
+                }
+
+                dist[b * sliceSize + r * nbCols + c] = dmin;
+            }
+        }
+    }
+
+    float max = 0;
+    for( int i = 0; i < nbPixels; ++i )
+    {
+        dist[i] = sqrt( (double)dist[i] );
+        max = std::max( max, dist[i] );
+    }
+    for( int i = 0; i < nbPixels; ++i )
+    {
+        dist[i] = dist[i] / max;
+    }
+
+    // Gaussian smoothing, sigma of 4 voxels, one axis after the other.
+    const double sigma = 4;
+    const int dim = (int)( 3.0 * sigma + 1 );
+    const int n = 2 * dim + 1;
+
+    std::vector< float > kernel( n );
+    double sum = 0;
+    for( int i = 0; i < n; ++i )
+    {
+        const double z = ( i - dim ) / sigma;
+        const double uu = exp( -z * z * 0.5 ) / ( sigma * 2.506628273 );
+        sum += uu;
+        kernel[i] = uu;
+    }
+    for( int i = 0; i < n; ++i )
+    {
+        kernel[i] = kernel[i] / sum;
+    }
+
+    const int d = n / 2;
+    std::vector< float > tmp( nbPixels, 0.0f );
+
+    for( int b = 0; b < nbBands; ++b )
+    {
+        for( int r = 0; r < nbRows; ++r )
+        {
+            for( int c = d; c < nbCols - d; ++c )
+            {
+                double lineSum = 0;
+                for( int k = 0; k < n; ++k )
+                {
+                    lineSum += (double)dist[b * sliceSize + r * nbCols + c - d + k] * kernel[k];
+                }
+                tmp[b * sliceSize + r * nbCols + c] = lineSum;
+            }
+        }
+    }
+    for( int b = 0; b < nbBands; ++b )
+    {
+        for( int r = d; r < nbRows - d; ++r )
+        {
+            for( int c = 0; c < nbCols; ++c )
+            {
+                double lineSum = 0;
+                for( int k = 0; k < n; ++k )
+                {
+                    lineSum += (double)tmp[b * sliceSize + ( r - d + k ) * nbCols + c] * kernel[k];
+                }
+                dist[b * sliceSize + r * nbCols + c] = lineSum;
+            }
+        }
+    }
+    for( int b = d; b < nbBands - d; ++b )
+    {
+        for( int r = 0; r < nbRows; ++r )
+        {
+            for( int c = 0; c < nbCols; ++c )
+            {
+                double lineSum = 0;
+                for( int k = 0; k < n; ++k )
+                {
+                    lineSum += (double)dist[( b - d + k ) * sliceSize + r * nbCols + c] * kernel[k];
+                }
+                tmp[b * sliceSize + r * nbCols + c] = lineSum;
+            }
+        }
+    }
+
+    io_dataset.swap( tmp );
+}
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+Benchmark::Benchmark( const wxString &workDir, int repetitions, bool quick )
+:   m_workDir( workDir ),
+    m_repetitions( std::max( repetitions, 1 ) ),
+    m_quick( quick ),
+    m_failedChecks( 0 )
+{
+    if( quick )
+    {
+        m_columns   = 48;
+        m_rows      = 48;
+        m_frames    = 30;
+        m_nbFibers  = 5000;
+        m_rsnSize   = 24;
+        m_nbSeeds   = 5;
+        m_maskSize  = 64;
+    }
+    else
+    {
+        m_columns   = 96;
+        m_rows      = 96;
+        m_frames    = 60;
+        m_nbFibers  = 50000;
+        m_rsnSize   = 48;
+        m_nbSeeds   = 10;
+        m_maskSize  = 256;
+    }
+
+    m_voxelSize = 2.0f;
+    m_nbPoints  = 100;
+    m_rsnBands  = 108;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+bool Benchmark::run()
+{
+    if( !setUp() )
+    {
+        return false;
+    }
+
+    benchLoadTRK();
+    benchOctree();
+    benchSelectionTree();
+    benchTracking();
+    benchTrackingHARDI();
+    benchCorrelation();
+    benchDistanceMap();
+
+    checkSelectionDelta();
+    checkVisibleLines();
+    checkTrackingThreads();
+
+    for( size_t i = 0; i < m_files.size(); ++i )
+    {
+        wxRemoveFile( m_files[i] );
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Writes the datasets and loads them the same way the navigator does. No
+// VBO can be created without GL context, they are disabled.
+///////////////////////////////////////////////////////////////////////////
+bool Benchmark::setUp()
+{
+    SceneManager::getInstance()->setUsingVBO( false );
+
+    const wxString prefix = m_workDir + wxFileName::GetPathSeparator() + wxT( "fn_benchmark_" );
+    const wxString anatomyPath = prefix + wxT( "anatomy.nii" );
+    const wxString tensorsPath = prefix + wxT( "tensors.nii" );
+    const wxString maximasPath = prefix + wxT( "maximas.nii" );
+    m_trkPath = prefix + wxT( "fibers.trk" );
+
+    m_files.push_back( anatomyPath );
+    m_files.push_back( tensorsPath );
+    m_files.push_back( maximasPath );
+    m_files.push_back( m_trkPath );
+
+    if( !SyntheticData::writeAnatomy( anatomyPath, m_columns, m_rows, m_frames, m_voxelSize ) ||
+        !SyntheticData::writeTensors( tensorsPath, m_columns, m_rows, m_frames, m_voxelSize ) ||
+        !SyntheticData::writeMaximas( maximasPath, m_columns, m_rows, m_frames, m_voxelSize ) ||
+        !SyntheticData::writeTRK( m_trkPath, m_nbFibers, m_nbPoints, m_columns, m_rows, m_frames, m_voxelSize ) )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "Cannot write the datasets in \"%s\"" ), m_workDir.c_str() ), LOGLEVEL_ERROR );
+        return false;
+    }
+
+    DatasetManager *pManager = DatasetManager::getInstance();
+    m_anatomyIndex = pManager->load( anatomyPath, wxT( "nii" ) );
+    if( !m_anatomyIndex.isOk() )
+    {
+        return false;
+    }
+
+    m_tensorsIndex = pManager->load( tensorsPath, wxT( "nii" ) );
+    m_maximasIndex = pManager->load( maximasPath, wxT( "nii" ) );
+    m_fibersIndex  = pManager->load( m_trkPath, wxT( "trk" ) );
+
+    return m_tensorsIndex.isOk() && m_maximasIndex.isOk() && m_fibersIndex.isOk();
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Includes the spatial indices and the global properties built by
+// Fibers::load, as when a file is opened in the navigator.
+///////////////////////////////////////////////////////////////////////////
+void Benchmark::benchLoadTRK()
+{
+    Result result;
+    result.m_name    = wxT( "load_trk" );
+    result.m_dataset = wxString::Format( wxT( "%d fibers x %d points" ), m_nbFibers, m_nbPoints );
+    result.m_unit    = wxT( "points/s" );
+    result.m_items   = static_cast< double >( m_nbFibers ) * m_nbPoints;
+
+    for( int r = 0; r < m_repetitions; ++r )
+    {
+        Fibers *pFibers = new Fibers();
+
+        wxStopWatch watch;
+        pFibers->load( m_trkPath );
+        result.m_times.push_back( getMs( watch ) );
+
+        delete pFibers;
+    }
+
+    addResult( result );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The box and the ellipsoid are moved around the tractogram. The VOI is the
+// sphere of the anatomy above half its maximum, it cannot be moved and is
+// queried where it is: most points fall in its bounds and are tested
+// against its voxels.
+///////////////////////////////////////////////////////////////////////////
+void Benchmark::benchOctree()
+{
+    Anatomy *pAnatomy = static_cast< Anatomy * >( DatasetManager::getInstance()->getDataset( m_anatomyIndex ) );
+
+    SelectionBox       box( Vector( 0.0f, 0.0f, 0.0f ), Vector( 10.0f, 10.0f, 10.0f ) );
+    SelectionEllipsoid ellipsoid( Vector( 0.0f, 0.0f, 0.0f ), Vector( 10.0f, 10.0f, 10.0f ) );
+    SelectionVOI       voi( pAnatomy, 0.5f, THRESHOLD_GREATER_EQUAL );
+
+    benchPointsInside( &box,       wxT( "octree_points" ),           wxT( "a 10x10x10 voxels box" ),       true );
+    benchPointsInside( &ellipsoid, wxT( "octree_points_ellipsoid" ), wxT( "a 10x10x10 voxels ellipsoid" ), true );
+    benchPointsInside( &voi,       wxT( "octree_points_voi" ),       wxT( "the anatomy VOI above 0.5" ),   false );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void Benchmark::benchPointsInside( SelectionObject *pObject, const wxString &name, const wxString &shape, bool isMoved )
+{
+    const int NB_QUERIES( 100 );
+
+    Fibers *pFibers = DatasetManager::getInstance()->getSelectedFibers( m_fibersIndex );
+    Octree *pOctree = pFibers->getOctree();
+
+    Result result;
+    result.m_name    = name;
+    result.m_dataset = wxString::Format( wxT( "%d points, %d queries of %s" ), pFibers->getPointCount(), NB_QUERIES, shape.c_str() );
+    result.m_unit    = wxT( "queries/s" );
+    result.m_items   = NB_QUERIES;
+
+    for( int r = 0; r < m_repetitions; ++r )
+    {
+        wxStopWatch watch;
+        for( int q = 0; q < NB_QUERIES; ++q )
+        {
+            if( isMoved )
+            {
+                pObject->setCenter( getSweepPosition( q, NB_QUERIES, m_columns * m_voxelSize, m_rows * m_voxelSize, m_frames * m_voxelSize ) );
+            }
+            pOctree->getPointsInside( pObject );
+        }
+        result.m_times.push_back( getMs( watch ) );
+    }
+
+    addResult( result );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Three boxes, each with an AND child and a NOT child, are moved together
+// as when a box is dragged: every update queries the moved objects again.
+///////////////////////////////////////////////////////////////////////////
+void Benchmark::benchSelectionTree()
+{
+    const int NB_UPDATES( 20 );
+    const int NB_ROOTS( 3 );
+
+    Fibers *pFibers = DatasetManager::getInstance()->getSelectedFibers( m_fibersIndex );
+    SelectionTree &tree = SceneManager::getInstance()->getSelectionTree();
+    tree.clear();
+
+    std::vector< SelectionObject * > roots;
+    std::vector< SelectionObject * > objects;
+    for( int i = 0; i < NB_ROOTS; ++i )
+    {
+        SelectionObject *pRoot    = new SelectionBox( Vector( 0.0f, 0.0f, 0.0f ), Vector( 20.0f, 20.0f, 20.0f ) );
+        SelectionObject *pAnd     = new SelectionBox( Vector( 0.0f, 0.0f, 0.0f ), Vector( 15.0f, 15.0f, 15.0f ) );
+        SelectionObject *pExclude = new SelectionBox( Vector( 0.0f, 0.0f, 0.0f ), Vector( 8.0f, 8.0f, 8.0f ) );
+        pExclude->setIsNOT( true );
+
+        const int rootId = tree.addChildrenObject( -1, pRoot );
+        tree.addChildrenObject( rootId, pAnd );
+        tree.addChildrenObject( rootId, pExclude );
+
+        roots.push_back( pRoot );
+        objects.push_back( pRoot );
+        objects.push_back( pAnd );
+        objects.push_back( pExclude );
+    }
+
+    Result result;
+    result.m_name    = wxT( "selection_tree" );
+    result.m_dataset = wxString::Format( wxT( "%d fibers, %d objects, %d updates" ), pFibers->getFibersCount(), static_cast< int >( objects.size() ), NB_UPDATES );
+    result.m_unit    = wxT( "updates/s" );
+    result.m_items   = NB_UPDATES;
+
+    const float extent[3] = { m_columns * m_voxelSize, m_rows * m_voxelSize, m_frames * m_voxelSize };
+
+    for( int r = 0; r < m_repetitions; ++r )
+    {
+        wxStopWatch watch;
+        for( int u = 0; u < NB_UPDATES; ++u )
+        {
+            for( int i = 0; i < NB_ROOTS; ++i )
+            {
+                // The boxes of a root are spread along X around its position.
+                const Vector center = getSweepPosition( ( u + i * NB_UPDATES / NB_ROOTS ) % NB_UPDATES, NB_UPDATES, extent[0], extent[1], extent[2] );
+                objects[i * 3]->setCenter( center );
+                objects[i * 3 + 1]->setCenter( center + Vector( 8.0f * m_voxelSize, 0.0f, 0.0f ) );
+                objects[i * 3 + 2]->setCenter( center - Vector( 4.0f * m_voxelSize, 0.0f, 0.0f ) );
+            }
+            tree.getSelectedFibers( pFibers );
+        }
+        result.m_times.push_back( getMs( watch ) );
+    }
+
+    tree.clear();
+    addResult( result );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void Benchmark::benchTracking()
+{
+    RTTFibers rtt;
+    rtt.setTensorsInfo( static_cast< Tensors * >( DatasetManager::getInstance()->getDataset( m_tensorsIndex ) ) );
+
+    timeTracking( rtt, wxT( "rtt_seed" ), wxT( "DTI" ) );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The anatomy is the tracking mask, its values are above the FA threshold
+// inside the ellipsoid.
+///////////////////////////////////////////////////////////////////////////
+void Benchmark::benchTrackingHARDI()
+{
+    RTTFibers rtt;
+    rtt.setIsHardi( true );
+    rtt.setHARDIInfo( static_cast< Maximas * >( DatasetManager::getInstance()->getDataset( m_maximasIndex ) ) );
+    rtt.setMaskInfo( static_cast< Anatomy * >( DatasetManager::getInstance()->getDataset( m_anatomyIndex ) ) );
+
+    timeTracking( rtt, wxT( "rtt_seed_hardi" ), wxT( "HARDI, 3 peaks" ) );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Tracks from the same seed box for the DTI and HARDI cases. The allocations
+// made during a repetition are counted along with its steps.
+///////////////////////////////////////////////////////////////////////////
+void Benchmark::timeTracking( RTTFibers &rtt, const wxString &name, const wxString &method )
+{
+    SelectionTree &tree = SceneManager::getInstance()->getSelectionTree();
+    tree.clear();
+
+    const Vector center( m_columns * m_voxelSize * 0.7f, m_rows * m_voxelSize * 0.5f, m_frames * m_voxelSize * 0.5f );
+    tree.addChildrenObject( -1, new SelectionBox( center, Vector( 10.0f, 10.0f, 10.0f ) ) );
+
+    rtt.setNbSeed( m_nbSeeds );
+    rtt.setMinFiberLength( 0.0f );
+    rtt.setMaxFiberLength( 10000.0f );
+
+    Result result;
+    result.m_name    = name;
+    result.m_dataset = wxString::Format( wxT( "%s, %dx%dx%d voxels, %d seeds" ), method.c_str(), m_columns, m_rows, m_frames, m_nbSeeds * m_nbSeeds * m_nbSeeds );
+    result.m_unit    = wxT( "steps/s" );
+
+    for( int r = 0; r < m_repetitions; ++r )
+    {
+        const unsigned long allocations = AllocationCounter::getCount();
+
+        wxStopWatch watch;
+        rtt.track();
+        result.m_times.push_back( getMs( watch ) );
+
+        result.m_allocations = static_cast< double >( AllocationCounter::getCount() - allocations );
+
+        // Every stored point is one tracking step.
+        result.m_items = rtt.getSize() / 3;
+    }
+
+    tree.clear();
+    addResult( result );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void Benchmark::benchCorrelation()
+{
+    nifti_image *pImage = SyntheticData::createRestingState( m_rsnSize, m_rsnSize, m_rsnSize * 2 / 3, m_rsnBands, m_voxelSize );
+
+    RestingStateNetwork network;
+    network.load( pImage, pImage );
+    nifti_image_free( pImage );
+
+    // A 3x3x3 seed region inside the first network.
+    const int frames = m_rsnSize * 2 / 3;
+    std::vector< float > positions;
+    for( int z = frames / 2 - 1; z <= frames / 2 + 1; ++z )
+    {
+        for( int y = m_rsnSize / 4 - 1; y <= m_rsnSize / 4 + 1; ++y )
+        {
+            for( int x = m_rsnSize / 4 - 1; x <= m_rsnSize / 4 + 1; ++x )
+            {
+                positions.push_back( z * m_rsnSize * m_rsnSize + y * m_rsnSize + x );
+            }
+        }
+    }
+
+    Result result;
+    result.m_name    = wxT( "rsn_correlate" );
+    result.m_dataset = wxString::Format( wxT( "%dx%dx%d voxels, %d volumes" ), m_rsnSize, m_rsnSize, frames, m_rsnBands );
+    result.m_unit    = wxT( "voxels/s" );
+    result.m_items   = static_cast< double >( m_rsnSize ) * m_rsnSize * frames;
+
+    for( int r = 0; r < m_repetitions; ++r )
+    {
+        network.clear3DPoints();
+
+        wxStopWatch watch;
+        network.correlate( positions );
+        result.m_times.push_back( getMs( watch ) );
+    }
+
+    addResult( result );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Same as the "distance map" action of the navigator: distance to the mask
+// of the anatomy, then smoothed.
+///////////////////////////////////////////////////////////////////////////
+void Benchmark::benchDistanceMap()
+{
+    Anatomy *pAnatomy = static_cast< Anatomy * >( DatasetManager::getInstance()->getDataset( m_anatomyIndex ) );
+
+    Result result;
+    result.m_name    = wxT( "distance_map" );
+    result.m_dataset = wxString::Format( wxT( "%dx%dx%d voxels" ), m_columns, m_rows, m_frames );
+    result.m_unit    = wxT( "voxels/s" );
+    result.m_items   = static_cast< double >( m_columns ) * m_rows * m_frames;
+
+    for( int r = 0; r < m_repetitions; ++r )
+    {
+        wxStopWatch watch;
+        Anatomy *pDistanceMap = new Anatomy( pAnatomy, true );
+        result.m_times.push_back( getMs( watch ) );
+
+        delete pDistanceMap;
+    }
+
+    addResult( result );
+
+    // The same on a mask of the size of a T1 volume, timed against the
+    // distance map used before.
+    std::vector< float > mask;
+    SyntheticData::createMask( m_maskSize, m_maskSize, m_maskSize, mask );
+
+    Result maskResult;
+    maskResult.m_name    = wxT( "distance_map_mask" );
+    maskResult.m_dataset = wxString::Format( wxT( "%dx%dx%d voxels" ), m_maskSize, m_maskSize, m_maskSize );
+    maskResult.m_unit    = wxT( "voxels/s" );
+    maskResult.m_items   = static_cast< double >( mask.size() );
+
+    Result referenceResult( maskResult );
+    referenceResult.m_name = wxT( "distance_map_reference" );
+
+    std::vector< float > distances;
+    std::vector< float > reference;
+    for( int r = 0; r < m_repetitions; ++r )
+    {
+        distances = mask;
+        wxStopWatch watch;
+        Anatomy::computeOffset( distances, m_maskSize, m_maskSize, m_maskSize, 1.0f, 1.0f, 1.0f );
+        maskResult.m_times.push_back( getMs( watch ) );
+
+        reference = mask;
+        watch.Start();
+        referenceOffset( reference, m_maskSize, m_maskSize, m_maskSize );
+        referenceResult.m_times.push_back( getMs( watch ) );
+    }
+
+    addResult( maskResult );
+    addResult( referenceResult );
+
+    float maxDifference( 0.0f );
+    for( size_t i = 0; i < mask.size(); ++i )
+    {
+        maxDifference = std::max( maxDifference, std::abs( distances[i] - reference[i] ) );
+    }
+    Logger::getInstance()->print( wxString::Format( wxT( "distance_map_reference: largest difference %g" ), maxDifference ), LOGLEVEL_MESSAGE );
+    check( maxDifference < 1e-5f, wxT( "distance_map_reference" ) );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// A box dragged by steps smaller than itself is updated from the points that
+// entered and left it. After each step, the selection must be the fibers
+// found by a full query of the BVH. The last step jumps back to the start,
+// which recomputes the whole box.
+///////////////////////////////////////////////////////////////////////////
+void Benchmark::checkSelectionDelta()
+{
+    const int NB_STEPS( 40 );
+
+    Fibers *pFibers = DatasetManager::getInstance()->getSelectedFibers( m_fibersIndex );
+    SelectionTree &tree = SceneManager::getInstance()->getSelectionTree();
+    tree.clear();
+
+    SelectionObject *pBox = new SelectionBox( Vector( 0.0f, 0.0f, 0.0f ), Vector( 15.0f, 15.0f, 15.0f ) );
+    tree.addChildrenObject( -1, pBox );
+
+    const float extent[3] = { m_columns * m_voxelSize, m_rows * m_voxelSize, m_frames * m_voxelSize };
+
+    bool passed( true );
+    FiberBitset inBox;
+    for( int s = 0; s <= NB_STEPS && passed; ++s )
+    {
+        pBox->setCenter( getSweepPosition( s % NB_STEPS, NB_STEPS, extent[0], extent[1], extent[2] ) );
+        if( s % 10 == 5 )
+        {
+            // Resizing moves the faces on both sides of an axis.
+            pBox->setSize( Vector( 15.0f + s / 10 + 1, 15.0f - s / 10 - 1, 15.0f ) );
+        }
+
+        const std::vector< bool > selected = tree.getSelectedFibers( pFibers );
+        pFibers->getFiberBVH()->getFibersInside( pBox, inBox );
+
+        for( unsigned int i = 0; i < selected.size(); ++i )
+        {
+            if( selected[i] != inBox.test( i ) )
+            {
+                Logger::getInstance()->print( wxString::Format( wxT( "selection_delta: fiber %u differs at step %d" ), i, s ), LOGLEVEL_ERROR );
+                passed = false;
+                break;
+            }
+        }
+    }
+
+    tree.clear();
+    check( passed, wxT( "selection_delta" ) );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The lines have 1 to 7 points. Their counts and the visible lines are chosen
+// around 64, where the masks change of word, and at both ends. The outputs
+// are filled beforehand, as when draw() rebuilds them.
+///////////////////////////////////////////////////////////////////////////
+void Benchmark::checkVisibleLines()
+{
+    const int LINE_COUNTS[] = { 0, 1, 63, 64, 65, 129 };
+    enum { ALL_HIDDEN, ALL_SHOWN, MIXED, ONLY_BOUNDARIES, NB_CASES };
+
+    bool passed( true );
+    for( size_t l = 0; l < sizeof( LINE_COUNTS ) / sizeof( LINE_COUNTS[0] ); ++l )
+    {
+        const int countLines = LINE_COUNTS[l];
+
+        std::vector< int > linePointers( 1, 0 );
+        for( int i = 0; i < countLines; ++i )
+        {
+            linePointers.push_back( linePointers.back() + 1 + i % 7 );
+        }
+
+        for( int c = 0; c < NB_CASES; ++c )
+        {
+            std::vector< bool > selected( countLines );
+            std::vector< bool > filtered( countLines );
+            for( int i = 0; i < countLines; ++i )
+            {
+                const bool isBoundary = i == 0 || i == 63 || i == 64 || i == countLines - 1;
+                selected[i] = c == ALL_SHOWN || ( c == MIXED && i % 3 != 0 ) || ( c == ONLY_BOUNDARIES && isBoundary );
+                filtered[i] = c == ALL_HIDDEN || ( c == MIXED && i % 5 == 0 );
+            }
+
+            for( int activateAll = 0; activateAll < 2; ++activateAll )
+            {
+                std::vector< int > expectedFirsts;
+                std::vector< int > expectedCounts;
+                for( int i = 0; i < countLines; ++i )
+                {
+                    if( !filtered[i] && ( selected[i] || activateAll == 0 ) )
+                    {
+                        expectedFirsts.push_back( linePointers[i] );
+                        expectedCounts.push_back( 1 + i % 7 );
+                    }
+                }
+
+                std::vector< int > firsts( 3, -1 );
+                std::vector< int > counts( 5, -1 );
+                compactVisibleLines( linePointers, selected, filtered, activateAll != 0, firsts, counts );
+
+                if( firsts != expectedFirsts || counts != expectedCounts )
+                {
+                    Logger::getInstance()->print( wxString::Format( wxT( "visible_lines: wrong lines for %d lines, case %d, activate all %d" ), countLines, c, activateAll ), LOGLEVEL_ERROR );
+                    passed = false;
+                }
+            }
+        }
+    }
+
+    check( passed, wxT( "visible_lines" ) );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The seed box of rtt_seed is tracked by one thread, then by several. The
+// chunks are merged in seed order, so the streamlines must be the same, point
+// for point. Random initialization is turned off, as in a reproducible run.
+///////////////////////////////////////////////////////////////////////////
+void Benchmark::checkTrackingThreads()
+{
+    const int NB_THREADS( 4 );
+
+    if( RTTrackingHelper::getInstance()->isRandomInit() )
+    {
+        RTTrackingHelper::getInstance()->toggleRandomInit();
+    }
+
+    SelectionTree &tree = SceneManager::getInstance()->getSelectionTree();
+    tree.clear();
+
+    const Vector center( m_columns * m_voxelSize * 0.7f, m_rows * m_voxelSize * 0.5f, m_frames * m_voxelSize * 0.5f );
+    tree.addChildrenObject( -1, new SelectionBox( center, Vector( 10.0f, 10.0f, 10.0f ) ) );
+
+    RTTFibers rtt;
+    rtt.setTensorsInfo( static_cast< Tensors * >( DatasetManager::getInstance()->getDataset( m_tensorsIndex ) ) );
+    rtt.setNbSeed( m_nbSeeds );
+    rtt.setMinFiberLength( 0.0f );
+    rtt.setMaxFiberLength( 10000.0f );
+
+    rtt.setNbThreads( 1 );
+    rtt.track();
+    const std::vector< float > serialPoints( *rtt.getRTTFibers() );
+    const std::vector< int >   serialNbPoints( *rtt.getRTTNbPointsPerLine() );
+
+    rtt.setNbThreads( NB_THREADS );
+    rtt.track();
+
+    const bool passed = !serialPoints.empty() && serialPoints == *rtt.getRTTFibers() && serialNbPoints == *rtt.getRTTNbPointsPerLine();
+    if( !passed )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "tracking_threads: %u points with 1 thread, %u with %d" ), 
+                                                        static_cast< unsigned int >( serialPoints.size() ), static_cast< unsigned int >( rtt.getSize() ), NB_THREADS ), LOGLEVEL_ERROR );
+    }
+
+    tree.clear();
+    check( passed, wxT( "tracking_threads" ) );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void Benchmark::addResult( Result &result )
+{
+    result.m_peakRss = getPeakRss();
+
+    const double median = getMedian( result.m_times );
+    Logger::getInstance()->print( wxString::Format( wxT( "%s: %.2f ms (median of %d), %.4g %s" ), result.m_name.c_str(), median, m_repetitions, 
+                                                    median > 0.0 ? result.m_items * 1000.0 / median : 0.0, result.m_unit.c_str() ), LOGLEVEL_MESSAGE );
+
+    m_results.push_back( result );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void Benchmark::check( bool passed, const wxString &name )
+{
+    if( passed )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "%s: passed" ), name.c_str() ), LOGLEVEL_MESSAGE );
+    }
+    else
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "%s: FAILED" ), name.c_str() ), LOGLEVEL_ERROR );
+        ++m_failedChecks;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+wxString Benchmark::toJson() const
+{
+    int nbThreads( 1 );
+#ifdef _OPENMP
+    nbThreads = omp_get_max_threads();
+#endif
+
+    wxString json;
+    json += wxT( "{\n" );
+    json += wxString::Format( wxT( "  \"git_sha1\": \"%s\",\n" ), wxString::FromAscii( VERSION_GIT_SHA1 ).c_str() );
+    json += wxString::Format( wxT( "  \"build_date\": \"%s %s\",\n" ), wxString::FromAscii( VERSION_BUILD_DATE ).c_str(), wxString::FromAscii( VERSION_BUILD_TIME ).c_str() );
+    json += wxString::Format( wxT( "  \"threads\": %d,\n" ), nbThreads );
+    json += wxString::Format( wxT( "  \"repetitions\": %d,\n" ), m_repetitions );
+    json += wxString::Format( wxT( "  \"quick\": %s,\n" ), m_quick ? wxT( "true" ) : wxT( "false" ) );
+    json += wxT( "  \"benchmarks\": [" );
+
+    for( size_t i = 0; i < m_results.size(); ++i )
+    {
+        const Result &result = m_results[i];
+        const double median = getMedian( result.m_times );
+
+        wxString times;
+        for( size_t t = 0; t < result.m_times.size(); ++t )
+        {
+            times += wxString::Format( t == 0 ? wxT( "%.3f" ) : wxT( ", %.3f" ), result.m_times[t] );
+        }
+
+        json += i == 0 ? wxT( "\n" ) : wxT( ",\n" );
+        json += wxT( "    {\n" );
+        json += wxString::Format( wxT( "      \"name\": \"%s\",\n" ), result.m_name.c_str() );
+        json += wxString::Format( wxT( "      \"dataset\": \"%s\",\n" ), result.m_dataset.c_str() );
+        json += wxString::Format( wxT( "      \"times_ms\": [%s],\n" ), times.c_str() );
+        json += wxString::Format( wxT( "      \"median_ms\": %.3f,\n" ), median );
+        json += wxString::Format( wxT( "      \"min_ms\": %.3f,\n" ), *std::min_element( result.m_times.begin(), result.m_times.end() ) );
+        json += wxString::Format( wxT( "      \"throughput\": %.1f,\n" ), median > 0.0 ? result.m_items * 1000.0 / median : 0.0 );
+        json += wxString::Format( wxT( "      \"throughput_unit\": \"%s\",\n" ), result.m_unit.c_str() );
+        if( result.m_allocations >= 0.0 )
+        {
+            json += wxString::Format( wxT( "      \"allocations\": %.0f,\n" ), result.m_allocations );
+            json += wxString::Format( wxT( "      \"allocations_per_item\": %.4f,\n" ), result.m_items > 0.0 ? result.m_allocations / result.m_items : 0.0 );
+        }
+        json += wxString::Format( wxT( "      \"peak_rss_kb\": %ld\n" ), result.m_peakRss );
+        json += wxT( "    }" );
+    }
+
+    json += wxT( "\n  ]\n}\n" );
+    return json;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+double Benchmark::getMedian( std::vector< double > values )
+{
+    std::sort( values.begin(), values.end() );
+    const size_t half = values.size() / 2;
+    return values.size() % 2 == 1 ? values[half] : ( values[half - 1] + values[half] ) / 2.0;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Peak resident set size of the whole process, in kB. It only grows, each
+// case reports the peak reached once it is done.
+///////////////////////////////////////////////////////////////////////////
+long Benchmark::getPeakRss()
+{
+#ifdef __WXMSW__
+    PROCESS_MEMORY_COUNTERS counters;
+    if( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+    {
+        return static_cast< long >( counters.PeakWorkingSetSize / 1024 );
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if( getrusage( RUSAGE_SELF, &usage ) != 0 )
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // In bytes on OS X.
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
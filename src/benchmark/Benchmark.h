@@ -0,0 +1,127 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            Benchmark.h
+//
+// Description: Times the hot paths of the navigator on synthetic datasets
+// of fixed size, without any window or GL context.
+//
+// Cases:
+//     load_trk             Fibers::load of a TrackVis file.
+//     octree_points        Octree::getPointsInside for a box moved around.
+//     octree_points_ellipsoid
+//                          Same for an ellipsoid.
+//     octree_points_voi    Same for a VOI of the anatomy, queried in place.
+//     selection_tree       SelectionTree::getSelectedFibers for a tree of
+//                          boxes (AND and NOT children) moved around.
+//     rtt_seed             RTTFibers::track (DTI) from a seed box.
+//     rtt_seed_hardi       RTTFibers::track (HARDI) from the same seed box.
+//     rsn_correlate        RestingStateNetwork::correlate from a seed region.
+//     distance_map         Distance map of the anatomy (Anatomy::createOffset).
+//     distance_map_mask    Anatomy::computeOffset on a 256^3 mask of 1 mm
+//                          voxels (64^3 with quick).
+//     distance_map_reference
+//                          The distance map used before the exact transform,
+//                          on the same mask.
+//
+// Every case is repeated and the results are written as JSON: wall time of
+// each repetition (ms), median throughput and peak resident set size of the
+// process (kB) once the case is done. The tracking cases also report the
+// calls to operator new of a repetition, and their number per step.
+//
+// Checks, each run once:
+//     selection_delta      Incremental update of a dragged box against a
+//                          full query of the fibers BVH.
+//     distance_map_reference
+//                          Both maps of the mask agree within 1e-5.
+//     visible_lines        compactVisibleLines for hidden, shown, filtered
+//                          and unselected lines, around the word boundaries
+//                          of the masks.
+//     tracking_threads     RTTFibers::track of the rtt_seed box gives the same
+//                          streamlines with one thread and with four.
+//
+// A failed check is logged as an error and makes the executable fail.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include "../dataset/DatasetIndex.h"
+
+#include <wx/string.h>
+
+#include <vector>
+
+class Fibers;
+class RTTFibers;
+class SelectionObject;
+
+class Benchmark
+{
+public:
+    // The datasets are written to workDir. With quick, they are about ten
+    // times smaller, to check that everything runs.
+    Benchmark( const wxString &workDir, int repetitions, bool quick );
+
+    bool run();
+    wxString toJson() const;
+
+    bool checksPassed() const               { return m_failedChecks == 0; }
+
+private:
+    struct Result
+    {
+        Result() : m_items( 0.0 ), m_peakRss( 0 ), m_allocations( -1.0 ) {}
+
+        wxString              m_name;
+        wxString              m_dataset;    // Size of the input, for the reader.
+        wxString              m_unit;       // Unit of the throughput.
+        double                m_items;      // Items processed by one repetition.
+        std::vector< double > m_times;      // Wall time of each repetition, in ms.
+        long                  m_peakRss;    // In kB.
+        double                m_allocations; // Per repetition, negative if not counted.
+    };
+
+    bool setUp();
+    void benchLoadTRK();
+    void benchOctree();
+    void benchPointsInside( SelectionObject *pObject, const wxString &name, const wxString &shape, bool isMoved );
+    void benchSelectionTree();
+    void benchTracking();
+    void benchTrackingHARDI();
+    void benchCorrelation();
+    void benchDistanceMap();
+
+    void checkSelectionDelta();
+    void checkVisibleLines();
+    void checkTrackingThreads();
+
+    void timeTracking( RTTFibers &rtt, const wxString &name, const wxString &method );
+    void addResult( Result &result );
+    void check( bool passed, const wxString &name );
+
+    static double getMedian( std::vector< double > values );
+    static long   getPeakRss();
+
+    wxString m_workDir;
+    int      m_repetitions;
+    bool     m_quick;
+    int      m_columns;
+    int      m_rows;
+    int      m_frames;
+    float    m_voxelSize;
+    int      m_nbFibers;
+    int      m_nbPoints;
+    int      m_nbSeeds;     // Per axis of the seed box.
+    int      m_rsnSize;
+    int      m_rsnBands;
+    int      m_maskSize;    // Per axis.
+
+    std::vector< wxString > m_files;
+    wxString     m_trkPath;
+    DatasetIndex m_anatomyIndex;
+    DatasetIndex m_fibersIndex;
+    DatasetIndex m_tensorsIndex;
+    DatasetIndex m_maximasIndex;
+    std::vector< Result > m_results;
+    int          m_failedChecks;
+};
+
+#endif /* BENCHMARK_H_ */
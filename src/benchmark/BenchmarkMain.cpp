@@ -0,0 +1,86 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            BenchmarkMain.cpp
+//
+// Description: Entry point of the benchmark executable (BUILD_BENCHMARK in
+// CMake), see Benchmark.h.
+/////////////////////////////////////////////////////////////////////////////
+
+#include "Benchmark.h"
+#include "../Logger.h"
+
+#include <wx/app.h>
+#include <wx/cmdline.h>
+#include <wx/filename.h>
+#include <wx/init.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+static const wxCmdLineEntryDesc desc[] =
+{
+    { wxCMD_LINE_SWITCH, "h", "help", "help yourself" },
+    { wxCMD_LINE_SWITCH, "q", "quick", "run on small datasets, to check that every case works" },
+    { wxCMD_LINE_SWITCH, "v", "verbose", "print the messages of the loaders" },
+    { wxCMD_LINE_OPTION, "r", "repetitions", "repetitions of each case (default: 5)", wxCMD_LINE_VAL_NUMBER },
+    { wxCMD_LINE_OPTION, "w", "workdir", "directory of the generated datasets (default: temporary directory)", wxCMD_LINE_VAL_STRING },
+    { wxCMD_LINE_OPTION, "o", "output", "JSON file of the results (default: standard output)", wxCMD_LINE_VAL_STRING },
+    { wxCMD_LINE_NONE }
+};
+
+int main( int argc, char **argv )
+{
+    // Without initializer function, wxWidgets creates a console application
+    // and never connects to the display.
+    wxApp::SetInitializerFunction( NULL );
+    wxInitializer initializer( argc, argv );
+    if( !initializer.IsOk() )
+    {
+        return EXIT_FAILURE;
+    }
+
+    wxCmdLineParser cmdParser( desc, argc, argv );
+    if( cmdParser.Parse() != 0 )
+    {
+        return EXIT_FAILURE;
+    }
+    if( cmdParser.Found( _T( "h" ) ) )
+    {
+        cmdParser.Usage();
+        return EXIT_SUCCESS;
+    }
+
+    long repetitions = 5;
+    cmdParser.Found( _T( "r" ), &repetitions );
+
+    wxString workDir = wxFileName::GetTempDir();
+    cmdParser.Found( _T( "w" ), &workDir );
+
+    // The results are the output, the loaders are quiet unless asked.
+    Logger::getInstance()->setMessageLevel( cmdParser.Found( _T( "v" ) ) ? LOGLEVEL_MESSAGE : LOGLEVEL_WARNING );
+
+    Benchmark benchmark( workDir, repetitions, cmdParser.Found( _T( "q" ) ) );
+    if( !benchmark.run() )
+    {
+        return EXIT_FAILURE;
+    }
+
+    const wxString json = benchmark.toJson();
+    wxString output;
+    if( cmdParser.Found( _T( "o" ), &output ) )
+    {
+        std::ofstream file( output.fn_str() );
+        file << json.mb_str();
+        if( !file )
+        {
+            Logger::getInstance()->print( wxString::Format( wxT( "Cannot write \"%s\"" ), output.c_str() ), LOGLEVEL_ERROR );
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        printf( "%s", static_cast< const char * >( json.mb_str() ) );
+    }
+
+    return benchmark.checksPassed() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
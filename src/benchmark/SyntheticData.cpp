@@ -0,0 +1,353 @@
+#include "SyntheticData.h"
+
+#include <wx/defs.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+// Small LCG, so that the data does not depend on the rand() of the platform.
+class Random
+{
+public:
+    explicit Random( unsigned int seed ) : m_state( seed ) {}
+
+    // Uniform in [0, 1).
+    float uniform()
+    {
+        m_state = m_state * 1664525u + 1013904223u;
+        return ( m_state >> 8 ) / 16777216.0f;
+    }
+
+    // Uniform in [-1, 1).
+    float symmetric() { return 2.0f * uniform() - 1.0f; }
+
+private:
+    unsigned int m_state;
+};
+
+void writeBytes( char *pHeader, int offset, const void *pValue, size_t size )
+{
+    memcpy( pHeader + offset, pValue, size );
+}
+
+// Unit vector tangent to the circle around the center of the grid, climbing
+// along Z, shared by the tensors and the maximas.
+void getHelixDirection( int x, int y, int columns, int rows, float *pDir )
+{
+    const float HELIX_PITCH( 0.5f );
+
+    pDir[0] = -( y - rows * 0.5f );
+    pDir[1] = x - columns * 0.5f;
+    float norm = std::sqrt( pDir[0] * pDir[0] + pDir[1] * pDir[1] );
+    if( norm < 1.0f )
+    {
+        pDir[0] = 1.0f;
+        pDir[1] = 0.0f;
+        norm = 1.0f;
+    }
+    pDir[0] /= norm;
+    pDir[1] /= norm;
+    pDir[2] = HELIX_PITCH;
+
+    norm = std::sqrt( 1.0f + HELIX_PITCH * HELIX_PITCH );
+    pDir[0] /= norm;
+    pDir[1] /= norm;
+    pDir[2] /= norm;
+}
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+bool SyntheticData::writeAnatomy( const wxString &filename, int columns, int rows, int frames, float voxelSize )
+{
+    nifti_image *pImage = createImage( columns, rows, frames, 1, NIFTI_TYPE_FLOAT32, voxelSize );
+    float *pData = static_cast< float * >( pImage->data );
+
+    for( int z = 0; z < frames; ++z )
+    {
+        for( int y = 0; y < rows; ++y )
+        {
+            for( int x = 0; x < columns; ++x )
+            {
+                const float dx = ( x - columns * 0.5f ) / ( columns * 0.45f );
+                const float dy = ( y - rows    * 0.5f ) / ( rows    * 0.45f );
+                const float dz = ( z - frames  * 0.5f ) / ( frames  * 0.45f );
+                const float r2 = dx * dx + dy * dy + dz * dz;
+                pData[x + ( y + z * rows ) * columns] = 1000.0f / ( 1.0f + std::exp( 10.0f * ( r2 - 1.0f ) ) );
+            }
+        }
+    }
+
+    return writeImage( pImage, filename );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void SyntheticData::createMask( int columns, int rows, int frames, std::vector< float > &o_mask )
+{
+    o_mask.assign( columns * rows * frames, 0.0f );
+
+    for( int z = 0; z < frames; ++z )
+    {
+        for( int y = 0; y < rows; ++y )
+        {
+            for( int x = 0; x < columns; ++x )
+            {
+                const float dx = ( x - columns * 0.5f  ) / ( columns * 0.39f );
+                const float dy = ( y - rows    * 0.47f ) / ( rows    * 0.35f );
+                const float dz = ( z - frames  * 0.51f ) / ( frames  * 0.31f );
+                const bool inTunnel = std::abs( x - columns * 0.5f ) < columns * 0.04f && std::abs( y - rows * 0.39f ) < rows * 0.12f;
+                if( dx * dx + dy * dy + dz * dz < 1.0f && !inTunnel )
+                {
+                    o_mask[x + ( y + z * rows ) * columns] = 1.0f;
+                }
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+bool SyntheticData::writeTensors( const wxString &filename, int columns, int rows, int frames, float voxelSize )
+{
+    const float LAMBDA_1( 1.7e-3f );
+    const float LAMBDA_2( 0.3e-3f );
+    const int   nbVoxels( columns * rows * frames );
+
+    nifti_image *pImage = createImage( columns, rows, frames, 6, NIFTI_TYPE_FLOAT32, voxelSize );
+    float *pData = static_cast< float * >( pImage->data );
+
+    for( int z = 0; z < frames; ++z )
+    {
+        for( int y = 0; y < rows; ++y )
+        {
+            for( int x = 0; x < columns; ++x )
+            {
+                float v[3];
+                getHelixDirection( x, y, columns, rows, v );
+
+                // D = LAMBDA_2 * I + ( LAMBDA_1 - LAMBDA_2 ) * v * v^T
+                const float d = LAMBDA_1 - LAMBDA_2;
+                const float tensor[6] = { LAMBDA_2 + d * v[0] * v[0], d * v[0] * v[1], d * v[0] * v[2],
+                                          LAMBDA_2 + d * v[1] * v[1], d * v[1] * v[2],
+                                          LAMBDA_2 + d * v[2] * v[2] };
+
+                const int i = x + ( y + z * rows ) * columns;
+                for( int band = 0; band < 6; ++band )
+                {
+                    pData[band * nbVoxels + i] = tensor[band];
+                }
+            }
+        }
+    }
+
+    return writeImage( pImage, filename );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+bool SyntheticData::writeMaximas( const wxString &filename, int columns, int rows, int frames, float voxelSize )
+{
+    const int NB_PEAKS( 3 );
+    const int nbVoxels( columns * rows * frames );
+
+    nifti_image *pImage = createImage( columns, rows, frames, 3 * NB_PEAKS, NIFTI_TYPE_FLOAT32, voxelSize );
+    float *pData = static_cast< float * >( pImage->data );
+
+    for( int z = 0; z < frames; ++z )
+    {
+        for( int y = 0; y < rows; ++y )
+        {
+            for( int x = 0; x < columns; ++x )
+            {
+                float v[3];
+                getHelixDirection( x, y, columns, rows, v );
+
+                // Helix, weaker crossing along Z, no third peak.
+                const float peaks[3 * NB_PEAKS] = { v[0], v[1], v[2],
+                                                    0.0f, 0.0f, 0.5f,
+                                                    0.0f, 0.0f, 0.0f };
+
+                const int i = x + ( y + z * rows ) * columns;
+                for( int band = 0; band < 3 * NB_PEAKS; ++band )
+                {
+                    pData[band * nbVoxels + i] = peaks[band];
+                }
+            }
+        }
+    }
+
+    return writeImage( pImage, filename );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+bool SyntheticData::writeTRK( const wxString &filename, int nbFibers, int nbPoints, 
+                              int columns, int rows, int frames, float voxelSize )
+{
+    const int HEADER_SIZE( 1000 );
+    const float extent[3] = { columns * voxelSize, rows * voxelSize, frames * voxelSize };
+
+    char header[HEADER_SIZE];
+    memset( header, 0, HEADER_SIZE );
+
+    const wxInt16 dim[3]        = { static_cast< wxInt16 >( columns ), static_cast< wxInt16 >( rows ), static_cast< wxInt16 >( frames ) };
+    const float   voxel[3]      = { voxelSize, voxelSize, voxelSize };
+    const wxInt16 nbScalars     = 3;
+    const wxInt32 nbCount       = nbFibers;
+    const wxInt32 version       = 2;
+    const wxInt32 headerSize    = HEADER_SIZE;
+
+    writeBytes( header, 0,   "TRACK", 6 );
+    writeBytes( header, 6,   dim, sizeof( dim ) );
+    writeBytes( header, 12,  voxel, sizeof( voxel ) );
+    writeBytes( header, 36,  &nbScalars, sizeof( nbScalars ) );
+    writeBytes( header, 948, "LAS", 4 );
+    writeBytes( header, 988, &nbCount, sizeof( nbCount ) );
+    writeBytes( header, 992, &version, sizeof( version ) );
+    writeBytes( header, 996, &headerSize, sizeof( headerSize ) );
+
+    std::ofstream file( filename.fn_str(), std::ios::binary );
+    file.write( header, HEADER_SIZE );
+
+    Random random( 12345 );
+    std::vector< float > track( nbPoints * 6 );
+
+    for( int f = 0; f < nbFibers; ++f )
+    {
+        float pos[3];
+        float dir[3];
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            pos[axis] = extent[axis] * ( 0.1f + 0.8f * random.uniform() );
+            dir[axis] = random.symmetric();
+        }
+
+        for( int p = 0; p < nbPoints; ++p )
+        {
+            // The direction bends a little at every step.
+            float norm( 0.0f );
+            for( int axis = 0; axis < 3; ++axis )
+            {
+                dir[axis] += 0.15f * random.symmetric();
+                norm += dir[axis] * dir[axis];
+            }
+            norm = std::max( std::sqrt( norm ), 1e-6f );
+
+            for( int axis = 0; axis < 3; ++axis )
+            {
+                dir[axis] /= norm;
+                pos[axis] += dir[axis] * voxelSize;
+                if( pos[axis] < 0.0f || pos[axis] >= extent[axis] )
+                {
+                    dir[axis] = -dir[axis];
+                    pos[axis] = std::min( std::max( pos[axis], 0.0f ), extent[axis] - 1e-3f );
+                }
+
+                track[p * 6 + axis]     = pos[axis];
+                track[p * 6 + 3 + axis] = std::fabs( dir[axis] ) * 255.0f;
+            }
+        }
+
+        const wxInt32 count = nbPoints;
+        file.write( reinterpret_cast< const char * >( &count ), sizeof( count ) );
+        file.write( reinterpret_cast< const char * >( &track[0] ), track.size() * sizeof( float ) );
+    }
+
+    return file.good();
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+nifti_image * SyntheticData::createRestingState( int columns, int rows, int frames, int bands, float voxelSize )
+{
+    const float PI( 3.14159265f );
+    const int   NB_NETWORKS( 4 );
+    const int   nbVoxels( columns * rows * frames );
+
+    nifti_image *pImage = createImage( columns, rows, frames, bands, NIFTI_TYPE_INT16, voxelSize );
+    short *pData = static_cast< short * >( pImage->data );
+
+    // One slow oscillation per network.
+    std::vector< float > signals( NB_NETWORKS * bands );
+    for( int n = 0; n < NB_NETWORKS; ++n )
+    {
+        for( int t = 0; t < bands; ++t )
+        {
+            signals[n * bands + t] = std::sin( 2.0f * PI * t * ( n + 2 ) / bands + n );
+        }
+    }
+
+    Random random( 54321 );
+    for( int z = 0; z < frames; ++z )
+    {
+        for( int y = 0; y < rows; ++y )
+        {
+            for( int x = 0; x < columns; ++x )
+            {
+                const float dx = ( x - columns * 0.5f ) / ( columns * 0.45f );
+                const float dy = ( y - rows    * 0.5f ) / ( rows    * 0.45f );
+                const float dz = ( z - frames  * 0.5f ) / ( frames  * 0.45f );
+                if( dx * dx + dy * dy + dz * dz > 1.0f )
+                {
+                    continue;
+                }
+
+                const int network = ( 2 * x / columns ) + 2 * ( 2 * y / rows );
+                const int i = x + ( y + z * rows ) * columns;
+                for( int t = 0; t < bands; ++t )
+                {
+                    const float value = 1000.0f + 100.0f * signals[network * bands + t] + 60.0f * random.symmetric();
+                    pData[t * nbVoxels + i] = static_cast< short >( value );
+                }
+            }
+        }
+    }
+
+    return pImage;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+nifti_image * SyntheticData::createImage( int columns, int rows, int frames, int bands, int datatype, float voxelSize )
+{
+    const int dims[8] = { bands > 1 ? 4 : 3, columns, rows, frames, bands, 1, 1, 1 };
+    nifti_image *pImage = nifti_make_new_nim( dims, datatype, 1 );
+
+    pImage->dx = pImage->pixdim[1] = voxelSize;
+    pImage->dy = pImage->pixdim[2] = voxelSize;
+    pImage->dz = pImage->pixdim[3] = voxelSize;
+
+    for( int i = 0; i < 4; ++i )
+    {
+        for( int j = 0; j < 4; ++j )
+        {
+            pImage->sto_xyz.m[i][j] = i != j ? 0.0f : ( i < 3 ? voxelSize : 1.0f );
+        }
+    }
+    pImage->sto_ijk    = nifti_mat44_inverse( pImage->sto_xyz );
+    pImage->sform_code = NIFTI_XFORM_SCANNER_ANAT;
+
+    return pImage;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+bool SyntheticData::writeImage( nifti_image *pImage, const wxString &filename )
+{
+    bool result( false );
+    if( nifti_set_filenames( pImage, std::string( filename.mb_str() ).c_str(), 0, 1 ) == 0 )
+    {
+        nifti_image_write( pImage );
+        result = true;
+    }
+
+    nifti_image_free( pImage );
+    return result;
+}
@@ -0,0 +1,59 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            SyntheticData.h
+//
+// Description: Generators of the synthetic datasets used by the benchmark.
+//
+// Everything is drawn from a fixed seed, so two builds run on exactly the
+// same data. Volumes are written with a positive diagonal transform and are
+// never flipped when loaded.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef SYNTHETICDATA_H_
+#define SYNTHETICDATA_H_
+
+#include "../misc/nifti/nifti1_io.h"
+
+#include <wx/string.h>
+
+#include <vector>
+
+class SyntheticData
+{
+private:
+    SyntheticData(){};
+    ~SyntheticData(){};
+
+public:
+    // Float volume, a blurred ellipsoid filling the grid.
+    static bool writeAnatomy( const wxString &filename, int columns, int rows, int frames, float voxelSize );
+
+    // Tensor field (6 bands, FSL order) with a FA of about 0.8. The main
+    // direction winds around the Z axis at the center of the grid while
+    // climbing along it, so that the streamlines are helices that always
+    // leave the volume.
+    static bool writeTensors( const wxString &filename, int columns, int rows, int frames, float voxelSize );
+
+    // Maximas (3 peaks, 9 bands): the main direction of the tensors, a
+    // weaker peak along Z that the tracking must not follow, and an empty
+    // peak.
+    static bool writeMaximas( const wxString &filename, int columns, int rows, int frames, float voxelSize );
+
+    // TrackVis file of smooth random walks bouncing inside the grid, each
+    // point holding a RGB color as scalars. Coordinates are in mm.
+    static bool writeTRK( const wxString &filename, int nbFibers, int nbPoints, 
+                          int columns, int rows, int frames, float voxelSize );
+
+    // 4D int16 resting-state volume in memory. The voxels belong to one of a
+    // few networks following their position, each network sharing the same
+    // signal plus noise. To be released with nifti_image_free.
+    static nifti_image * createRestingState( int columns, int rows, int frames, int bands, float voxelSize );
+
+    // Binary mask (0 or 1) in memory: an ellipsoid pierced by a tunnel along
+    // Z, so that the distances are not all to its outer surface.
+    static void createMask( int columns, int rows, int frames, std::vector< float > &o_mask );
+
+private:
+    static nifti_image * createImage( int columns, int rows, int frames, int bands, int datatype, float voxelSize );
+    static bool          writeImage( nifti_image *pImage, const wxString &filename );
+};
+
+#endif /* SYNTHETICDATA_H_ */
@@ -5,6 +5,7 @@
 
 #include "Anatomy.h"
 #include "Fibers.h"
+#include "NiftiFile.h"
 
 #include "../Logger.h"
 #include "../main.h"
@@ -12,6 +13,9 @@
 #include "../gui/MainFrame.h"
 #include "../gui/SceneManager.h"
 #include "../gui/SelectionObject.h"
+#include "../misc/Profiler.h"
+#include "../misc/Algorithms/BinaryMorphology.h"
+#include "../misc/Algorithms/DistanceTransform.h"
 #include "../misc/lic/TensorField.h"
 #include "../misc/nifti/nifti1_io.h"
 
@@ -44,6 +48,8 @@ Anatomy::Anatomy( )
 : DatasetInfo(),
   m_isSegmentOn( false ),  
   m_dataType( 2 ),
+  m_storageType( STORAGE_FLOAT ),
+  m_storageMax( 1.0f ),
   m_pTensorField( NULL ),
   m_useEqualizedDataset( false ),
   m_lowerEqThreshold( LOWER_EQ_THRES ),
@@ -59,6 +65,8 @@ Anatomy::Anatomy( const wxString &filename )
 : DatasetInfo(),
   m_isSegmentOn( false ),  
   m_dataType( 2 ),
+  m_storageType( STORAGE_FLOAT ),
+  m_storageMax( 1.0f ),
   m_pTensorField( NULL ),
   m_useEqualizedDataset( false ),
   m_lowerEqThreshold( LOWER_EQ_THRES ),
@@ -83,6 +91,8 @@ Anatomy::Anatomy( const Anatomy * const pAnatomy, bool Offset )
 : DatasetInfo(),
   m_isSegmentOn( false ),
   m_dataType( 2 ),
+  m_storageType( STORAGE_FLOAT ),
+  m_storageMax( 1.0f ),
   m_pTensorField( NULL ),
   m_useEqualizedDataset( false ),
   m_lowerEqThreshold( LOWER_EQ_THRES ),
@@ -116,6 +126,8 @@ Anatomy::Anatomy( std::vector< float >* pDataset,
 : DatasetInfo(),
   m_isSegmentOn( false ),
   m_dataType( 2 ),
+  m_storageType( STORAGE_FLOAT ),
+  m_storageMax( 1.0f ),
   m_pTensorField( NULL ),
   m_useEqualizedDataset( false ),
   m_lowerEqThreshold( LOWER_EQ_THRES ),
@@ -164,6 +176,8 @@ Anatomy::Anatomy( const int type )
 : DatasetInfo(),
   m_isSegmentOn( false ),
   m_dataType( 2 ),
+  m_storageType( STORAGE_FLOAT ),
+  m_storageMax( 1.0f ),
   m_pTensorField( NULL ),
   m_useEqualizedDataset( false ),
   m_lowerEqThreshold( LOWER_EQ_THRES ),
@@ -207,6 +221,8 @@ Anatomy::Anatomy( const wxString &filename, const int type )
 : DatasetInfo(),
 m_isSegmentOn( false ),
 m_dataType( 2 ),
+m_storageType( STORAGE_FLOAT ),
+m_storageMax( 1.0f ),
 m_pTensorField( NULL ),
 m_useEqualizedDataset( false ),
 m_lowerEqThreshold( LOWER_EQ_THRES ),
@@ -251,24 +267,68 @@ m_originalAxialOrientation( ORIENTATION_UNDEFINED )
 
 void Anatomy::add( Anatomy* pAnatomy )
 {
+    ensureFloatDataset();
+
     for( unsigned int i = 0; i < m_floatDataset.size(); ++i )
     {
-        m_floatDataset[i] += pAnatomy->m_floatDataset[i];
+        m_floatDataset[i] += pAnatomy->at( i );
     }
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-float Anatomy::at( const int pos ) const
+std::vector< float >* Anatomy::getFloatDataset()
 {
-    return m_floatDataset[pos];
+    ensureFloatDataset();
+    return &m_floatDataset;
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-std::vector< float >* Anatomy::getFloatDataset()
+void Anatomy::setFloatDataset( std::vector< float > &dataset )
 {
-    return &m_floatDataset;
+    releaseStoredDataset();
+    m_floatDataset = dataset;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void Anatomy::ensureFloatDataset()
+{
+    if( STORAGE_FLOAT == m_storageType )
+    {
+        return;
+    }
+
+    std::vector< float > floatDataset( getSize() );
+    for( unsigned int i( 0 ); i < floatDataset.size(); ++i )
+    {
+        floatDataset[i] = at( i );
+    }
+
+    releaseStoredDataset();
+    m_floatDataset.swap( floatDataset );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void Anatomy::releaseStoredDataset()
+{
+    std::vector< wxUint8 >().swap( m_byteDataset );
+    std::vector< wxInt16 >().swap( m_shortDataset );
+    m_storageType = STORAGE_FLOAT;
+    m_storageMax  = 1.0f;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void Anatomy::releaseEqualizedDataset()
+{
+    std::vector< float >().swap( m_equalizedDataset );
+
+    // Forces equalizeHistogram() to run again when equalization is turned on.
+    m_currentLowerEqThreshold = -1;
+    m_currentUpperEqThreshold = -1;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -307,10 +367,10 @@ void Anatomy::setZero( const int sizeX,
 
     int datasetSize = m_rows * m_columns * m_frames;
 
+    releaseStoredDataset();
+    releaseEqualizedDataset();
     m_floatDataset.clear();
     m_floatDataset.resize( datasetSize, 0.0f );
-    m_equalizedDataset.clear();
-    m_equalizedDataset.resize( datasetSize, 0.0f );
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -326,10 +386,10 @@ void Anatomy::setRGBZero( const int sizeX,
 
     int datasetSize = m_rows * m_columns * m_frames;
 
+    releaseStoredDataset();
+    releaseEqualizedDataset();
     m_floatDataset.clear();
     m_floatDataset.resize( datasetSize * m_bands, 0.0f );
-    m_equalizedDataset.clear();
-    m_equalizedDataset.resize( datasetSize * m_bands, 0.0f );
 
     m_dataType = 2;
     m_type = RGB;
@@ -346,38 +406,12 @@ TensorField* Anatomy::getTensorField()
 
 void Anatomy::dilate()
 {
-    int datasetSize(m_columns * m_rows * m_frames);
-    std::vector<bool> tmp( datasetSize, false );
-    int curIndex;
+    ensureFloatDataset();
 
-    for( int c(1); c < m_columns - 1; ++c )
-    {
-        for( int r(1); r < m_rows - 1; ++r )
-        {
-            for( int f(1); f < m_frames - 1; ++f )
-            {
-                curIndex = c + r * m_columns + f * m_columns * m_rows;
-                if( m_floatDataset[curIndex] == 1.0f )
-                {
-                    dilateInternal( tmp, curIndex );
-                }
-            }
-        }
-    }
-
-    if( m_equalizedDataset.size() != m_floatDataset.size() )
-    {
-        m_equalizedDataset.resize( m_floatDataset.size() );
-    }
-
-    for( int i(0); i < datasetSize; ++i )
-    {
-        if ( tmp[i] )
-        {
-            m_floatDataset[i] = 1.0f;
-            m_equalizedDataset[i] = 1.0f;
-        }
-    }
+    BinaryVolume mask;
+    getMask( mask );
+    BinaryMorphology::dilate( mask, StructuringElement( StructuringElement::SHAPE_EDGES ) );
+    setMask( mask, true );
 
     const GLuint* pTexId = &m_GLuint;
     glDeleteTextures( 1, pTexId );
@@ -390,38 +424,12 @@ void Anatomy::dilate()
 
 void Anatomy::erode()
 {
-    int datasetSize = m_columns * m_rows * m_frames;
-    std::vector<bool> tmp( datasetSize, false );
-    int curIndex;
+    ensureFloatDataset();
 
-    for( int c(1); c < m_columns - 1; ++c )
-    {
-        for( int r(1); r < m_rows - 1; ++r )
-        {
-            for( int f(1); f < m_frames - 1; ++f )
-            {
-                curIndex = c + r * m_columns + f * m_columns * m_rows;
-                if( m_floatDataset[curIndex] == 1.0f )
-                {
-                    erodeInternal(tmp, curIndex );
-                }
-            }
-        }
-    }
-
-    if( m_equalizedDataset.size() != m_floatDataset.size() )
-    {
-        m_equalizedDataset.resize( m_floatDataset.size() );
-    }
-
-    for( int i(0); i < datasetSize; ++i )
-    {
-        if( !tmp[i] )
-        {
-            m_floatDataset[i] = 0.0f;
-            m_equalizedDataset[i] = 0.0f;
-        }
-    }
+    BinaryVolume mask;
+    getMask( mask );
+    BinaryMorphology::erode( mask, StructuringElement( StructuringElement::SHAPE_EDGES ) );
+    setMask( mask, false );
 
     const GLuint* pTexId = &m_GLuint;
     glDeleteTextures( 1, pTexId );
@@ -438,14 +446,14 @@ void Anatomy::minimize()
         return;
     }
 
-    std::vector<bool> workData( m_columns * m_rows * m_frames, false );
+    BinaryVolume workData( m_columns, m_rows, m_frames );
 
     long index = MyApp::frame->getCurrentListIndex();
     if( -1 != index )
     {
         Fibers* pFibers = DatasetManager::getInstance()->getSelectedFibers( MyApp::frame->m_pListCtrl->GetItem( index ) );
 
-        int curX, curY, curZ, index;
+        int curX, curY, curZ;
 
         for( int i(0); i < pFibers->getLineCount(); ++i )
         {
@@ -459,8 +467,7 @@ void Anatomy::minimize()
                     curY = std::min( m_rows    - 1, std::max( 0, (int)( pFibers->getPointValue( j * 3 + 1) / m_voxelSizeY ) ) ); // m_dh->m_yVoxel ) );
                     curZ = std::min( m_frames  - 1, std::max( 0, (int)( pFibers->getPointValue( j * 3 + 2) / m_voxelSizeZ ) ) ); // m_dh->m_zVoxel ) );
 
-                    index = curX + curY * m_columns + curZ * m_rows * m_columns;
-                    workData[index] = true;
+                    workData.set( curX, curY, curZ, true );
                 }
             }
         }
@@ -471,11 +478,18 @@ void Anatomy::minimize()
 
         std::vector<float> *pNewAnatDataset = pNewAnatomy->getFloatDataset();
 
-        for( int i(0); i < m_columns * m_rows * m_frames; ++i )
+        for( int z(0); z < m_frames; ++z )
         {
-            if( workData[i] && m_floatDataset[i] > 0.0f )
+            for( int y(0); y < m_rows; ++y )
             {
-                pNewAnatDataset->at( i ) = 1.0;
+                for( int x(0); x < m_columns; ++x )
+                {
+                    const int i = x + y * m_columns + z * m_columns * m_rows;
+                    if( workData.get( x, y, z ) && at( i ) > 0.0f )
+                    {
+                        pNewAnatDataset->at( i ) = 1.0;
+                    }
+                }
             }
         }
 
@@ -494,15 +508,18 @@ void Anatomy::flipAxis( AxisType axe )
     flipAxisInternal( axe, true );
 }
 
-void Anatomy::flipAxisInternal( AxisType axe, const bool regenerateDisplayObjects )
+namespace
+{
+// Flips the voxels of a dataset of any stored type along one axis.
+template< typename T >
+void flipVoxels( std::vector< T > &dataset, AxisType axe, int columns, int rows, int frames, int bands )
 {
-    float tmp;
     int curIndex;
-    int flipIndex;
+    int flipIndex( 0 );
 
-    int row(m_rows);
-    int col(m_columns);
-    int frames(m_frames);
+    int row(rows);
+    int col(columns);
+    int frame(frames);
 
     switch (axe)
     {
@@ -513,46 +530,63 @@ void Anatomy::flipAxisInternal( AxisType axe, const bool regenerateDisplayObject
             row /= 2;
             break;
         case Z_AXIS:
-            frames /= 2;
+            frame /= 2;
             break;
         default:
-            Logger::getInstance()->print( wxT( "Cannot flip axis. The given axis is undefined." ), LOGLEVEL_ERROR );
             return;
     }
 
-    for( int f(0); f < frames; ++f )
+    for( int f(0); f < frame; ++f )
     {
         for( int r(0); r < row; ++r )
         {
             for( int c(0); c < col; ++c )
             {
-                curIndex = (c + r * m_columns + f * m_columns * m_rows) * m_bands;
+                curIndex = (c + r * columns + f * columns * rows) * bands;
 
                 //Compute the index of the value that will be replaced by the one defined by our current index
                 switch (axe)
                 {
                     case X_AXIS:
-                        flipIndex = ((m_columns - 1 - c) + r * m_columns + f * m_columns * m_rows) * m_bands;
+                        flipIndex = ((columns - 1 - c) + r * columns + f * columns * rows) * bands;
                         break;
                     case Y_AXIS:
-                        flipIndex = (c + (m_rows - 1 - r) * m_columns + f * m_columns * m_rows) * m_bands;
+                        flipIndex = (c + (rows - 1 - r) * columns + f * columns * rows) * bands;
                         break;
                     case Z_AXIS:
-                        flipIndex = (c + r * m_columns + (m_frames - 1 - f) * m_columns * m_rows) * m_bands;
+                        flipIndex = (c + r * columns + (frames - 1 - f) * columns * rows) * bands;
                         break;
                     default:
                         break;
                 }
 
-                for ( int i(0); i < m_bands; ++i )
-                { 
-                    tmp = m_floatDataset[curIndex + i];
-                    m_floatDataset[curIndex + i] = m_floatDataset[flipIndex + i];
-                    m_floatDataset[flipIndex + i] = tmp;
-                }
+                std::swap_ranges( dataset.begin() + curIndex, dataset.begin() + curIndex + bands, dataset.begin() + flipIndex );
             }
         }
     }
+}
+}
+
+void Anatomy::flipAxisInternal( AxisType axe, const bool regenerateDisplayObjects )
+{
+    if( X_AXIS != axe && Y_AXIS != axe && Z_AXIS != axe )
+    {
+        Logger::getInstance()->print( wxT( "Cannot flip axis. The given axis is undefined." ), LOGLEVEL_ERROR );
+        return;
+    }
+
+    switch( m_storageType )
+    {
+        case STORAGE_BYTE:
+            flipVoxels( m_byteDataset, axe, m_columns, m_rows, m_frames, m_bands );
+            break;
+        case STORAGE_SHORT:
+            flipVoxels( m_shortDataset, axe, m_columns, m_rows, m_frames, m_bands );
+            break;
+        default:
+            flipVoxels( m_floatDataset, axe, m_columns, m_rows, m_frames, m_bands );
+            break;
+    }
 
     if( 0 != m_equalizedDataset.size() )
     {
@@ -779,12 +813,9 @@ bool Anatomy::load( nifti_image *pHeader, nifti_image *pBody )
         case HEAD_BYTE:
         {
             unsigned char* pData = (unsigned char*)pBody->data;
-            m_floatDataset.resize( datasetSize );
-
-            for( int i(0); i < datasetSize; ++i )
-            {
-                m_floatDataset[i] = (float)pData[i] / 255.0;
-            }
+            m_byteDataset.assign( pData, pData + datasetSize );
+            m_storageType = STORAGE_BYTE;
+            m_storageMax  = 255.0f;
 
             flag = true;
             m_oldMax = 255;
@@ -818,20 +849,16 @@ bool Anatomy::load( nifti_image *pHeader, nifti_image *pBody )
                 }
             }
             
-            for( int i(0); i < datasetSize; ++i )
-            {
-                if ( pData[i] > newMax )
-                {
-                    pData[i] = newMax;
-                }
-            }
-
-            m_floatDataset.resize( datasetSize );
+            // The body may be a read-only mapping of the file, so it is
+            // clamped while copying instead of in place.
+            m_shortDataset.resize( datasetSize );
 
             for( int i(0); i < datasetSize; ++i )
             {
-                m_floatDataset[i] = (float)pData[i] / (float)newMax;
+                m_shortDataset[i] = std::min( (int)pData[i], newMax );
             }
+            m_storageType = STORAGE_SHORT;
+            m_storageMax  = newMax;
 
             m_oldMax    = dataMax;
             m_newMax    = newMax;
@@ -843,20 +870,12 @@ bool Anatomy::load( nifti_image *pHeader, nifti_image *pBody )
         {
             float* pData = (float*)pBody->data;
 
-            m_floatDataset.resize( datasetSize );
-            
-            for( int i(0); i < datasetSize; ++i )
-            {
-                m_floatDataset[i] = (float)pData[i];
-            }
+            m_floatDataset.assign( pData, pData + datasetSize );
 
             float dataMax = 0.0f;
             for( int i(0); i < datasetSize; ++i )
             {
-                if (m_floatDataset[i] > dataMax)
-                {
-                    dataMax = m_floatDataset[i];
-                }
+                dataMax = std::max( dataMax, m_floatDataset[i] );
             }
 
             for( int i(0); i < datasetSize; ++i )
@@ -891,13 +910,7 @@ bool Anatomy::load( nifti_image *pHeader, nifti_image *pBody )
         {
             float* pData = (float*)pBody->data;
             m_floatDataset.resize( datasetSize * 3 );
-
-            for( int i(0); i < datasetSize; ++i )
-            {
-                m_floatDataset[i * 3]       = pData[i];
-                m_floatDataset[i * 3 + 1]   = pData[datasetSize + i];
-                m_floatDataset[i * 3 + 2]   = pData[2 * datasetSize + i];
-            }
+            NiftiFile::interleaveBands( pData, datasetSize, 3, &m_floatDataset[0] );
 
             flag = true;
             break;
@@ -1011,7 +1024,18 @@ void Anatomy::saveNifti( wxString fileName )
     // Prevents copying the whole vector
     vector<float> *pDataset = m_useEqualizedDataset ? &m_equalizedDataset : &m_floatDataset;
 
-    if( m_type == HEAD_BYTE )
+    if( !m_useEqualizedDataset && STORAGE_BYTE == m_storageType )
+    {
+        // Already in the format of the file.
+        pImage->data = &m_byteDataset[0];
+        nifti_image_write( pImage );
+    }
+    else if( !m_useEqualizedDataset && STORAGE_SHORT == m_storageType )
+    {
+        pImage->data = &m_shortDataset[0];
+        nifti_image_write( pImage );
+    }
+    else if( m_type == HEAD_BYTE )
     {
         vector<unsigned char> tmp( pDataset->size() );
         for(unsigned int i(0); i < pDataset->size(); ++i )
@@ -1411,6 +1435,11 @@ bool Anatomy::toggleEqualization()
     {
         equalizeHistogram();
     }
+    else if( !m_useEqualizedDataset )
+    {
+        // Do not keep a second copy of the volume that is not displayed.
+        releaseEqualizedDataset();
+    }
 
     const GLuint* pTexId = &m_GLuint;
     glDeleteTextures( 1, pTexId );
@@ -1465,9 +1494,9 @@ void Anatomy::edgeDetect( const Anatomy * const pAnatomy )
 
 				if(!pAnatomy->m_useEqualizedDataset)
 				{
-					col = std::pow((pAnatomy->m_floatDataset[xPlus1] - pAnatomy->m_floatDataset[xMoins1])/2.0,2);
-					col += std::pow((pAnatomy->m_floatDataset[yPlus1] - pAnatomy->m_floatDataset[yMoins1])/2.0,2);
-					col += std::pow((pAnatomy->m_floatDataset[zPlus1] - pAnatomy->m_floatDataset[zMoins1])/2.0,2);
+					col = std::pow((pAnatomy->at(xPlus1) - pAnatomy->at(xMoins1))/2.0,2);
+					col += std::pow((pAnatomy->at(yPlus1) - pAnatomy->at(yMoins1))/2.0,2);
+					col += std::pow((pAnatomy->at(zPlus1) - pAnatomy->at(zMoins1))/2.0,2);
 				}
 				else
 				{
@@ -1483,7 +1512,8 @@ void Anatomy::edgeDetect( const Anatomy * const pAnatomy )
 
 	m_floatDataset = tmpGradient;
 	equalizeHistogram(); //For scaling purposes
-	m_floatDataset = m_equalizedDataset;
+	m_floatDataset.swap( m_equalizedDataset );
+	releaseEqualizedDataset();
 }
 
 
@@ -1493,185 +1523,64 @@ void Anatomy::edgeDetect( const Anatomy * const pAnatomy )
 
 void Anatomy::createOffset( const Anatomy * const pAnatomy )
 {
-    int b, r, c, bb, rr, r0, b0, c0;
-    int i, istart, iend;
-    int nbPixels;
-    int d, d1, d2, cc1, cc2;
-    float u, dmin;
-    bool *pSrcPix;
-    double g;
-
-    const int nbBands( m_frames );
-    const int nbRows( m_rows );
-    const int nbCols( m_columns );
-
-    nbPixels = wxMax( nbBands, nbRows );
-    double *array = new double[nbPixels];
-
-    nbPixels = nbBands * nbRows * nbCols;
+    m_floatDataset.resize( m_columns * m_rows * m_frames );
+    for( unsigned int i(0); i < m_floatDataset.size(); ++i )
+    {
+        m_floatDataset[i] = pAnatomy->at(i);
+    }
 
-    m_floatDataset.assign( nbPixels, 0.0f );
+    computeOffset( m_floatDataset, m_columns, m_rows, m_frames, m_voxelSizeX, m_voxelSizeY, m_voxelSizeZ );
+}
 
-    bool *pBitMask = new bool[nbPixels];
+///////////////////////////////////////////////////////////////////////////
+// Replaces the values of a volume by the distance of its voxels to the
+// background (values below 0.01), normalized, then smoothed.
+///////////////////////////////////////////////////////////////////////////
+void Anatomy::computeOffset( std::vector<float> &io_dataset, int columns, int rows, int frames,
+                             float voxelX, float voxelY, float voxelZ )
+{
+    const int nbBands( frames );
+    const int nbRows( rows );
+    const int nbCols( columns );
+    const int nbPixels( nbBands * nbRows * nbCols );
+    const int sliceSize( nbRows * nbCols );
+
+    // Distance of each voxel of the object to the background, exact and in
+    // the units of the voxel sizes.
+    bool hasBackground( false );
     for( int i(0); i < nbPixels; ++i )
     {
-        if( pAnatomy->at(i) < 0.01 )
+        if( io_dataset[i] < 0.01 )
         {
-            pBitMask[i] = true;
+            io_dataset[i] = 0.0f;
+            hasBackground = true;
         }
         else
         {
-            pBitMask[i] = false;
+            io_dataset[i] = DistanceTransform::getInfinity();
         }
     }
 
-    float dmax( 999999999.0f );
-
-    // first pass
-    for( b = 0; b < nbBands; ++b )
+    if( !hasBackground )
     {
-        for( r = 0; r < nbRows; ++r )
-        {
-            for( c = 0; c < nbCols; ++c )
-            {
-                if ( pBitMask[b * nbRows * nbCols + r * nbCols + c] )
-                {
-                    continue;
-                }
-
-                pSrcPix = pBitMask + b * nbRows * nbCols + r * nbCols + c;
-                cc1 = c;
-
-                while( cc1 < nbCols && *pSrcPix++ == 0 )
-                {
-                    cc1++;
-                }
-
-                d1 = ( cc1 >= nbCols ? nbCols : ( cc1 - c ) );
-
-                pSrcPix = pBitMask + b * nbRows * nbCols + r * nbCols + c;
-                cc2 = c;
-
-                while( cc2 >= 0 && *pSrcPix-- == 0 )
-                {
-                    cc2--;
-                }
-
-                d2 = ( cc2 <= 0 ? nbCols : ( c - cc2 ) );
-
-                if( d1 <= d2 )
-                {
-                    d  = d1;
-                    c0 = cc1;
-                }
-                else
-                {
-                    d  = d2;
-                    c0 = cc2;
-                }
-
-                m_floatDataset[b * nbRows * nbCols + r * nbCols + c] = (float)( d * d );
-            }
-        }
-    }
-
-    // second pass
-    for( b = 0; b < nbBands; b++ )
-    {
-        for( c = 0; c < nbCols; c++ )
-        {
-            for( r = 0; r < nbRows; r++ )
-            {
-                array[r] = (double)m_floatDataset[b * nbRows * nbCols + r * nbCols + c];
-            }
-
-            for( r = 0; r < nbRows; r++ )
-            {
-                if( pBitMask[b * nbRows * nbCols + r * nbCols + c] == 1 )
-                    continue;
-
-                dmin    = dmax;
-                r0      = r;
-                g       = sqrt(array[r]);
-                istart  = r - (int) g;
-
-                if( istart < 0 )
-                    istart = 0;
-
-                iend    = r + (int) g + 1;
-
-                if ( iend >= nbRows )
-                    iend = nbRows;
-
-                for( rr = istart; rr < iend; rr++ )
-                {
-                    u = array[rr] + (r - rr) * (r - rr);
-                    if( u < dmin )
-                    {
-                        dmin = u;
-                        r0   = rr;
-                    }
-                }
-
-                m_floatDataset[b * nbRows * nbCols + r * nbCols + c] = dmin;
-            }
-        }
+        io_dataset.assign( nbPixels, 0.0f );
+        return;
     }
 
-    // third pass
-
-    for( r = 0; r < nbRows; r++ )
-    {
-        for( c = 0; c < nbCols; c++ )
-        {
-            for( b = 0; b < nbBands; b++ )
-            {
-                array[b] = (double) m_floatDataset[b * nbRows * nbCols + r * nbCols + c];
-            }
-
-            for( b = 0; b < nbBands; b++ )
-            {
-                if( pBitMask[b * nbRows * nbCols + r * nbCols + c] == 1 )
-                    continue;
-
-                dmin   = dmax;
-                b0     = b;
-                g      = sqrt(array[b]);
-                istart = b - (int) g - 1;
-
-                if( istart < 0 )
-                    istart = 0;
-
-                iend   = b + (int) g + 1;
-
-                if( iend >= nbBands )
-                    iend = nbBands;
-
-                for( bb = istart; bb < iend; bb++ )
-                {
-                    u = array[bb] + (b - bb) * (b - bb);
-
-                    if( u < dmin )
-                    {
-                        dmin = u;
-                        b0   = bb;
-                    }
-                }
-                m_floatDataset[b * nbRows * nbCols + r * nbCols + c] = dmin;
-            }
-        }
-    }
+    DistanceTransform::computeSquared( io_dataset, nbCols, nbRows, nbBands, voxelX, voxelY, voxelZ );
 
     float max = 0;
-    for( i = 0; i < nbPixels; ++i )
+    for( int i(0); i < nbPixels; ++i )
     {
-        m_floatDataset[i] = sqrt( (double)m_floatDataset[i] );
-        if( m_floatDataset[i] > max )
-            max = m_floatDataset[i];
+        io_dataset[i] = sqrt( io_dataset[i] );
+        max = std::max( max, io_dataset[i] );
     }
-    for( i = 0; i < nbPixels; ++i )
+    if( max > 0.0f )
     {
-        m_floatDataset[i] = m_floatDataset[i] / max;
+        for( int i(0); i < nbPixels; ++i )
+        {
+            io_dataset[i] = io_dataset[i] / max;
+        }
     }
 
     // filter with gauss
@@ -1682,7 +1591,7 @@ void Anatomy::createOffset( const Anatomy * const pAnatomy )
     int n         = 2* dim + 1;
     double step   = 1;
 
-    float* kernel = new float[n];
+    std::vector<float> kernel( n );
 
     double sum    = 0;
     double x      = -(float)dim;
@@ -1699,85 +1608,91 @@ void Anatomy::createOffset( const Anatomy * const pAnatomy )
     /* normalize */
     for( int i = 0; i < n; ++i )
     {
-        uu        = kernel[i];
-        uu        /= sum;
-        kernel[i] = uu;
+        kernel[i] /= sum;
     }
 
-    d = n / 2;
-    float* float_pp;
+    // Each pass only smoothes the voxels at least d voxels away from the
+    // borders of its axis, the others keep the value of the previous pass.
+    const int d = n / 2;
     std::vector<float> tmp( nbPixels, 0.0f );
-    int c1, cc;
 
-    for( b = 0; b < nbBands; ++b )
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( static )
+#endif
+    for( int b = 0; b < nbBands; ++b )
     {
-        for( r = 0; r < nbRows; ++r )
+        for( int r = 0; r < nbRows; ++r )
         {
-            for( c = d; c < nbCols - d; ++c )
+            const float *pLine = &io_dataset[b * sliceSize + r * nbCols];
+            for( int c = d; c < nbCols - d; ++c )
             {
-                float_pp = kernel;
-                sum      = 0;
-                c0       = c - d;
-                c1       = c + d;
-
-                for( cc = c0; cc <= c1; cc++ )
+                double lineSum = 0;
+                for( int k = 0; k < n; ++k )
                 {
-                    x = m_floatDataset[b * nbRows * nbCols + r * nbCols + cc];
-                    sum += x * (*float_pp++);
+                    lineSum += pLine[c - d + k] * kernel[k];
                 }
-                tmp[b * nbRows * nbCols + r * nbCols + c] = sum;
+                tmp[b * sliceSize + r * nbCols + c] = lineSum;
             }
         }
     }
-    int r1;
-    for( b = 0; b < nbBands; ++b )
+
+    // The y and z passes accumulate whole rows, so that the inner loops
+    // read contiguous voxels.
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
     {
-        for( r = d; r < nbRows - d; ++r )
+        std::vector<double> rowSum( nbCols );
+
+#ifdef _OPENMP
+        #pragma omp for schedule( static )
+#endif
+        for( int b = 0; b < nbBands; ++b )
         {
-            for( c = 0; c < nbCols; ++c )
+            for( int r = d; r < nbRows - d; ++r )
             {
-                float_pp = kernel;
-                sum      = 0;
-                r0       = r - d;
-                r1       = r + d;
-
-                for( rr = r0; rr <= r1; rr++ )
+                std::fill( rowSum.begin(), rowSum.end(), 0.0 );
+                for( int k = 0; k < n; ++k )
                 {
-                    x = tmp[b * nbRows * nbCols + rr * nbCols + c];
-                    sum += x * (*float_pp++);
+                    const float *pRow = &tmp[b * sliceSize + ( r - d + k ) * nbCols];
+                    for( int c = 0; c < nbCols; ++c )
+                    {
+                        rowSum[c] += pRow[c] * kernel[k];
+                    }
                 }
-
-                m_floatDataset[b * nbRows * nbCols + r * nbCols + c] = sum;
+                std::copy( rowSum.begin(), rowSum.end(), io_dataset.begin() + b * sliceSize + r * nbCols );
             }
         }
     }
-    int b1;
-    for( b = d; b < nbBands - d; ++b )
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
     {
-        for( r = 0; r < nbRows; ++r )
+        std::vector<double> rowSum( nbCols );
+
+#ifdef _OPENMP
+        #pragma omp for schedule( static )
+#endif
+        for( int b = d; b < nbBands - d; ++b )
         {
-            for( c = 0; c < nbCols; ++c )
+            for( int r = 0; r < nbRows; ++r )
             {
-                float_pp = kernel;
-                sum      = 0;
-                b0       = b - d;
-                b1       = b + d;
-
-                for( bb = b0; bb <= b1; bb++ )
+                std::fill( rowSum.begin(), rowSum.end(), 0.0 );
+                for( int k = 0; k < n; ++k )
                 {
-                    x   = m_floatDataset[bb * nbRows * nbCols + r * nbCols + c];
-                    sum += x * (*float_pp++);
+                    const float *pRow = &io_dataset[( b - d + k ) * sliceSize + r * nbCols];
+                    for( int c = 0; c < nbCols; ++c )
+                    {
+                        rowSum[c] += pRow[c] * kernel[k];
+                    }
                 }
-
-                tmp[b * nbRows * nbCols + r * nbCols + c] = sum;
+                std::copy( rowSum.begin(), rowSum.end(), tmp.begin() + b * sliceSize + r * nbCols );
             }
         }
     }
 
-    delete[] pBitMask;
-    delete[] kernel;
-
-    m_floatDataset = tmp;
+    io_dataset.swap( tmp );
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -1794,55 +1709,61 @@ double Anatomy::xxgauss( const double x, const double sigma )
 
 //////////////////////////////////////////////////////////////////////////
 
-void Anatomy::dilateInternal( std::vector< bool > &workData, int curIndex )
+///////////////////////////////////////////////////////////////////////////
+// The mask holds the voxels at 1, the value painted by the drawing tools.
+///////////////////////////////////////////////////////////////////////////
+void Anatomy::getMask( BinaryVolume &mask ) const
 {
-    workData.at( curIndex - 1 )                              = true;
-    workData.at( curIndex )                                  = true;
-    workData.at( curIndex + 1 )                              = true;
-    workData.at( curIndex - m_columns - 1 )                  = true;
-    workData.at( curIndex - m_columns )                      = true;
-    workData.at( curIndex - m_columns + 1 )                  = true;
-    workData.at( curIndex + m_columns - 1 )                  = true;
-    workData.at( curIndex + m_columns )                      = true;
-    workData.at( curIndex + m_columns + 1 )                  = true;
-    workData.at( curIndex - m_columns * m_rows - 1 )         = true;
-    workData.at( curIndex - m_columns * m_rows )             = true;
-    workData.at( curIndex - m_columns * m_rows + 1 )         = true;
-    workData.at( curIndex + m_columns * m_rows - 1 )         = true;
-    workData.at( curIndex + m_columns * m_rows )             = true;
-    workData.at( curIndex + m_columns * m_rows + 1 )         = true;
-    workData.at( curIndex - m_columns * m_rows - m_columns ) = true;
-    workData.at( curIndex - m_columns * m_rows + m_columns ) = true;
-    workData.at( curIndex + m_columns * m_rows - m_columns ) = true;
-    workData.at( curIndex + m_columns * m_rows + m_columns ) = true;
-}
+    BinaryVolume( m_columns, m_rows, m_frames ).swap( mask );
 
-//////////////////////////////////////////////////////////////////////////
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( static )
+#endif
+    for( int z = 0; z < m_frames; ++z )
+    {
+        for( int y = 0; y < m_rows; ++y )
+        {
+            const float *pRow = &m_floatDataset[( z * m_rows + y ) * m_columns];
+            for( int x = 0; x < m_columns; ++x )
+            {
+                if( pRow[x] == 1.0f )
+                {
+                    mask.set( x, y, z, true );
+                }
+            }
+        }
+    }
+}
 
-void Anatomy::erodeInternal( std::vector< bool > &workData, int curIndex )
+///////////////////////////////////////////////////////////////////////////
+// With isDilation, the voxels of the mask are set to 1, the others are left
+// as is. Otherwise, the voxels outside of the mask are set to 0.
+///////////////////////////////////////////////////////////////////////////
+void Anatomy::setMask( const BinaryVolume &mask, bool isDilation )
 {
-    float acc  = m_floatDataset[curIndex - 1]
-    + m_floatDataset[curIndex] + m_floatDataset[curIndex + 1]
-    + m_floatDataset[curIndex - m_columns - 1]
-    + m_floatDataset[curIndex - m_columns]
-    + m_floatDataset[curIndex - m_columns + 1]
-    + m_floatDataset[curIndex + m_columns - 1]
-    + m_floatDataset[curIndex + m_columns]
-    + m_floatDataset[curIndex + m_columns + 1]
-    + m_floatDataset[curIndex - m_columns * m_rows - 1]
-    + m_floatDataset[curIndex - m_columns * m_rows]
-    + m_floatDataset[curIndex - m_columns * m_rows + 1]
-    + m_floatDataset[curIndex + m_columns * m_rows - 1]
-    + m_floatDataset[curIndex + m_columns * m_rows]
-    + m_floatDataset[curIndex + m_columns * m_rows + 1]
-    + m_floatDataset[curIndex - m_columns * m_rows - m_columns]
-    + m_floatDataset[curIndex - m_columns * m_rows + m_columns]
-    + m_floatDataset[curIndex + m_columns * m_rows - m_columns]
-    + m_floatDataset[curIndex + m_columns * m_rows + m_columns];
-
-    if( acc == 19.0 )
-    {
-        workData.at( curIndex ) = true;
+    const bool isEqualized( m_equalizedDataset.size() == m_floatDataset.size() );
+    const float value( isDilation ? 1.0f : 0.0f );
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( static )
+#endif
+    for( int z = 0; z < m_frames; ++z )
+    {
+        for( int y = 0; y < m_rows; ++y )
+        {
+            const int rowStart = ( z * m_rows + y ) * m_columns;
+            for( int x = 0; x < m_columns; ++x )
+            {
+                if( mask.get( x, y, z ) == isDilation )
+                {
+                    m_floatDataset[rowStart + x] = value;
+                    if( isEqualized )
+                    {
+                        m_equalizedDataset[rowStart + x] = value;
+                    }
+                }
+            }
+        }
     }
 }
 
@@ -1861,6 +1782,8 @@ void Anatomy::erodeInternal( std::vector< bool > &workData, int curIndex )
 /************************************************************************/
 void Anatomy::equalizeHistogram()
 {
+    PROFILE_SCOPE( "Anatomy::equalizeHistogram" );
+
     Logger::getInstance()->print( wxT( "Anatomy::equalizeHistogram() Starting equalization..." ), LOGLEVEL_DEBUG );
     clock_t startTime( clock() );
 
@@ -1886,7 +1809,7 @@ void Anatomy::equalizeHistogram()
 
         for( unsigned int i( 0 ); i < size; ++i )
         {
-            unsigned int pixelValue( static_cast< unsigned int >( m_floatDataset.at( i ) * ( GRAY_SCALE - 1 ) ) );
+            unsigned int pixelValue( static_cast< unsigned int >( at( i ) * ( GRAY_SCALE - 1 ) ) );
 
             if( pixelValue < GRAY_SCALE )
             {
@@ -1955,7 +1878,7 @@ void Anatomy::equalizeHistogram()
     // Calculate the equalized frame
     for( unsigned int i( 0 ); i < size; ++i )
     {
-        m_equalizedDataset[i] = equalizedHistogram[static_cast< unsigned int >( m_floatDataset.at( i ) * ( GRAY_SCALE - 1 ) )];
+        m_equalizedDataset[i] = equalizedHistogram[static_cast< unsigned int >( at( i ) * ( GRAY_SCALE - 1 ) )];
     }
 
     clock_t endTime( clock() );
@@ -1970,6 +1893,7 @@ void Anatomy::equalizeHistogram()
 //////////////////////////////////////////////////////////////////////////
 void Anatomy::writeVoxel( const int x, const int y, const int z, const int layer, const int size, const bool isRound, const bool draw3d, wxColor colorRGB )
 {
+    ensureFloatDataset();
     SubTextureBox l_stb = getStrokeBox(x, y, z, layer, size, draw3d);
 
     switch( m_type )
@@ -2057,7 +1981,27 @@ void Anatomy::generateTexture()
         case HEAD_BYTE:
         case HEAD_SHORT:
         case OVERLAY:
-            glTexImage3D( GL_TEXTURE_3D, 0, GL_RGBA, m_columns, m_rows, m_frames, 0, GL_LUMINANCE, GL_FLOAT, m_useEqualizedDataset ? &m_equalizedDataset[0] : &m_floatDataset[0] );
+            if( !m_useEqualizedDataset && STORAGE_BYTE == m_storageType )
+            {
+                // Unsigned bytes are normalized by 255, like at() does.
+                glTexImage3D( GL_TEXTURE_3D, 0, GL_RGBA, m_columns, m_rows, m_frames, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, &m_byteDataset[0] );
+            }
+            else if( !m_useEqualizedDataset && STORAGE_SHORT == m_storageType )
+            {
+                // Unsigned shorts are normalized by 65535, rescale the values
+                // so that m_storageMax becomes 1.
+                std::vector< GLushort > texture( m_shortDataset.size() );
+                const float scale( 65535.0f / m_storageMax );
+                for( unsigned int i( 0 ); i < texture.size(); ++i )
+                {
+                    texture[i] = static_cast< GLushort >( std::max( 0, static_cast< int >( m_shortDataset[i] ) ) * scale + 0.5f );
+                }
+                glTexImage3D( GL_TEXTURE_3D, 0, GL_RGBA, m_columns, m_rows, m_frames, 0, GL_LUMINANCE, GL_UNSIGNED_SHORT, &texture[0] );
+            }
+            else
+            {
+                glTexImage3D( GL_TEXTURE_3D, 0, GL_RGBA, m_columns, m_rows, m_frames, 0, GL_LUMINANCE, GL_FLOAT, m_useEqualizedDataset ? &m_equalizedDataset[0] : &m_floatDataset[0] );
+            }
             break;
 
         case RGB:
@@ -2092,6 +2036,7 @@ Anatomy::~Anatomy()
 
 void Anatomy::pushHistory()
 {
+    ensureFloatDataset();
     m_drawHistory.push(stack<SubTextureBox>());
 }
 
@@ -2133,6 +2078,7 @@ void Anatomy::popHistory(bool isRGB)
     {
         return;
     }
+    ensureFloatDataset();
 
     //restore the data from top of history
     while( !m_drawHistory.top().empty() )
@@ -9,6 +9,7 @@
 #include <stack>
 #include <vector>
 
+class BinaryVolume;
 class SelectionObject;
 class MainFrame;
 class MySlider;
@@ -52,6 +53,12 @@ friend class PropertiesWindow;
         ORIENTATION_ANT_TO_POST,
         ORIENTATION_POST_TO_ANT,
     };
+    enum StorageType
+    {
+        STORAGE_FLOAT,
+        STORAGE_BYTE,
+        STORAGE_SHORT
+    };
 
 public:
     //constructor/destructor
@@ -65,11 +72,14 @@ public:
 
     void add( Anatomy* anatomy);
 
+    // Byte and short anatomies keep the values of their file, at() and the
+    // texture read them directly. getFloatDataset() converts them to float
+    // the first time it is called, since its callers may modify the values.
     float at( const int i ) const;
-    unsigned int getSize() { return m_floatDataset.size(); }
+    unsigned int getSize() const;
     std::vector<float>* getFloatDataset();
     std::vector<float>* getEqualizedDataset();
-    void setFloatDataset(std::vector<float>& dataset) { m_floatDataset = dataset; }
+    void setFloatDataset(std::vector<float>& dataset);
 
     MySlider            *m_pSliderFlood;
     MySlider            *m_pSliderGraphSigma;
@@ -125,6 +135,10 @@ public:
     bool toggleEqualization();
     void equalizationSliderChange();
     void generateTexture();
+
+    // Distance map of a volume, computed in place (see createOffset).
+    static void computeOffset( std::vector<float> &io_dataset, int columns, int rows, int frames,
+                               float voxelX, float voxelY, float voxelZ );
     
 
 public:
@@ -153,10 +167,10 @@ private:
 
     void createOffset( const Anatomy * const pAnatomy );
     void edgeDetect( const Anatomy * const pAnatomy );
-    double xxgauss( const double x, const double sigma );   
+    static double xxgauss( const double x, const double sigma );   
     
-    void dilateInternal( std::vector<bool> &workData, int curIndex );
-    void erodeInternal(  std::vector<bool> &workData, int curIndex );
+    void getMask( BinaryVolume &mask ) const;
+    void setMask( const BinaryVolume &mask, bool isDilation );
 
     void equalizeHistogram();
 
@@ -164,6 +178,10 @@ private:
     void updateTexture( SubTextureBox drawZone, const bool isRound, wxColor colorRGB );
     void fillHistory(const SubTextureBox drawZone, bool isRGB);
 
+    void ensureFloatDataset();
+    void releaseStoredDataset();
+    void releaseEqualizedDataset();
+
     void generateGeometry() {};
     void initializeBuffer() {};
     void smooth()           {};
@@ -175,9 +193,13 @@ private:
 
     float                   m_floodThreshold;
     float                   m_graphSigma;
+    std::vector<wxUint8>    m_byteDataset;      // HEAD_BYTE, as read
+    std::vector<wxInt16>    m_shortDataset;     // HEAD_SHORT, as read, clamped to m_newMax
     std::vector<float>      m_floatDataset;
-    std::vector<float>      m_equalizedDataset; // Dataset having its histogram equalized
+    std::vector<float>      m_equalizedDataset; // Dataset having its histogram equalized, only while it is used
     int                     m_dataType;
+    StorageType             m_storageType;
+    float                   m_storageMax;       // Stored value of 1.0
     TensorField             *m_pTensorField;
 
     bool                    m_useEqualizedDataset;
@@ -191,4 +213,30 @@ private:
     SagOrientation          m_originalSagOrientation;
 };
 
+inline float Anatomy::at( const int i ) const
+{
+    switch( m_storageType )
+    {
+        case STORAGE_BYTE:
+            return m_byteDataset[i] / m_storageMax;
+        case STORAGE_SHORT:
+            return m_shortDataset[i] / m_storageMax;
+        default:
+            return m_floatDataset[i];
+    }
+}
+
+inline unsigned int Anatomy::getSize() const
+{
+    switch( m_storageType )
+    {
+        case STORAGE_BYTE:
+            return m_byteDataset.size();
+        case STORAGE_SHORT:
+            return m_shortDataset.size();
+        default:
+            return m_floatDataset.size();
+    }
+}
+
 #endif /* ANATOMY_H_ */
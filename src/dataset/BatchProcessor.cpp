@@ -0,0 +1,581 @@
+#include "BatchProcessor.h"
+
+#include "FiberBVH.h"
+#include "Fibers.h"
+#include "SelectionQuery.h"
+#include "../Logger.h"
+#include "../gui/SceneManager.h"
+#include "../misc/XmlHelper.h"
+#include "../misc/Algorithms/FiberRasterizer.h"
+#include "../misc/nifti/nifti1_io.h"
+
+#include <wx/filename.h>
+#include <wx/stopwatch.h>
+#include <wx/xml/xml.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+///////////////////////////////////////////////////////////////////////////
+// Scenes are spread over the threads. With a single scene, the loops of the
+// rasterizer get the threads instead.
+///////////////////////////////////////////////////////////////////////////
+int BatchProcessor::run( const std::vector< wxString > &scenes, const wxString &outputDir )
+{
+    // The fibers read the SceneManager when created. It is created here,
+    // before the threads, and without GL context the fibers keep their
+    // colors in memory instead of buffer objects.
+    SceneManager::getInstance()->setUsingVBO( false );
+
+    if( !createOutputDir( outputDir ) )
+    {
+        return static_cast< int >( scenes.size() );
+    }
+
+    const int nbScenes = static_cast< int >( scenes.size() );
+    int failures = 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic, 1 ) reduction( +:failures ) if( nbScenes > 1 )
+#endif
+    for( int i = 0; i < nbScenes; ++i )
+    {
+        if( !processScene( scenes[i], outputDir ) )
+        {
+            ++failures;
+        }
+    }
+
+    Logger::getInstance()->print( wxString::Format( wxT( "Batch done: %d scene(s), %d failure(s)" ), nbScenes, failures ), LOGLEVEL_MESSAGE );
+
+    return failures;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The fibers are loaded as if they were opened over the anatomy in the
+// navigator, then all of them are saved. Files are spread over the threads,
+// as the scenes are.
+///////////////////////////////////////////////////////////////////////////
+int BatchProcessor::convert( const std::vector< wxString > &fibersFiles, const wxString &anatomyPath, const wxString &outputDir )
+{
+    SceneManager::getInstance()->setUsingVBO( false );
+
+    const int nbFiles = static_cast< int >( fibersFiles.size() );
+
+    FibersGrid grid;
+    if( !readGrid( anatomyPath, grid ) )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "Cannot read the header of \"%s\"" ), anatomyPath.c_str() ), LOGLEVEL_ERROR );
+        return nbFiles;
+    }
+
+    if( !createOutputDir( outputDir ) )
+    {
+        return nbFiles;
+    }
+
+    int failures = 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic, 1 ) reduction( +:failures ) if( nbFiles > 1 )
+#endif
+    for( int i = 0; i < nbFiles; ++i )
+    {
+        wxString fibersName;
+        wxFileName::SplitPath( fibersFiles[i], NULL, NULL, &fibersName, NULL );
+        const wxString output = outputDir + wxFileName::GetPathSeparator() + fibersName + wxT( ".fbt" );
+
+        Fibers *pFibers = new Fibers();
+        if( !pFibers->load( fibersFiles[i], grid ) )
+        {
+            Logger::getInstance()->print( wxString::Format( wxT( "Cannot load the fibers \"%s\"" ), fibersFiles[i].c_str() ), LOGLEVEL_ERROR );
+            ++failures;
+        }
+        else
+        {
+            pFibers->setSelectedFibers( std::vector< bool >( pFibers->getLineCount(), true ) );
+            if( !pFibers->saveBinary( output ) )
+            {
+                Logger::getInstance()->print( wxString::Format( wxT( "Cannot write \"%s\"" ), output.c_str() ), LOGLEVEL_ERROR );
+                ++failures;
+            }
+            else
+            {
+                Logger::getInstance()->print( wxString::Format( wxT( "%s: %d fibers written to \"%s\"" ), fibersName.c_str(), pFibers->getLineCount(), output.c_str() ), LOGLEVEL_MESSAGE );
+            }
+        }
+
+#ifdef _OPENMP
+        #pragma omp critical( BatchProcessorFibers )
+#endif
+        delete pFibers;
+    }
+
+    Logger::getInstance()->print( wxString::Format( wxT( "Conversion done: %d file(s), %d failure(s)" ), nbFiles, failures ), LOGLEVEL_MESSAGE );
+
+    return failures;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+bool BatchProcessor::createOutputDir( const wxString &outputDir )
+{
+    if( !wxFileName::DirExists( outputDir ) && !wxFileName::Mkdir( outputDir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL ) )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "Cannot create the output directory \"%s\"" ), outputDir.c_str() ), LOGLEVEL_ERROR );
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+bool BatchProcessor::processScene( const wxString &sceneFile, const wxString &outputDir )
+{
+    wxStopWatch timer;
+
+    Scene scene;
+    if( !readScene( sceneFile, scene ) )
+    {
+        return false;
+    }
+
+    if( scene.m_anatomyPath.IsEmpty() )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "%s: the scene has no anatomy to give the size of the volume" ), scene.m_name.c_str() ), LOGLEVEL_ERROR );
+        return false;
+    }
+
+    FibersGrid grid;
+    if( !readGrid( scene.m_anatomyPath, grid ) )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "%s: cannot read the header of \"%s\"" ), scene.m_name.c_str(), scene.m_anatomyPath.c_str() ), LOGLEVEL_ERROR );
+        return false;
+    }
+
+    FiberRasterizer rasterizer( grid.m_columns, grid.m_rows, grid.m_frames,
+                                grid.m_voxelX, grid.m_voxelY, grid.m_voxelZ );
+
+    const wxString prefix = outputDir + wxFileName::GetPathSeparator() + scene.m_name;
+    wxString csv( wxT( "fibers,object,count,mean_length,min_length,max_length\n" ) );
+    bool success = true;
+
+    for( std::vector< wxString >::const_iterator it = scene.m_fibersPaths.begin(); it != scene.m_fibersPaths.end(); ++it )
+    {
+        wxString fibersName;
+        wxFileName::SplitPath( *it, NULL, NULL, &fibersName, NULL );
+
+        Fibers *pFibers = new Fibers();
+        if( !pFibers->load( *it, grid ) )
+        {
+            Logger::getInstance()->print( wxString::Format( wxT( "%s: cannot load the fibers \"%s\"" ), scene.m_name.c_str(), it->c_str() ), LOGLEVEL_ERROR );
+            success = false;
+        }
+        else if( pFibers->getLineCount() > 0 )
+        {
+            const int countLines = pFibers->getLineCount();
+
+            FiberBitset selected;
+            getSelectedFibers( scene.m_selection, *pFibers->getFiberBVH(), countLines, grid, selected );
+
+            std::vector< bool > mask;
+            selected.toBoolVector( mask );
+            pFibers->setSelectedFibers( mask );
+
+            if( !pFibers->saveBinary( prefix + wxT( "_" ) + fibersName + wxT( "_selected.fbt" ) ) )
+            {
+                success = false;
+            }
+            pFibers->rasterizeVisibleFibers( rasterizer );
+
+            // In mm, as shown by the fibers in the application.
+            std::vector< float > lengths( countLines );
+            for( int l = 0; l < countLines; ++l )
+            {
+                lengths[l] = pFibers->getFiberLength( l );
+            }
+
+            writeStats( csv, fibersName, wxT( "(selection)" ), selected, lengths );
+            writeStatsRecur( csv, fibersName, scene.m_selection, selected, lengths );
+
+            Logger::getInstance()->print( wxString::Format( wxT( "%s: %d of %d fibers selected in %s" ), scene.m_name.c_str(), 
+                                                            static_cast< int >( std::count( mask.begin(), mask.end(), true ) ), countLines, fibersName.c_str() ), LOGLEVEL_MESSAGE );
+        }
+
+        // The destructor removes the fibers from the selection tree of the
+        // SceneManager, shared by the threads.
+#ifdef _OPENMP
+        #pragma omp critical( BatchProcessorFibers )
+#endif
+        delete pFibers;
+    }
+
+    if( !writeDensity( prefix + wxT( "_density.nii.gz" ), scene.m_anatomyPath, rasterizer.getDensity(), grid ) )
+    {
+        success = false;
+    }
+
+    std::ofstream statsFile( ( prefix + wxT( "_stats.csv" ) ).fn_str() );
+    statsFile << csv.mb_str();
+    if( !statsFile )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "%s: cannot write the statistics" ), scene.m_name.c_str() ), LOGLEVEL_ERROR );
+        success = false;
+    }
+
+    Logger::getInstance()->print( wxString::Format( wxT( "%s: processed in %ldms" ), scene.m_name.c_str(), timer.Time() ), LOGLEVEL_MESSAGE );
+
+    return success;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Reads the same nodes as SceneManager::loadOldVersion, paths being relative
+// to the scene file.
+///////////////////////////////////////////////////////////////////////////
+bool BatchProcessor::readScene( const wxString &sceneFile, Scene &o_scene )
+{
+    wxString scenePath;
+    wxFileName::SplitPath( sceneFile, NULL, &scenePath, &o_scene.m_name, NULL );
+
+    wxXmlDocument doc;
+    if( !doc.Load( sceneFile ) || NULL == doc.GetRoot() || doc.GetRoot()->GetName() != wxT( "theScene" ) )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "Cannot read the scene \"%s\"" ), sceneFile.c_str() ), LOGLEVEL_ERROR );
+        return false;
+    }
+
+    for( wxXmlNode *pChild = doc.GetRoot()->GetChildren(); NULL != pChild; pChild = pChild->GetNext() )
+    {
+        if( wxT( "data" ) == pChild->GetName() )
+        {
+            for( wxXmlNode *pDatasetNode = pChild->GetChildren(); NULL != pDatasetNode; pDatasetNode = pDatasetNode->GetNext() )
+            {
+                wxXmlNode *pStatus = getXmlNodeByName( wxT( "status" ), pDatasetNode );
+                wxXmlNode *pPath   = getXmlNodeByName( wxT( "path" ), pDatasetNode );
+                if( NULL == pPath || ( NULL != pStatus && pStatus->GetAttribute( wxT( "isFiberGroup" ), wxT( "no" ) ) == wxT( "yes" ) ) )
+                {
+                    continue;
+                }
+
+                wxFileName fullPath( pPath->GetNodeContent() );
+                fullPath.MakeAbsolute( scenePath );
+                const wxString path = fullPath.GetFullPath();
+
+                wxString extension = path.AfterLast( '.' );
+                if( wxT( "gz" ) == extension )
+                {
+                    extension = path.BeforeLast( '.' ).AfterLast( '.' );
+                }
+
+                if( wxT( "nii" ) == extension || wxT( "hdr" ) == extension )
+                {
+                    // Like the DatasetManager, the first anatomy gives the volume.
+                    if( o_scene.m_anatomyPath.IsEmpty() )
+                    {
+                        o_scene.m_anatomyPath = path;
+                    }
+                }
+                else if( wxT( "fib" ) == extension || wxT( "vtk" ) == extension || wxT( "bundlesdata" ) == extension || 
+                         wxT( "Bfloat" ) == extension || wxT( "trk" ) == extension || wxT( "tck" ) == extension || wxT( "fbt" ) == extension )
+                {
+                    o_scene.m_fibersPaths.push_back( path );
+                }
+            }
+        }
+        else if( wxT( "selection_setup" ) == pChild->GetName() )
+        {
+            wxXmlNode *pRootChildNode = pChild->GetChildren();
+            if( NULL != pRootChildNode && pRootChildNode->GetName() == wxT( "children_objects" ) )
+            {
+                readSelectionObjects( pRootChildNode, o_scene.m_name, o_scene.m_selection );
+            }
+        }
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Same grid and transformation as set in the DatasetManager by Anatomy::load.
+///////////////////////////////////////////////////////////////////////////
+bool BatchProcessor::readGrid( const wxString &anatomyPath, FibersGrid &o_grid )
+{
+    nifti_image *pHeader = nifti_image_read( std::string( anatomyPath.mb_str() ).c_str(), 0 );
+    if( NULL == pHeader )
+    {
+        return false;
+    }
+
+    o_grid.m_columns = pHeader->dim[1];
+    o_grid.m_rows    = pHeader->dim[2];
+    o_grid.m_frames  = pHeader->dim[3];
+    o_grid.m_voxelX  = pHeader->dx;
+    o_grid.m_voxelY  = pHeader->dy;
+    o_grid.m_voxelZ  = pHeader->dz;
+
+    o_grid.m_niftiTransform = FMatrix( 4, 4 );
+    if( pHeader->sform_code > 0 || pHeader->qform_code > 0 )
+    {
+        const mat44 &transform = pHeader->sform_code > 0 ? pHeader->sto_xyz : pHeader->qto_xyz;
+        for( int row = 0; row < 4; ++row )
+        {
+            for( int col = 0; col < 4; ++col )
+            {
+                o_grid.m_niftiTransform( row, col ) = transform.m[row][col];
+            }
+        }
+    }
+    else
+    {
+        // This is not a typo, the method is called makeIdendity in FMatrix.
+        o_grid.m_niftiTransform.makeIdendity();
+    }
+
+    nifti_image_free( pHeader );
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Same content as read by the SelectionObject constructor, see
+// SelectionObject::populateXMLNode.
+///////////////////////////////////////////////////////////////////////////
+void BatchProcessor::readSelectionObjects( wxXmlNode *pChildrenNode, const wxString &sceneName, std::vector< SelectionNode > &o_nodes )
+{
+    for( wxXmlNode *pObjNode = pChildrenNode->GetChildren(); NULL != pObjNode; pObjNode = pObjNode->GetNext() )
+    {
+        const wxString type = pObjNode->GetAttribute( wxT( "type" ), wxT( "" ) );
+        if( type != wxT( "box" ) && type != wxT( "ellipsoid" ) )
+        {
+            Logger::getInstance()->print( wxString::Format( wxT( "%s: selection object of type \"%s\" skipped, with its children" ), sceneName.c_str(), type.c_str() ), LOGLEVEL_WARNING );
+            continue;
+        }
+
+        SelectionNode node;
+        node.m_isActive    = true;
+        node.m_isNOT       = false;
+        node.m_isEllipsoid = type == wxT( "ellipsoid" );
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            node.m_center[axis] = 0.0;
+            node.m_size[axis]   = 0.0;
+        }
+
+        for( wxXmlNode *pChildNode = pObjNode->GetChildren(); NULL != pChildNode; pChildNode = pChildNode->GetNext() )
+        {
+            const wxString nodeName = pChildNode->GetName();
+            wxString propVal;
+            double value;
+
+            if( nodeName == wxT( "state" ) )
+            {
+                node.m_name = pChildNode->GetAttribute( wxT( "name" ), wxT( "" ) );
+                propVal = pChildNode->GetAttribute( wxT( "active" ), wxT( "yes" ) );
+                node.m_isActive = parseXmlBoolString( propVal );
+                propVal = pChildNode->GetAttribute( wxT( "isNOT" ), wxT( "no" ) );
+                node.m_isNOT = parseXmlBoolString( propVal );
+            }
+            else if( nodeName == wxT( "center" ) )
+            {
+                pChildNode->GetAttribute( wxT( "posX" ), wxT( "0" ) ).ToDouble( &value );
+                node.m_center[0] = value;
+                pChildNode->GetAttribute( wxT( "posY" ), wxT( "0" ) ).ToDouble( &value );
+                node.m_center[1] = value;
+                pChildNode->GetAttribute( wxT( "posZ" ), wxT( "0" ) ).ToDouble( &value );
+                node.m_center[2] = value;
+            }
+            else if( nodeName == wxT( "size" ) )
+            {
+                pChildNode->GetAttribute( wxT( "sizeX" ), wxT( "0" ) ).ToDouble( &value );
+                node.m_size[0] = value;
+                pChildNode->GetAttribute( wxT( "sizeY" ), wxT( "0" ) ).ToDouble( &value );
+                node.m_size[1] = value;
+                pChildNode->GetAttribute( wxT( "sizeZ" ), wxT( "0" ) ).ToDouble( &value );
+                node.m_size[2] = value;
+            }
+            else if( nodeName == wxT( "children_objects" ) )
+            {
+                readSelectionObjects( pChildNode, sceneName, node.m_children );
+            }
+        }
+
+        o_nodes.push_back( node );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Same query and combination as SelectionTree::SelectionTreeNode.
+///////////////////////////////////////////////////////////////////////////
+void BatchProcessor::updateInBranch( SelectionNode &node, FiberBVH &bvh, const FibersGrid &grid )
+{
+    const float voxelSize[3] = { grid.m_voxelX, grid.m_voxelY, grid.m_voxelZ };
+
+    SelectionQuery query;
+    query.setShape( node.m_isEllipsoid, node.m_center, node.m_size, voxelSize );
+    bvh.getFibersInside( query, node.m_inBranch );
+
+    FiberBranchCombiner combiner;
+    for( std::vector< SelectionNode >::iterator it = node.m_children.begin(); it != node.m_children.end(); ++it )
+    {
+        updateInBranch( *it, bvh, grid );
+        if( it->m_isActive )
+        {
+            combiner.addChild( it->m_inBranch, it->m_isNOT );
+        }
+    }
+    combiner.applyTo( node.m_inBranch );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Without any active object, every fiber is selected, as in
+// SelectionTree::getSelectedFibers.
+///////////////////////////////////////////////////////////////////////////
+void BatchProcessor::getSelectedFibers( std::vector< SelectionNode > &roots, FiberBVH &bvh, int countLines, const FibersGrid &grid, FiberBitset &o_selected )
+{
+    o_selected.assign( countLines, false );
+    bool anyActive( false );
+
+    for( std::vector< SelectionNode >::iterator it = roots.begin(); it != roots.end(); ++it )
+    {
+        updateInBranch( *it, bvh, grid );
+        if( it->m_isActive )
+        {
+            o_selected.orWith( it->m_inBranch );
+            anyActive = true;
+        }
+    }
+
+    if( !anyActive )
+    {
+        o_selected.assign( countLines, true );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void BatchProcessor::writeStats( wxString &io_csv, const wxString &fibersName, const wxString &objectName,
+                                 const FiberBitset &fibers, const std::vector< float > &lengths )
+{
+    int   count( 0 );
+    float sum( 0.0f );
+    float minLength( 0.0f );
+    float maxLength( 0.0f );
+
+    for( unsigned int l = 0; l < fibers.size(); ++l )
+    {
+        if( fibers.test( l ) )
+        {
+            minLength = count == 0 ? lengths[l] : std::min( minLength, lengths[l] );
+            maxLength = count == 0 ? lengths[l] : std::max( maxLength, lengths[l] );
+            sum += lengths[l];
+            ++count;
+        }
+    }
+
+    // Names are quoted, they may hold commas.
+    wxString quotedFibers( fibersName );
+    wxString quotedObject( objectName );
+    quotedFibers.Replace( wxT( "\"" ), wxT( "\"\"" ) );
+    quotedObject.Replace( wxT( "\"" ), wxT( "\"\"" ) );
+
+    io_csv += wxString::Format( wxT( "\"%s\",\"%s\",%d,%.4f,%.4f,%.4f\n" ), quotedFibers.c_str(), quotedObject.c_str(),
+                                count, count > 0 ? sum / count : 0.0f, minLength, maxLength );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The fibers of an object are the selected ones in its branch, as shown by
+// SelectionTree::getSelectedFibersInBranch.
+///////////////////////////////////////////////////////////////////////////
+void BatchProcessor::writeStatsRecur( wxString &io_csv, const wxString &fibersName, const std::vector< SelectionNode > &nodes,
+                                      const FiberBitset &selected, const std::vector< float > &lengths )
+{
+    for( std::vector< SelectionNode >::const_iterator it = nodes.begin(); it != nodes.end(); ++it )
+    {
+        FiberBitset inBranch( selected );
+        if( it->m_isNOT )
+        {
+            inBranch.andNotWith( it->m_inBranch );
+        }
+        else
+        {
+            inBranch.andWith( it->m_inBranch );
+        }
+
+        writeStats( io_csv, fibersName, it->m_name, inBranch, lengths );
+        writeStatsRecur( io_csv, fibersName, it->m_children, selected, lengths );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The density is written as floats, with the header of the anatomy so that
+// it keeps its transformation. Anatomies stored right to left or anterior to
+// posterior are flipped when loaded (see Anatomy::load), the density is
+// flipped back the same way as in Anatomy::saveNifti.
+///////////////////////////////////////////////////////////////////////////
+bool BatchProcessor::writeDensity( const wxString &filename, const wxString &anatomyPath, const std::vector< float > &density, const FibersGrid &grid )
+{
+    nifti_image *pImage = nifti_image_read( std::string( anatomyPath.mb_str() ).c_str(), 0 );
+    if( NULL == pImage )
+    {
+        return false;
+    }
+
+    bool flipX( false );
+    bool flipY( false );
+    if( pImage->sform_code > 0 )
+    {
+        flipX = pImage->sto_xyz.m[0][0] < 0.0;
+        flipY = pImage->sto_xyz.m[1][1] < 0.0;
+    }
+    else if( pImage->qform_code > 0 )
+    {
+        flipX = pImage->qto_xyz.m[0][0] < 0.0;
+        flipY = pImage->qto_xyz.m[1][1] < 0.0;
+    }
+
+    std::vector< float > data( density.size() );
+    float maxDensity( 0.0f );
+    for( int z = 0; z < grid.m_frames; ++z )
+    {
+        for( int y = 0; y < grid.m_rows; ++y )
+        {
+            const int fileY = flipY ? grid.m_rows - 1 - y : y;
+            for( int x = 0; x < grid.m_columns; ++x )
+            {
+                const int fileX = flipX ? grid.m_columns - 1 - x : x;
+                const float value = density[x + ( y + z * grid.m_rows ) * grid.m_columns];
+                data[fileX + ( fileY + z * grid.m_rows ) * grid.m_columns] = value;
+                maxDensity = std::max( maxDensity, value );
+            }
+        }
+    }
+
+    pImage->dim[0] = 3;
+    for( int i = 4; i < 8; ++i )
+    {
+        pImage->dim[i] = 1;
+    }
+    nifti_update_dims_from_array( pImage );
+
+    pImage->datatype    = NIFTI_TYPE_FLOAT32;
+    pImage->nbyper      = sizeof( float );
+    pImage->scl_slope   = 1.0f;
+    pImage->scl_inter   = 0.0f;
+    pImage->cal_min     = 0.0f;
+    pImage->cal_max     = maxDensity;
+    pImage->intent_code = NIFTI_INTENT_NONE;
+    pImage->nifti_type  = NIFTI_FTYPE_NIFTI1_1;
+
+    bool result( false );
+    if( nifti_set_filenames( pImage, std::string( filename.mb_str() ).c_str(), 0, 1 ) == 0 )
+    {
+        // Do not let nifti_image_free release the vector.
+        pImage->data = &data[0];
+        nifti_image_write( pImage );
+        pImage->data = NULL;
+        result = true;
+    }
+
+    nifti_image_free( pImage );
+    return result;
+}
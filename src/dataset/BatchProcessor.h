@@ -0,0 +1,84 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            BatchProcessor.h
+//
+// Description: Headless processing of scene files (-b on the command line).
+//
+// A scene is read without creating any window, GL context or dataset of
+// the DatasetManager, so several scenes are processed at the same time.
+// For each scene, the selection tree is applied to every fiber set and the
+// output directory receives:
+//     <scene>_<fibers>_selected.fbt  The selected fibers.
+//     <scene>_density.nii.gz         Number of selected fibers per voxel.
+//     <scene>_stats.csv              Fiber count and lengths per selection object.
+// The fibers are loaded by Fibers::load, in the grid of the first anatomy of
+// the scene instead of the one of the DatasetManager. VOI selection objects
+// are not supported and are ignored.
+//
+// Fibers files (TRK, TCK, VTK, ...) are also converted to the binary format
+// (-c on the command line), in the grid of a given anatomy. The output
+// directory receives <fibers>.fbt for each of them, with all their fibers.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef BATCHPROCESSOR_H_
+#define BATCHPROCESSOR_H_
+
+#include "FiberBitset.h"
+
+#include <wx/string.h>
+
+#include <vector>
+
+class FiberBVH;
+class wxXmlNode;
+struct FibersGrid;
+
+class BatchProcessor
+{
+private:
+    BatchProcessor(){};
+    ~BatchProcessor(){};
+
+public:
+    // Returns the number of scenes that could not be processed.
+    static int run( const std::vector< wxString > &scenes, const wxString &outputDir );
+
+    // Returns the number of fibers files that could not be converted.
+    static int convert( const std::vector< wxString > &fibersFiles, const wxString &anatomyPath, const wxString &outputDir );
+
+private:
+    struct SelectionNode
+    {
+        wxString    m_name;
+        bool        m_isActive;
+        bool        m_isNOT;
+        bool        m_isEllipsoid;
+        double      m_center[3];  // In mm
+        double      m_size[3];    // In voxels
+        FiberBitset m_inBranch;
+        std::vector< SelectionNode > m_children;
+    };
+
+    struct Scene
+    {
+        wxString m_name;
+        wxString m_anatomyPath;
+        std::vector< wxString >      m_fibersPaths;
+        std::vector< SelectionNode > m_selection;
+    };
+
+    static bool createOutputDir( const wxString &outputDir );
+    static bool processScene( const wxString &sceneFile, const wxString &outputDir );
+    static bool readScene( const wxString &sceneFile, Scene &o_scene );
+    static bool readGrid( const wxString &anatomyPath, FibersGrid &o_grid );
+    static void readSelectionObjects( wxXmlNode *pChildrenNode, const wxString &sceneName, std::vector< SelectionNode > &o_nodes );
+
+    static void updateInBranch( SelectionNode &node, FiberBVH &bvh, const FibersGrid &grid );
+    static void getSelectedFibers( std::vector< SelectionNode > &roots, FiberBVH &bvh, int countLines, const FibersGrid &grid, FiberBitset &o_selected );
+
+    static void writeStats( wxString &io_csv, const wxString &fibersName, const wxString &objectName,
+                            const FiberBitset &fibers, const std::vector< float > &lengths );
+    static void writeStatsRecur( wxString &io_csv, const wxString &fibersName, const std::vector< SelectionNode > &nodes,
+                                 const FiberBitset &selected, const std::vector< float > &lengths );
+    static bool writeDensity( const wxString &filename, const wxString &anatomyPath, const std::vector< float > &density, const FibersGrid &grid );
+};
+
+#endif /* BATCHPROCESSOR_H_ */
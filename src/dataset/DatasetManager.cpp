@@ -6,11 +6,13 @@
 #include "ODFs.h"
 #include "Tensors.h"
 #include "Maximas.h"
+#include "NiftiFile.h"
 #include "RestingStateNetwork.h"
 #include "RTFMRIHelper.h"
 #include "../Logger.h"
 #include "../gui/SceneManager.h"
 #include "../gui/SelectionTree.h"
+#include "../misc/Profiler.h"
 #include "../misc/nifti/nifti1_io.h"
 
 #include <wx/filename.h>
@@ -286,6 +288,8 @@ void DatasetManager::clear()
 
 DatasetIndex DatasetManager::load( const wxString &filename, const wxString &extension )
 {
+    PROFILE_SCOPE( "DatasetManager::load" );
+
     DatasetIndex result( BAD_INDEX );
 
     if( !wxFileName::FileExists( filename ) )
@@ -296,14 +300,13 @@ DatasetIndex DatasetManager::load( const wxString &filename, const wxString &ext
 
     if( wxT( "nii" ) == extension )
     {
-        // Get std::string from wxString.
-        // This avoids problems between different compiler versions.
-        std::string filename_str = std::string(filename.mb_str());
-
-        nifti_image *pHeader = nifti_image_read( filename_str.c_str(), 0 );
-        nifti_image *pBody   = nifti_image_read( filename_str.c_str(), 1 );
+        // The header and the body are the same image, read once.
+        NiftiFile niftiFile;
+        niftiFile.open( filename );
+        nifti_image *pHeader = niftiFile.getImage();
+        nifti_image *pBody   = pHeader;
 
-        if( NULL == pHeader || NULL == pBody )
+        if( NULL == pHeader )
         {
             Logger::getInstance()->print( wxT( "nifti file corrupt, cannot create nifti image from header" ), LOGLEVEL_ERROR );
         }
@@ -370,9 +373,6 @@ DatasetIndex DatasetManager::load( const wxString &filename, const wxString &ext
         {
             result = loadAnatomy( filename, pHeader, pBody );
         }
-
-        nifti_image_free( pHeader );
-        nifti_image_free( pBody );
     }
     else if( wxT("mesh") == extension || wxT( "surf" ) == extension || wxT( "dip" ) == extension )
     {
@@ -385,7 +385,7 @@ DatasetIndex DatasetManager::load( const wxString &filename, const wxString &ext
             result = loadMesh( filename, extension );
         }
     }
-    else if( wxT( "fib" ) == extension || wxT( "trk" ) == extension || wxT( "bundlesdata" ) == extension || wxT( "Bfloat" ) == extension || wxT( "tck" ) == extension || wxT( "vtk" ) == extension)
+    else if( wxT( "fib" ) == extension || wxT( "trk" ) == extension || wxT( "bundlesdata" ) == extension || wxT( "Bfloat" ) == extension || wxT( "tck" ) == extension || wxT( "vtk" ) == extension || wxT( "fbt" ) == extension)
     {
         if( !isAnatomyLoaded() )
         {
@@ -655,7 +655,7 @@ DatasetIndex DatasetManager::loadRestingState( const wxString &filename, nifti_i
 }
 //////////////////////////////////////////////////////////////////////////
 
-// Loads a fiber set. Extension supported: .fib, .vtk, .bundlesdata, .trk and .tck
+// Loads a fiber set. Extension supported: .fib, .vtk, .bundlesdata, .trk, .tck and .fbt
 DatasetIndex DatasetManager::loadFibers( const wxString &filename )
 {
     Fibers* l_fibers = new Fibers();
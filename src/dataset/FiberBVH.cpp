@@ -0,0 +1,296 @@
+#include "FiberBVH.h"
+
+#include "../Logger.h"
+
+#include <algorithm>
+
+namespace
+{
+    const int SEGMENT_POINTS = 16; // Points per segment
+    const int LEAF_SEGMENTS  = 4;  // Segments under which a node is not split
+    const int MAX_DEPTH      = 48;
+
+    // Orders segments along one axis, by the center of their box.
+    class SegmentCenterLess
+    {
+    public:
+        SegmentCenterLess( int axis ) : m_axis( axis ) {}
+
+        template< class T >
+        bool operator()( const T &a, const T &b ) const
+        {
+            return a.m_box.m_min[m_axis] + a.m_box.m_max[m_axis] < b.m_box.m_min[m_axis] + b.m_box.m_max[m_axis];
+        }
+
+    private:
+        int m_axis;
+    };
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////////////////////////////
+FiberBVH::FiberBVH( const std::vector< float > &pointArray, const std::vector< int > &linePointers, int countLines )
+:   m_pointArray( pointArray ),
+    m_countLines( countLines )
+{
+    for( int fiber = 0; fiber < countLines; ++fiber )
+    {
+        for( int begin = linePointers[fiber]; begin < linePointers[fiber + 1]; begin += SEGMENT_POINTS )
+        {
+            Segment segment;
+            segment.m_fiber = fiber;
+            segment.m_begin = begin;
+            segment.m_end   = std::min( begin + SEGMENT_POINTS, linePointers[fiber + 1] );
+
+            for( int axis = 0; axis < 3; ++axis )
+            {
+                segment.m_box.m_min[axis] = m_pointArray[begin * 3 + axis];
+                segment.m_box.m_max[axis] = m_pointArray[begin * 3 + axis];
+            }
+            for( int i = begin + 1; i < segment.m_end; ++i )
+            {
+                for( int axis = 0; axis < 3; ++axis )
+                {
+                    segment.m_box.m_min[axis] = std::min( segment.m_box.m_min[axis], m_pointArray[i * 3 + axis] );
+                    segment.m_box.m_max[axis] = std::max( segment.m_box.m_max[axis], m_pointArray[i * 3 + axis] );
+                }
+            }
+            m_segments.push_back( segment );
+        }
+    }
+
+    if( !m_segments.empty() )
+    {
+        Node root;
+        root.m_left  = -1;
+        root.m_begin = 0;
+        root.m_end   = m_segments.size();
+        m_nodes.push_back( root );
+        build( 0, 0 );
+    }
+
+    Logger::getInstance()->print( wxString::Format( wxT( "Fibers BVH: %u segments, %u nodes" ), (unsigned int)m_segments.size(), (unsigned int)m_nodes.size() ), LOGLEVEL_DEBUG );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Computes the box of a node and splits it in two halves along the longest
+// axis of its segments' centers.
+///////////////////////////////////////////////////////////////////////////
+void FiberBVH::build( int nodeIdx, int depth )
+{
+    const int begin = m_nodes[nodeIdx].m_begin;
+    const int end   = m_nodes[nodeIdx].m_end;
+
+    Box box = m_segments[begin].m_box;
+    float centerMin[3];
+    float centerMax[3];
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        centerMin[axis] = centerMax[axis] = box.m_min[axis] + box.m_max[axis];
+    }
+
+    for( int i = begin + 1; i < end; ++i )
+    {
+        const Box &segBox = m_segments[i].m_box;
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            box.m_min[axis]   = std::min( box.m_min[axis], segBox.m_min[axis] );
+            box.m_max[axis]   = std::max( box.m_max[axis], segBox.m_max[axis] );
+            centerMin[axis]   = std::min( centerMin[axis], segBox.m_min[axis] + segBox.m_max[axis] );
+            centerMax[axis]   = std::max( centerMax[axis], segBox.m_min[axis] + segBox.m_max[axis] );
+        }
+    }
+    m_nodes[nodeIdx].m_box = box;
+
+    if( end - begin <= LEAF_SEGMENTS || depth >= MAX_DEPTH )
+    {
+        return;
+    }
+
+    int splitAxis = 0;
+    for( int axis = 1; axis < 3; ++axis )
+    {
+        if( centerMax[axis] - centerMin[axis] > centerMax[splitAxis] - centerMin[splitAxis] )
+        {
+            splitAxis = axis;
+        }
+    }
+
+    const int mid = begin + ( end - begin ) / 2;
+    std::nth_element( m_segments.begin() + begin, m_segments.begin() + mid, m_segments.begin() + end, SegmentCenterLess( splitAxis ) );
+
+    const int left = m_nodes.size();
+    m_nodes[nodeIdx].m_left = left;
+
+    Node child;
+    child.m_left  = -1;
+    child.m_begin = begin;
+    child.m_end   = mid;
+    m_nodes.push_back( child );
+    child.m_begin = mid;
+    child.m_end   = end;
+    m_nodes.push_back( child );
+
+    build( left, depth + 1 );
+    build( left + 1, depth + 1 );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Marks the fibers that have at least one point inside the selection object.
+///////////////////////////////////////////////////////////////////////////
+void FiberBVH::getFibersInside( SelectionObject *pSelObj, FiberBitset &o_inObject )
+{
+    o_inObject.assign( m_countLines, false );
+
+    m_query.setObject( pSelObj );
+    query( o_inObject );
+}
+
+void FiberBVH::getFibersInside( const SelectionQuery &selection, FiberBitset &o_inObject )
+{
+    o_inObject.assign( m_countLines, false );
+
+    m_query = selection;
+    query( o_inObject );
+}
+
+void FiberBVH::query( FiberBitset &o_inObject )
+{
+    if( m_nodes.empty() )
+    {
+        return;
+    }
+
+    m_stack.clear();
+    m_stack.push_back( 0 );
+
+    while( !m_stack.empty() )
+    {
+        const Node &node = m_nodes[m_stack.back()];
+        m_stack.pop_back();
+
+        if( !m_query.overlaps( node.m_box.m_min, node.m_box.m_max ) )
+        {
+            continue;
+        }
+
+        if( node.m_left >= 0 )
+        {
+            m_stack.push_back( node.m_left );
+            m_stack.push_back( node.m_left + 1 );
+            continue;
+        }
+
+        for( int s = node.m_begin; s < node.m_end; ++s )
+        {
+            const Segment &segment = m_segments[s];
+
+            // Early out, this fiber is already known to be inside.
+            if( o_inObject.test( segment.m_fiber ) || !m_query.overlaps( segment.m_box.m_min, segment.m_box.m_max ) )
+            {
+                continue;
+            }
+
+            if( m_query.contains( segment.m_box.m_min, segment.m_box.m_max ) )
+            {
+                o_inObject.set( segment.m_fiber );
+                continue;
+            }
+
+            for( int i = segment.m_begin; i < segment.m_end; ++i )
+            {
+                if( m_query.contains( m_pointArray[i * 3], m_pointArray[i * 3 + 1], m_pointArray[i * 3 + 2] ) )
+                {
+                    o_inObject.set( segment.m_fiber );
+                    break;
+                }
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Unlike getFibersInside, every point of a fiber has to be visited. Only the
+// segments fully inside the selection are counted without testing them.
+///////////////////////////////////////////////////////////////////////////
+void FiberBVH::countPointsInside( const SelectionQuery &selection, std::vector< unsigned int > &o_counts )
+{
+    o_counts.assign( m_countLines, 0 );
+
+    m_query = selection;
+    count( o_counts );
+}
+
+void FiberBVH::count( std::vector< unsigned int > &o_counts )
+{
+    if( m_nodes.empty() )
+    {
+        return;
+    }
+
+    m_stack.clear();
+    m_stack.push_back( 0 );
+
+    while( !m_stack.empty() )
+    {
+        const Node &node = m_nodes[m_stack.back()];
+        m_stack.pop_back();
+
+        if( !m_query.overlaps( node.m_box.m_min, node.m_box.m_max ) )
+        {
+            continue;
+        }
+
+        if( node.m_left >= 0 )
+        {
+            m_stack.push_back( node.m_left );
+            m_stack.push_back( node.m_left + 1 );
+            continue;
+        }
+
+        for( int s = node.m_begin; s < node.m_end; ++s )
+        {
+            const Segment &segment = m_segments[s];
+
+            if( !m_query.overlaps( segment.m_box.m_min, segment.m_box.m_max ) )
+            {
+                continue;
+            }
+
+            if( m_query.contains( segment.m_box.m_min, segment.m_box.m_max ) )
+            {
+                o_counts[segment.m_fiber] += segment.m_end - segment.m_begin;
+                continue;
+            }
+
+            for( int i = segment.m_begin; i < segment.m_end; ++i )
+            {
+                if( m_query.contains( m_pointArray[i * 3], m_pointArray[i * 3 + 1], m_pointArray[i * 3 + 2] ) )
+                {
+                    ++o_counts[segment.m_fiber];
+                }
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+void FiberBVH::flip( int axis, float axisShift )
+{
+    for( unsigned int i = 0; i < m_segments.size(); ++i )
+    {
+        flipBox( m_segments[i].m_box, axis, axisShift );
+    }
+    for( unsigned int i = 0; i < m_nodes.size(); ++i )
+    {
+        flipBox( m_nodes[i].m_box, axis, axisShift );
+    }
+}
+
+void FiberBVH::flipBox( Box &box, int axis, float axisShift )
+{
+    float oldMin = box.m_min[axis];
+    box.m_min[axis] = 2.0f * axisShift - box.m_max[axis];
+    box.m_max[axis] = 2.0f * axisShift - oldMin;
+}
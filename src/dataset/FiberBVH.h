@@ -0,0 +1,73 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            FiberBVH.h
+//
+// Description: Bounding volume hierarchy over the fibers, used to find which
+// fibers go through a selection object.
+//
+// Fibers are cut in segments of a few points. Each segment has its own
+// bounding box and the segments are grouped in a binary tree of boxes. A
+// query stops testing the points of a fiber as soon as one of them is found
+// inside the selection.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FIBERBVH_H_
+#define FIBERBVH_H_
+
+#include "FiberBitset.h"
+#include "SelectionQuery.h"
+
+#include <vector>
+
+class SelectionObject;
+
+class FiberBVH
+{
+public:
+    FiberBVH( const std::vector< float > &pointArray, const std::vector< int > &linePointers, int countLines );
+
+    // Sets bit i of o_inObject for every fiber i that has a point inside the object.
+    void getFibersInside( SelectionObject *pSelObj, FiberBitset &o_inObject );
+    void getFibersInside( const SelectionQuery &selection, FiberBitset &o_inObject );
+
+    // Sets o_counts[i] to the number of points of fiber i inside the selection.
+    void countPointsInside( const SelectionQuery &selection, std::vector< unsigned int > &o_counts );
+
+    // Mirrors the boxes around axisShift, as done by Fibers::flipAxis on the points.
+    void flip( int axis, float axisShift );
+
+private:
+    struct Box
+    {
+        float m_min[3];
+        float m_max[3];
+    };
+
+    struct Segment
+    {
+        Box m_box;
+        int m_fiber;
+        int m_begin; // Points [m_begin, m_end[ of m_pointArray.
+        int m_end;
+    };
+
+    struct Node
+    {
+        Box m_box;
+        int m_left;  // Index of the left child, the right one follows. -1 for a leaf.
+        int m_begin; // Segments [m_begin, m_end[ of a leaf.
+        int m_end;
+    };
+
+    void build( int nodeIdx, int depth );
+    void query( FiberBitset &o_inObject );
+    void count( std::vector< unsigned int > &o_counts );
+    void flipBox( Box &box, int axis, float axisShift );
+
+    const std::vector< float > &m_pointArray;
+    int                          m_countLines;
+    std::vector< Segment >       m_segments;
+    std::vector< Node >          m_nodes;  //Root is m_nodes[0]
+    std::vector< int >           m_stack;  //Traversal, reused between queries
+    SelectionQuery               m_query;
+};
+
+#endif /* FIBERBVH_H_ */
@@ -0,0 +1,169 @@
+#include "FiberBitset.h"
+
+FiberBitset::FiberBitset()
+:   m_size( 0 )
+{
+}
+
+FiberBitset::FiberBitset( unsigned int size, bool value )
+:   m_size( 0 )
+{
+    assign( size, value );
+}
+
+void FiberBitset::assign( unsigned int size, bool value )
+{
+    m_size = size;
+    m_words.assign( ( size + WORD_BITS - 1 ) / WORD_BITS, value ? ~Word( 0 ) : Word( 0 ) );
+    clearTail();
+}
+
+void FiberBitset::orWith( const FiberBitset &other )
+{
+    if( other.m_size != m_size )
+    {
+        return;
+    }
+
+    Word *pDst = m_words.empty() ? NULL : &m_words[0];
+    const Word *pSrc = other.m_words.empty() ? NULL : &other.m_words[0];
+    const std::size_t nbWords = m_words.size();
+
+    for( std::size_t i = 0; i < nbWords; ++i )
+    {
+        pDst[i] |= pSrc[i];
+    }
+}
+
+void FiberBitset::andWith( const FiberBitset &other )
+{
+    if( other.m_size != m_size )
+    {
+        return;
+    }
+
+    Word *pDst = m_words.empty() ? NULL : &m_words[0];
+    const Word *pSrc = other.m_words.empty() ? NULL : &other.m_words[0];
+    const std::size_t nbWords = m_words.size();
+
+    for( std::size_t i = 0; i < nbWords; ++i )
+    {
+        pDst[i] &= pSrc[i];
+    }
+}
+
+void FiberBitset::andNotWith( const FiberBitset &other )
+{
+    if( other.m_size != m_size )
+    {
+        return;
+    }
+
+    Word *pDst = m_words.empty() ? NULL : &m_words[0];
+    const Word *pSrc = other.m_words.empty() ? NULL : &other.m_words[0];
+    const std::size_t nbWords = m_words.size();
+
+    for( std::size_t i = 0; i < nbWords; ++i )
+    {
+        pDst[i] &= ~pSrc[i];
+    }
+}
+
+void FiberBitset::flip()
+{
+    for( std::size_t i = 0; i < m_words.size(); ++i )
+    {
+        m_words[i] = ~m_words[i];
+    }
+    clearTail();
+}
+
+bool FiberBitset::any() const
+{
+    for( std::size_t i = 0; i < m_words.size(); ++i )
+    {
+        if( m_words[i] != 0 )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FiberBitset::toBoolVector( std::vector< bool > &o_bools ) const
+{
+    o_bools.assign( m_size, false );
+
+    for( std::size_t i = 0; i < m_words.size(); ++i )
+    {
+        Word word = m_words[i];
+        unsigned int idx = i * WORD_BITS;
+
+        while( word != 0 )
+        {
+            if( word & 1 )
+            {
+                o_bools[idx] = true;
+            }
+            word >>= 1;
+            ++idx;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Keeps the bits past m_size at 0, so that whole words can be compared and
+// scanned without masking.
+///////////////////////////////////////////////////////////////////////////
+void FiberBitset::clearTail()
+{
+    const unsigned int used = m_size % WORD_BITS;
+
+    if( used != 0 )
+    {
+        m_words.back() &= ( Word( 1 ) << used ) - 1;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+FiberBranchCombiner::FiberBranchCombiner()
+:   m_hasIncluded( false ),
+    m_hasExcluded( false )
+{
+}
+
+void FiberBranchCombiner::reset()
+{
+    m_hasIncluded = false;
+    m_hasExcluded = false;
+}
+
+void FiberBranchCombiner::addChild( const FiberBitset &childInBranch, bool isNOT )
+{
+    FiberBitset &merged = isNOT ? m_excluded    : m_included;
+    bool        &any    = isNOT ? m_hasExcluded : m_hasIncluded;
+
+    if( any )
+    {
+        merged.orWith( childInBranch );
+    }
+    else
+    {
+        merged = childInBranch;
+        any    = true;
+    }
+}
+
+void FiberBranchCombiner::applyTo( FiberBitset &io_inBranch ) const
+{
+    if( m_hasIncluded )
+    {
+        io_inBranch.andWith( m_included );
+    }
+
+    if( m_hasExcluded )
+    {
+        io_inBranch.andNotWith( m_excluded );
+    }
+}
@@ -0,0 +1,80 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            FiberBitset.h
+//
+// Description: Dense set of bits, one per fiber, used to store which fibers
+// are in a selection object or in its branch.
+//
+// The bits are packed in machine words so that combining two selections
+// (and, or, and not) is done one word at a time, in loops simple enough for
+// the compiler to vectorize.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FIBERBITSET_H_
+#define FIBERBITSET_H_
+
+#include <climits>
+#include <cstddef>
+#include <vector>
+
+class FiberBitset
+{
+public:
+    typedef std::size_t Word;
+
+    FiberBitset();
+    explicit FiberBitset( unsigned int size, bool value = false );
+
+    // Resizes the set and gives all the bits the same value.
+    void assign( unsigned int size, bool value );
+
+    unsigned int size() const  { return m_size;  }
+    bool         empty() const { return m_size == 0; }
+
+    bool test( unsigned int idx ) const { return ( m_words[idx / WORD_BITS] >> ( idx % WORD_BITS ) & 1 ) != 0; }
+    void set( unsigned int idx )        { m_words[idx / WORD_BITS] |= Word( 1 ) << ( idx % WORD_BITS ); }
+    void reset( unsigned int idx )      { m_words[idx / WORD_BITS] &= ~( Word( 1 ) << ( idx % WORD_BITS ) ); }
+
+    // Word-wise combinations. Both sets must have the same size.
+    void orWith(     const FiberBitset &other );
+    void andWith(    const FiberBitset &other );
+    void andNotWith( const FiberBitset &other );
+    void flip();
+
+    bool any() const;
+
+    // Expands the set, only visiting the words that have bits set.
+    void toBoolVector( std::vector< bool > &o_bools ) const;
+
+private:
+    static const unsigned int WORD_BITS = sizeof( Word ) * CHAR_BIT;
+
+    void clearTail();
+
+    std::vector< Word > m_words;
+    unsigned int        m_size;
+};
+
+///////////////////////////////////////////////////////////////////////////
+// Combination of the children of a selection object with the fibers in the
+// object: they are restricted to the fibers in at least one active child,
+// minus those in any active NOT child. Used by the SelectionTree and by the
+// BatchProcessor. The merged sets are kept to reuse their memory.
+///////////////////////////////////////////////////////////////////////////
+class FiberBranchCombiner
+{
+public:
+    FiberBranchCombiner();
+
+    void reset();
+
+    // Only the active children are added.
+    void addChild( const FiberBitset &childInBranch, bool isNOT );
+    void applyTo( FiberBitset &io_inBranch ) const;
+
+private:
+    FiberBitset m_included;
+    FiberBitset m_excluded;
+    bool        m_hasIncluded;
+    bool        m_hasExcluded;
+};
+
+#endif /* FIBERBITSET_H_ */
@@ -9,6 +9,8 @@
 #include "Anatomy.h"
 #include "DatasetManager.h"
 #include "RTTrackingHelper.h"
+#include "TractogramFile.h"
+#include "VisibleLines.h"
 
 #include "../main.h"
 #include "../Logger.h"
@@ -16,9 +18,14 @@
 #include "../gui/MainFrame.h"
 #include "../gui/SceneManager.h"
 #include "../gui/SelectionTree.h"
+#include "../misc/Algorithms/BSpline.h"
+#include "../misc/Algorithms/FiberRasterizer.h"
 #include "../misc/Fantom/FMatrix.h"
+#include "../misc/MappedFile.h"
+#include "../misc/Profiler.h"
 
 #include <wx/file.h>
+#include <wx/stopwatch.h>
 #include <wx/tglbtn.h>
 #include <wx/tokenzr.h>
 #include <wx/xml/xml.h>
@@ -29,6 +36,7 @@
 #include <fstream>
 using std::ofstream;
 
+#include <iterator>
 #include <limits>
 #include <stdio.h>
 #include <stdlib.h>
@@ -48,6 +56,150 @@ using std::vector;
 #define LINEAR_GRADIENT_THRESHOLD 0.085f
 #define MIN_ALPHA_VALUE 0.017f
 
+namespace
+{
+    // Reads a 4 bytes word, swapping its bytes when the file does not use the host order.
+    inline wxUint32 readWord( const char *pSrc, bool swap )
+    {
+        wxUint32 word;
+        memcpy( &word, pSrc, 4 );
+        if( swap )
+        {
+            word = ( word >> 24 ) | ( ( word >> 8 ) & 0xFF00 ) | ( ( word << 8 ) & 0xFF0000 ) | ( word << 24 );
+        }
+        return word;
+    }
+
+    inline float readFloat( const char *pSrc, bool swap )
+    {
+        wxUint32 word = readWord( pSrc, swap );
+        float value;
+        memcpy( &value, &word, 4 );
+        return value;
+    }
+
+    inline wxUint16 readHalfWord( const char *pSrc, bool swap )
+    {
+        wxUint16 halfWord;
+        memcpy( &halfWord, pSrc, 2 );
+        if( swap )
+        {
+            halfWord = static_cast< wxUint16 >( ( halfWord >> 8 ) | ( halfWord << 8 ) );
+        }
+        return halfWord;
+    }
+
+    // Swaps the bytes of count words in place. The iterations are
+    // independent: the loop compiles to one bswap per word, or to byte
+    // shuffles of whole registers when SSSE3 is enabled.
+    void swapWords( wxUint32 *pWords, size_t count )
+    {
+        for( size_t i = 0; i < count; ++i )
+        {
+            const wxUint32 word = pWords[i];
+            pWords[i] = ( word >> 24 ) | ( ( word >> 8 ) & 0xFF00 ) | ( ( word << 8 ) & 0xFF0000 ) | ( word << 24 );
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Finds the (x,y,z) triples of a MRtrix file whose x is NaN, which end the
+    // tracts, and the first one whose x is infinite, which ends the data.
+    // The file is cut in chunks scanned in parallel, merged back in order.
+    ///////////////////////////////////////////////////////////////////////////
+    void findTckSeparators( const char *pData, size_t nbTriples, bool swap, 
+                            std::vector< size_t > &o_separators, size_t &o_endOfData )
+    {
+        const size_t MIN_CHUNK_TRIPLES = 1 << 16;
+        const int nbChunks = static_cast< int >( std::min< size_t >( 256, nbTriples / MIN_CHUNK_TRIPLES + 1 ) );
+
+        std::vector< std::vector< size_t > > chunkSeparators( nbChunks );
+        std::vector< size_t > chunkEnds( nbChunks, nbTriples );
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule( dynamic, 1 )
+#endif
+        for( int c = 0; c < nbChunks; ++c )
+        {
+            const size_t first = nbTriples * c / nbChunks;
+            const size_t last  = nbTriples * ( c + 1 ) / nbChunks;
+
+            for( size_t t = first; t < last; ++t )
+            {
+                const wxUint32 word = readWord( pData + t * 12, swap );
+                if( ( word & 0x7F800000 ) == 0x7F800000 )
+                {
+                    if( word & 0x007FFFFF )
+                    {
+                        chunkSeparators[c].push_back( t );
+                    }
+                    else
+                    {
+                        chunkEnds[c] = t;
+                        break;
+                    }
+                }
+            }
+        }
+
+        o_separators.clear();
+        o_endOfData = nbTriples;
+
+        for( int c = 0; c < nbChunks; ++c )
+        {
+            o_separators.insert( o_separators.end(), chunkSeparators[c].begin(), chunkSeparators[c].end() );
+            if( chunkEnds[c] < nbTriples )
+            {
+                o_endOfData = chunkEnds[c];
+                break;
+            }
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Downsamples a MRtrix tract: only the points at least sqrt(0.2) mm away
+    // from the last kept one are kept. Returns the number of points kept, and
+    // writes them to pOut unless it is NULL.
+    ///////////////////////////////////////////////////////////////////////////
+    int decodeTckTract( const char *pTract, size_t nbTriples, bool swap, float *pOut )
+    {
+        float x = readFloat( pTract, swap );
+        float y = readFloat( pTract + 4, swap );
+        float z = readFloat( pTract + 8, swap );
+        int nodes = 0;
+
+        if( pOut != NULL )
+        {
+            pOut[0] = x;
+            pOut[1] = y;
+            pOut[2] = z;
+        }
+        ++nodes;
+
+        for( size_t t = 1; t < nbTriples; ++t )
+        {
+            const float x2 = readFloat( pTract + t * 12, swap );
+            const float y2 = readFloat( pTract + t * 12 + 4, swap );
+            const float z2 = readFloat( pTract + t * 12 + 8, swap );
+
+            if( ( ( x - x2 ) * ( x - x2 ) + ( y - y2 ) * ( y - y2 ) + ( z - z2 ) * ( z - z2 ) ) >= 0.2 )
+            {
+                x = x2;
+                y = y2;
+                z = z2;
+                if( pOut != NULL )
+                {
+                    pOut[nodes * 3]     = x;
+                    pOut[nodes * 3 + 1] = y;
+                    pOut[nodes * 3 + 2] = z;
+                }
+                ++nodes;
+            }
+        }
+
+        return nodes;
+    }
+}
+
 Fibers::Fibers()
 :   DatasetInfo(),
     m_isSpecialFiberDisplay( false ),
@@ -79,6 +231,13 @@ Fibers::Fibers()
     m_isColorationUpdated( false ),
     m_fiberColorationMode( NORMAL_COLOR ),
     m_pOctree( NULL ),
+    m_pFiberBVH( NULL ),
+    m_visibleFirsts(),
+    m_visibleCounts(),
+    m_visibleLinesDirty( true ),
+    m_visibleLinesActivateAll( false ),
+    m_snippetsDirty( true ),
+    m_snippetOrderValid( false ),
     m_cfDrawDirty( true ),
     m_axialShown(    SceneManager::getInstance()->isAxialDisplayed() ),
     m_coronalShown(  SceneManager::getInstance()->isCoronalDisplayed() ),
@@ -91,6 +250,7 @@ Fibers::Fibers()
     m_zDrawn( 0.0f ),
     m_cfStartOfLine(),
     m_cfPointsPerLine(),
+    m_cfIndexDirty( true ),
     m_constantColor( 0, 0, 0 ),
     m_pSliderFibersFilterMin( NULL ),
     m_pSliderFibersFilterMax( NULL ),
@@ -145,6 +305,12 @@ Fibers::~Fibers()
         m_pOctree = NULL;
     }
 
+    if( m_pFiberBVH )
+    {
+        delete m_pFiberBVH;
+        m_pFiberBVH = NULL;
+    }
+
     m_lineArray.clear();
     m_linePointers.clear();
     m_reverse.clear();
@@ -155,6 +321,17 @@ Fibers::~Fibers()
 
 bool Fibers::load( const wxString &filename )
 {
+    return load( filename, getAnatomyGrid() );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Loads the fibers in the grid of the given anatomy, without using the
+// DatasetManager. Also used by the BatchProcessor.
+///////////////////////////////////////////////////////////////////////////
+bool Fibers::load( const wxString &filename, const FibersGrid &grid )
+{
+    PROFILE_SCOPE( "Fibers::load" );
+
     bool res( false );
 
     wxString extension = filename.AfterLast( '.' );
@@ -171,58 +348,52 @@ bool Fibers::load( const wxString &filename )
     }
     else if( wxT( "bundlesdata" ) == extension )
     {
-        res = loadPTK( filename );
+        res = loadPTK( filename, grid );
     }
     else if( wxT( "Bfloat" ) == extension )
     {
-        res = loadCamino( filename );
+        res = loadCamino( filename, grid );
     }
     else if( wxT( "trk" ) == extension )
     {
-        res = loadTRK( filename );
+        res = loadTRK( filename, grid );
     }
     else if( wxT( "tck" ) == extension )
     {
-        res = loadMRtrix( filename );
+        res = loadMRtrix( filename, grid );
+    }
+    else if( wxT( "fbt" ) == extension )
+    {
+        res = loadBinary( filename );
     }
 
-    /* OcTree points classification */
-    m_pOctree = new Octree( 2, m_pointArray, m_countPoints );
+    buildSpatialIndices();
 
     //Global properties for opacity rendering
-    computeGLobalProperties();
+    computeGLobalProperties( grid );
 
     return res;
 }
 
-bool Fibers::loadTRK( const wxString &filename )
+bool Fibers::loadTRK( const wxString &filename, const FibersGrid &grid )
 {
     stringstream ss;
     Logger::getInstance()->print( wxT( "Loading TRK file..." ), LOGLEVEL_MESSAGE );
-    wxFile dataFile;
-    wxFileOffset nSize( 0 );
-    converterByteINT16 cbi;
-    converterByteINT32 cbi32;
-    converterByteFloat cbf;
+    wxStopWatch watch;
+    MappedFile dataFile;
 
-    if( !dataFile.Open( filename ) )
+    if( !dataFile.open( filename ) || dataFile.getSize() < 1000 )
     {
         return false;
     }
 
-    nSize = dataFile.Length();
-
-    if( nSize == wxInvalidOffset )
-    {
-        return false;
-    }
+    const size_t nSize = dataFile.getSize();
 
     ////
     // READ HEADER
     ////
-    //Read file header. [1000 bytes]
-    wxUint8 *pBuffer = new wxUint8[1000];
-    dataFile.Read( pBuffer, ( size_t )1000 );
+    //File header. [1000 bytes]
+    const wxUint8 *pBuffer = reinterpret_cast< const wxUint8 * >( dataFile.getData() );
 
     //ID String for track file. The first 5 characters must match "TRACK". [6 bytes]
     char idString[6];
@@ -236,13 +407,24 @@ bool Fibers::loadTRK( const wxString &filename )
         return false;
     }
 
+    //Size of the header. Used to determine byte swap. Should be 1000. [4 bytes]
+    //The file uses the byte order of the machine that wrote it.
+    const char *pHeader = reinterpret_cast< const char * >( pBuffer );
+    wxUint32 hdrSize = readWord( &pHeader[996], false );
+    const bool swapBytes = hdrSize != 1000 && readWord( &pHeader[996], true ) == 1000;
+
+    if( swapBytes )
+    {
+        hdrSize = 1000;
+        Logger::getInstance()->print( wxT( "TRK file uses the other byte order, its values are swapped" ), LOGLEVEL_MESSAGE );
+    }
+
     //Dimension of the image volume. [6 bytes]
     wxUint16 dim[3];
 
     for( int i = 0; i != 3; ++i )
     {
-        memcpy( cbi.b, &pBuffer[6 + ( i * 2 )], 2 );
-        dim[i] = cbi.i;
+        dim[i] = readHalfWord( &pHeader[6 + ( i * 2 )], swapBytes );
     }
 
     ss.str( "" );
@@ -254,8 +436,7 @@ bool Fibers::loadTRK( const wxString &filename )
 
     for( int i = 0; i != 3; ++i )
     {
-        memcpy( cbf.b, &pBuffer[12 + ( i * 4 )], 4 );
-        voxelSize[i] = cbf.f;
+        voxelSize[i] = readFloat( &pHeader[12 + ( i * 4 )], swapBytes );
     }
 
     ss.str( "" );
@@ -267,8 +448,7 @@ bool Fibers::loadTRK( const wxString &filename )
 
     for( int i = 0; i != 3; ++i )
     {
-        memcpy( cbf.b, &pBuffer[24 + ( i * 4 )], 4 );
-        origin[i] = cbf.f;
+        origin[i] = readFloat( &pHeader[24 + ( i * 4 )], swapBytes );
     }
 
     ss.str( "" );
@@ -276,9 +456,7 @@ bool Fibers::loadTRK( const wxString &filename )
     Logger::getInstance()->print( wxString( ss.str().c_str(), wxConvUTF8 ), LOGLEVEL_MESSAGE );
 
     //Number of scalars saved at each track point. [2 bytes]
-    wxUint16 nbScalars;
-    memcpy( cbi.b, &pBuffer[36], 2 );
-    nbScalars = cbi.i;
+    wxUint16 nbScalars = readHalfWord( &pHeader[36], swapBytes );
     ss.str( "" );
     ss << "Nb. scalars: " << nbScalars;
     Logger::getInstance()->print( wxString( ss.str().c_str(), wxConvUTF8 ), LOGLEVEL_MESSAGE );
@@ -295,9 +473,7 @@ bool Fibers::loadTRK( const wxString &filename )
     }
 
     //Number of properties saved at each track. [2 bytes]
-    wxUint16 nbProperties;
-    memcpy( cbi.b, &pBuffer[238], 2 );
-    nbProperties = cbi.i;
+    wxUint16 nbProperties = readHalfWord( &pHeader[238], swapBytes );
     ss.str( "" );
     ss << "Nb. properties: " << nbProperties;
     Logger::getInstance()->print( wxString( ss.str().c_str(), wxConvUTF8 ), LOGLEVEL_MESSAGE );
@@ -323,8 +499,7 @@ bool Fibers::loadTRK( const wxString &filename )
 
         for( int j = 0; j != 4; ++j )
         {
-            memcpy( cbf.b, &pBuffer[440 + ( i * 4 + j )], 4 );
-            voxToRas[i][j] = cbf.f;
+            voxToRas[i][j] = readFloat( &pHeader[440 + ( i * 4 + j ) * 4], swapBytes );
             ss << voxToRas[i][j] << " ";
         }
 
@@ -355,8 +530,7 @@ bool Fibers::loadTRK( const wxString &filename )
 
     for( int i = 0; i != 6; ++i )
     {
-        memcpy( cbf.b, &pBuffer[956 + ( i * 4 )], 4 );
-        imageOrientationPatient[i] = cbf.f;
+        imageOrientationPatient[i] = readFloat( &pHeader[956 + ( i * 4 )], swapBytes );
         ss << imageOrientationPatient[i] << " ";
     }
 
@@ -406,25 +580,17 @@ bool Fibers::loadTRK( const wxString &filename )
     Logger::getInstance()->print( wxString( ss.str().c_str(), wxConvUTF8 ), LOGLEVEL_MESSAGE );
 
     //Number of tracks stored in this track file. 0 means the number was NOT stored. [4 bytes]
-    wxUint32 nbCount;
-    memcpy( cbi32.b, &pBuffer[988], 4 );
-    nbCount = cbi32.i;
+    wxUint32 nbCount = readWord( &pHeader[988], swapBytes );
     ss.str( "" );
     ss << "Nb. tracks: " << nbCount;
     Logger::getInstance()->print( wxString( ss.str().c_str(), wxConvUTF8 ), LOGLEVEL_MESSAGE );
 
     //Version number. Current version is 2. [4 bytes]
-    wxUint32 version;
-    memcpy( cbi32.b, &pBuffer[992], 4 );
-    version = cbi32.i;
+    wxUint32 version = readWord( &pHeader[992], swapBytes );
     ss.str( "" );
     ss << "Version: " << version;
     Logger::getInstance()->print( wxString( ss.str().c_str(), wxConvUTF8 ), LOGLEVEL_MESSAGE );
 
-    //Size of the header. Used to determine byte swap. Should be 1000. [4 bytes]
-    wxUint32 hdrSize;
-    memcpy( cbi32.b, &pBuffer[996], 4 );
-    hdrSize = cbi32.i;
     ss.str( "" );
     ss << "HDR size: " << hdrSize;
     Logger::getInstance()->print( wxString( ss.str().c_str(), wxConvUTF8 ), LOGLEVEL_MESSAGE );
@@ -432,89 +598,51 @@ bool Fibers::loadTRK( const wxString &filename )
     ////
     // READ DATA
     ////
-    delete[] pBuffer;
-    pBuffer = NULL;
-    vector<float> tmpPoints;
+    if( hdrSize > nSize )
+    {
+        return false;
+    }
 
-    //File size - header size (used when the number of fiber was not stored)
-    int remainingBytes = nSize - hdrSize;
+    const wxUint8 *pData = pBuffer + hdrSize;
+    const size_t dataSize = nSize - hdrSize;
+    const size_t ptsSize = 3 + nbScalars;
+    const size_t propertiesSize = 4 * nbProperties;
+    const bool hasColors = nbScalars >= 3; //TODO: incorporate other scalars in the navigator.
 
-    vector< vector< float > > lines;
-    m_countPoints = 0;
-    vector< float > colors;
-
-    //if( nbCount == 0 )
-    //{
-    //   return false; //TODO: handle it. (0 means the number was NOT stored.)
-    //}
+    //nbCount may be 0 (the number was NOT stored), the tracks are read until the end of the file.
+    //First pass: only the number of points of each track is read, to find where each one starts.
+    vector< size_t > trackOffsets;
+    trackOffsets.reserve( nbCount );
+    m_linePointers.reserve( nbCount + 1 );
+    m_linePointers.assign( 1, 0 );
 
-    for( unsigned int i = 0; i < nbCount || remainingBytes > 0; ++i )
-    //for( unsigned int i = 0; i != nbCount ; ++i )
+    size_t offset = 0;
+    while( offset + 4 <= dataSize )
     {
         //Number of points in this track. [4 bytes]
-        wxUint32 nbPoints;
-        dataFile.Read( cbi32.b, ( size_t )4 );
-        nbPoints = cbi32.i;
-
-        //Read data of one track.
-        size_t ptsSize = 3 + nbScalars;
-        size_t tractSize = 4 * ( nbPoints * ( ptsSize ) + nbProperties );
-        pBuffer = new wxUint8[tractSize];
-        dataFile.Read( pBuffer, tractSize );
-        vector< float > curLine;
-
-        for( unsigned int j = 0; j != nbPoints; ++j )
-        {
-            //Read coordinates (x,y,z) and scalars associated to each point.
-            for( unsigned int k = 0; k != ptsSize; ++k )
-            {
-                memcpy( cbf.b, &pBuffer[4 * ( j * ptsSize + k )], 4 );
+        const wxUint32 nbPoints = readWord( reinterpret_cast< const char * >( &pData[offset] ), swapBytes );
+        size_t trackSize = 4 + 4 * ptsSize * nbPoints + propertiesSize;
 
-                if( k >= 6 ) //TODO: incorporate other scalars in the navigator.
-                {
-                    break;
-                }
-                else if( k >= 3 ) //RGB color of each point.
-                {
-                    colors.push_back( cbf.f );
-                }
-                else
-                {
-                    curLine.push_back( cbf.f );
-                }
-            }
+        if( trackSize > dataSize - offset )
+        {
+            Logger::getInstance()->print( wxT( "TRK file is truncated, the last track was ignored" ), LOGLEVEL_WARNING );
+            break;
         }
 
-        //TODO: incorporate properties in the navigator.
-//         for( unsigned int j = 0; j != nbProperties; ++j )
-//         {}
-
-        m_countPoints += curLine.size() / 3;
-        lines.push_back( curLine );
-        delete[] pBuffer;
-        pBuffer = NULL;
-
-       //Adjust remainingBytes
-       remainingBytes -= 1*4; //Number of points (4 bytes)
-       remainingBytes -= 3*nbPoints * 4; //Coordinates (4 bytes)
-       remainingBytes -= nbScalars*nbPoints * 4; //Scalars (4 bytes)
-       remainingBytes -= nbProperties * 4; //Properties (4 bytes)
-       //cout <<  "i : " << i << ", remainingBytes : " << remainingBytes << "\n";
+        trackOffsets.push_back( offset + 4 );
+        m_linePointers.push_back( m_linePointers.back() + nbPoints );
+        offset += trackSize;
     }
 
-    dataFile.Close();
+    m_countLines  = trackOffsets.size();
+    m_countPoints = m_linePointers.back();
 
     ////
     //POST PROCESS: set all the data in the right format for the navigator
     ////
     Logger::getInstance()->print( wxT( "Setting data in right format for the navigator..." ), LOGLEVEL_MESSAGE );
-    m_countLines = lines.size();
-    m_pointArray.max_size();
-    m_colorArray.max_size();
-    m_linePointers.resize( m_countLines + 1 );
     m_pointArray.resize( m_countPoints * 3 );
-    m_colorArray.resize( m_countPoints * 3 );
-    m_linePointers[m_countLines] = m_countPoints;
+    m_colorArray.resize( hasColors ? m_countPoints * 3 : 0 );
     m_reverse.resize( m_countPoints );
     m_selected.resize( m_countLines, false );
     m_filtered.resize( m_countLines, false );
@@ -524,48 +652,13 @@ bool Fibers::loadTRK( const wxString &filename )
     ss.str( "" );
     ss << "m_countPoints: " << m_countPoints;
     Logger::getInstance()->print( wxString( ss.str().c_str(), wxConvUTF8 ), LOGLEVEL_MESSAGE );
-    m_linePointers[0] = 0;
-
-    for( int i = 0; i < m_countLines; ++i )
-    {
-        m_linePointers[i + 1] = m_linePointers[i] + lines[i].size() / 3;
-    }
-
-    int lineCounter = 0;
-
-    for( int i = 0; i < m_countPoints; ++i )
-    {
-        if( i == m_linePointers[lineCounter + 1] )
-        {
-            ++lineCounter;
-        }
-
-        m_reverse[i] = lineCounter;
-    }
-
-    unsigned int pos( 0 );
-    vector< vector< float > >::iterator it;
-
-    for( it = lines.begin(); it < lines.end(); it++ )
-    {
-        vector< float >::iterator it2;
-
-        for( it2 = ( *it ).begin(); it2 < ( *it ).end(); it2++ )
-        {
-            if (colors.size() > 0)
-            {
-                m_colorArray[pos] = colors[pos] / 255.;
-            }
-            m_pointArray[pos++] = *it2;
-        }
-    }
 
-    float columns = DatasetManager::getInstance()->getColumns();
-    float rows    = DatasetManager::getInstance()->getRows();
-    float frames  = DatasetManager::getInstance()->getFrames();
-    float voxelX  = DatasetManager::getInstance()->getVoxelX();
-    float voxelY  = DatasetManager::getInstance()->getVoxelY();
-    float voxelZ  = DatasetManager::getInstance()->getVoxelZ();
+    float columns = grid.m_columns;
+    float rows    = grid.m_rows;
+    float frames  = grid.m_frames;
+    float voxelX  = grid.m_voxelX;
+    float voxelY  = grid.m_voxelY;
+    float voxelZ  = grid.m_voxelZ;
 
     if( voxelSize[0] == 0 && voxelSize[1] == 0 && voxelSize[2] == 0 )
     {
@@ -591,17 +684,68 @@ bool Fibers::loadTRK( const wxString &filename )
     anatomy[1] = ( flipY - 1. ) * rows    * voxelY / -2.;
     anatomy[2] = ( flipZ - 1. ) * frames  * voxelZ / -2.;
 
-    for( int i = 0; i < m_countPoints * 3; ++i )
+    //Second pass: the tracks are decoded in parallel, each one straight
+    //to its place in the arrays, and brought to the anatomy's space. Each
+    //track is first copied to a buffer of the thread, where its bytes are
+    //swapped at once if needed.
+    const size_t pointBytes = 4 * std::min< size_t >( ptsSize, 6 );
+    const int countLines = m_countLines;
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
     {
-        m_pointArray[i] = flipX * ( m_pointArray[i] - origin[0] ) * voxelX / voxelSize[0] + anatomy[0];
-        ++i;
-        m_pointArray[i] = flipY * ( m_pointArray[i] - origin[1] ) * voxelY / voxelSize[1] + anatomy[1];
-        ++i;
-        m_pointArray[i] = flipZ * ( m_pointArray[i] - origin[2] ) * voxelZ / voxelSize[2] + anatomy[2];
+        vector< wxUint32 > trackWords;
+
+#ifdef _OPENMP
+        #pragma omp for schedule( dynamic, 256 )
+#endif
+        for( int l = 0; l < countLines; ++l )
+        {
+            const int first = m_linePointers[l];
+            const int nbPoints = m_linePointers[l + 1] - first;
+            if( nbPoints == 0 )
+            {
+                continue;
+            }
+
+            trackWords.resize( nbPoints * ptsSize );
+            memcpy( &trackWords[0], &pData[trackOffsets[l]], trackWords.size() * 4 );
+            if( swapBytes )
+            {
+                swapWords( &trackWords[0], trackWords.size() );
+            }
+
+            for( int j = 0; j < nbPoints; ++j )
+            {
+                //Coordinates (x,y,z), then the scalars associated to each point.
+                float values[6];
+                memcpy( values, &trackWords[j * ptsSize], pointBytes );
+
+                const size_t pos = ( first + j ) * 3;
+                m_pointArray[pos]     = flipX * ( values[0] - origin[0] ) * voxelX / voxelSize[0] + anatomy[0];
+                m_pointArray[pos + 1] = flipY * ( values[1] - origin[1] ) * voxelY / voxelSize[1] + anatomy[1];
+                m_pointArray[pos + 2] = flipZ * ( values[2] - origin[2] ) * voxelZ / voxelSize[2] + anatomy[2];
+
+                if( hasColors ) //RGB color of each point.
+                {
+                    m_colorArray[pos]     = values[3] / 255.;
+                    m_colorArray[pos + 1] = values[4] / 255.;
+                    m_colorArray[pos + 2] = values[5] / 255.;
+                }
+            }
+
+            std::fill( m_reverse.begin() + first, m_reverse.begin() + first + nbPoints, l );
+        }
     }
 
+    dataFile.close();
+
+    long elapsed = watch.Time();
+    Logger::getInstance()->print( wxString::Format( wxT( "TRK: %.1f MB read in %ld ms (%.0f MB/s)" ), nSize / 1048576.0, elapsed, elapsed > 0 ? nSize / 1048.576 / elapsed : 0.0 ), LOGLEVEL_MESSAGE );
+
     Logger::getInstance()->print( wxT( "TRK file loaded" ), LOGLEVEL_MESSAGE );
-    createColorArray( colors.size() > 0 );
+    createColorArray( hasColors && m_countPoints > 0 );
     m_type = FIBERS;
     m_fullPath = filename;
 
@@ -613,7 +757,7 @@ bool Fibers::loadTRK( const wxString &filename )
     return true;
 }
 
-bool Fibers::loadCamino( const wxString &filename )
+bool Fibers::loadCamino( const wxString &filename, const FibersGrid &grid )
 {
     Logger::getInstance()->print( wxT( "Loading Camino file" ), LOGLEVEL_MESSAGE );
     wxFile dataFile;
@@ -692,12 +836,12 @@ bool Fibers::loadCamino( const wxString &filename )
     printf( "%d lines and %d points \n", m_countLines, m_countPoints );
     Logger::getInstance()->print( wxT( "Move vertices" ), LOGLEVEL_MESSAGE );
 
-    float columns = DatasetManager::getInstance()->getColumns();
-    float rows    = DatasetManager::getInstance()->getRows();
-    float frames  = DatasetManager::getInstance()->getFrames();
-    float voxelX  = DatasetManager::getInstance()->getVoxelX();
-    float voxelY  = DatasetManager::getInstance()->getVoxelY();
-    float voxelZ  = DatasetManager::getInstance()->getVoxelZ();
+    float columns = grid.m_columns;
+    float rows    = grid.m_rows;
+    float frames  = grid.m_frames;
+    float voxelX  = grid.m_voxelX;
+    float voxelY  = grid.m_voxelY;
+    float voxelZ  = grid.m_voxelZ;
 
     for( int i = 0; i < m_countPoints * 3; ++i )
     {
@@ -725,19 +869,22 @@ bool Fibers::loadCamino( const wxString &filename )
     return true;
 }
 
-bool Fibers::loadMRtrix( const wxString &filename )
+bool Fibers::loadMRtrix( const wxString &filename, const FibersGrid &grid )
 {
     Logger::getInstance()->print( wxT( "Loading MRtrix file" ), LOGLEVEL_MESSAGE );
-    wxFile dataFile;
-    long int nSize = 0;
-    long int pc = 0, nodes = 0;
-    converterByteFloat cbf;
-    float x, y, z, x2, y2, z2;
-    std::vector< float > tmpPoints;
-    vector< vector< float > > lines;
+    wxStopWatch watch;
+    long int pc = 0;
+    int headerCount = -1;
+    bool bigEndianData( false );
 
     //Open file
     FILE *pFs = fopen( filename.ToAscii(), "r" ) ;
+
+    if( pFs == NULL )
+    {
+        return false;
+    }
+
     ////
     // read header
     ////
@@ -747,7 +894,10 @@ bool Fibers::loadMRtrix( const wxString &filename )
 
     while(readLine.find( "END" ) == std::string::npos)
     {
-        fgets( lineBuffer, 200, pFs );
+        if( fgets( lineBuffer, 200, pFs ) == NULL )
+        {
+            break;
+        }
 
         readLine = std::string( lineBuffer );
 
@@ -758,153 +908,99 @@ bool Fibers::loadMRtrix( const wxString &filename )
 
         if( readLine.find( "count" ) != std::string::npos && !countFieldFound )
         {
-            sscanf( lineBuffer, "count: %d", &m_countLines );
+            sscanf( lineBuffer, "count: %d", &headerCount );
             countFieldFound = true;
         }
-    }
-
-    fclose( pFs );
 
-    if( dataFile.Open( filename ) )
-    {
-        nSize = dataFile.Length();
-
-        if( nSize < 1 )
+        if( readLine.find( "datatype" ) != std::string::npos && readLine.find( "BE" ) != std::string::npos )
         {
-            return false;
+            bigEndianData = true;
         }
     }
 
-    nSize -= pc;
-    dataFile.Seek( pc );
-    wxUint8 *pBuffer = new wxUint8[nSize];
-    dataFile.Read( pBuffer, nSize );
-    dataFile.Close();
+    fclose( pFs );
 
-    Logger::getInstance()->print( wxT( "Reading fibers" ), LOGLEVEL_DEBUG );
-    pc = 0;
-    m_countPoints = 0; // number of points
+    MappedFile dataFile;
 
-    for( int i = 0; i < m_countLines; i++ )
+    if( !dataFile.open( filename ) || pc < 0 || static_cast< size_t >( pc ) > dataFile.getSize() )
     {
-        tmpPoints.clear();
-        nodes = 0;
-        // read one tract
-        cbf.b[0] = pBuffer[pc++];
-        cbf.b[1] = pBuffer[pc++];
-        cbf.b[2] = pBuffer[pc++];
-        cbf.b[3] = pBuffer[pc++];
-        x = cbf.f;
-        cbf.b[0] = pBuffer[pc++];
-        cbf.b[1] = pBuffer[pc++];
-        cbf.b[2] = pBuffer[pc++];
-        cbf.b[3] = pBuffer[pc++];
-        y = cbf.f;
-        cbf.b[0] = pBuffer[pc++];
-        cbf.b[1] = pBuffer[pc++];
-        cbf.b[2] = pBuffer[pc++];
-        cbf.b[3] = pBuffer[pc++];
-        z = cbf.f;
-        //add first point
-        tmpPoints.push_back( x );
-        tmpPoints.push_back( y );
-        tmpPoints.push_back( z );
-        ++nodes;
-        x2 = x;
-        cbf.f = x2;
+        return false;
+    }
 
-        //Read points (x,y,z) until x2 equals NaN (0x0000C07F), meaning end of the tract.
-        while( !( cbf.b[0] == 0x00 && cbf.b[1] == 0x00 && cbf.b[2] == 0xC0 && cbf.b[3] == 0x7F ) )
-        {
-            cbf.b[0] = pBuffer[pc++];   // get next float
-            cbf.b[1] = pBuffer[pc++];
-            cbf.b[2] = pBuffer[pc++];
-            cbf.b[3] = pBuffer[pc++];
-            x2 = cbf.f;
-            cbf.b[0] = pBuffer[pc++];
-            cbf.b[1] = pBuffer[pc++];
-            cbf.b[2] = pBuffer[pc++];
-            cbf.b[3] = pBuffer[pc++];
-            y2 = cbf.f;
-            cbf.b[0] = pBuffer[pc++];
-            cbf.b[1] = pBuffer[pc++];
-            cbf.b[2] = pBuffer[pc++];
-            cbf.b[3] = pBuffer[pc++];
-            z2 = cbf.f;
+    const size_t nSize = dataFile.getSize();
+    const char *pData = dataFile.getData() + pc;
+    const size_t nbTriples = ( nSize - pc ) / 12;
+    const bool swap = bigEndianData == TractogramFile::isHostLittleEndian();
 
-            // downsample fibers: take only points in distance of min 0.75 mm
-            if( ( ( x - x2 ) * ( x - x2 ) + ( y - y2 ) * ( y - y2 ) + ( z - z2 ) * ( z - z2 ) ) >= 0.2 )
-            {
-                x = x2;
-                y = y2;
-                z = z2;
-                tmpPoints.push_back( x );
-                tmpPoints.push_back( y );
-                tmpPoints.push_back( z );
-                ++nodes;
-            }
+    Logger::getInstance()->print( wxT( "Reading fibers" ), LOGLEVEL_DEBUG );
 
-            cbf.f = x2;
-        }
+    //Tracts are separated by a NaN triple (0x7FC00000), and the file ends with an
+    //infinite triple. Both are found by scanning chunks of the file in parallel.
+    vector< size_t > trackEnds;
+    size_t endOfData = nbTriples;
+    findTckSeparators( pData, nbTriples, swap, trackEnds, endOfData );
 
-        // put the tract in the line array
-        lines.push_back( tmpPoints );
+    vector< size_t > trackStarts;
+    trackStarts.reserve( trackEnds.size() );
+    size_t start = 0;
 
-        for( int i = 0; i < nodes ; i++ )
+    for( size_t i = 0; i < trackEnds.size() && trackEnds[i] < endOfData; ++i )
+    {
+        //Empty tracts (two separators in a row) are skipped.
+        if( trackEnds[i] > start )
         {
-            m_countPoints++;
+            trackStarts.push_back( start );
+            trackEnds[trackStarts.size() - 1] = trackEnds[i];
         }
+        start = trackEnds[i] + 1;
     }
 
-    delete[] pBuffer;
-    pBuffer = NULL;
-
-    ////
-    //POST PROCESS: set all the data in the right format for the navigator
-    ////
-    m_pointArray.max_size();
-    m_linePointers.resize( m_countLines + 1 );
-    m_pointArray.resize( m_countPoints * 3 );
-    m_linePointers[m_countLines] = m_countPoints;
-    m_reverse.resize( m_countPoints );
-    m_selected.resize( m_countLines, false );
-    m_filtered.resize( m_countLines, false );
-    m_linePointers[0] = 0;
+    m_countLines = trackStarts.size();
 
-    for( int i = 0; i < m_countLines; ++i )
+    if( headerCount >= 0 && headerCount < m_countLines )
     {
-        m_linePointers[i + 1] = m_linePointers[i] + lines[i].size() / 3;
+        m_countLines = headerCount;
     }
 
-    int lineCounter = 0;
+    //The fibers are downsampled while decoded, count the points kept
+    //for each tract first, so that they can be written in place.
+    m_linePointers.assign( m_countLines + 1, 0 );
+    const int countLines = m_countLines;
 
-    for( int i = 0; i < m_countPoints; ++i )
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic, 256 )
+#endif
+    for( int i = 0; i < countLines; ++i )
     {
-        if( i == m_linePointers[lineCounter + 1] )
-        {
-            ++lineCounter;
-        }
+        m_linePointers[i + 1] = decodeTckTract( pData + trackStarts[i] * 12, trackEnds[i] - trackStarts[i], swap, NULL );
+    }
 
-        m_reverse[i] = lineCounter;
+    for( int i = 0; i < m_countLines; ++i )
+    {
+        m_linePointers[i + 1] += m_linePointers[i];
     }
 
-    unsigned int pos = 0;
-    vector< vector< float > >::iterator it;
+    m_countPoints = m_linePointers[m_countLines];
+    m_pointArray.resize( m_countPoints * 3 );
+    m_reverse.resize( m_countPoints );
+    m_selected.resize( m_countLines, false );
+    m_filtered.resize( m_countLines, false );
 
-    for( it = lines.begin(); it < lines.end(); it++ )
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic, 256 )
+#endif
+    for( int i = 0; i < countLines; ++i )
     {
-        vector< float >::iterator it2;
-
-        for( it2 = ( *it ).begin(); it2 < ( *it ).end(); it2++ )
-        {
-            m_pointArray[pos++] = *it2;
-        }
+        decodeTckTract( pData + trackStarts[i] * 12, trackEnds[i] - trackStarts[i], swap, &m_pointArray[0] + m_linePointers[i] * 3 );
+        std::fill( m_reverse.begin() + m_linePointers[i], m_reverse.begin() + m_linePointers[i + 1], i );
     }
 
+    dataFile.close();
+
     // The MrTrix fibers are defined in the same geometric reference
     // as the anatomical file. That is, the fibers coordinates are related to
     // the anatomy in world space. The transformation from local to world space
-    // for the anatomy is encoded in the m_dh->m_niftiTransform member.
+    // for the anatomy is encoded in the m_niftiTransform member of the grid.
     // Since we do not consider this tranform when loading the anatomy, we must
     // bring back the fibers in the same reference, using the inverse of the
     // local to world transformation. A further problem arises when loading an
@@ -912,11 +1008,11 @@ bool Fibers::loadMRtrix( const wxString &filename )
     // scaling factor is encoded in the transformation matrix, but we do not,
     // for the moment, use this scaling. Therefore, we must remove it from the
     // the transformation matrix before computing its inverse.
-    FMatrix localToWorld = FMatrix( DatasetManager::getInstance()->getNiftiTransform() );
+    FMatrix localToWorld = FMatrix( grid.m_niftiTransform );
 
-    float voxelX = DatasetManager::getInstance()->getVoxelX();
-    float voxelY = DatasetManager::getInstance()->getVoxelY();
-    float voxelZ = DatasetManager::getInstance()->getVoxelZ();
+    float voxelX = grid.m_voxelX;
+    float voxelY = grid.m_voxelY;
+    float voxelZ = grid.m_voxelZ;
 
     if( voxelX != 1.0 || voxelY != 1.0 || voxelZ != 1.0 )
     {
@@ -936,23 +1032,34 @@ bool Fibers::loadMRtrix( const wxString &filename )
     FMatrix invertedTransform( 4, 4 );
     invertedTransform = invert( localToWorld );
 
-    for( int i = 0; i < m_countPoints * 3; ++i )
+    double transform[3][4];
+    for( int row = 0; row < 3; ++row )
     {
-        FMatrix curPoint( 4, 1 );
-        curPoint( 0, 0 ) = m_pointArray[i];
-        curPoint( 1, 0 ) = m_pointArray[i + 1];
-        curPoint( 2, 0 ) = m_pointArray[i + 2];
-        curPoint( 3, 0 ) = 1;
+        for( int col = 0; col < 4; ++col )
+        {
+            transform[row][col] = invertedTransform( row, col );
+        }
+    }
 
-        FMatrix invertedPoint = invertedTransform * curPoint;
+    const int countPoints = m_countPoints;
 
-        m_pointArray[i] = invertedPoint( 0, 0 );
-        m_pointArray[i + 1] = invertedPoint( 1, 0 );
-        m_pointArray[i + 2] = invertedPoint( 2, 0 );
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for( int i = 0; i < countPoints; ++i )
+    {
+        float *pPoint = &m_pointArray[i * 3];
+        double x = pPoint[0];
+        double y = pPoint[1];
+        double z = pPoint[2];
 
-        i += 2;
+        pPoint[0] = transform[0][0] * x + transform[0][1] * y + transform[0][2] * z + transform[0][3];
+        pPoint[1] = transform[1][0] * x + transform[1][1] * y + transform[1][2] * z + transform[1][3];
+        pPoint[2] = transform[2][0] * x + transform[2][1] * y + transform[2][2] * z + transform[2][3];
     }
 
+    long elapsed = watch.Time();
+    Logger::getInstance()->print( wxString::Format( wxT( "TCK: %.1f MB read in %ld ms (%.0f MB/s)" ), nSize / 1048576.0, elapsed, elapsed > 0 ? nSize / 1048.576 / elapsed : 0.0 ), LOGLEVEL_MESSAGE );
     Logger::getInstance()->print( wxT( "TCK file loaded" ), LOGLEVEL_MESSAGE );
     createColorArray( false );
     m_type = FIBERS;
@@ -966,7 +1073,67 @@ bool Fibers::loadMRtrix( const wxString &filename )
     return true;
 }
 
-bool Fibers::loadPTK( const wxString &filename )
+///////////////////////////////////////////////////////////////////////////
+// Loads a binary fibers file (see TractogramFile.h). The file is mapped and
+// its blocks are copied once, straight into the arrays of the fibers. The
+// points are not used from the mapping: the octree, the BVH and the buffer
+// objects all work on m_pointArray. While loading, the memory used is thus
+// up to twice the size of the file, then the mapping is closed.
+///////////////////////////////////////////////////////////////////////////
+bool Fibers::loadBinary( const wxString &filename )
+{
+    Logger::getInstance()->print( wxT( "Loading binary fibers file" ), LOGLEVEL_MESSAGE );
+
+    vector< wxUint8 > colors;
+    if( !TractogramFile::read( filename, m_pointArray, m_linePointers, colors ) )
+    {
+        return false;
+    }
+
+    // The rest of the navigator expects at least one point per line. Empty
+    // lines share their pointer with the next one, they are dropped.
+    const size_t countLines = m_linePointers.size() - 1;
+    m_linePointers.erase( std::unique( m_linePointers.begin(), m_linePointers.end() ), m_linePointers.end() );
+    if( m_linePointers.size() - 1 != countLines )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "%d empty lines ignored" ), static_cast< int >( countLines - ( m_linePointers.size() - 1 ) ) ), LOGLEVEL_WARNING );
+    }
+
+    m_countLines  = m_linePointers.size() - 1;
+    m_countPoints = m_pointArray.size() / 3;
+
+    m_reverse.resize( m_countPoints );
+    for( int i = 0; i < m_countLines; ++i )
+    {
+        std::fill( m_reverse.begin() + m_linePointers[i], m_reverse.begin() + m_linePointers[i + 1], i );
+    }
+
+    m_selected.assign( m_countLines, false );
+    m_filtered.assign( m_countLines, false );
+
+    if( !colors.empty() )
+    {
+        m_colorArray.resize( m_countPoints * 3 );
+        for( int i = 0; i < m_countPoints * 3; ++i )
+        {
+            m_colorArray[i] = colors[i] / 255.;
+        }
+    }
+
+    createColorArray( !colors.empty() );
+    Logger::getInstance()->print( wxString::Format( wxT( "Binary fibers file loaded: %d points and %d lines" ), m_countPoints, m_countLines ), LOGLEVEL_MESSAGE );
+    m_type      = FIBERS;
+    m_fullPath  = filename;
+#ifdef __WXMSW__
+    m_name = wxT( "-" ) + filename.AfterLast( '\\' );
+#else
+    m_name = wxT( "-" ) + filename.AfterLast( '/' );
+#endif
+
+    return true;
+}
+
+bool Fibers::loadPTK( const wxString &filename, const FibersGrid &grid )
 {
     Logger::getInstance()->print( wxT( "Loading PTK file" ), LOGLEVEL_MESSAGE );
     wxFile dataFile;
@@ -1052,12 +1219,12 @@ bool Fibers::loadPTK( const wxString &filename )
     * already in the space of the dataset. Good voxel size and origin
     *
     ********************************************************************/
-    float columns = DatasetManager::getInstance()->getColumns();
-    float rows    = DatasetManager::getInstance()->getRows();
-    float frames  = DatasetManager::getInstance()->getFrames();
-    float voxelX  = DatasetManager::getInstance()->getVoxelX();
-    float voxelY  = DatasetManager::getInstance()->getVoxelY();
-    float voxelZ  = DatasetManager::getInstance()->getVoxelZ();
+    float columns = grid.m_columns;
+    float rows    = grid.m_rows;
+    float frames  = grid.m_frames;
+    float voxelX  = grid.m_voxelX;
+    float voxelY  = grid.m_voxelY;
+    float voxelZ  = grid.m_voxelZ;
 
     for( int i = 0; i < m_countPoints * 3; ++i )
     {
@@ -1565,7 +1732,8 @@ bool Fibers::createFrom( const vector<Fibers*>& bundles, wxString name )
     m_fullPath = wxString(name);
     m_name = wxString(name);
 
-    m_pOctree = new Octree( 2, m_pointArray, m_countPoints );
+    buildSpatialIndices();
+    computeGLobalProperties( getAnatomyGrid() );
 
     return true;
 }
@@ -1685,6 +1853,8 @@ void Fibers::loadTestFibers()
 ///////////////////////////////////////////////////////////////////////////
 void Fibers::updateFibersColors()
 {
+    PROFILE_SCOPE( "Fibers::updateFibersColors" );
+
     if( m_fiberColorationMode == NORMAL_COLOR )
     {
         resetColorArray();
@@ -1732,195 +1902,229 @@ void Fibers::updateFibersColors()
 }
 
 ///////////////////////////////////////////////////////////////////////////
-// This function will color the fibers depending on their torsion value.
-//
-// pColorData      : A pointer to the fiber color info.
+// Curvature and torsion colorings. Both are measured on the 5 points
+// B-spline going through the window of points around each fiber point.
 ///////////////////////////////////////////////////////////////////////////
-void Fibers::colorWithTorsion( float *pColorData )
+namespace
 {
-    if( pColorData == NULL )
-    {
-        return;
-    }
-
-    int    pc = 0;
-    // TODO remove
-    //Vector firstDerivative, secondDerivative, thirdDerivative;
+    // Progressions on the spline of the first, second, middle, before last
+    // and last points of a fiber.
+    const double SPLINE_PROGRESSIONS[5] = { 0.0, 0.25, 0.5, 0.75, 1.0 };
 
-    // For each fibers.
-    for( int i = 0; i < getLineCount(); ++i )
+    // m_weights[order - 1][progression][k] is the weight of the k-th point of
+    // the window in the derivative of the given order. They are found once by
+    // evaluating the spline on unit impulses, so that a derivative is only a
+    // weighted sum of 5 consecutive points of m_pointArray.
+    struct SplineWeights
     {
-        double color        = 0.0f;
-        int    index        = 0;
-        float  progression  = 0.0f;
-        int    pointPerLine = getPointsPerLine( i );
-
-        // We cannot calculate the torsion for a fiber that as less that 5 points.
-        // So we simply do not cange the color for this fiber
-        if( pointPerLine < 5 )
+        SplineWeights()
         {
-            continue;
-        }
+            BSpline spline( INTERPOLATION_ON_5_POINTS );
 
-        // For each points of this fiber.
-        for( int j = 0; j < pointPerLine; ++j )
-        {
-            if( j == 0 )
-            {
-                index = 6;                             // For the first point of each fiber.
-                progression = 0.0f;
-            }
-            else if( j == 1 )
-            {
-                index = 6;                             // For the second point of each fiber.
-                progression = 0.25f;
-            }
-            else if( j == pointPerLine - 2 )
-            {
-                index = ( pointPerLine - 2 ) * 3;    // For the before last point of each fiber.
-                progression = 0.75f;
-            }
-            else if( j == pointPerLine - 1 )
-            {
-                index = ( pointPerLine - 2 ) * 3;    // For the last point of each fiber.
-                progression = 1.0f;
-            }
-            else
+            for( int p = 0; p < 5; ++p )
             {
-                progression = 0.5f;     // For every other points.
-            }
-
-            Helper::getProgressionTorsion(
-                    Vector( m_pointArray[index - 6], m_pointArray[index - 5], m_pointArray[index - 4] ),
-                    Vector( m_pointArray[index - 3], m_pointArray[index - 2], m_pointArray[index - 1] ),
-                    Vector( m_pointArray[index],     m_pointArray[index + 1], m_pointArray[index + 2] ),
-                    Vector( m_pointArray[index + 3], m_pointArray[index + 4], m_pointArray[index + 5] ),
-                    Vector( m_pointArray[index + 6], m_pointArray[index + 7], m_pointArray[index + 8] ),
-                    progression, color );
+                for( int k = 0; k < 5; ++k )
+                {
+                    Vector points[5];
+                    points[k] = Vector( 1.0, 0.0, 0.0 );
 
-            // Lets apply a specific hard coded coloration for the torsion.
-            float realColor;
+                    Vector deriv1, deriv2, deriv3;
+                    spline.getDerivativeOrder1( SPLINE_PROGRESSIONS[p], points[0], points[1], points[2], points[3], points[4], deriv1 );
+                    spline.getDerivativeOrder2( SPLINE_PROGRESSIONS[p], points[0], points[1], points[2], points[3], points[4], deriv2 );
+                    spline.getDerivativeOrder3( SPLINE_PROGRESSIONS[p], points[0], points[1], points[2], points[3], points[4], deriv3 );
 
-            if( color <= 0.01f ) // Those points have no torsion so we simply but them pure blue.
-            {
-                pColorData[pc]     = 0.0f;
-                pColorData[pc + 1] = 0.0f;
-                pColorData[pc + 2] = 1.0f;
-            }
-            else if( color < 0.1f )  // The majority of the values are here.
-            {
-                double normalizedValue = ( color - 0.01f ) / ( 0.1f - 0.01f );
-                realColor = ( pow( ( double )2.71828182845904523536, normalizedValue ) ) - 1.0f;
-                pColorData[pc]     = 0.0f;
-                pColorData[pc + 1] = realColor;
-                pColorData[pc + 2] = 1.0f - realColor;
-            }
-            else // All the rest is simply pure green.
-            {
-                pColorData[pc]     = 0.0f;
-                pColorData[pc + 1] = 1.0f;
-                pColorData[pc + 2] = 0.0f;
+                    m_weights[0][p][k] = deriv1.x;
+                    m_weights[1][p][k] = deriv2.x;
+                    m_weights[2][p][k] = deriv3.x;
+                }
             }
+        }
+
+        double m_weights[3][5][5];
+    };
+
+    inline void getSplineDerivative( const double *pWeights, const float *pWindow, double *pDeriv )
+    {
+        pDeriv[0] = pDeriv[1] = pDeriv[2] = 0.0;
+        for( int k = 0; k < 5; ++k )
+        {
+            pDeriv[0] += pWeights[k] * pWindow[k * 3];
+            pDeriv[1] += pWeights[k] * pWindow[k * 3 + 1];
+            pDeriv[2] += pWeights[k] * pWindow[k * 3 + 2];
+        }
+    }
 
-            pc    += 3;
-            index += 3;
+    // Same formulas as Helper::getProgressionCurvature and Helper::getProgressionTorsion.
+    inline double getCurvature( const double *d1, const double *d2 )
+    {
+        const double crossX = d2[2] * d1[1] - d2[1] * d1[2];
+        const double crossY = d2[0] * d1[2] - d2[2] * d1[0];
+        const double crossZ = d2[1] * d1[0] - d2[0] * d1[1];
+        const double norm1  = d1[0] * d1[0] + d1[1] * d1[1] + d1[2] * d1[2];
+        const double denominator = norm1 * std::sqrt( norm1 );
+
+        if( std::fabs( denominator ) < EPSILON )
+        {
+            return 0.0;
+        }
+        return std::sqrt( crossX * crossX + crossY * crossY + crossZ * crossZ ) / denominator;
+    }
+
+    inline double getTorsion( const double *d1, const double *d2, const double *d3 )
+    {
+        const double denominator = ( d1[0] * d1[0] + d1[1] * d1[1] + d1[2] * d1[2] ) * ( d2[0] * d2[0] + d2[1] * d2[1] + d2[2] * d2[2] );
+
+        if( std::fabs( denominator ) < EPSILON )
+        {
+            return 0.0;
         }
+        return ( d3[2] * ( d1[0] * d2[1] - d1[1] * d2[0] )
+               + d2[2] * ( d3[0] * d1[1] - d1[0] * d3[1] )
+               + d1[2] * ( d2[0] * d3[1] - d3[0] * d2[1] ) ) / denominator;
     }
 }
 
+///////////////////////////////////////////////////////////////////////////
+// This function will color the fibers depending on their torsion value.
+//
+// pColorData      : A pointer to the fiber color info.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::colorWithTorsion( float *pColorData )
+{
+    colorWithSplineMeasure( pColorData, true );
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // This function will color the fibers depending on their curvature value.
 //
 // pColorData      : A pointer to the fiber color info.
 ///////////////////////////////////////////////////////////////////////////
 void Fibers::colorWithCurvature( float *pColorData )
+{
+    colorWithSplineMeasure( pColorData, false );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Colors every point with the curvature or the torsion of the fiber at
+// this point. The fibers are processed in parallel.
+//
+// pColorData      : A pointer to the fiber color info.
+// useTorsion      : Measure the torsion instead of the curvature.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::colorWithSplineMeasure( float *pColorData, const bool useTorsion )
 {
     if( pColorData == NULL )
     {
         return;
     }
 
-    int    pc = 0;
-    // TODO remove
-    //Vector firstDerivative, secondDerivative, thirdDerivative;
+    const SplineWeights weights;
+    const int countLines = getLineCount();
 
-    // For each fibers.
-    for( int i = 0; i < getLineCount(); ++i )
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic, 256 )
+#endif
+    for( int i = 0; i < countLines; ++i )
     {
-        double color        = 0.0f;
-        int    index        = 0;
-        float  progression  = 0.0f;
-        int    pointPerLine = getPointsPerLine( i );
+        const int pointPerLine = getPointsPerLine( i );
 
-        // We cannot calculate the curvature for a fiber that as less that 5 points.
-        // So we simply do not cange the color for this fiber
+        // We cannot calculate the curvature or the torsion for a fiber that as less that 5 points.
+        // So we simply do not change the color for this fiber
         if( pointPerLine < 5 )
         {
             continue;
         }
 
+        const int start = getStartIndexForLine( i );
+
         // For each point of this fiber.
         for( int j = 0; j < pointPerLine; ++j )
         {
+            int progression = 2;                            // For every other points.
             if( j == 0 )
             {
-                index = 6;                             // For the first point of each fiber.
-                progression = 0.0f;
+                progression = 0;                            // For the first point of each fiber.
             }
             else if( j == 1 )
             {
-                index = 6;                             // For the second point of each fiber.
-                progression = 0.25f;
+                progression = 1;                            // For the second point of each fiber.
             }
             else if( j == pointPerLine - 2 )
             {
-                index = ( pointPerLine - 2 ) * 3;    // For the before last point of each fiber.
-                progression = 0.75f;
+                progression = 3;                            // For the before last point of each fiber.
             }
             else if( j == pointPerLine - 1 )
             {
-                index = ( pointPerLine - 2 ) * 3;    // For the last point of each fiber.
-                progression = 1.0f;
+                progression = 4;                            // For the last point of each fiber.
+            }
+
+            // The 5 points around this one, kept inside the fiber.
+            const int first = std::min( std::max( j - 2, 0 ), pointPerLine - 5 );
+            const float *pWindow = &m_pointArray[( start + first ) * 3];
+
+            double deriv1[3], deriv2[3];
+            getSplineDerivative( weights.m_weights[0][progression], pWindow, deriv1 );
+            getSplineDerivative( weights.m_weights[1][progression], pWindow, deriv2 );
+
+            double color;
+            if( useTorsion )
+            {
+                double deriv3[3];
+                getSplineDerivative( weights.m_weights[2][progression], pWindow, deriv3 );
+                color = getTorsion( deriv1, deriv2, deriv3 );
             }
             else
             {
-                progression = 0.5f;     // For every other points.
+                color = getCurvature( deriv1, deriv2 );
             }
 
-            Helper::getProgressionCurvature(
-                    Vector( m_pointArray[index - 6], m_pointArray[index - 5], m_pointArray[index - 4] ),
-                    Vector( m_pointArray[index - 3], m_pointArray[index - 2], m_pointArray[index - 1] ),
-                    Vector( m_pointArray[index],     m_pointArray[index + 1], m_pointArray[index + 2] ),
-                    Vector( m_pointArray[index + 3], m_pointArray[index + 4], m_pointArray[index + 5] ),
-                    Vector( m_pointArray[index + 6], m_pointArray[index + 7], m_pointArray[index + 8] ),
-                    progression, color );
-
-            // Lets apply a specific hard coded coloration for the curvature.
-            float realColor;
+            // Lets apply a specific hard coded coloration for the curvature and the torsion.
+            float *pColor = &pColorData[( start + j ) * 3];
 
             if( color <= 0.01f ) // Those points have no curvature so we simply but them pure blue.
             {
-                pColorData[pc]     = 0.0f;
-                pColorData[pc + 1] = 0.0f;
-                pColorData[pc + 2] = 1.0f;
+                pColor[0] = 0.0f;
+                pColor[1] = 0.0f;
+                pColor[2] = 1.0f;
             }
             else if( color < 0.1f )  // The majority of the values are here.
             {
                 double normalizedValue = ( color - 0.01f ) / ( 0.1f - 0.01f );
-                realColor = ( pow( ( double )2.71828182845904523536, normalizedValue ) ) - 1.0f;
-                pColorData[pc]     = 0.0f;
-                pColorData[pc + 1] = realColor;
-                pColorData[pc + 2] = 1.0f - realColor;
+                float realColor = std::exp( normalizedValue ) - 1.0f;
+                pColor[0] = 0.0f;
+                pColor[1] = realColor;
+                pColor[2] = 1.0f - realColor;
             }
             else // All the rest is simply pure green.
             {
-                pColorData[pc]     = 0.0f;
-                pColorData[pc + 1] = 1.0f;
-                pColorData[pc + 2] = 0.0f;
+                pColor[0] = 0.0f;
+                pColor[1] = 1.0f;
+                pColor[2] = 0.0f;
             }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Gets the distance fields of the selection objects flagged for distance
+// coloring. The fields are computed here, when needed, so that the
+// coloring loops only read them.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::getDistanceColoringFields( vector< const float * > &o_fields )
+{
+    SelectionTree::SelectionObjectVector selectionObjects = SceneManager::getInstance()->getSelectionTree().getAllObjects();
 
-            pc    += 3;
-            index += 3;
+    o_fields.clear();
+
+    for( unsigned int objIdx( 0 ); objIdx < selectionObjects.size(); ++objIdx )
+    {
+        if( selectionObjects[objIdx]->IsUsedForDistanceColoring() )
+        {
+            const vector< float > &field = selectionObjects[objIdx]->getDistanceField();
+            if( !field.empty() )
+            {
+                o_fields.push_back( &field[0] );
+            }
         }
     }
 }
@@ -1938,26 +2142,23 @@ void Fibers::colorWithDistance( float *pColorData )
         return;
     }
 
-    SelectionTree::SelectionObjectVector selectionObjects = SceneManager::getInstance()->getSelectionTree().getAllObjects();
-
-    vector< SelectionObject* > simplifiedList;
-
-    for( unsigned int objIdx( 0 ); objIdx < selectionObjects.size(); ++objIdx )
-    {
-        if( selectionObjects[objIdx]->IsUsedForDistanceColoring() )
-        {
-            simplifiedList.push_back( selectionObjects[objIdx] );
-        }
-    }
+    vector< const float * > distanceFields;
+    getDistanceColoringFields( distanceFields );
 
-    int   columns = DatasetManager::getInstance()->getColumns();
-    int   rows    = DatasetManager::getInstance()->getRows();
-    int   frames  = DatasetManager::getInstance()->getFrames();
-    float voxelX  = DatasetManager::getInstance()->getVoxelX();
-    float voxelY  = DatasetManager::getInstance()->getVoxelY();
-    float voxelZ  = DatasetManager::getInstance()->getVoxelZ();
+    const int   nbFields = static_cast< int >( distanceFields.size() );
+    const int   columns = DatasetManager::getInstance()->getColumns();
+    const int   rows    = DatasetManager::getInstance()->getRows();
+    const int   frames  = DatasetManager::getInstance()->getFrames();
+    const float voxelX  = DatasetManager::getInstance()->getVoxelX();
+    const float voxelY  = DatasetManager::getInstance()->getVoxelY();
+    const float voxelZ  = DatasetManager::getInstance()->getVoxelZ();
+    const float thresh  = m_threshold / 2.0f;
+    const int   countPoints = getPointCount();
 
-    for( int i = 0; i < getPointCount(); ++i )
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for( int i = 0; i < countPoints; ++i )
     {
         float minDistance = FLT_MAX;
         int x     = std::min( columns - 1, std::max( 0, (int)( m_pointArray[i * 3 ]    / voxelX ) ) );
@@ -1965,22 +2166,11 @@ void Fibers::colorWithDistance( float *pColorData )
         int z     = std::min( frames  - 1, std::max( 0, (int)( m_pointArray[i * 3 + 2] / voxelZ ) ) );
         int index = x + y * columns + z * rows * columns;
 
-        for( unsigned int j = 0; j < simplifiedList.size(); ++j )
+        for( int j = 0; j < nbFields; ++j )
         {
-            // TODO selection VOI adjust
-            /*if( simplifiedList[j]->m_sourceAnatomy != NULL )
-            {
-                float curValue = simplifiedList[j]->m_sourceAnatomy->at( index );
-
-                if( curValue < minDistance )
-                {
-                    minDistance = curValue;
-                }
-            }*/
+            minDistance = std::min( minDistance, distanceFields[j][index] );
         }
 
-        float thresh = m_threshold / 2.0f;
-
         if( minDistance > ( thresh ) && minDistance < ( thresh + LINEAR_GRADIENT_THRESHOLD ) )
         {
             float greenVal = ( minDistance - thresh ) / LINEAR_GRADIENT_THRESHOLD;
@@ -2004,6 +2194,12 @@ void Fibers::colorWithDistance( float *pColorData )
     }
 }
 
+///////////////////////////////////////////////////////////////////////////
+// This function will color each fiber, and set its alpha, depending on the
+// distance of its closest point to the flagged distance anchors voi.
+//
+// pColorData      : A pointer to the fiber color info.
+///////////////////////////////////////////////////////////////////////////
 void Fibers::colorWithMinDistance( float *pColorData )
 {
     if( pColorData == NULL )
@@ -2011,26 +2207,28 @@ void Fibers::colorWithMinDistance( float *pColorData )
         return;
     }
 
-    SelectionTree::SelectionObjectVector selectionObjects = SceneManager::getInstance()->getSelectionTree().getAllObjects();
+    vector< const float * > distanceFields;
+    getDistanceColoringFields( distanceFields );
 
-    vector< SelectionObject* > simplifiedList;
+    const int   nbFields = static_cast< int >( distanceFields.size() );
+    const int   columns = DatasetManager::getInstance()->getColumns();
+    const int   rows    = DatasetManager::getInstance()->getRows();
+    const int   frames  = DatasetManager::getInstance()->getFrames();
+    const float voxelX  = DatasetManager::getInstance()->getVoxelX();
+    const float voxelY  = DatasetManager::getInstance()->getVoxelY();
+    const float voxelZ  = DatasetManager::getInstance()->getVoxelZ();
+    const float thresh  = m_threshold / 2.0f;
+    const int   countLines = getLineCount();
 
-    for( unsigned int objIdx( 0 ); objIdx < selectionObjects.size(); ++objIdx )
+    if( m_localizedAlpha.size() != ( unsigned int ) getPointCount() )
     {
-        if( selectionObjects[objIdx]->IsUsedForDistanceColoring() )
-        {
-            simplifiedList.push_back( selectionObjects[objIdx] );
-        }
+        m_localizedAlpha = vector< float >( getPointCount() );
     }
 
-    int   columns = DatasetManager::getInstance()->getColumns();
-    int   rows    = DatasetManager::getInstance()->getRows();
-    int   frames  = DatasetManager::getInstance()->getFrames();
-    float voxelX  = DatasetManager::getInstance()->getVoxelX();
-    float voxelY  = DatasetManager::getInstance()->getVoxelY();
-    float voxelZ  = DatasetManager::getInstance()->getVoxelZ();
-
-    for( int i = 0; i < getLineCount(); ++i )
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic, 256 )
+#endif
+    for( int i = 0; i < countLines; ++i )
     {
         int nbPointsInLine = getPointsPerLine( i );
         int index = getStartIndexForLine( i );
@@ -2041,29 +2239,17 @@ void Fibers::colorWithMinDistance( float *pColorData )
             int x     = std::min( columns - 1, std::max( 0, (int)( m_pointArray[( index + j ) * 3 ]    / voxelX ) ) ) ;
             int y     = std::min( rows    - 1, std::max( 0, (int)( m_pointArray[( index + j ) * 3 + 1] / voxelY ) ) ) ;
             int z     = std::min( frames  - 1, std::max( 0, (int)( m_pointArray[( index + j ) * 3 + 2] / voxelZ ) ) ) ;
-            int index = x + y * columns + z * rows * columns;
+            int voxel = x + y * columns + z * rows * columns;
 
-            for( unsigned int k = 0; k < simplifiedList.size(); ++k )
+            for( int k = 0; k < nbFields; ++k )
             {
-                // TODO selection VOI m_sourceanat
-                /*float curValue = simplifiedList[k]->m_sourceAnatomy->at( index );
-
-                if( curValue < minDistance )
-                {
-                    minDistance = curValue;
-                }*/
+                minDistance = std::min( minDistance, distanceFields[k][voxel] );
             }
         }
 
-        float thresh = m_threshold / 2.0f;
         Vector theColor;
         float theAlpha;
 
-        if( m_localizedAlpha.size() != ( unsigned int ) getPointCount() )
-        {
-            m_localizedAlpha = vector< float >( getPointCount() );
-        }
-
         if( minDistance > ( thresh ) && minDistance < ( thresh + LINEAR_GRADIENT_THRESHOLD ) )
         {
             float greenVal = ( minDistance - thresh ) / LINEAR_GRADIENT_THRESHOLD;
@@ -2203,8 +2389,8 @@ void Fibers::fitToAnat(bool saving)
         }
     }
 
-    /* OcTree points classification */
-    m_pOctree = new Octree( 2, m_pointArray, m_countPoints );
+    buildSpatialIndices();
+    computeGLobalProperties( getAnatomyGrid() );
     m_isInitialized = false;
 
 }
@@ -2228,62 +2414,55 @@ void Fibers::colorWithConstantColor( float *pColorData )
     }
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Colors each voxel with the mean orientation of the visible fibers going
+// through it. The fibers are rasterized on the CPU, no GL buffer is read.
+///////////////////////////////////////////////////////////////////////////
 Anatomy* Fibers::generateFiberVolume()
 {
-    float* pColorData( NULL );
-    if( SceneManager::getInstance()->isUsingVBO() )
-    {
-        glBindBuffer( GL_ARRAY_BUFFER, m_bufferObjects[2] );
-
-        #ifdef __WXMAC__
-            // TODO check this
-            //glBufferData(GL_ARRAY_BUFFER, getPointCount()*3 + 2, NULL, GL_STREAM_DRAW);
-        #endif
-        pColorData = ( float * ) glMapBuffer( GL_ARRAY_BUFFER, GL_READ_WRITE );
-    }
-    else
-    {
-        pColorData  = &m_normalArray[0];
-    }
+    wxStopWatch timer;
 
-    if( m_localizedAlpha.size() != ( unsigned int )getPointCount() )
-    {
-        m_localizedAlpha = vector< float >( getPointCount(), 1 );
-    }
+    FiberRasterizer rasterizer( DatasetManager::getInstance()->getColumns(),
+                                DatasetManager::getInstance()->getRows(),
+                                DatasetManager::getInstance()->getFrames(),
+                                DatasetManager::getInstance()->getVoxelX(),
+                                DatasetManager::getInstance()->getVoxelY(),
+                                DatasetManager::getInstance()->getVoxelZ() );
+    rasterizeVisibleFibers( rasterizer );
 
     DatasetIndex index = DatasetManager::getInstance()->createAnatomy( RGB );
     Anatomy *pTmpAnatomy = (Anatomy *)DatasetManager::getInstance()->getDataset( index );
     pTmpAnatomy->setName( m_name.BeforeFirst( '.' ) + wxT(" Fiber-Orientation Volume" ) );
 
+    rasterizer.getDirection( *pTmpAnatomy->getFloatDataset() );
+
     MyApp::frame->m_pListCtrl->InsertItem( index );
 
     MyApp::frame->refreshAllGLWidgets();
 
-    int   columns = DatasetManager::getInstance()->getColumns();
-    int   rows    = DatasetManager::getInstance()->getRows();
-    int   frames  = DatasetManager::getInstance()->getFrames();
-    float voxelX  = DatasetManager::getInstance()->getVoxelX();
-    float voxelY  = DatasetManager::getInstance()->getVoxelY();
-    float voxelZ  = DatasetManager::getInstance()->getVoxelZ();
+    Logger::getInstance()->print( wxString::Format( wxT( "Fiber-orientation volume generated in %ldms" ), timer.Time() ), LOGLEVEL_DEBUG );
 
-    for( int i = 0; i < getPointCount(); ++i )
-    {
-        int x     = std::min( columns - 1, std::max( 0, (int)( m_pointArray[i * 3 ]    / voxelX ) ) ) ;
-        int y     = std::min( rows    - 1, std::max( 0, (int)( m_pointArray[i * 3 + 1] / voxelY ) ) ) ;
-        int z     = std::min( frames  - 1, std::max( 0, (int)( m_pointArray[i * 3 + 2] / voxelZ ) ) ) ;
-        int index = x + y * columns + z * rows * columns;
+    return pTmpAnatomy;
+}
 
-        ( *pTmpAnatomy->getFloatDataset() )[index * 3]     = pColorData[i * 3]     ;
-        ( *pTmpAnatomy->getFloatDataset() )[index * 3 + 1] = pColorData[i * 3 + 1] ;
-        ( *pTmpAnatomy->getFloatDataset() )[index * 3 + 2] = pColorData[i * 3 + 2] ;
+///////////////////////////////////////////////////////////////////////////
+// Adds the fibers that are selected and not filtered out. This does not need
+// a GL context.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::rasterizeVisibleFibers( FiberRasterizer &rasterizer ) const
+{
+    if( m_countLines == 0 )
+    {
+        return;
     }
 
-    if( SceneManager::getInstance()->isUsingVBO() )
+    vector< bool > visible( m_countLines );
+    for( int l = 0; l < m_countLines; ++l )
     {
-        glUnmapBuffer( GL_ARRAY_BUFFER );
+        visible[l] = m_selected[l] && !m_filtered[l];
     }
 
-    return pTmpAnatomy;
+    rasterizer.add( &m_pointArray[0], m_linePointers, &visible );
 }
 
 void Fibers::getFibersInfoToSave( vector<float>& pointsToSave,  vector<int>& linesToSave, vector<int>& colorsToSave, int& countLines )
@@ -2471,6 +2650,58 @@ void Fibers::save( wxString filename, int format )
     }
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Saves the selected fibers in the binary format (see TractogramFile.h).
+// Used to convert any loaded TRK, TCK or VTK file, from the save dialog.
+//////////////////////////////////////////////////////////////////////////
+
+bool Fibers::saveBinary( wxString filename )
+{
+    if( filename.AfterLast( '.' ) != _T( "fbt" ) )
+    {
+        filename += _T( ".fbt" );
+    }
+
+    float *pColorData( NULL );
+
+    if( SceneManager::getInstance()->isUsingVBO() )
+    {
+        glBindBuffer( GL_ARRAY_BUFFER, m_bufferObjects[1] );
+        pColorData = ( float * ) glMapBuffer( GL_ARRAY_BUFFER, GL_READ_ONLY );
+    }
+    else
+    {
+        pColorData = &m_colorArray[0];
+    }
+
+    vector< float >   points;
+    vector< int >     linePointers( 1, 0 );
+    vector< wxUint8 > colors;
+
+    for( int l = 0; l < m_countLines; ++l )
+    {
+        if( m_selected[l] && !m_filtered[l] )
+        {
+            const int begin = getStartIndexForLine( l ) * 3;
+            const int end   = begin + getPointsPerLine( l ) * 3;
+
+            points.insert( points.end(), m_pointArray.begin() + begin, m_pointArray.begin() + end );
+            for( int i = begin; i < end; ++i )
+            {
+                colors.push_back( ( wxUint8 )( pColorData[i] * 255 ) );
+            }
+            linePointers.push_back( points.size() / 3 );
+        }
+    }
+
+    if( SceneManager::getInstance()->isUsingVBO() )
+    {
+        glUnmapBuffer( GL_ARRAY_BUFFER );
+    }
+
+    return TractogramFile::write( filename, points, linePointers, colors );
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 bool Fibers::save( wxXmlNode *pNode, const wxString &rootPath ) const
@@ -2856,13 +3087,21 @@ wxColour Fibers::getFiberPointColor( const int fiberIdx, const int ptIdx )
 void Fibers::resetLinesShown()
 {
     m_selected.assign( m_countLines, false );
+    m_visibleLinesDirty = true;
+    m_snippetsDirty = true;
+    m_cfDrawDirty = true;
 }
 
 void Fibers::updateLinesShown()
 {
+    PROFILE_SCOPE( "Fibers::updateLinesShown" );
+
     SelectionTree::SelectionObjectVector selectionObjects = SceneManager::getInstance()->getSelectionTree().getAllObjects();
 
     m_selected.assign( m_countLines, true );
+    m_visibleLinesDirty = true;
+    m_snippetsDirty = true;
+    m_cfDrawDirty = true;
 
     int activeCount( 0 );
 
@@ -2889,6 +3128,8 @@ void Fibers::updateLinesShown()
         }
     }
 
+    PROFILE_COUNT( "Selected fibers", std::count( m_selected.begin(), m_selected.end(), true ) );
+
     // TODO selection convex hull
     // This is to update the information display in the fiber grid info and the mean fiber
     /*if( boxWasUpdated && m_dh->m_lastSelectedObject != NULL )
@@ -2949,151 +3190,145 @@ void Fibers::initializeBuffer()
     }
 }
 
-//Compute T matrix for each fiber and extract the first eigen vec (t0), and the K term using eigen values.
-void Fibers::computeGLobalProperties()
+///////////////////////////////////////////////////////////////////////////
+// Grid of the anatomy loaded in the DatasetManager.
+///////////////////////////////////////////////////////////////////////////
+FibersGrid Fibers::getAnatomyGrid()
 {
-    m_tractDirection.max_size();
-    m_tractDirection.resize( m_countLines * 3 );
-
-    m_dispFactors.max_size();
-    m_dispFactors.resize( m_countLines );
+    DatasetManager *pDatMan = DatasetManager::getInstance();
 
-    m_endPointsVector.max_size();
-    m_endPointsVector.resize( m_countLines * 3);
+    FibersGrid grid;
+    grid.m_columns        = pDatMan->getColumns();
+    grid.m_rows           = pDatMan->getRows();
+    grid.m_frames         = pDatMan->getFrames();
+    grid.m_voxelX         = pDatMan->getVoxelX();
+    grid.m_voxelY         = pDatMan->getVoxelY();
+    grid.m_voxelZ         = pDatMan->getVoxelZ();
+    grid.m_niftiTransform = pDatMan->getNiftiTransform();
 
-    int t = 0;
-    //For each fiber
-    for( int i = 0; i < m_countLines; ++i )
-    {        
-        
-        int idx1 = getStartIndexForLine( i ) * 3;
-        int idx2 = idx1+3;
-        
-        FMatrix T(3,3); //For watson distribution
+    return grid;
+}
 
-        //Also keep end points for comparison
-        int ptsperline = getPointsPerLine( i );
-        Vector startPt = Vector(m_pointArray[idx1], m_pointArray[idx1+1], m_pointArray[idx1+2]);
-        Vector endPt = Vector(m_pointArray[idx1+ptsperline*3-3], m_pointArray[idx1+ptsperline*3-2], m_pointArray[idx1+ptsperline*3-1]);
-        Vector endDir = Vector(endPt - startPt);
-        endDir.normalize();
+///////////////////////////////////////////////////////////////////////////
+// (Re)builds the structures used to find the points and fibers inside the
+// selection objects: the octree over the points and the BVH over the fibers.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::buildSpatialIndices()
+{
+    delete m_pOctree;
+    delete m_pFiberBVH;
 
-        //for each segment
-        for( int k = 0; k < getPointsPerLine( i ) - 1; ++k )
-        {
-            //Extract segment
-            Vector localDir = Vector( m_pointArray[idx2] - m_pointArray[idx1], m_pointArray[idx2 + 1] - m_pointArray[idx1 + 1], m_pointArray[idx2 + 2] - m_pointArray[idx1 + 2]);
-            localDir.normalize();
-
-            FMatrix n(3,1);
-            n(0,0) = localDir.x;
-            n(1,0) = localDir.y;
-            n(2,0) = localDir.z;
-            
-            //Perform Outter product
-            FMatrix n_t = n.transposed();
-            FMatrix tmp = n*n_t;
-            
-            //Accumulate Outter products
-            T += tmp;
+    /* OcTree points classification */
+    m_pOctree = new Octree( m_pointArray, m_countPoints );
+    m_pFiberBVH = new FiberBVH( m_pointArray, m_linePointers, m_countLines );
+    m_cfIndexDirty = true;
+}
 
-            idx1 += 3;
-            idx2 += 3;
-        } 
+///////////////////////////////////////////////////////////////////////////
+// Computes, in a single parallel pass over the fibers, the properties used
+// by the opacity rendering and the length filters:
+// - the main direction t0 of each fiber and its dispersion term cl, from the
+//   eigen system of the mean outer product T of its segment directions
+//   (Watson distribution),
+// - the normalized vector from its first to its last point,
+// - its length in millimeters, and the min and max lengths.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::computeGLobalProperties( const FibersGrid &grid )
+{
+    wxStopWatch watch;
 
-        //Divide Outter product by number of line
-        T = T * (1.0f/(getPointsPerLine( i )));
+    m_tractDirection.resize( m_countLines * 3 );
+    m_dispFactors.resize( m_countLines );
+    m_endPointsVector.resize( m_countLines * 3 );
+    m_length.resize( m_countLines );
+
+    // The values are in pixel, we need to set them in millimeters using the spacing
+    // specified in the anatomy file.
+    const double voxelX = grid.m_voxelX;
+    const double voxelY = grid.m_voxelY;
+    const double voxelZ = grid.m_voxelZ;
+    const int countLines = m_countLines;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic, 256 )
+#endif
+    for( int i = 0; i < countLines; ++i )
+    {
+        const int ptsperline = getPointsPerLine( i );
+        const float *pPoints = &m_pointArray[getStartIndexForLine( i ) * 3];
 
-        //Extract first eigen Vector and 3 eigen values
-        std::vector< FArray > evecs;
-        FArray evals( 0.0f, 0.0f, 0.0f );
-        T.getEigenSystem( evals, evecs);
+        //Watson distribution: upper triangle of T (xx, xy, xz, yy, yz, zz)
+        double T[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+        double length = 0.0;
 
-        //Sort
-        Vector e1;
-        float B1, B2, B3;
-        if( evals[0] >= evals[1] && evals[0] > evals[2] )
-        {
-            e1.x = evecs[0][0];
-            e1.y = evecs[0][1];
-            e1.z = evecs[0][2];
-            B1 = evals[0];
-            B2 = evals[1];
-            B3 = evals[2];
-
-            if( evals[2] > evals[1])
-            {
-                B2 = evals[2];
-                B3 = evals[1];
-            }     
-        }
-        else if( evals[1] > evals[0] && evals[1] >= evals[2] )
-        {
-            e1.x = evecs[1][0];
-            e1.y = evecs[1][1];
-            e1.z = evecs[1][2];
-            B1 = evals[1];
-            B2 = evals[0];
-            B3 = evals[2];
-
-            if( evals[2] > evals[0])
-            {
-                B2 = evals[2];
-                B3 = evals[0];
-            }
-        }
-        else if( evals[2] >= evals[0] && evals[2] > evals[1] )
+        //for each segment
+        for( int k = 0; k < ptsperline - 1; ++k )
         {
-            e1.x = evecs[2][0];
-            e1.y = evecs[2][1];
-            e1.z = evecs[2][2];
-            B1 = evals[2];
-            B2 = evals[0];
-            B3 = evals[1];
-
-            if( evals[1] > evals[0])
+            const float *p1 = pPoints + k * 3;
+            double dx = p1[3] - p1[0];
+            double dy = p1[4] - p1[1];
+            double dz = p1[5] - p1[2];
+
+            length += sqrt( dx * voxelX * dx * voxelX + dy * voxelY * dy * voxelY + dz * voxelZ * dz * voxelZ );
+
+            const double norm = sqrt( dx * dx + dy * dy + dz * dz );
+            if( norm > 0.000001 )
             {
-                B2 = evals[0];
-                B3 = evals[1];
+                dx /= norm;
+                dy /= norm;
+                dz /= norm;
             }
+
+            //Accumulate Outter products
+            T[0] += dx * dx;
+            T[1] += dx * dy;
+            T[2] += dx * dz;
+            T[3] += dy * dy;
+            T[4] += dy * dz;
+            T[5] += dz * dz;
         }
-        else
+
+        //Divide Outter product by number of points
+        for( int k = 0; k < 6; ++k )
         {
-            e1.x = evecs[0][0];
-            e1.y = evecs[0][1];
-            e1.z = evecs[0][2];
-            B1 = evals[0];
-            B2 = evals[1];
-            B3 = evals[2];
-
-            if( evals[2] > evals[1])
-            {
-                B2 = evals[2];
-                B3 = evals[1];
-            } 
+            T[k] /= ptsperline;
         }
-         
-        //Compute dipersion term from 3 eigen values
-        //float K = 1.0f - (sqrt(B2+B3)/2.0f*B1);
-        float cl = (B1-B2)/(B1+B2+B3);
 
-        //Save terms 
-        m_tractDirection[t] = e1.x;
-        m_tractDirection[t+1] = e1.y;
-        m_tractDirection[t+2] = e1.z;
+        //Extract first eigen Vector and the sorted eigen values
+        double evals[3], e1[3];
+        Helper::getSymmetricEigenSystem( T, evals, e1 );
+
+        //Compute dispersion term from 3 eigen values
+        const double sum = evals[0] + evals[1] + evals[2];
+        const float cl = sum > 0.0 ? (float)( ( evals[0] - evals[1] ) / sum ) : 0.0f;
+
+        //Also keep end points for comparison
+        const float *pLast = pPoints + ( ptsperline - 1 ) * 3;
+        Vector endDir = Vector( pLast[0] - pPoints[0], pLast[1] - pPoints[1], pLast[2] - pPoints[2] );
+        endDir.normalize();
 
-        m_endPointsVector[t] = endDir.x;
-        m_endPointsVector[t+1] = endDir.y;
-        m_endPointsVector[t+2] = endDir.z;
+        //Save terms 
+        m_tractDirection[i * 3]     = e1[0];
+        m_tractDirection[i * 3 + 1] = e1[1];
+        m_tractDirection[i * 3 + 2] = e1[2];
 
-        //std::cout << "Evals: " << evals[0] << " " << evals[1] << " " << evals[2] << "\n";
-        //std::cout << "Evecs1: " << evecs[0][0] << " " << evecs[0][1] << " " << evecs[0][2] << "\n";
-        //std::cout << "Evecs2: " << evecs[1][0] << " " << evecs[1][1] << " " << evecs[1][2] << "\n";
-        //std::cout << "Evecs3: " << evecs[2][0] << " " << evecs[2][1] << " " << evecs[2][2] << "\n";
+        m_endPointsVector[i * 3]     = endDir.x;
+        m_endPointsVector[i * 3 + 1] = endDir.y;
+        m_endPointsVector[i * 3 + 2] = endDir.z;
 
         m_dispFactors[i] = cl;
-        t+=3;
-    }   
+        m_length[i] = (float)length;
+    }
+
+    m_maxLength = 0;
+    m_minLength = 1000000;
+    for( int i = 0; i < m_countLines; ++i )
+    {
+        m_maxLength = std::max( m_maxLength, m_length[i] );
+        m_minLength = std::min( m_minLength, m_length[i] );
+    }
+
+    Logger::getInstance()->print( wxString::Format( wxT( "Global fiber properties computed in %ld ms" ), watch.Time() ), LOGLEVEL_DEBUG );
 }
 
 void Fibers::draw()
@@ -3180,47 +3415,179 @@ void Fibers::draw()
             glColorPointer( 3, GL_FLOAT, 0, 0 );
         }
 
-        glBindBuffer( GL_ARRAY_BUFFER, m_bufferObjects[2] );
-        glNormalPointer( GL_FLOAT, 0, 0 );
+        glBindBuffer( GL_ARRAY_BUFFER, m_bufferObjects[2] );
+        glNormalPointer( GL_FLOAT, 0, 0 );
+    }
+
+    bool activateAllSelObj( SceneManager::getInstance()->getActivateAllSelObj() );
+    if( m_visibleLinesDirty || m_visibleLinesActivateAll != activateAllSelObj )
+    {
+        buildVisibleLines( activateAllSelObj );
+    }
+
+    GLsizei visibleCount = (GLsizei)m_visibleFirsts.size();
+    if( visibleCount > 0 )
+    {
+        if( GLEW_VERSION_1_4 )
+        {
+            // One driver call for all the visible fibers.
+            glMultiDrawArrays( GL_LINE_STRIP, &m_visibleFirsts[0], &m_visibleCounts[0], visibleCount );
+        }
+        else
+        {
+            for( GLsizei i = 0; i < visibleCount; ++i )
+            {
+                glDrawArrays( GL_LINE_STRIP, m_visibleFirsts[i], m_visibleCounts[i] );
+            }
+        }
+    }
+
+    glDisableClientState( GL_VERTEX_ARRAY );
+    glDisableClientState( GL_COLOR_ARRAY );
+    glDisableClientState( GL_NORMAL_ARRAY );
+
+    releaseShader();
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Compacts the start index and point count of every line that draw() has
+// to render, so that they can be sent in a single glMultiDrawArrays call.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::buildVisibleLines( const bool activateAllSelObj )
+{
+    compactVisibleLines( m_linePointers, m_selected, m_filtered, activateAllSelObj, m_visibleFirsts, m_visibleCounts );
+
+    m_visibleLinesActivateAll = activateAllSelObj;
+    m_visibleLinesDirty = false;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Sorting of the transparent snippets. Snippets are sorted back to front
+// on a 32 bits key quantized from their depth.
+///////////////////////////////////////////////////////////////////////////
+namespace
+{
+    const size_t MIN_SORT_BLOCK = 1 << 16;
+    const size_t SNIPPETS_PER_BATCH = 1 << 16;
+
+    // Window z of a point, highest z being the farthest from the viewer.
+    inline float projectDepth( const float *pPoint, const GLfloat *pProj )
+    {
+        return ( pPoint[0] * pProj[2] + pPoint[1] * pProj[6] + pPoint[2] * pProj[10] + pProj[14] )
+             / ( pPoint[0] * pProj[3] + pPoint[1] * pProj[7] + pPoint[2] * pProj[11] + pProj[15] );
+    }
+
+    // The visible volume spans [-1, 1] in normalized z, so the key of the
+    // farthest snippet is 0 and sorting the keys ascending paints it first.
+    inline unsigned int depthKey( float z )
+    {
+        z = std::max( -1.0f, std::min( 1.0f, z ) );
+        return static_cast< unsigned int >( ( 1.0 - z ) * 0.5 * 4294967040.0 );
+    }
+
+    // Insertion sort of the keys, and of their values along with them. Gives
+    // up as soon as it has moved more than maxMoves elements, so it is only
+    // worth it when the order of the previous frame is nearly right.
+    bool insertionSortByKey( std::vector< unsigned int > &keys, std::vector< unsigned int > &values, size_t maxMoves )
+    {
+        size_t moves = 0;
+
+        for( size_t i = 1; i < keys.size(); ++i )
+        {
+            const unsigned int key = keys[i];
+            if( keys[i - 1] <= key )
+            {
+                continue;
+            }
+
+            const unsigned int value = values[i];
+            size_t j = i;
+            for( ; j > 0 && keys[j - 1] > key; --j )
+            {
+                keys[j]   = keys[j - 1];
+                values[j] = values[j - 1];
+            }
+            keys[j]   = key;
+            values[j] = value;
+
+            moves += i - j;
+            if( moves > maxMoves )
+            {
+                return false;
+            }
+        }
+        return true;
     }
 
-    for( int i = 0; i < m_countLines; ++i )
+    // Stable LSD radix sort of the keys, and of their values along with them,
+    // on 8 bits digits. Each pass counts then scatters independent blocks of
+    // the arrays in parallel. Passes on a digit shared by all keys are skipped.
+    void radixSortByKey( std::vector< unsigned int > &keys, std::vector< unsigned int > &values,
+                         std::vector< unsigned int > &keysTmp, std::vector< unsigned int > &valuesTmp )
     {
-        if( ( m_selected[i] || !SceneManager::getInstance()->getActivateAllSelObj() ) && !m_filtered[i] )
+        const size_t n = keys.size();
+        const int nbBlocks = static_cast< int >( std::min< size_t >( 64, n / MIN_SORT_BLOCK + 1 ) );
+        std::vector< size_t > offsets( nbBlocks * 256 );
+
+        keysTmp.resize( n );
+        valuesTmp.resize( n );
+
+        for( int shift = 0; shift < 32; shift += 8 )
         {
-            glDrawArrays( GL_LINE_STRIP, getStartIndexForLine( i ), getPointsPerLine( i ) );
-        }
-    }
+            std::fill( offsets.begin(), offsets.end(), 0 );
 
-    glDisableClientState( GL_VERTEX_ARRAY );
-    glDisableClientState( GL_COLOR_ARRAY );
-    glDisableClientState( GL_NORMAL_ARRAY );
+#ifdef _OPENMP
+            #pragma omp parallel for schedule( static, 1 )
+#endif
+            for( int b = 0; b < nbBlocks; ++b )
+            {
+                size_t *pCount = &offsets[b * 256];
+                const size_t last = n * ( b + 1 ) / nbBlocks;
+                for( size_t i = n * b / nbBlocks; i < last; ++i )
+                {
+                    ++pCount[( keys[i] >> shift ) & 0xFF];
+                }
+            }
 
-    releaseShader();
-}
+            // Offsets in (digit, block) order keep the sort stable.
+            size_t sum = 0;
+            bool isSharedDigit = false;
+            for( int d = 0; d < 256; ++d )
+            {
+                const size_t digitStart = sum;
+                for( int b = 0; b < nbBlocks; ++b )
+                {
+                    const size_t count = offsets[b * 256 + d];
+                    offsets[b * 256 + d] = sum;
+                    sum += count;
+                }
+                isSharedDigit = isSharedDigit || sum - digitStart == n;
+            }
 
-///////////////////////////////////////////////////////////////////////////
-// COMMENT
-///////////////////////////////////////////////////////////////////////////
-namespace
-{
-template< class T > struct IndirectComp
-{
-    IndirectComp( const T &zvals ) :
-        zvals( zvals )
-    {
-    }
+            if( isSharedDigit )
+            {
+                continue;
+            }
 
-    // Watch out: operator less, but we are sorting in descending z-order, i.e.,
-    // highest z value will be first in array and painted first as well
-    template< class I > bool operator()( const I &i1, const I &i2 ) const
-    {
-        return zvals[i1] > zvals[i2];
-    }
+#ifdef _OPENMP
+            #pragma omp parallel for schedule( static, 1 )
+#endif
+            for( int b = 0; b < nbBlocks; ++b )
+            {
+                size_t *pOffset = &offsets[b * 256];
+                const size_t last = n * ( b + 1 ) / nbBlocks;
+                for( size_t i = n * b / nbBlocks; i < last; ++i )
+                {
+                    const size_t dst = pOffset[( keys[i] >> shift ) & 0xFF]++;
+                    keysTmp[dst]   = keys[i];
+                    valuesTmp[dst] = values[i];
+                }
+            }
 
-private:
-    const T &zvals;
-};
+            keys.swap( keysTmp );
+            values.swap( valuesTmp );
+        }
+    }
 }
 
 
@@ -3296,63 +3663,152 @@ void Fibers::drawFakeTubes()
     }
 }
 
-void Fibers::drawSortedLines()
+///////////////////////////////////////////////////////////////////////////
+// Builds the list of snippets (segments between two consecutive points) of
+// the selected lines. Only needed when the selection or the filters change.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::buildSortedSnippets()
 {
-    //SORT LINES
-    // Only sort those lines we see.
-    unsigned int *pSnippletSort = NULL;
-    unsigned int *pLineIds      = NULL;
+    std::vector< size_t > lineOffsets( m_countLines + 1, 0 );
+    for( int i = 0; i < m_countLines; ++i )
+    {
+        const bool isShown = m_selected[i] && !m_filtered[i];
+        lineOffsets[i + 1] = lineOffsets[i] + ( isShown ? getPointsPerLine( i ) - 1 : 0 );
+    }
 
-    int nbSnipplets = 0;
+    const size_t nbSnippets = lineOffsets[m_countLines];
+    m_snippetStarts.resize( nbSnippets );
+    m_snippetOrder.resize( nbSnippets );
+    m_snippetKeys.resize( nbSnippets );
 
-    // Estimate memory required for arrays.
-    for( int i = 0; i < m_countLines; ++i )
+    const int countLines = m_countLines;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic, 256 )
+#endif
+    for( int i = 0; i < countLines; ++i )
     {
-        if( m_selected[i] && !m_filtered[i] )
+        const unsigned int start = getStartIndexForLine( i );
+        const size_t last = lineOffsets[i + 1];
+        for( size_t s = lineOffsets[i]; s < last; ++s )
         {
-            nbSnipplets += getPointsPerLine( i ) - 1;
+            m_snippetStarts[s] = start + static_cast< unsigned int >( s - lineOffsets[i] );
+            m_snippetOrder[s]  = static_cast< unsigned int >( s );
         }
     }
 
-    pSnippletSort = new unsigned int[nbSnipplets + 1]; // +1 just to be sure because of fancy problems with some sort functions.
-    pLineIds      = new unsigned int[nbSnipplets * 2];
-    // Build data structure for sorting.
-    int snp = 0;
+    m_snippetsDirty = false;
+    m_snippetOrderValid = false;
+}
 
-    for( int i = 0; i < m_countLines; ++i )
+///////////////////////////////////////////////////////////////////////////
+// Sorts the snippets back to front for the given projection. When the
+// view only moved a bit, the order of the previous frame is nearly right
+// and an insertion sort finishes it. Otherwise, a radix sort is used.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::sortSnippets( const GLfloat *pProjMatrix )
+{
+    if( m_snippetOrderValid && std::equal( pProjMatrix, pProjMatrix + 16, m_snippetProjection ) )
     {
-        if( !( m_selected[i] && !m_filtered[i] ) )
-        {
-            continue;
-        }
+        return;
+    }
+
+    const int nbSnippets = static_cast< int >( m_snippetOrder.size() );
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for( int s = 0; s < nbSnippets; ++s )
+    {
+        m_snippetKeys[s] = depthKey( projectDepth( &m_pointArray[m_snippetStarts[m_snippetOrder[s]] * 3], pProjMatrix ) );
+    }
+
+    if( !m_snippetOrderValid || !insertionSortByKey( m_snippetKeys, m_snippetOrder, m_snippetOrder.size() ) )
+    {
+        radixSortByKey( m_snippetKeys, m_snippetOrder, m_snippetKeysTmp, m_snippetOrderTmp );
+    }
 
-        const unsigned int p = getPointsPerLine( i );
+    std::copy( pProjMatrix, pProjMatrix + 16, m_snippetProjection );
+    m_snippetOrderValid = true;
+}
 
-        // TODO: update pLineIds and pSnippletSort size only when fiber selection changes.
-        for( unsigned int k = 0; k < p - 1; ++k )
+///////////////////////////////////////////////////////////////////////////
+// Alpha of a snippet going in the given direction, for the current
+// opacity mode (transparent or opaque, alpha or linear function).
+///////////////////////////////////////////////////////////////////////////
+float Fibers::getSnippetAlpha( const Vector &direction, const Vector &zVector ) const
+{
+    float alphaValue;
+    if(m_ModeOpac)
+    {
+        //Transparent
+        if(m_isAlphaFunc)
         {
-            pLineIds[snp << 1] = getStartIndexForLine( i ) + k;
-            pLineIds[( snp << 1 ) + 1] = getStartIndexForLine( i ) + k + 1;
-            pSnippletSort[snp] = snp;
-            snp++;
+            //Alpha func
+            alphaValue = 1-std::abs(direction.Dot(zVector)); 
+            alphaValue = std::pow(alphaValue,m_exponent);
         }
-    }
+        else
+        {
+            //Linear func
+            float theta = std::acos(std::abs(direction.Dot(zVector)));
 
-    GLfloat projMatrix[16];
-    glGetFloatv( GL_PROJECTION_MATRIX, projMatrix );
+            if(theta > (1-m_linb)/m_lina)
+            {
+                alphaValue = 1.0f;
+            }
+            else if(theta < (-m_linb)/m_lina)
+            {
+                alphaValue = 0.0f;
+            }
+            else
+            {
+                alphaValue = (m_lina*theta+m_linb);
+            }
+        }
+    }
+    else
+    {
+        //Opaque
+        if(m_isAlphaFunc)
+        {
+            //Alpha func
+            alphaValue = std::abs(direction.Dot(zVector)); 
+            alphaValue = std::pow(alphaValue,m_exponent);
+        }
+        else
+        {
+            //Linear func
+            float theta = std::acos(std::abs(direction.Dot(zVector)));
 
-    // Compute z values of lines (in our case: starting points only).
-    vector< float > zVals( nbSnipplets );
+            if(theta > (1-m_linb)/m_lina)
+            {
+                alphaValue = 1-1.0f;
+            }
+            else if(theta < (-m_linb)/m_lina)
+            {
+                alphaValue = 1-0.0f;
+            }
+            else
+            {
+                alphaValue = 1-m_lina*theta+m_linb;
+            }
+        }
+    }
+    return alphaValue;
+}
 
-    for( int i = 0; i < nbSnipplets; ++i )
+void Fibers::drawSortedLines()
+{
+    // The snippets and their order are kept from one frame to the next.
+    if( m_snippetsDirty )
     {
-        const int id = pLineIds[i << 1] * 3;
-        zVals[i] = ( m_pointArray[id + 0] * projMatrix[2] + m_pointArray[id + 1] * projMatrix[6]
-                      + m_pointArray[id + 2] * projMatrix[10] + projMatrix[14] ) / ( m_pointArray[id + 0] * projMatrix[3]
-                              + m_pointArray[id + 1] * projMatrix[7] + m_pointArray[id + 2] * projMatrix[11] + projMatrix[15] );
+        buildSortedSnippets();
     }
 
-    sort( &pSnippletSort[0], &pSnippletSort[nbSnipplets], IndirectComp< vector< float > > ( zVals ) );
+    GLfloat projMatrix[16];
+    glGetFloatv( GL_PROJECTION_MATRIX, projMatrix );
+    sortSnippets( projMatrix );
 
     float *pColors  = NULL;
     float *pNormals = NULL;
@@ -3365,6 +3821,7 @@ void Fibers::drawSortedLines()
         glBindBuffer( GL_ARRAY_BUFFER, m_bufferObjects[2] );
         pNormals = ( float * ) glMapBuffer( GL_ARRAY_BUFFER, GL_READ_ONLY );
         glUnmapBuffer( GL_ARRAY_BUFFER );
+        glBindBuffer( GL_ARRAY_BUFFER, 0 );
     }
     else
     {
@@ -3381,161 +3838,117 @@ void Fibers::drawSortedLines()
         glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
     }
 
-    glEnable( GL_BLEND );
-    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
-    glBegin( GL_LINES );
+    // View axis used by the opacity of the snippets.
+    Matrix4fT transform = SceneManager::getInstance()->getTransform();
+    Vector3fT v1 = { { 0, 0, 1 } };
+    Vector3fT view;
+    Vector3fMultMat4( &view, &v1, &transform );
 
-    if( m_fiberColorationMode == MINDISTANCE_COLOR )
+    Vector zVector;
+    if(m_axisView)
     {
-        int i = 0;
-
-        for( int c = 0; c < nbSnipplets; ++c )
-        {
-            i = c;
-            int idx  = pLineIds[pSnippletSort[i] << 1];
-            int idx3 = idx * 3;
-            int id2  = pLineIds[( pSnippletSort[i] << 1 ) + 1];
-            int id23 = id2 * 3;
-            glColor4f(  pColors[idx3 + 0],       pColors[idx3 + 1],       pColors[idx3 + 2],   m_localizedAlpha[idx] * m_alpha );
-            glNormal3f( pNormals[idx3 + 0],      pNormals[idx3 + 1],      pNormals[idx3 + 2] );
-            glVertex3f( m_pointArray[idx3 + 0],  m_pointArray[idx3 + 1],  m_pointArray[idx3 + 2] );
-            glColor4f(  pColors[id23 + 0],       pColors[id23 + 1],       pColors[id23 + 2],   m_localizedAlpha[id2] * m_alpha );
-            glNormal3f( pNormals[id23 + 0],      pNormals[id23 + 1],      pNormals[id23 + 2] );
-            glVertex3f( m_pointArray[id23 + 0],  m_pointArray[id23 + 1],  m_pointArray[id23 + 2] );
-        }
+        //View axis
+        zVector = Vector(view.s.X, view.s.Y, view.s.Z); 
+        zVector.normalize();
     }
     else
     {
-        int i = 0;
+        //Fixed axis
+        zVector = Vector(m_xAngle,m_yAngle,m_zAngle); 
+    }
+
+    // The sorted snippets are expanded, a batch at a time, into vertex
+    // arrays that are drawn with a single call per batch.
+    const size_t nbSnippets = m_snippetOrder.size();
+    const size_t batchCapacity = std::min( nbSnippets, SNIPPETS_PER_BATCH );
+    m_sortedVertices.resize( batchCapacity * 6 );
+    m_sortedColors.resize( batchCapacity * 8 );
+    m_sortedNormals.resize( batchCapacity * 6 );
+
+    if( batchCapacity > 0 )
+    {
+        glEnableClientState( GL_VERTEX_ARRAY );
+        glEnableClientState( GL_COLOR_ARRAY );
+        glEnableClientState( GL_NORMAL_ARRAY );
+        glVertexPointer( 3, GL_FLOAT, 0, &m_sortedVertices[0] );
+        glColorPointer( 4, GL_FLOAT, 0, &m_sortedColors[0] );
+        glNormalPointer( GL_FLOAT, 0, &m_sortedNormals[0] );
+    }
+
+    glEnable( GL_BLEND );
+    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+
+    const bool isMinDistanceColor = m_fiberColorationMode == MINDISTANCE_COLOR;
+
+    for( size_t first = 0; first < nbSnippets; first += SNIPPETS_PER_BATCH )
+    {
+        const int batchSize = static_cast< int >( std::min( SNIPPETS_PER_BATCH, nbSnippets - first ) );
 
-        for( int c = 1; c < nbSnipplets; ++c )
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for( int s = 0; s < batchSize; ++s )
         {
-            i = c;
-            int idx  = pLineIds[pSnippletSort[i] << 1];
-            int idx3 = idx * 3;
-            int id2  = pLineIds[( pSnippletSort[i] << 1 ) + 1];
-            int id23 = id2 * 3;
-
-            /* --------------OPACITY TEST -------------*/
-            //View vector
-            Matrix4fT transform = SceneManager::getInstance()->getTransform();
-            float dots[8];
-            Vector3fT v1 = { { 0, 0, 1 } };
-            Vector3fT v2 = { { 1, 1, 1 } };
-            Vector3fT view;
-
-            Vector3fMultMat4( &view, &v1, &transform );
-            dots[0] = Vector3fDot( &v2, &view );
-
-            //Local vector
-            Vector normalVector = Vector(m_pointArray[id23 + 0]-m_pointArray[idx3 + 0],m_pointArray[id23 + 1]-m_pointArray[idx3 + 1],m_pointArray[id23 + 2]-m_pointArray[idx3 + 2]);
-            
-            if(!m_isLocalRendering)
-            {
-                int id = getLineForPoint(idx);
-                normalVector = Vector(m_tractDirection[id*3], m_tractDirection[id*3+1], m_tractDirection[id*3+2]); 
+            const int idx  = m_snippetStarts[m_snippetOrder[first + s]];
+            const int id2  = idx + 1;
+            const int idx3 = idx * 3;
+            const int id23 = id2 * 3;
 
-                if(m_usingEndpts)
-                {
-                    normalVector = Vector(m_endPointsVector[id*3], m_endPointsVector[id*3+1], m_endPointsVector[id*3+2]);
-                }
+            float *pVertex = &m_sortedVertices[s * 6];
+            float *pColor  = &m_sortedColors[s * 8];
+            float *pNormal = &m_sortedNormals[s * 6];
+
+            if( isMinDistanceColor )
+            {
+                std::copy( &pColors[idx3], &pColors[idx3 + 3], pColor );
+                std::copy( &pColors[id23], &pColors[id23 + 3], pColor + 4 );
+                pColor[3] = m_localizedAlpha[idx] * m_alpha;
+                pColor[7] = m_localizedAlpha[id2] * m_alpha;
             }
-                
-            normalVector.normalize();
-            
-			Vector zVector;
-            if(m_axisView)
-			{
-                //View axis
-				zVector = Vector(view.s.X, view.s.Y, view.s.Z); 
-				zVector.normalize();
-			}
-			else
-			{
-                //Fixed axis
-				zVector = Vector(m_xAngle,m_yAngle,m_zAngle); 
-			}
-
-			float alphaValue;
-			if(m_ModeOpac)
-			{
-                //Transparent
-                if(m_isAlphaFunc)
-                {
-                    //Alpha func
-				    alphaValue = 1-std::abs(normalVector.Dot(zVector)); 
-                    alphaValue = std::pow(alphaValue,m_exponent);
-                }
-                else
-                {
-                    //Linear func
-                    float theta = std::acos(std::abs(normalVector.Dot(zVector)));
+            else
+            {
+                //Local vector
+                Vector normalVector = Vector(m_pointArray[id23 + 0]-m_pointArray[idx3 + 0],m_pointArray[id23 + 1]-m_pointArray[idx3 + 1],m_pointArray[id23 + 2]-m_pointArray[idx3 + 2]);
 
-                    if(theta > (1-m_linb)/m_lina)
-                    {
-                        alphaValue = 1.0f;
-                    }
-                    else if(theta < (-m_linb)/m_lina)
-                    {
-                        alphaValue = 0.0f;
-                    }
-                    else
-                    {
-                        alphaValue = (m_lina*theta+m_linb);
-                    }
-                }
-			}
-			else
-			{
-                //Opaque
-                if(m_isAlphaFunc)
+                const int id = m_reverse[idx];
+                if(!m_isLocalRendering)
                 {
-                    //Alpha func
-				    alphaValue = std::abs(normalVector.Dot(zVector)); 
-                    alphaValue = std::pow(alphaValue,m_exponent);
-                }
-                else
-                {
-                    //Linear func
-                    float theta = std::acos(std::abs(normalVector.Dot(zVector)));
+                    normalVector = Vector(m_tractDirection[id*3], m_tractDirection[id*3+1], m_tractDirection[id*3+2]); 
 
-                    if(theta > (1-m_linb)/m_lina)
-                    {
-                        alphaValue = 1-1.0f;
-                    }
-                    else if(theta < (-m_linb)/m_lina)
+                    if(m_usingEndpts)
                     {
-                        alphaValue = 1-0.0f;
-                    }
-                    else
-                    {
-                        alphaValue = 1-m_lina*theta+m_linb;
+                        normalVector = Vector(m_endPointsVector[id*3], m_endPointsVector[id*3+1], m_endPointsVector[id*3+2]);
                     }
                 }
-			}
+                normalVector.normalize();
 
-            int id = getLineForPoint(idx);
-            if(m_dispFactors[id] < m_cl)
-                alphaValue = 1.0f;
+                float alphaValue = getSnippetAlpha( normalVector, zVector );
+                if(m_dispFactors[id] < m_cl)
+                    alphaValue = 1.0f;
 
-			//glColor4f(  normalVector.x, normalVector.y, normalVector.z,   alphaValue );
-            glColor4f( m_normalArray[idx3+0], m_normalArray[idx3 + 1],  m_normalArray[idx3 + 2], alphaValue );
-            glNormal3f( pNormals[idx3 + 0],      pNormals[idx3 + 1],      pNormals[idx3 + 2] );
-            glVertex3f( m_pointArray[idx3 + 0],  m_pointArray[idx3 + 1],  m_pointArray[idx3 + 2] );
+                std::copy( &m_normalArray[idx3], &m_normalArray[idx3 + 3], pColor );
+                std::copy( &m_normalArray[idx3], &m_normalArray[idx3 + 3], pColor + 4 );
+                pColor[3] = alphaValue;
+                pColor[7] = alphaValue;
+            }
 
-			//glColor4f(  normalVector.x, normalVector.y, normalVector.z,   alphaValue );
-            glColor4f( m_normalArray[idx3+0], m_normalArray[idx3 + 1],  m_normalArray[idx3 + 2], alphaValue );
-            glNormal3f( pNormals[id23 + 0],      pNormals[id23 + 1],      pNormals[id23 + 2] );
-            glVertex3f( m_pointArray[id23 + 0],  m_pointArray[id23 + 1],  m_pointArray[id23 + 2] );
+            std::copy( &pNormals[idx3], &pNormals[idx3 + 3], pNormal );
+            std::copy( &pNormals[id23], &pNormals[id23 + 3], pNormal + 3 );
+            std::copy( &m_pointArray[idx3], &m_pointArray[idx3 + 3], pVertex );
+            std::copy( &m_pointArray[id23], &m_pointArray[id23 + 3], pVertex + 3 );
         }
+
+        glDrawArrays( GL_LINES, 0, batchSize * 2 );
     }
 
-    glEnd();
-    glDisable( GL_BLEND );
+    if( batchCapacity > 0 )
+    {
+        glDisableClientState( GL_VERTEX_ARRAY );
+        glDisableClientState( GL_COLOR_ARRAY );
+        glDisableClientState( GL_NORMAL_ARRAY );
+    }
 
-    // FIXME: store these later on!
-    delete[] pSnippletSort;
-    delete[] pLineIds;
+    glDisable( GL_BLEND );
 }
 
 void Fibers::useFakeTubes()
@@ -3715,55 +4128,23 @@ bool Fibers::isSelected( int fiberId )
     return m_selected[fiberId];
 }
 
-float Fibers::getLocalizedAlpha( int index )
-{
-    return m_localizedAlpha[index];
-}
-
-void Fibers::setFibersLength()
+///////////////////////////////////////////////////////////////////////////
+// Selection computed outside of the SelectionTree, by the BatchProcessor.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::setSelectedFibers( const vector< bool > &selected )
 {
-    m_length.resize( m_countLines, false );
-
-    vector< Vector >           currentFiberPoints;
-    vector< vector< Vector > > fibersPoints;
-
-    for( int i = 0; i < m_countLines; i++ )
+    if( selected.size() == m_selected.size() )
     {
-        if( getFiberCoordValues( i, currentFiberPoints ) )
-        {
-            fibersPoints.push_back( currentFiberPoints );
-            currentFiberPoints.clear();
-        }
+        m_selected = selected;
+        m_visibleLinesDirty = true;
+        m_snippetsDirty = true;
+        m_cfDrawDirty = true;
     }
+}
 
-    float dx, dy, dz;
-    m_maxLength = 0;
-    m_minLength = 1000000;
-
-    float voxelX = DatasetManager::getInstance()->getVoxelX();
-    float voxelY = DatasetManager::getInstance()->getVoxelY();
-    float voxelZ = DatasetManager::getInstance()->getVoxelZ();
-
-    for( unsigned int j = 0 ; j < fibersPoints.size(); j++ )
-    {
-        currentFiberPoints = fibersPoints[j];
-        m_length[j] = 0;
-
-        for( unsigned int i = 1; i < currentFiberPoints.size(); ++i )
-        {
-            // The values are in pixel, we need to set them in millimeters using the spacing
-            // specified in the anatomy file ( m_datasetHelper->xVoxel... ).
-            dx = ( currentFiberPoints[i].x - currentFiberPoints[i - 1].x ) * voxelX;
-            dy = ( currentFiberPoints[i].y - currentFiberPoints[i - 1].y ) * voxelY;
-            dz = ( currentFiberPoints[i].z - currentFiberPoints[i - 1].z ) * voxelZ;
-            FArray currentVector( dx, dy, dz );
-            m_length[j] += ( float )currentVector.norm();
-        }
-
-        if( m_length[j] > m_maxLength ) m_maxLength = m_length[j];
-
-        if( m_length[j] < m_minLength ) m_minLength = m_length[j];
-    }
+float Fibers::getLocalizedAlpha( int index )
+{
+    return m_localizedAlpha[index];
 }
 
 bool Fibers::getFiberCoordValues( int fiberIndex, vector< Vector > &fiberPoints )
@@ -3806,6 +4187,9 @@ void Fibers::updateFibersFilters(int minLength, int maxLength, int minSubsamplin
         }
         m_filtered[i] = !( ( i % maxSubsampling ) >= minSubsampling && m_length[i] >= minLength && m_length[i] <= maxLength );
     }
+    m_visibleLinesDirty = true;
+    m_snippetsDirty = true;
+    m_cfDrawDirty = true;
 
     SceneManager::getInstance()->getSelectionTree().notifyAllObjectsNeedUpdating();
 
@@ -3865,6 +4249,13 @@ void Fibers::flipAxis( AxisType i_axe )
         m_pointArray[i] = -( m_pointArray[i] - axisShift ) + axisShift;
     }
 
+    m_pFiberBVH->flip( i_axe, axisShift );
+    m_cfIndexDirty = true;
+
+    // The depths of the snippets changed, their order has to be sorted again
+    // even if the camera did not move.
+    m_snippetOrderValid = false;
+
     glBindBuffer( GL_ARRAY_BUFFER, m_bufferObjects[0] );
     glBufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * m_countPoints * 3, &m_pointArray[0], GL_STATIC_DRAW );
 
@@ -3875,8 +4266,6 @@ void Fibers::createPropertiesSizer( PropertiesWindow *pParent )
 {
     DatasetInfo::createPropertiesSizer( pParent );
 
-    setFibersLength();
-
     wxBoxSizer *pBoxMain = new wxBoxSizer( wxVERTICAL );
 
     //////////////////////////////////////////////////////////////////////////
@@ -4255,15 +4644,98 @@ void Fibers::updateTubeRadius()
 
 //////////////////////////////////////////////////////////////////////////
 
+///////////////////////////////////////////////////////////////////////////
+// Buckets the points by voxel slab along each axis, so that the points
+// near a slice are found without scanning the whole dataset. Points out of
+// the volume go to the border slabs.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::buildCrossingFibersIndex()
+{
+    const int dims[3] = { DatasetManager::getInstance()->getColumns(),
+                          DatasetManager::getInstance()->getRows(),
+                          DatasetManager::getInstance()->getFrames() };
+    const float voxelSizes[3] = { DatasetManager::getInstance()->getVoxelX(),
+                                  DatasetManager::getInstance()->getVoxelY(),
+                                  DatasetManager::getInstance()->getVoxelZ() };
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        const int nbSlabs = std::max( 1, dims[axis] );
+        std::vector< unsigned int > &starts = m_cfSlabStarts[axis];
+        std::vector< unsigned int > &points = m_cfSlabPoints[axis];
+        std::vector< unsigned int > slabs( m_countPoints );
+
+        starts.assign( nbSlabs + 1, 0 );
+        for( int p = 0; p < m_countPoints; ++p )
+        {
+            const int slab = std::min( nbSlabs - 1, std::max( 0, (int)std::floor( m_pointArray[p * 3 + axis] / voxelSizes[axis] ) ) );
+            slabs[p] = slab;
+            ++starts[slab + 1];
+        }
+
+        for( int s = 0; s < nbSlabs; ++s )
+        {
+            starts[s + 1] += starts[s];
+        }
+
+        // Counting sort: the points of a slab stay in increasing order.
+        std::vector< unsigned int > next( starts.begin(), starts.end() - 1 );
+        points.resize( m_countPoints );
+        for( int p = 0; p < m_countPoints; ++p )
+        {
+            points[next[slabs[p]]++] = p;
+        }
+    }
+
+    m_cfIndexDirty = false;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Gets, in increasing order, the points of the shown lines whose coordinate
+// along axis is in [minPos, maxPos]. Only the slabs of that range are read.
+///////////////////////////////////////////////////////////////////////////
+void Fibers::gatherCrossingPoints( const int axis, const float minPos, const float maxPos, std::vector< unsigned int > &o_points )
+{
+    o_points.clear();
+
+    const float voxelSize = axis == 0 ? DatasetManager::getInstance()->getVoxelX()
+                          : axis == 1 ? DatasetManager::getInstance()->getVoxelY()
+                          :             DatasetManager::getInstance()->getVoxelZ();
+    const std::vector< unsigned int > &starts = m_cfSlabStarts[axis];
+    const std::vector< unsigned int > &points = m_cfSlabPoints[axis];
+    const int lastSlab = static_cast< int >( starts.size() ) - 2;
+
+    const int first = std::min( lastSlab, std::max( 0, (int)std::floor( minPos / voxelSize ) ) );
+    const int last  = std::min( lastSlab, std::max( 0, (int)std::floor( maxPos / voxelSize ) ) );
+
+    for( unsigned int i = starts[first]; i < starts[last + 1]; ++i )
+    {
+        const unsigned int point = points[i];
+        const float pos = m_pointArray[point * 3 + axis];
+        const int line = m_reverse[point];
+
+        if( minPos <= pos && maxPos >= pos && m_selected[line] && !m_filtered[line] )
+        {
+            o_points.push_back( point );
+        }
+    }
+
+    if( first != last )
+    {
+        std::sort( o_points.begin(), o_points.end() );
+    }
+}
+
 void Fibers::findCrossingFibers()
 {
-    if (   m_cfDrawDirty
-        || m_xDrawn != SceneManager::getInstance()->getSliceX()
-        || m_yDrawn != SceneManager::getInstance()->getSliceY()
-        || m_zDrawn != SceneManager::getInstance()->getSliceZ()
-        || m_axialShown    != SceneManager::getInstance()->isAxialDisplayed()
-        || m_coronalShown  != SceneManager::getInstance()->isCoronalDisplayed()
-        || m_sagittalShown != SceneManager::getInstance()->isSagittalDisplayed() )
+    const bool xChanged = m_xDrawn != SceneManager::getInstance()->getSliceX() || m_sagittalShown != SceneManager::getInstance()->isSagittalDisplayed();
+    const bool yChanged = m_yDrawn != SceneManager::getInstance()->getSliceY() || m_coronalShown  != SceneManager::getInstance()->isCoronalDisplayed();
+    const bool zChanged = m_zDrawn != SceneManager::getInstance()->getSliceZ() || m_axialShown    != SceneManager::getInstance()->isAxialDisplayed();
+
+    if ( m_cfDrawDirty || m_cfIndexDirty || xChanged || yChanged || zChanged )
     {
         m_xDrawn = SceneManager::getInstance()->getSliceX();
         m_yDrawn = SceneManager::getInstance()->getSliceY();
@@ -4276,7 +4748,13 @@ void Fibers::findCrossingFibers()
         float yVoxSize = DatasetManager::getInstance()->getVoxelY();
         float zVoxSize = DatasetManager::getInstance()->getVoxelZ();
 
-        m_cfDrawDirty = true;
+        // A change of selection, of filter or of thickness affects every axis.
+        // Otherwise, only the axes whose slice moved are gathered again.
+        const bool allChanged = m_cfDrawDirty || m_cfIndexDirty;
+        if( m_cfIndexDirty )
+        {
+            buildCrossingFibersIndex();
+        }
 
         // Determine X, Y and Z range
         const float xMin( (m_xDrawn + 0.5f) * xVoxSize - m_thickness );
@@ -4286,62 +4764,58 @@ void Fibers::findCrossingFibers()
         const float zMin( (m_zDrawn + 0.5f) * zVoxSize - m_thickness );
         const float zMax( (m_zDrawn + 0.5f) * zVoxSize + m_thickness );
 
-        bool lineStarted(false);
+        if( allChanged || xChanged )
+        {
+            m_cfAxisPoints[0].clear();
+            if( m_sagittalShown )
+            {
+                gatherCrossingPoints( 0, xMin, xMax, m_cfAxisPoints[0] );
+            }
+        }
+        if( allChanged || yChanged )
+        {
+            m_cfAxisPoints[1].clear();
+            if( m_coronalShown )
+            {
+                gatherCrossingPoints( 1, yMin, yMax, m_cfAxisPoints[1] );
+            }
+        }
+        if( allChanged || zChanged )
+        {
+            m_cfAxisPoints[2].clear();
+            if( m_axialShown )
+            {
+                gatherCrossingPoints( 2, zMin, zMax, m_cfAxisPoints[2] );
+            }
+        }
+
+        // A point near any of the shown slices is drawn.
+        std::vector< unsigned int > xyPoints;
+        std::vector< unsigned int > points;
+        std::set_union( m_cfAxisPoints[0].begin(), m_cfAxisPoints[0].end(),
+                        m_cfAxisPoints[1].begin(), m_cfAxisPoints[1].end(), std::back_inserter( xyPoints ) );
+        std::set_union( xyPoints.begin(), xyPoints.end(),
+                        m_cfAxisPoints[2].begin(), m_cfAxisPoints[2].end(), std::back_inserter( points ) );
 
+        // Consecutive points of the same line are drawn as one strip.
         m_cfStartOfLine.clear();
         m_cfPointsPerLine.clear();
 
-        unsigned int index( 0 );
-        unsigned int point( 0 );
-        for ( unsigned int line( 0 ); line < static_cast<unsigned int>(m_countLines); ++line )
+        for( unsigned int i( 0 ); i < points.size(); ++i )
         {
-            if ( m_selected[line] && !m_filtered[line] )
+            const unsigned int point = points[i];
+            if( i > 0 && point == points[i - 1] + 1 && m_reverse[point] == m_reverse[point - 1] )
             {
-                for ( unsigned int i( 0 ); i < static_cast<unsigned int>(getPointsPerLine(line)); ++i, ++point, index += 3 )
-                {
-                    if ( m_sagittalShown && xMin <= m_pointArray[index] && xMax >= m_pointArray[index] )
-                    {
-                        if ( !lineStarted )
-                        {
-                            m_cfStartOfLine.push_back(point);
-                            m_cfPointsPerLine.push_back(0);
-                            lineStarted = true;
-                        }
-                        ++m_cfPointsPerLine.back();
-                    }
-                    else if ( m_coronalShown && yMin <= m_pointArray[index + 1] && yMax >= m_pointArray[index + 1] )
-                    {
-                        if ( !lineStarted )
-                        {
-                            m_cfStartOfLine.push_back(point);
-                            m_cfPointsPerLine.push_back(0);
-                            lineStarted = true;
-                        }
-                        ++m_cfPointsPerLine.back();
-                    }
-                    else if ( m_axialShown && zMin <= m_pointArray[index + 2] && zMax >= m_pointArray[index + 2] )
-                    {
-                        if ( !lineStarted )
-                        {
-                            m_cfStartOfLine.push_back(point);
-                            m_cfPointsPerLine.push_back(0);
-                            lineStarted = true;
-                        }
-                        ++m_cfPointsPerLine.back();
-                    }
-                    else
-                    {
-                        lineStarted = false;
-                    }
-                }
-                lineStarted = false;
+                ++m_cfPointsPerLine.back();
             }
             else
             {
-                point += getPointsPerLine(line);
-                index += getPointsPerLine(line) * 3;
+                m_cfStartOfLine.push_back( point );
+                m_cfPointsPerLine.push_back( 1 );
             }
         }
+
+        m_cfDrawDirty = false;
     }
 }
 
@@ -4527,8 +5001,8 @@ void Fibers::convertFromRTT()
 	wxString id = wxString::Format(_T("%d"), RTTrackingHelper::getInstance()->generateId());
     m_name = wxT( "RTTFibers" + id );
 
-	m_pOctree = new Octree( 2, m_pointArray, m_countPoints );
-    computeGLobalProperties();
+    buildSpatialIndices();
+    computeGLobalProperties( getAnatomyGrid() );
 }
 
 void Fibers::updateAlpha()
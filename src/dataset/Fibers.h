@@ -2,8 +2,10 @@
 #define FIBERS_H_
 
 #include "DatasetInfo.h"
+#include "FiberBVH.h"
 #include "Octree.h"
 #include "../gui/SelectionObject.h"
+#include "../misc/Fantom/FMatrix.h"
 #include "../misc/Fantom/FVector.h"
 
 #include <GL/glew.h>
@@ -17,6 +19,8 @@
 #include <string>
 #include <vector>
 
+class FiberRasterizer;
+
 enum FiberFileType
 {
     ASCII_FIBER = 0,
@@ -28,6 +32,22 @@ const int FIBERS_SUBSAMPLING_RANGE_MIN(0);
 const int FIBERS_SUBSAMPLING_RANGE_MAX(99);
 const int FIBERS_SUBSAMPLING_RANGE_START(0);
 
+/**
+ * Anatomy in which the fibers are loaded. The formats that are not saved in
+ * the space of the navigator are brought into its grid. In the application,
+ * it is the anatomy of the DatasetManager.
+ */
+struct FibersGrid
+{
+    int     m_columns;
+    int     m_rows;
+    int     m_frames;
+    float   m_voxelX;
+    float   m_voxelY;
+    float   m_voxelZ;
+    FMatrix m_niftiTransform;   // Local to world space
+};
+
 /**
  * This class represents a set of fibers.
  * It supports loading different fibers file types.
@@ -42,11 +62,13 @@ public:
 
     // Fibers loading methods
     bool    load( const wxString &filename );
+    bool    load( const wxString &filename, const FibersGrid &grid );
     bool    createFrom( const vector<Fibers*>& fibers, wxString name=wxT("Merged"));
 
     void    updateFibersColors();
 
     Anatomy* generateFiberVolume();
+    void    rasterizeVisibleFibers( FiberRasterizer &rasterizer ) const;
 
     void    getFibersInfoToSave( std::vector<float> &pointsToSave, std::vector<int> &linesToSave, std::vector<int> &colorsToSave, int &countLines );
     void    getNbLines( int &nbLines );
@@ -55,6 +77,7 @@ public:
     void    save( wxString filename, int format );
     bool    save( wxXmlNode *pNode, const wxString &rootPath ) const;
     void    saveDMRI( wxString filename );
+    bool    saveBinary( wxString filename );
 
     int     getPointsPerLine(     const int lineId );
     int     getStartIndexForLine( const int lineId );
@@ -77,11 +100,10 @@ public:
     int     getLineCount();
     int     getPointCount();
     bool    isSelected( int  fiberId );
+    void    setSelectedFibers( const std::vector< bool > &selected );
 
     float    getLocalizedAlpha( int index );
 
-    void    setFibersLength();
-    
     float   getFiberLength( const int fiberId ) const
     {
         if( fiberId < 0 || static_cast< unsigned int >( fiberId ) >= m_length.size() )
@@ -112,8 +134,9 @@ public:
     
     // TODO check if we can set const
     Octree* getOctree() const { return m_pOctree; }
+    FiberBVH* getFiberBVH() const { return m_pFiberBVH; }
     
-    vector< int > getReverseIdx() const { return m_reverse; }
+    const vector< int >& getReverseIdx() const { return m_reverse; }
 
     virtual void createPropertiesSizer( PropertiesWindow *pParent );
     virtual void updatePropertiesSizer();
@@ -170,12 +193,13 @@ private:
     Fibers &operator=( const Fibers & );
 
 private:
-    bool            loadTRK(    const wxString &filename );
-    bool            loadCamino( const wxString &filename );
-    bool            loadMRtrix( const wxString &filename );
-    bool            loadPTK(    const wxString &filename );
+    bool            loadTRK(    const wxString &filename, const FibersGrid &grid );
+    bool            loadCamino( const wxString &filename, const FibersGrid &grid );
+    bool            loadMRtrix( const wxString &filename, const FibersGrid &grid );
+    bool            loadPTK(    const wxString &filename, const FibersGrid &grid );
     bool            loadVTK(    const wxString &filename );
     bool            loadDmri(   const wxString &filename );
+    bool            loadBinary( const wxString &filename );
     void            loadTestFibers();
 
     void            colorWithTorsion(       float *pColorData );
@@ -183,6 +207,8 @@ private:
     void            colorWithDistance(      float *pColorData );
     void            colorWithMinDistance(   float *pColorData );
     void            colorWithConstantColor( float *pColorData );
+    void            colorWithSplineMeasure( float *pColorData, const bool useTorsion );
+    void            getDistanceColoringFields( std::vector< const float * > &o_fields );
     
 
     void            toggleEndianess();
@@ -196,13 +222,21 @@ private:
     void            drawFakeTubes();
     void            drawSortedLines();
     void            drawCrossingFibers();
+    void            buildVisibleLines( const bool activateAllSelObj );
+    void            buildSortedSnippets();
+    void            buildCrossingFibersIndex();
+    void            gatherCrossingPoints( const int axis, const float minPos, const float maxPos, std::vector< unsigned int > &o_points );
+    void            sortSnippets( const GLfloat *pProjMatrix );
+    float           getSnippetAlpha( const Vector &direction, const Vector &zVector ) const;
 
     void            freeArrays();
 
     void            setShader();
     void            releaseShader();
 
-    void            computeGLobalProperties();
+    static FibersGrid getAnatomyGrid();
+    void            computeGLobalProperties( const FibersGrid &grid );
+    void            buildSpatialIndices();
 
 private:
     // Variables
@@ -240,6 +274,29 @@ private:
     FibersColorationMode  m_fiberColorationMode;
 
     Octree                *m_pOctree;
+    FiberBVH              *m_pFiberBVH;
+
+    // Compacted first/count arrays of the lines drawn by draw(), rebuilt
+    // only when the selection, the filters or the "activate all" flag change.
+    std::vector< GLint >   m_visibleFirsts;
+    std::vector< GLsizei > m_visibleCounts;
+    bool                   m_visibleLinesDirty;
+    bool                   m_visibleLinesActivateAll;
+
+    // Snippets (segments) of the selected lines drawn in transparency mode,
+    // their back to front order for the last projection, and the vertex
+    // arrays of the batch being drawn.
+    std::vector< unsigned int > m_snippetStarts;
+    std::vector< unsigned int > m_snippetOrder;
+    std::vector< unsigned int > m_snippetKeys;
+    std::vector< unsigned int > m_snippetOrderTmp;
+    std::vector< unsigned int > m_snippetKeysTmp;
+    std::vector< float >        m_sortedVertices;
+    std::vector< float >        m_sortedColors;
+    std::vector< float >        m_sortedNormals;
+    GLfloat                     m_snippetProjection[16];
+    bool                        m_snippetsDirty;
+    bool                        m_snippetOrderValid;
 
     bool            m_cfDrawDirty;
     float           m_exponent;
@@ -265,6 +322,12 @@ private:
     float           m_zDrawn;
     std::vector< unsigned int > m_cfStartOfLine;
     std::vector< unsigned int > m_cfPointsPerLine;
+    // Points bucketed by voxel slab along x, y and z (CSR layout), and the
+    // points near the current slice of each axis.
+    std::vector< unsigned int > m_cfSlabStarts[3];
+    std::vector< unsigned int > m_cfSlabPoints[3];
+    std::vector< unsigned int > m_cfAxisPoints[3];
+    bool            m_cfIndexDirty;
     
     wxColor         m_constantColor;
 
@@ -11,12 +11,14 @@
 #include "../main.h"
 #include "../gui/MainFrame.h"
 #include "../gui/SceneManager.h"
+#include "../misc/Algorithms/FiberRasterizer.h"
 #include "../misc/XmlHelper.h"
 
 #include <wx/tglbtn.h>
 #include <wx/tokenzr.h>
 #include <wx/xml/xml.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cfloat>
 #include <fstream>
@@ -706,22 +708,43 @@ void FibersGroup::fibersNormalColoring()
 
 void FibersGroup::OnClickGenerateFiberVolumeBtn()
 {
-    std::vector<Anatomy*> vAnatomies;
-
     vector<Fibers *> fibers = DatasetManager::getInstance()->getFibers();
     // Generate fiber volume for individual bundle
     for( vector<Fibers *>::const_iterator it = fibers.begin(); it != fibers.end(); ++it )
     {
-        Anatomy* pAnatomy = (*it)->generateFiberVolume();
-        vAnatomies.push_back( pAnatomy );
+        (*it)->generateFiberVolume();
     }
 
-    generateGlobalFiberVolume( vAnatomies );
+    generateGlobalFiberVolume();
 }
 
-void FibersGroup::generateGlobalFiberVolume(std::vector<Anatomy*> vAnatomies)
+///////////////////////////////////////////////////////////////////////////
+// Counts, for each voxel, the visible fibers of all the bundles going through it.
+///////////////////////////////////////////////////////////////////////////
+void FibersGroup::generateGlobalFiberVolume()
 {
-    int index = DatasetManager::getInstance()->createAnatomy( RGB );
+    FiberRasterizer rasterizer( DatasetManager::getInstance()->getColumns(),
+                                DatasetManager::getInstance()->getRows(),
+                                DatasetManager::getInstance()->getFrames(),
+                                DatasetManager::getInstance()->getVoxelX(),
+                                DatasetManager::getInstance()->getVoxelY(),
+                                DatasetManager::getInstance()->getVoxelZ() );
+
+    vector<Fibers *> fibers = DatasetManager::getInstance()->getFibers();
+    for( vector<Fibers *>::const_iterator it = fibers.begin(); it != fibers.end(); ++it )
+    {
+        (*it)->rasterizeVisibleFibers( rasterizer );
+    }
+
+    vector<float> density( rasterizer.getDensity() );
+    if( density.empty() || *std::max_element( density.begin(), density.end() ) == 0.0f )
+    {
+        Logger::getInstance()->print( wxT( "No visible fiber goes through the volume, no density volume generated." ), LOGLEVEL_WARNING );
+        return;
+    }
+
+    // The anatomy keeps the maximum count aside and stores values scaled to [0, 1].
+    int index = DatasetManager::getInstance()->createAnatomy( &density, HEAD_BYTE );
     Anatomy* pGlobalAnatomy = (Anatomy *)DatasetManager::getInstance()->getDataset( index );
 
     pGlobalAnatomy->setName( wxT( "Global Fiber-Density Volume" ) );
@@ -729,11 +752,6 @@ void FibersGroup::generateGlobalFiberVolume(std::vector<Anatomy*> vAnatomies)
     MyApp::frame->m_pListCtrl->InsertItem( index );
 
     MyApp::frame->refreshAllGLWidgets();
-
-    for(int i = 0; i < (int)vAnatomies.size(); i++)
-    {
-        pGlobalAnatomy->add( vAnatomies[i] );
-    }
 }
 
 void FibersGroup::OnClickApplyBtn()
@@ -46,7 +46,7 @@ public:
     void    fibersLocalColoring();
     void    fibersNormalColoring();
 
-    void    generateGlobalFiberVolume(std::vector<Anatomy*> vAnatomies);
+    void    generateGlobalFiberVolume();
 
     void    OnToggleVisibleBtn();
     void    OnToggleIntensityBtn();
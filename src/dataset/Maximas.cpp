@@ -6,6 +6,7 @@
 #include "Maximas.h"
 
 #include "DatasetManager.h"
+#include "NiftiFile.h"
 #include "RTTrackingHelper.h"
 #include "../Logger.h"
 #include "../gfx/ShaderHelper.h"
@@ -105,13 +106,11 @@ bool Maximas::load( nifti_image *pHeader, nifti_image *pBody )
     l_fileFloatData.assign( datasetSize * m_bands, 0.0f);
     float* pData = (float*)pBody->data;
 
-    for( int i( 0 ); i < datasetSize; ++i )
+    NiftiFile::interleaveBands( pData, datasetSize, m_bands, &l_fileFloatData[0] );
+    for( size_t i( 0 ); i < l_fileFloatData.size(); ++i )
     {
-        for( int j( 0 ); j < m_bands; ++j )
-        {
-            if(!isnan(pData[j * datasetSize + i]))
-                l_fileFloatData[i * m_bands + j] = pData[j * datasetSize + i];
-        }
+        if( isnan( l_fileFloatData[i] ) )
+            l_fileFloatData[i] = 0.0f;
     }
     
     createStructure( l_fileFloatData );
@@ -256,16 +255,10 @@ void Maximas::saveNifti( wxString fileName )
 bool Maximas::createStructure  ( std::vector< float > &i_fileFloatData )
 {
     m_nbGlyphs         = DatasetManager::getInstance()->getColumns() * DatasetManager::getInstance()->getRows() * DatasetManager::getInstance()->getFrames();
-    m_mainDirections.resize( m_nbGlyphs );
-
-    vector< float >::iterator it;
-    int i = 0;
 
     //Fetching the directions
-    for( it = i_fileFloatData.begin(), i = 0; it != i_fileFloatData.end(); it += m_bands, ++i )
-    { 
-        m_mainDirections[i].insert( m_mainDirections[i].end(), it, it + m_bands );
-    }
+    m_mainDirections.assign( i_fileFloatData.begin(), i_fileFloatData.end() );
+    m_mainDirections.resize( m_nbGlyphs * m_bands, 0.0f );
 
     getSlidersPositions( m_currentSliderPos );
 
@@ -323,7 +316,6 @@ void Maximas::flipAnat( AxisType axe )
     int m_rows = DatasetManager::getInstance()->getRows();
     int m_columns = DatasetManager::getInstance()->getColumns();
     int m_frames = DatasetManager::getInstance()->getFrames();
-    int m_bands = DatasetManager::getInstance()->getBands();
 
     switch (axe)
     {
@@ -365,9 +357,9 @@ void Maximas::flipAnat( AxisType axe )
                         break;
                 }
 
-                std::vector<float> tmp = m_mainDirections[curIndex];
-                m_mainDirections[curIndex] = m_mainDirections[flipIndex];
-                m_mainDirections[flipIndex] = tmp;
+                std::swap_ranges( m_mainDirections.begin() + curIndex * m_bands,
+                                  m_mainDirections.begin() + ( curIndex + 1 ) * m_bands,
+                                  m_mainDirections.begin() + flipIndex * m_bands );
             }
         }
     }
@@ -440,14 +432,15 @@ void Maximas::drawGlyph( int i_zVoxel, int i_yVoxel, int i_xVoxel, AxisType i_ax
 
     ShaderHelper::getInstance()->getOdfsShader()->setUniInt( "showAxis", 1 );
 
-    if(m_mainDirections[currentIdx].size() != 0)
+    PeakSpan peaks = getPeaks( currentIdx );
+    if(peaks.size() != 0)
     { 
-        for(unsigned int i =0; i < m_mainDirections[currentIdx].size()/3; i++)
+        for(unsigned int i =0; i < peaks.nbPeaks(); i++)
         {
             GLfloat l_coloring[3];
-            l_coloring[0] = m_mainDirections[currentIdx][i*3];
-            l_coloring[1] = m_mainDirections[currentIdx][i*3+1];
-            l_coloring[2] = m_mainDirections[currentIdx][i*3+2];
+            l_coloring[0] = peaks[i*3];
+            l_coloring[1] = peaks[i*3+1];
+            l_coloring[2] = peaks[i*3+2];
 
             ShaderHelper::getInstance()->getOdfsShader()->setUni3Float( "coloring", l_coloring );
             
@@ -456,9 +449,9 @@ void Maximas::drawGlyph( int i_zVoxel, int i_yVoxel, int i_xVoxel, AxisType i_ax
 			float halfScale = norm * scale;
 
             GLfloat stickPos[3];
-            stickPos[0] = halfScale*m_mainDirections[currentIdx][i*3];
-            stickPos[1] = halfScale*m_mainDirections[currentIdx][i*3+1];
-            stickPos[2] = halfScale*m_mainDirections[currentIdx][i*3+2];
+            stickPos[0] = halfScale*peaks[i*3];
+            stickPos[1] = halfScale*peaks[i*3+1];
+            stickPos[2] = halfScale*peaks[i*3+2];
 
             glLineWidth(2);
             glBegin(GL_LINES);  
@@ -11,6 +11,25 @@
 
 enum DISPLAY { SLICES, WHOLE };
 
+///////////////////////////////////////////////////////////////////////////
+// Read-only view over the peaks of one voxel, 3 floats per peak.
+///////////////////////////////////////////////////////////////////////////
+struct PeakSpan
+{
+    PeakSpan( const float *pData, unsigned int size )
+    :   m_pData( pData ),
+        m_size( size )
+    {
+    }
+
+    const float & operator[]( unsigned int i ) const { return m_pData[i]; }
+    unsigned int  size() const                       { return m_size; }
+    unsigned int  nbPeaks() const                    { return m_size / 3; }
+
+    const float  *m_pData;
+    unsigned int  m_size;
+};
+
 class Maximas : public Glyph
 {
 public:
@@ -20,7 +39,9 @@ public:
     virtual ~Maximas();
     bool save( wxXmlNode *pNode, const wxString &rootPath ) const;
 
-    std::vector< std::vector<float> > *getMainDirData()                       { return &m_mainDirections;           };
+    // Peaks are stored contiguously, m_bands floats per voxel.
+    unsigned int getNbPeakVoxels() const                  { return m_bands > 0 ? m_mainDirections.size() / m_bands : 0; }
+    PeakSpan     getPeaks( unsigned int voxel ) const     { return PeakSpan( &m_mainDirections[voxel * m_bands], m_bands ); }
 
     // From DatasetInfo
     bool load( nifti_image *pHeader, nifti_image *pBody );
@@ -44,7 +65,7 @@ private:
     void drawGlyph        ( int i_zVoxel, int i_yVoxel, int i_xVoxel, AxisType i_axis );
     void setScalingFactor( float i_scalingFactor );
     
-    std::vector<std::vector<float> >   m_mainDirections;
+    std::vector< float >   m_mainDirections;
     std::vector< float > l_fileFloatData;
     DISPLAY m_displayType;
     int m_dataType;
@@ -0,0 +1,86 @@
+#include "NiftiFile.h"
+
+#include "../Logger.h"
+
+#include <string>
+
+NiftiFile::NiftiFile()
+:   m_pImage( NULL )
+{
+}
+
+NiftiFile::~NiftiFile()
+{
+    close();
+}
+
+bool NiftiFile::open( const wxString &filename )
+{
+    close();
+
+    // Get std::string from wxString.
+    // This avoids problems between different compiler versions.
+    std::string filename_str = std::string( filename.mb_str() );
+
+    m_pImage = nifti_image_read( filename_str.c_str(), 0 );
+    if( NULL == m_pImage )
+    {
+        return false;
+    }
+
+    if( mapBody( filename ) )
+    {
+        return true;
+    }
+
+    if( nifti_image_load( m_pImage ) < 0 )
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void NiftiFile::close()
+{
+    if( NULL != m_pImage )
+    {
+        // The mapped data is not owned by the image.
+        if( m_file.isOpen() )
+        {
+            m_pImage->data = NULL;
+        }
+        nifti_image_free( m_pImage );
+        m_pImage = NULL;
+    }
+    m_file.close();
+}
+
+bool NiftiFile::mapBody( const wxString &filename )
+{
+    if( NIFTI_FTYPE_NIFTI1_1 != m_pImage->nifti_type
+        || nifti_is_gzfile( m_pImage->iname )
+        || nifti_short_order() != m_pImage->byteorder
+        || m_pImage->nbyper <= 0
+        || m_pImage->iname_offset < 0
+        || 0 != m_pImage->iname_offset % m_pImage->nbyper )
+    {
+        return false;
+    }
+
+    if( !m_file.open( filename ) )
+    {
+        return false;
+    }
+
+    const std::size_t bodySize = m_pImage->nvox * m_pImage->nbyper;
+    if( m_file.getSize() < m_pImage->iname_offset + bodySize )
+    {
+        Logger::getInstance()->print( wxT( "nifti file is shorter than its header says" ), LOGLEVEL_WARNING );
+        m_file.close();
+        return false;
+    }
+
+    m_pImage->data = const_cast< char * >( m_file.getData() + m_pImage->iname_offset );
+    return true;
+}
@@ -0,0 +1,69 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            NiftiFile.h
+//
+// Description: Reads a nifti image, header and body, in a single pass.
+//
+// Uncompressed single file images (.nii) in host byte order are memory
+// mapped and the image data points into the mapping, so the body is never
+// copied before the datasets convert it. Other images (.nii.gz, .hdr/.img,
+// swapped byte order) are read once by nifti_image_load, which inflates
+// straight into the image buffer.
+//
+// The data of a mapped image is read-only.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef NIFTIFILE_H_
+#define NIFTIFILE_H_
+
+#include "../misc/MappedFile.h"
+#include "../misc/nifti/nifti1_io.h"
+
+#include <wx/string.h>
+
+#include <cstddef>
+
+class NiftiFile
+{
+public:
+    NiftiFile();
+    ~NiftiFile();
+
+    bool open( const wxString &filename );
+    void close();
+
+    nifti_image * getImage() const { return m_pImage; }
+    bool          isMapped() const { return m_file.isOpen(); }
+
+    // Nifti stores 4D images volume by volume. Copies pSrc, bands volumes of
+    // voxels values, into pDst, voxel by voxel, converting each value to U.
+    // The writes are sequential, the reads of every band are left to the
+    // prefetcher, which did better than tiling the copy.
+    template< typename T, typename U >
+    static void interleaveBands( const T *pSrc, int voxels, int bands, U *pDst );
+
+private:
+    NiftiFile( const NiftiFile & );             // Not copyable
+    NiftiFile & operator=( const NiftiFile & );
+
+    bool mapBody( const wxString &filename );
+
+    nifti_image *m_pImage;
+    MappedFile   m_file;
+};
+
+template< typename T, typename U >
+void NiftiFile::interleaveBands( const T *pSrc, int voxels, int bands, U *pDst )
+{
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( static )
+#endif
+    for( int i = 0; i < voxels; ++i )
+    {
+        U *pVoxel = pDst + static_cast< std::size_t >( i ) * bands;
+        for( int j = 0; j < bands; ++j )
+        {
+            pVoxel[j] = static_cast< U >( pSrc[static_cast< std::size_t >( j ) * voxels + i] );
+        }
+    }
+}
+
+#endif //NIFTIFILE_H_
@@ -12,6 +12,7 @@
 #include "ODFs.h"
 
 #include "DatasetManager.h"
+#include "NiftiFile.h"
 #include "../Logger.h"
 #include "../gfx/ShaderHelper.h"
 #include "../gui/MyListCtrl.h"
@@ -167,13 +168,7 @@ bool ODFs::load( nifti_image *pHeader, nifti_image *pBody )
     std::vector< float > l_fileFloatData( l_nSize * m_bands );
 
     // We need to do a bit of moving around with the data in order to have it like we want.
-    for( int i( 0 ); i < l_nSize; ++i )
-    {
-        for( int j( 0 ); j < m_bands; ++j )
-        {
-            l_fileFloatData[i * m_bands + j] = l_data[j * l_nSize + i];
-        }
-    }
+    NiftiFile::interleaveBands( l_data, l_nSize, m_bands, &l_fileFloatData[0] );
 
     // Once the file has been read successfully, we need to create the structure 
     // that will contain all the sphere points representing the ODFs.
@@ -1316,14 +1311,8 @@ complex< float > ODFs::getSphericalHarmonic( int i_l, int i_m, float i_theta, fl
 */
 void ODFs::changeShBasis( SH_BASIS basis )
 {
-    // Get std::string from wxString.
-    // This avoids problems between different compiler versions.
-    std::string fullpath_str = std::string(m_fullPath.mb_str());
-
-    nifti_image *pHeader = nifti_image_read( fullpath_str.c_str(), 0 );
-    nifti_image *pBody   = nifti_image_read( fullpath_str.c_str(), 1 );
-
-    if( NULL == pHeader || NULL == pBody )
+    NiftiFile niftiFile;
+    if( !niftiFile.open( m_fullPath ) )
     {
         Logger::getInstance()->print( wxT( "nifti file corrupt, cannot create nifti image from header" ), LOGLEVEL_ERROR );
         return;
@@ -1332,14 +1321,11 @@ void ODFs::changeShBasis( SH_BASIS basis )
     ODFs tmp( m_fullPath );
     tmp.setShBasis( basis );
 
-    if( tmp.load( pHeader, pBody ) )
+    if( tmp.load( niftiFile.getImage(), niftiFile.getImage() ) )
     {
         swap( tmp );
         updatePropertiesSizer();
     }
-
-    nifti_image_free( pHeader );
-    nifti_image_free( pBody );
 }
 ///////////////////////////////////////////////////////////////////////////
 // This function will set a specific scaling factor for the glyph.
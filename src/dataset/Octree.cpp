@@ -2,27 +2,43 @@
 
 #include "DatasetManager.h"
 #include "../Logger.h"
-#include "../gui/SelectionObject.h"
-#include "../gui/SelectionVOI.h"
 
 #include <algorithm>
 #include <vector>
 using std::vector;
 
+unsigned int Octree::s_lastGeneration = 0;
+
 //////////////////////////////////////////
 /*Constructor*/
 //////////////////////////////////////////
-Octree::Octree( int lvl, const std::vector< float > &pointArray, int nb )
-:   m_level(lvl),
+Octree::Octree( const std::vector< float > &pointArray, int nb, int maxDepth, int leafCapacity )
+:   m_maxDepth(maxDepth),
+    m_leafCapacity(leafCapacity),
     m_countPoints(nb),
-    m_pointArray(pointArray)    
+    m_pointArray(pointArray),
+    m_generation(nextGeneration())
 {
     Logger::getInstance()->print( wxT( "Building Octree..." ), LOGLEVEL_MESSAGE );
     
     findBoundingBox();
     classifyPoints();
     
-    Logger::getInstance()->print( wxT( "Octree done" ), LOGLEVEL_MESSAGE );
+    Logger::getInstance()->print( wxString::Format( wxT( "Octree done (%u nodes)" ), (unsigned int)m_nodes.size() ), LOGLEVEL_MESSAGE );
+}
+
+//////////////////////////////////////////
+//Generations are unique across all the octrees. Fibers may be loaded
+//in parallel (batch mode), so the counter is shared between threads.
+//////////////////////////////////////////
+unsigned int Octree::nextGeneration()
+{
+    unsigned int generation;
+#ifdef _OPENMP
+    #pragma omp critical( OctreeGeneration )
+#endif
+    generation = ++s_lastGeneration;
+    return generation;
 }
 
 //////////////////////////////////////////
@@ -37,172 +53,118 @@ Octree::~Octree()
 //////////////////////////////////////////
 void Octree::findBoundingBox()
 {
-    m_maxPointX = m_pointArray[0];
-    m_maxPointY = m_pointArray[1];
-    m_maxPointZ = m_pointArray[2];
-
-    m_minPointX = m_pointArray[0];
-    m_minPointY = m_pointArray[1];
-    m_minPointZ = m_pointArray[2];
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        m_min[axis] = m_countPoints > 0 ? m_pointArray[axis] : 0.0f;
+        m_max[axis] = m_min[axis];
+    }
 
     //Find the bounding box for the dataSet
     for(int i=0; i < m_countPoints; i++)
     {
-        if(m_pointArray[i*3] > m_maxPointX)
-            m_maxPointX = m_pointArray[i*3];
-
-        if(m_pointArray[i*3+1] > m_maxPointY)
-            m_maxPointY = m_pointArray[i*3+1];
-
-        if(m_pointArray[i*3+2] > m_maxPointZ)
-            m_maxPointZ = m_pointArray[i*3+2];
-
-        if(m_pointArray[i*3] < m_minPointX)
-            m_minPointX = m_pointArray[i*3];
-
-        if(m_pointArray[i*3+1] < m_minPointY)
-            m_minPointY = m_pointArray[i*3+1];
-
-        if(m_pointArray[i*3+2] < m_minPointZ)
-            m_minPointZ = m_pointArray[i*3+2];
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            m_min[axis] = std::min( m_min[axis], m_pointArray[i*3 + axis] );
+            m_max[axis] = std::max( m_max[axis], m_pointArray[i*3 + axis] );
+        }
     }
 }
 
 //////////////////////////////////////////
-//Classify points from a dataset into specifics octree divisions
-// front:   in front of XY plane
-// back:    behind XY plane
-// bottom:  under XZ plane
-// up:      over XZ plane
-// left:    left of YZ plane
-// right:   right of YZ plane
+//Classify points from a dataset into the octree nodes
 /////////////////////////////////////////
 void Octree::classifyPoints()
 {
-    vector<int> bigVolume1;
-    vector<int> bigVolume2;
-    vector<int> bigVolume3;
-    vector<int> bigVolume4;
-    vector<int> bigVolume5;
-    vector<int> bigVolume6;
-    vector<int> bigVolume7;
-    vector<int> bigVolume8;
-
-    //Cutting planes
-    float midX = (m_maxPointX + m_minPointX) / 2.0f;
-    float midY = (m_maxPointY + m_minPointY) / 2.0f;
-    float midZ = (m_maxPointZ + m_minPointZ) / 2.0f;
+    m_nodes.clear();
+    m_indices.resize( m_countPoints );
 
-    float posX, posY, posZ;
-        
-    //fill the tree 
-    for(int i=0; i < m_countPoints; i++)
+    if( m_countPoints == 0 )
     {
-        posX = m_pointArray[i*3];
-        posY = m_pointArray[i*3+1];
-        posZ = m_pointArray[i*3+2];
-         
-        if(posX <= midX && posY <= midY && posZ <= midZ)  //front bottom left   
-            bigVolume1.push_back(i);
-
-        else if(posX <= midX && posY > midY && posZ <= midZ) //front up left
-            bigVolume2.push_back(i);    
-
-        else if(posX > midX && posY <= midY && posZ <= midZ) //front bottom right
-            bigVolume3.push_back(i);  
-
-        else if(posX > midX && posY > midY && posZ <= midZ) //front up right
-            bigVolume4.push_back(i);
+        return;
+    }
 
-        else if(posX <= midX && posY <= midY && posZ > midZ) //back bottom left
-            bigVolume5.push_back(i);
-    
-        else if(posX <= midX && posY > midY && posZ > midZ) //back up left
-            bigVolume6.push_back(i);
-   
-        else if(posX > midX && posY <= midY && posZ > midZ) //back bottom right
-            bigVolume7.push_back(i);
-
-        else //back up right
-            bigVolume8.push_back(i);
+    for( int i = 0; i < m_countPoints; ++i )
+    {
+        m_indices[i] = i;
     }
-    
-    //Split each of the 8 boxes, into 8miniboxes
-    subClassifyPoints( bigVolume1, m_minPointX, m_minPointY, m_minPointZ, midX, midY, midZ, m_quad1 ); //front bottom left 
-    subClassifyPoints( bigVolume2, m_minPointX, midY, m_minPointZ, midX, m_maxPointY, midZ, m_quad2 ); //front up left
-    subClassifyPoints( bigVolume3, midX, m_minPointY, m_minPointZ, m_maxPointX, midY, midZ, m_quad3 ); //front bottom right
-    subClassifyPoints( bigVolume4, midX, midY, m_minPointZ, m_maxPointX, m_maxPointY, midZ, m_quad4 ); //front up right
-    subClassifyPoints( bigVolume5, m_minPointX, m_minPointY, midZ, midX, midY, m_maxPointZ, m_quad5 ); //back bottom left
-    subClassifyPoints( bigVolume6, m_minPointX, midY, midZ, midX, m_maxPointY, m_maxPointZ, m_quad6 ); //back up left
-    subClassifyPoints( bigVolume7, midX, m_minPointY, midZ, m_maxPointX, midY, m_maxPointZ, m_quad7 ); //back bottom right
-    subClassifyPoints( bigVolume8 ,midX, midY, midZ, m_maxPointX, m_maxPointY, m_maxPointZ, m_quad8 ); //back up right
 
+    std::vector< int > scratch( m_countPoints );
+    m_nodes.push_back( Node( 0, m_countPoints ) );
+    subdivide( 0, m_min, m_max, 0, scratch );
 }
 
 //////////////////////////////////////////
-//Subdivide the space
+//Splits a node in 8 and sorts its points by child,
+//then does the same for the children
 //////////////////////////////////////////
-void Octree::subClassifyPoints( vector<int> i_bigVolume, int i_xmin, int i_ymin, int i_zmin, int i_xmax, int i_ymax, int i_zmax, vector<vector<int > >& o_tree )
+void Octree::subdivide( int nodeIdx, const float *pMin, const float *pMax, int depth, std::vector< int > &scratch )
 {
-    vector<int> volume1;
-    vector<int> volume2;
-    vector<int> volume3;
-    vector<int> volume4;
-    vector<int> volume5;
-    vector<int> volume6;
-    vector<int> volume7;
-    vector<int> volume8;
-
-    //Cuting planes
-    float midX = (i_xmax + i_xmin) / 2.0f;
-    float midY = (i_ymax + i_ymin) / 2.0f;
-    float midZ = (i_zmax + i_zmin) / 2.0f;
-
-    float posX,posY,posZ;
-    int indice;
-        
-    //fill the tree 
-    for(unsigned int i=0; i < i_bigVolume.size(); i++)
+    const int begin = m_nodes[nodeIdx].m_begin;
+    const int end   = m_nodes[nodeIdx].m_end;
+
+    if( end - begin <= m_leafCapacity || depth >= m_maxDepth )
     {
-        indice = i_bigVolume[i];
-        posX = m_pointArray[indice*3];
-        posY = m_pointArray[indice*3+1];
-        posZ = m_pointArray[indice*3+2];
-         
-        if(posX <= midX && posY <= midY && posZ <= midZ)  //front bottom left   
-            volume1.push_back(indice);
+        return;
+    }
 
-        else if(posX <= midX && posY > midY && posZ <= midZ) //front up left
-            volume2.push_back(indice);    
+    //Cutting planes
+    float mid[3];
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        mid[axis] = ( pMin[axis] + pMax[axis] ) / 2.0f;
+    }
 
-        else if(posX > midX && posY <= midY && posZ <= midZ) //front bottom right
-            volume3.push_back(indice);  
+    int counts[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for( int i = begin; i < end; ++i )
+    {
+        ++counts[ getOctant( m_indices[i], mid ) ];
+    }
 
-        else if(posX > midX && posY > midY && posZ <= midZ) //front up right
-            volume4.push_back(indice);
+    int offsets[8];
+    offsets[0] = begin;
+    for( int o = 1; o < 8; ++o )
+    {
+        offsets[o] = offsets[o - 1] + counts[o - 1];
+    }
 
-        else if(posX <= midX && posY <= midY && posZ > midZ) //back bottom left
-            volume5.push_back(indice);
-    
-        else if(posX <= midX && posY > midY && posZ > midZ) //back up left
-            volume6.push_back(indice);
-   
-        else if(posX > midX && posY <= midY && posZ > midZ) //back bottom right
-            volume7.push_back(indice);
-
-        else //back up right
-            volume8.push_back(indice);
+    int next[8];
+    std::copy( offsets, offsets + 8, next );
+    for( int i = begin; i < end; ++i )
+    {
+        scratch[ next[ getOctant( m_indices[i], mid ) ]++ ] = m_indices[i];
     }
-    
-    o_tree.push_back(volume1);
-    o_tree.push_back(volume2);
-    o_tree.push_back(volume3);
-    o_tree.push_back(volume4);
-    o_tree.push_back(volume5);
-    o_tree.push_back(volume6);
-    o_tree.push_back(volume7);
-    o_tree.push_back(volume8);
+    std::copy( scratch.begin() + begin, scratch.begin() + end, m_indices.begin() + begin );
 
+    const int firstChild = m_nodes.size();
+    m_nodes[nodeIdx].m_firstChild = firstChild;
+    for( int o = 0; o < 8; ++o )
+    {
+        m_nodes.push_back( Node( offsets[o], offsets[o] + counts[o] ) );
+    }
+
+    for( int o = 0; o < 8; ++o )
+    {
+        float childMin[3];
+        float childMax[3];
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            bool isUpper = ( o >> axis ) & 1;
+            childMin[axis] = isUpper ? mid[axis]  : pMin[axis];
+            childMax[axis] = isUpper ? pMax[axis] : mid[axis];
+        }
+        subdivide( firstChild + o, childMin, childMax, depth + 1, scratch );
+    }
+}
+
+//////////////////////////////////////////
+//Child of a node containing a point:
+//bit 0 right of YZ plane, bit 1 over XZ plane, bit 2 behind XY plane
+//////////////////////////////////////////
+int Octree::getOctant( int pointIdx, const float *pMid ) const
+{
+    return   ( m_pointArray[pointIdx*3]     > pMid[0] ? 1 : 0 )
+           | ( m_pointArray[pointIdx*3 + 1] > pMid[1] ? 2 : 0 )
+           | ( m_pointArray[pointIdx*3 + 2] > pMid[2] ? 4 : 0 );
 }
 
 //////////////////////////////////////////
@@ -210,37 +172,10 @@ void Octree::subClassifyPoints( vector<int> i_bigVolume, int i_xmin, int i_ymin,
 //////////////////////////////////////////
 vector<int> Octree::getPointsInside( SelectionObject* i_selectionObject )
 {
-    Vector l_center = i_selectionObject->getCenter();
-    Vector l_size   = i_selectionObject->getSize();
-
-    m_boxMin.resize( 3 );
-    m_boxMax.resize( 3 );
-
-    float voxelX = DatasetManager::getInstance()->getVoxelX();
-    float voxelY = DatasetManager::getInstance()->getVoxelY();
-    float voxelZ = DatasetManager::getInstance()->getVoxelZ();
-
-    m_boxMin[0] = l_center.x - l_size.x / 2 * voxelX;
-    m_boxMax[0] = l_center.x + l_size.x / 2 * voxelX;
-    m_boxMin[1] = l_center.y - l_size.y / 2 * voxelY;
-    m_boxMax[1] = l_center.y + l_size.y / 2 * voxelY;
-    m_boxMin[2] = l_center.z - l_size.z / 2 * voxelZ;
-    m_boxMax[2] = l_center.z + l_size.z / 2 * voxelZ;
-    
-    m_id.clear();
-    if(i_selectionObject->getSelectionType() == BOX_TYPE)
-        boxTest( m_minPointX, m_minPointY, m_minPointZ, m_maxPointX, m_maxPointY, m_maxPointZ, 0, m_quad1 );
-    else  if( i_selectionObject->getSelectionType() == ELLIPSOID_TYPE )
-    {
-        ellipsoidTest( m_minPointX, m_minPointY, m_minPointZ, m_maxPointX, m_maxPointY, m_maxPointZ, 0, m_quad1 );
-    }
-    else
-    {
-        VOITest( m_minPointX, m_minPointY, m_minPointZ, m_maxPointX, m_maxPointY, m_maxPointZ, 0, m_quad1, i_selectionObject );
-    }
+    m_query.setObject( i_selectionObject );
+    query();
 
     return m_id;
-
 }
 
 //////////////////////////////////////////
@@ -249,217 +184,65 @@ vector<int> Octree::getPointsInside( SelectionObject* i_selectionObject )
 //////////////////////////////////////////
 vector< int > Octree::getPointsInBoundingBox( int xMin, int yMin, int zMin, int xMax, int yMax, int zMax )
 {
-    m_id.clear();
-    m_boxMin.resize( 3 );
-    m_boxMax.resize( 3 );
-    
     float voxelX = DatasetManager::getInstance()->getVoxelX();
     float voxelY = DatasetManager::getInstance()->getVoxelY();
     float voxelZ = DatasetManager::getInstance()->getVoxelZ();
 
-    m_boxMin[0] = xMin * voxelX;
-    m_boxMin[1] = yMin * voxelY;
-    m_boxMin[2] = zMin * voxelZ;
-    m_boxMax[0] = xMax * voxelX;
-    m_boxMax[1] = yMax * voxelY;
-    m_boxMax[2] = zMax * voxelZ;
+    float boxMin[3] = { xMin * voxelX, yMin * voxelY, zMin * voxelZ };
+    float boxMax[3] = { xMax * voxelX, yMax * voxelY, zMax * voxelZ };
     
-    boxTest( m_minPointX, m_minPointY, m_minPointZ, m_maxPointX, m_maxPointY, m_maxPointZ, 0, m_quad1 );
+    m_query.setBox( boxMin, boxMax );
+    query();
     
     return m_id;
 }
 
-void Octree::flipX()
-{
-    std::swap( m_quad1, m_quad3 );
-    std::swap( m_quad2, m_quad4 );
-    std::swap( m_quad5, m_quad7 );
-    std::swap( m_quad6, m_quad8 );
-    
-    flipXInternalVector( m_quad1 );
-    flipXInternalVector( m_quad2 );
-    flipXInternalVector( m_quad3 );
-    flipXInternalVector( m_quad4 );
-    flipXInternalVector( m_quad5 );
-    flipXInternalVector( m_quad6 );
-    flipXInternalVector( m_quad7 );
-    flipXInternalVector( m_quad8 );
-}
-
-void Octree::flipY()
-{
-    std::swap( m_quad1, m_quad2 );
-    std::swap( m_quad3, m_quad4 );
-    std::swap( m_quad5, m_quad6 );
-    std::swap( m_quad7, m_quad8 );
-    
-    flipYInternalVector( m_quad1 );
-    flipYInternalVector( m_quad2 );
-    flipYInternalVector( m_quad3 );
-    flipYInternalVector( m_quad4 );
-    flipYInternalVector( m_quad5 );
-    flipYInternalVector( m_quad6 );
-    flipYInternalVector( m_quad7 );
-    flipYInternalVector( m_quad8 );
-}
-
-void Octree::flipZ()
-{
-    std::swap( m_quad1, m_quad5 );
-    std::swap( m_quad3, m_quad7 );
-    std::swap( m_quad2, m_quad6 );
-    std::swap( m_quad4, m_quad8 );
-    
-    flipZInternalVector( m_quad1 );
-    flipZInternalVector( m_quad2 );
-    flipZInternalVector( m_quad3 );
-    flipZInternalVector( m_quad4 );
-    flipZInternalVector( m_quad5 );
-    flipZInternalVector( m_quad6 );
-    flipZInternalVector( m_quad7 );
-    flipZInternalVector( m_quad8 );
-}
-
-void Octree::flipXInternalVector( vector< vector< int > > &vectToFlip )
-{
-    std::swap( vectToFlip[0], vectToFlip[2] );
-    std::swap( vectToFlip[1], vectToFlip[3] );
-    std::swap( vectToFlip[4], vectToFlip[6] );
-    std::swap( vectToFlip[5], vectToFlip[7] );
-}
-
-void Octree::flipYInternalVector( vector< vector< int > > &vectToFlip )
-{
-    std::swap( vectToFlip[0], vectToFlip[1] );
-    std::swap( vectToFlip[2], vectToFlip[3] );
-    std::swap( vectToFlip[4], vectToFlip[5] );
-    std::swap( vectToFlip[6], vectToFlip[7] );
-}
-
-void Octree::flipZInternalVector( vector< vector< int > > &vectToFlip )
-{
-    std::swap( vectToFlip[0], vectToFlip[4] );
-    std::swap( vectToFlip[2], vectToFlip[6] );
-    std::swap( vectToFlip[1], vectToFlip[5] );
-    std::swap( vectToFlip[3], vectToFlip[7] );
-}
-
 //////////////////////////////////////////
-// BOX case
+// A \ B is cut in at most 6 disjoint slabs: the points of A
+// below or above B along x, then those within B along x but
+// below or above it along y, then the same along z. Each slab
+// is a box query followed by a strict test on its axis.
 //////////////////////////////////////////
-void Octree::boxTest( int i_minx, int i_miny, int i_minz, int i_maxx, int i_maxy, int i_maxz, int lvl, const vector<vector<int > >& currSub )
+void Octree::getPointsInBoxDifference( const float *pMinA, const float *pMaxA, 
+                                       const float *pMinB, const float *pMaxB, 
+                                       std::vector< int > &o_points )
 {
-    if(lvl == 2)
-        return;
-
-    int indice;
-
-    //Box extremities
-    float xMin = m_boxMin[0];
-    float xMax = m_boxMax[0];
-    float yMin = m_boxMin[1];
-    float yMax = m_boxMax[1];
-    float zMin = m_boxMin[2];
-    float zMax = m_boxMax[2];
-
-    //Octree planes cutting
-    float midX = (i_maxx + i_minx)  / 2.0f;
-    float midY = (i_maxy + i_miny) / 2.0f;
-    float midZ = (i_maxz + i_minz) / 2.0f;
-    
-
-    //Checks in which Octree the selection Box is
-    vector<bool> inBoxes(8, false);
-
-    if(xMin < midX && xMax > i_minx)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[0] = true;
-                boxTest( i_minx, i_miny, i_minz, midX, midY, midZ, lvl+1, m_quad1 ); // Front Bottom Left
-
-            }
-
-   if(xMin < midX && xMax > i_minx)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[1] = true;
-                boxTest( i_minx, midY, i_minz, midX, i_maxy, midZ, lvl+1, m_quad2 ); //Front Up Left
-            }
-
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[2] = true;
-                boxTest( midX, i_miny, i_minz, i_maxx, midY, midZ, lvl+1, m_quad3 ); //Front Bottom Right
-            }
+    o_points.clear();
 
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < midZ && zMax > i_minz)
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        for( int side = 0; side < 2; ++side )
+        {
+            float slabMin[3];
+            float slabMax[3];
+            for( int a = 0; a < 3; ++a )
             {
-                inBoxes[3] = true;
-                boxTest( midX, midY, i_minz, i_maxx, i_maxy, midZ, lvl+1, m_quad4 ); //Front Up Right
+                slabMin[a] = a < axis ? std::max( pMinA[a], pMinB[a] ) : pMinA[a];
+                slabMax[a] = a < axis ? std::min( pMaxA[a], pMaxB[a] ) : pMaxA[a];
             }
-
-    if(xMin < midX && xMax > i_minx)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < i_maxz && zMax > midZ)
+            if( side == 0 )
             {
-                inBoxes[4] = true;
-                boxTest( i_minx, i_miny, midZ, midX, midY, i_maxz, lvl+1, m_quad5); //Back Bottom Left
+                slabMax[axis] = std::min( pMaxA[axis], pMinB[axis] );
             }
-
-    if(xMin < midX && xMax > i_minx)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < i_maxz && zMax > midZ)
+            else
             {
-                inBoxes[5] = true;
-                boxTest( i_minx, midY, midZ, midX, i_maxy, i_maxz, lvl+1, m_quad6 ); //Back Up Left
+                slabMin[axis] = std::max( pMinA[axis], pMaxB[axis] );
             }
 
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < i_maxz && zMax > midZ)
+            if( slabMin[0] > slabMax[0] || slabMin[1] > slabMax[1] || slabMin[2] > slabMax[2] )
             {
-                inBoxes[6] = true;
-                boxTest(midX, i_miny, midZ, i_maxx, midY, i_maxz, lvl+1, m_quad7 ); //Back Bottom Right
-
+                continue;
             }
 
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < i_maxz && zMax > midZ)
-            {
-                inBoxes[7] = true;
-                boxTest(midX, midY , midZ, i_maxx, i_maxy, i_maxz, lvl+1, m_quad8 ); //Back up Right
-            }  
+            m_query.setBox( slabMin, slabMax );
+            query();
 
-    if(lvl == 1)
-    {
-        float posX,posY,posZ;
-        //Checks if any fibers are INSIDE the selection box, for Octree regions that are TRUE
-        for(unsigned int k=0; k < inBoxes.size(); k++)
-        {
-            if(inBoxes[k])
+            for( unsigned int i = 0; i < m_id.size(); ++i )
             {
-                for(unsigned int i = 0; i < currSub[k].size(); i++)
+                float pos = m_pointArray[m_id[i] * 3 + axis];
+                if( side == 0 ? pos < pMinB[axis] : pos > pMaxB[axis] )
                 {
-                    indice = currSub[k][i];
-                    posX = m_pointArray[indice*3];
-                    posY = m_pointArray[indice*3+1];
-                    posZ = m_pointArray[indice*3+2];
-
-
-                    if(posX <= m_boxMax[0] && posX >= m_boxMin[0] && 
-                       posY <= m_boxMax[1] && posY >= m_boxMin[1] &&
-                       posZ <= m_boxMax[2] && posZ >= m_boxMin[2] ) //If INTO the box
-                    {
-                        m_id.push_back(indice);
-                    }
-           
+                    o_points.push_back( m_id[i] );
                 }
             }
         }
@@ -467,252 +250,118 @@ void Octree::boxTest( int i_minx, int i_miny, int i_minz, int i_maxx, int i_maxy
 }
 
 //////////////////////////////////////////
-//ELLIPSOID case
+// The fibers are mirrored around the center of the volume
+// (see Fibers::flipAxis), so is the tree.
 //////////////////////////////////////////
-void Octree::ellipsoidTest( int i_minx, int i_miny, int i_minz, int i_maxx, int i_maxy, int i_maxz, int lvl, const vector<vector<int > >& currSub )
+void Octree::flipX()
 {
-    if(lvl == 2)
-        return;
-
-    int indice;
-
-    //Box extremities
-    float xMin = m_boxMin[0];
-    float xMax = m_boxMax[0];
-    float yMin = m_boxMin[1];
-    float yMax = m_boxMax[1];
-    float zMin = m_boxMin[2];
-    float zMax = m_boxMax[2];
-
-    //Octree planes cutting
-    float midX = (i_maxx + i_minx)  / 2.0f;
-    float midY = (i_maxy + i_miny) / 2.0f;
-    float midZ = (i_maxz + i_minz) / 2.0f;
-    
-
-    //Checks in which Octree the selection Box is 
-    vector<bool> inBoxes(8, false);
-
-    if(xMin < midX && xMax > i_minx)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[0] = true;
-                boxTest( i_minx, i_miny, i_minz, midX, midY, midZ, lvl+1, m_quad1 ); // Front Bottom Left
+    DatasetManager *pDatMan = DatasetManager::getInstance();
+    flip( 0, pDatMan->getColumns() * pDatMan->getVoxelX() / 2.0f );
+}
 
-            }
+void Octree::flipY()
+{
+    DatasetManager *pDatMan = DatasetManager::getInstance();
+    flip( 1, pDatMan->getRows() * pDatMan->getVoxelY() / 2.0f );
+}
 
-   if(xMin < midX && xMax > i_minx)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[1] = true;
-                boxTest( i_minx, midY, i_minz, midX, i_maxy, midZ, lvl+1, m_quad2 ); //Front Up Left
-            }
+void Octree::flipZ()
+{
+    DatasetManager *pDatMan = DatasetManager::getInstance();
+    flip( 2, pDatMan->getFrames() * pDatMan->getVoxelZ() / 2.0f );
+}
 
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[2] = true;
-                boxTest( midX, i_miny, i_minz, i_maxx, midY, midZ, lvl+1, m_quad3 ); //Front Bottom Right
-            }
+//////////////////////////////////////////
+// Mirrors the root bounds and swaps the lower and upper
+// children of every node along axis.
+//////////////////////////////////////////
+void Octree::flip( int axis, float axisShift )
+{
+    m_generation = nextGeneration();
 
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[3] = true;
-                boxTest( midX, midY, i_minz, i_maxx, i_maxy, midZ, lvl+1, m_quad4 ); //Front Up Right
-            }
+    float oldMin = m_min[axis];
+    m_min[axis] = 2.0f * axisShift - m_max[axis];
+    m_max[axis] = 2.0f * axisShift - oldMin;
 
-    if(xMin < midX && xMax > i_minx)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < i_maxz && zMax > midZ)
+    const int bit = 1 << axis;
+    for( unsigned int i = 0; i < m_nodes.size(); ++i )
+    {
+        const int firstChild = m_nodes[i].m_firstChild;
+        if( firstChild < 0 )
+        {
+            continue;
+        }
+        for( int o = 0; o < 8; ++o )
+        {
+            if( !( o & bit ) )
             {
-                inBoxes[4] = true;
-                boxTest( i_minx, i_miny, midZ, midX, midY, i_maxz, lvl+1, m_quad5 ); //Back Bottom Left
+                std::swap( m_nodes[firstChild + o], m_nodes[firstChild + ( o | bit )] );
             }
+        }
+    }
+}
 
-    if(xMin < midX && xMax > i_minx)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < i_maxz && zMax > midZ)
-            {
-                inBoxes[5] = true;
-                boxTest( i_minx, midY, midZ, midX, i_maxy, i_maxz, lvl+1, m_quad6 ); //Back Up Left
-            }
+//////////////////////////////////////////
+// Fills m_id with the points inside the current query
+//////////////////////////////////////////
+void Octree::query()
+{
+    m_id.clear();
+    if( !m_nodes.empty() )
+    {
+        queryNode( 0, m_min, m_max );
+    }
+}
 
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < i_maxz && zMax > midZ)
-            {
-                inBoxes[6] = true;
-                boxTest( midX, i_miny, midZ, i_maxx, midY, i_maxz, lvl+1, m_quad7 ); //Back Bottom Right
+void Octree::queryNode( int nodeIdx, const float *pMin, const float *pMax )
+{
+    //Does the node overlap the bounding box of the selection? Points lying
+    //on the cutting planes may be in either child, hence the inclusive test.
+    if( !m_query.overlaps( pMin, pMax ) )
+    {
+        return;
+    }
 
-            }
+    const Node &node = m_nodes[nodeIdx];
 
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < i_maxz && zMax > midZ)
-            {
-                inBoxes[7] = true;
-                boxTest( midX, midY ,midZ, i_maxx, i_maxy, i_maxz, lvl+1, m_quad8 ); //Back up Right
-            }  
+    if( m_query.contains( pMin, pMax ) )
+    {
+        m_id.insert( m_id.end(), m_indices.begin() + node.m_begin, m_indices.begin() + node.m_end );
+        return;
+    }
 
-    if(lvl == 1)
+    if( node.m_firstChild < 0 )
     {
-        float posX,posY,posZ;
-        float l_axisRadius  = ( m_boxMax[0]  - m_boxMin[0] ) / 2.0f;
-        float l_axis1Radius = ( m_boxMax[1] - m_boxMin[1] ) / 2.0f;
-        float l_axis2Radius = ( m_boxMax[2] - m_boxMin[2] ) / 2.0f;
-        float l_axisCenter  = m_boxMax[0]  - l_axisRadius;
-        float l_axis1Center = m_boxMax[1] - l_axis1Radius;
-        float l_axis2Center = m_boxMax[2] - l_axis2Radius;
-
-        //Checks if any fibers are INSIDE the selection box, for Octree regions that are TRUE
-        for(unsigned int k=0; k < inBoxes.size(); k++)
+        //Checks if any fibers are INSIDE the selection
+        for( int i = node.m_begin; i < node.m_end; ++i )
         {
-            if(inBoxes[k])
+            int indice = m_indices[i];
+            if( m_query.contains( m_pointArray[indice*3], m_pointArray[indice*3+1], m_pointArray[indice*3+2] ) )
             {
-                for(unsigned int i = 0; i < currSub[k].size(); i++)
-                {
-                    indice = currSub[k][i];
-                    posX = m_pointArray[indice*3];
-                    posY = m_pointArray[indice*3+1];
-                    posZ = m_pointArray[indice*3+2];
-
-                    if( (posX  - l_axisCenter)*(posX  - l_axisCenter) / ( l_axisRadius  * l_axisRadius  ) + 
-                        (posY - l_axis1Center)*(posY - l_axis1Center) / ( l_axis1Radius * l_axis1Radius ) + 
-                        (posZ - l_axis2Center)*(posZ - l_axis2Center) / ( l_axis2Radius * l_axis2Radius ) <= 1.0f )
-                    {
-                        m_id.push_back(indice);
-                    }
-                }
+                m_id.push_back( indice );
             }
         }
+        return;
     }
-}
 
-//////////////////////////////////////////
-// VOI case
-//////////////////////////////////////////
-void Octree::VOITest( int i_minx, int i_miny, int i_minz, 
-                     int i_maxx, int i_maxy, int i_maxz, 
-                     int lvl, const vector<vector<int > >& currSub,
-                     SelectionObject *pSelObj )
-{
-    if(lvl == 2)
-        return;
-    
-    int indice;
-    
-    //Box extremities
-    float xMin = m_boxMin[0];
-    float xMax = m_boxMax[0];
-    float yMin = m_boxMin[1];
-    float yMax = m_boxMax[1];
-    float zMin = m_boxMin[2];
-    float zMax = m_boxMax[2];
-    
     //Octree planes cutting
-    float midX = (i_maxx + i_minx) / 2.0f;
-    float midY = (i_maxy + i_miny) / 2.0f;
-    float midZ = (i_maxz + i_minz) / 2.0f;
-    
-    
-    //Checks in which Octree the selection Box is 
-    vector<bool> inBoxes(8, false);
-    
-    if(xMin < midX && xMax > i_minx)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[0] = true;
-                VOITest( i_minx, i_miny, i_minz, midX, midY, midZ, lvl+1, m_quad1, pSelObj ); // Front Bottom Left
-                
-            }
-    
-    if(xMin < midX && xMax > i_minx)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[1] = true;
-                VOITest( i_minx, midY, i_minz, midX, i_maxy, midZ, lvl+1, m_quad2, pSelObj ); //Front Up Left
-            }
-    
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[2] = true;
-                VOITest( midX, i_miny, i_minz, i_maxx, midY, midZ, lvl+1, m_quad3, pSelObj ); //Front Bottom Right
-            }
-    
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < midZ && zMax > i_minz)
-            {
-                inBoxes[3] = true;
-                VOITest( midX, midY, i_minz, i_maxx, i_maxy, midZ, lvl+1, m_quad4, pSelObj ); //Front Up Right
-            }
-    
-    if(xMin < midX && xMax > i_minx)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < i_maxz && zMax > midZ)
-            {
-                inBoxes[4] = true;
-                VOITest( i_minx, i_miny, midZ, midX, midY, i_maxz, lvl+1, m_quad5, pSelObj ); //Back Bottom Left
-            }
-    
-    if(xMin < midX && xMax > i_minx)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < i_maxz && zMax > midZ)
-            {
-                inBoxes[5] = true;
-                VOITest( i_minx, midY, midZ, midX, i_maxy, i_maxz, lvl+1, m_quad6, pSelObj ); //Back Up Left
-            }
-    
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < midY && yMax > i_miny)
-            if(zMin < i_maxz && zMax > midZ)
-            {
-                inBoxes[6] = true;
-                VOITest( midX, i_miny, midZ, i_maxx, midY, i_maxz, lvl+1, m_quad7, pSelObj ); //Back Bottom Right
-                
-            }
-    
-    if(xMin < i_maxx && xMax > midX)
-        if(yMin < i_maxy && yMax > midY)
-            if(zMin < i_maxz && zMax > midZ)
-            {
-                inBoxes[7] = true;
-                VOITest( midX, midY ,midZ, i_maxx, i_maxy, i_maxz, lvl+1, m_quad8, pSelObj ); //Back up Right
-            }  
-    
-    SelectionVOI *pSelVOI = (SelectionVOI*)pSelObj;
-    if(lvl == 1)
+    float mid[3];
+    for( int axis = 0; axis < 3; ++axis )
     {
-        float posX,posY,posZ;
-        
-        //Checks if any fibers are INSIDE the selection box, for Octree regions that are TRUE
-        for( unsigned int k( 0 ); k < inBoxes.size(); ++k)
+        mid[axis] = ( pMin[axis] + pMax[axis] ) / 2.0f;
+    }
+
+    const int firstChild = node.m_firstChild;
+    for( int o = 0; o < 8; ++o )
+    {
+        float childMin[3];
+        float childMax[3];
+        for( int axis = 0; axis < 3; ++axis )
         {
-            if( inBoxes[k] )
-            {
-                for(unsigned int i = 0; i < currSub[k].size(); i++)
-                {
-                    indice = currSub[k][i];
-                    
-                    posX = m_pointArray[indice*3];
-                    posY = m_pointArray[indice*3+1];
-                    posZ = m_pointArray[indice*3+2];
-                    
-                    if( pSelVOI->isPointInside( posX, posY, posZ ) )
-                    {
-                        m_id.push_back(indice);
-                    }
-                }
-            }
+            bool isUpper = ( o >> axis ) & 1;
+            childMin[axis] = isUpper ? mid[axis]  : pMin[axis];
+            childMax[axis] = isUpper ? pMax[axis] : mid[axis];
         }
+        queryNode( firstChild + o, childMin, childMax );
     }
-}
\ No newline at end of file
+}
@@ -5,12 +5,17 @@
 //
 // Description: Octree class.
 //
-//The implementation is "Hardcoded" for a level 2 Octree so far
-//and further ameliorations will be made for recursion.
+// Adaptive octree over the fiber points. A node is split in 8 until it holds
+// at most m_leafCapacity points or the maximum depth is reached. Nodes live in
+// a single array, the 8 children of a node being contiguous. The point indices
+// are sorted so that every node covers a contiguous range of m_indices
+// (Morton order at the leaf level).
 /////////////////////////////////////////////////////////////////////////////
 #ifndef OCTREE_H_
 #define OCTREE_H_
 
+#include "SelectionQuery.h"
+
 #include <vector>
 
 using std::vector;
@@ -20,12 +25,25 @@ class SelectionObject;
 class Octree 
 {
 public:
-    Octree( int lvl, const std::vector< float > &pointArray, int nb ); //Constructor
+    static const int DEFAULT_MAX_DEPTH     = 10;
+    static const int DEFAULT_LEAF_CAPACITY = 128;
+
+    Octree( const std::vector< float > &pointArray, int nb, 
+            int maxDepth = DEFAULT_MAX_DEPTH, int leafCapacity = DEFAULT_LEAF_CAPACITY ); //Constructor
     ~Octree(); //Destructor
 
     //Functions
     std::vector< int > getPointsInside( SelectionObject* selectionObject );
     std::vector< int > getPointsInBoundingBox( int xMin, int yMin, int zMin, int xMax, int yMax, int zMax );
+
+    // Points inside box A but not inside box B, bounds in mm and inclusive.
+    void getPointsInBoxDifference( const float *pMinA, const float *pMaxA, 
+                                   const float *pMinB, const float *pMaxB, 
+                                   std::vector< int > &o_points );
+
+    // Changes every time the points move (flips), results kept
+    // from an older generation are stale.
+    unsigned int getGeneration() const { return m_generation; }
     
     // Updates the data to represent the fiber structure when fibers are flipped.
     void flipX();
@@ -33,46 +51,47 @@ public:
     void flipZ();
 
 private:
-    //Octree divisions
-    std::vector< std::vector<int> > m_quad1; 
-    std::vector< std::vector<int> > m_quad2;
-    std::vector< std::vector<int> > m_quad3;
-    std::vector< std::vector<int> > m_quad4;
-    std::vector< std::vector<int> > m_quad5;
-    std::vector< std::vector<int> > m_quad6;
-    std::vector< std::vector<int> > m_quad7;
-    std::vector< std::vector<int> > m_quad8;
+    struct Node
+    {
+        Node( int begin, int end )
+        :   m_firstChild( -1 ),
+            m_begin( begin ),
+            m_end( end )
+        {
+        }
+
+        int m_firstChild; // Index of the first of the 8 children, -1 for a leaf.
+        int m_begin;      // Range of the node's points in m_indices.
+        int m_end;
+    };
+
+    std::vector< Node > m_nodes;   //Root is m_nodes[0]
+    std::vector< int >  m_indices; //Points, grouped by node
 
     std::vector<int> m_id; //Points selected
 
-    int m_level;  //Lvl of subdivision
-    int m_countPoints; //Nb of points from dataset
-    float m_maxPointX; //Quad corner
-    float m_maxPointY; //Quad corner
-    float m_maxPointZ; //Quad corner
-    float m_minPointX; //Quad corner
-    float m_minPointY; //Quad corner
-    float m_minPointZ; //Quad corner
+    int m_maxDepth;     //Max lvl of subdivision
+    int m_leafCapacity; //Nb of points under which a node is not split
+    int m_countPoints;  //Nb of points from dataset
+    float m_min[3];     //Root corner
+    float m_max[3];     //Root corner
     const std::vector< float > &m_pointArray; // Points (x,y,z)
-    std::vector< float > m_boxMax; //SelectionObject
-    std::vector< float > m_boxMin; //SelectionObject
+
+    SelectionQuery m_query; //Current query
+
+    unsigned int m_generation;
+    static unsigned int s_lastGeneration;
+    static unsigned int nextGeneration();
     
     void findBoundingBox(); //BB of the points
-    void classifyPoints(); //Classify the points according to their position
-    void subClassifyPoints( std::vector<int> i_bigVolume, int i_xmin, int i_ymin, int i_zmin, int i_xmax, int i_ymax, int i_zmax, std::vector< std::vector<int > > &o_tree); //Subclassify for lvl 2
-    
-    void flipXInternalVector( std::vector< std::vector< int > > &vectToFlip );
-    void flipYInternalVector( std::vector< std::vector< int > > &vectToFlip );
-    void flipZInternalVector( std::vector< std::vector< int > > &vectToFlip );
-    
-    void boxTest( int i_minx, int i_miny, int i_minz, int i_maxx, int i_maxy, int i_maxz, int lvl, const std::vector< std::vector<int > > &currSub);
-    void ellipsoidTest( int i_minx, int i_miny, int i_minz, int i_maxx, int i_maxy, int i_maxz, int lvl, const std::vector< std::vector<int > > &currSub);
+    void classifyPoints();  //Builds the tree
+    void subdivide( int nodeIdx, const float *pMin, const float *pMax, int depth, std::vector< int > &scratch );
+    int  getOctant( int pointIdx, const float *pMid ) const;
 
-    void VOITest( int i_minx, int i_miny, int i_minz, 
-                 int i_maxx, int i_maxy, int i_maxz,
-                 int lvl, const vector< vector< int > > &currSub, 
-                 SelectionObject *pSelObj );
-    
+    void flip( int axis, float axisShift );
+
+    void query();
+    void queryNode( int nodeIdx, const float *pMin, const float *pMax );
 };
 
 #endif /*OCTREE_H_*/
@@ -0,0 +1,141 @@
+#include "PackedTensorField.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const size_t CACHE_LINE = 64;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////////////////////////////
+PackedTensorField::PackedTensorField()
+:   m_pData( NULL ),
+    m_nbVoxels( 0 ),
+    m_columns( 0 ),
+    m_rows( 0 ),
+    m_frames( 0 ),
+    m_invVoxelX( 1.0f ),
+    m_invVoxelY( 1.0f ),
+    m_invVoxelZ( 1.0f )
+{
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Copies the tensors of a Tensors dataset into the packed layout.
+///////////////////////////////////////////////////////////////////////////
+void PackedTensorField::build( const std::vector< FMatrix > &matrices, const std::vector< float > &fa, const std::vector< F::FVector > &eigenValues,
+                               int columns, int rows, int frames, float voxelX, float voxelY, float voxelZ )
+{
+    clear();
+
+    m_columns   = columns;
+    m_rows      = rows;
+    m_frames    = frames;
+    m_invVoxelX = 1.0f / voxelX;
+    m_invVoxelY = 1.0f / voxelY;
+    m_invVoxelZ = 1.0f / voxelZ;
+
+    m_nbVoxels = std::min( matrices.size(), std::min( fa.size(), eigenValues.size() ) );
+
+    // Over-allocate by one cache line so the first voxel can be aligned on one.
+    m_storage.assign( m_nbVoxels * STRIDE + CACHE_LINE / sizeof( float ), 0.0f );
+    size_t misalignment = reinterpret_cast< size_t >( &m_storage[0] ) % CACHE_LINE;
+    m_pData = &m_storage[0] + ( misalignment == 0 ? 0 : ( CACHE_LINE - misalignment ) / sizeof( float ) );
+
+    for( size_t i = 0; i < m_nbVoxels; ++i )
+    {
+        float *pVoxel = m_pData + i * STRIDE;
+
+        for( unsigned int r = 0; r < 3; ++r )
+        {
+            for( unsigned int c = 0; c < 3; ++c )
+            {
+                pVoxel[MATRIX + r * 3 + c] = (float)matrices[i]( r, c );
+            }
+        }
+
+        pVoxel[FA] = fa[i];
+
+        pVoxel[EIGENVALUES]     = (float)eigenValues[i][0];
+        pVoxel[EIGENVALUES + 1] = (float)eigenValues[i][1];
+        pVoxel[EIGENVALUES + 2] = (float)eigenValues[i][2];
+        std::sort( pVoxel + EIGENVALUES, pVoxel + EIGENVALUES + 3 );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+void PackedTensorField::clear()
+{
+    std::vector< float >().swap( m_storage );
+    m_pData    = NULL;
+    m_nbVoxels = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Trilinear interpolation of the tensor matrix at (fx,fy,fz), in mm.
+// The 9 interpolated values are written in pMatrix.
+///////////////////////////////////////////////////////////////////////////
+void PackedTensorField::interpolate( float fx, float fy, float fz, float *pMatrix ) const
+{
+    using std::min;
+    using std::max;
+
+    const float gx = fx * m_invVoxelX;
+    const float gy = fy * m_invVoxelY;
+    const float gz = fz * m_invVoxelZ;
+
+    const int x = max( min( (int)std::floor( gx ), m_columns - 1 ), 0 );
+    const int y = max( min( (int)std::floor( gy ), m_rows - 1 ),    0 );
+    const int z = max( min( (int)std::floor( gz ), m_frames - 1 ),  0 );
+
+    const float dx = gx - x;
+    const float dy = gy - y;
+    const float dz = gz - z;
+
+    const int nx = dx > 0.0f ? min( x + 1, m_columns - 1 ) : x;
+    const int ny = dy > 0.0f ? min( y + 1, m_rows - 1 )    : y;
+    const int nz = dz > 0.0f ? min( z + 1, m_frames - 1 )  : z;
+
+    const size_t slice = (size_t)m_columns * m_rows;
+    const float *p000 = at( z  * slice + y  * m_columns + x  );
+    const float *p100 = at( z  * slice + y  * m_columns + nx );
+    const float *p010 = at( z  * slice + ny * m_columns + x  );
+    const float *p110 = at( z  * slice + ny * m_columns + nx );
+    const float *p001 = at( nz * slice + y  * m_columns + x  );
+    const float *p101 = at( nz * slice + y  * m_columns + nx );
+    const float *p011 = at( nz * slice + ny * m_columns + x  );
+    const float *p111 = at( nz * slice + ny * m_columns + nx );
+
+    const float w000 = ( 1 - dx ) * ( 1 - dy ) * ( 1 - dz );
+    const float w100 = dx         * ( 1 - dy ) * ( 1 - dz );
+    const float w010 = ( 1 - dx ) * dy         * ( 1 - dz );
+    const float w110 = dx         * dy         * ( 1 - dz );
+    const float w001 = ( 1 - dx ) * ( 1 - dy ) * dz;
+    const float w101 = dx         * ( 1 - dy ) * dz;
+    const float w011 = ( 1 - dx ) * dy         * dz;
+    const float w111 = dx         * dy         * dz;
+
+    for( unsigned int i = MATRIX; i < MATRIX + 9; ++i )
+    {
+        pMatrix[i - MATRIX] = w000 * p000[i] + w100 * p100[i] + w010 * p010[i] + w110 * p110[i]
+                            + w001 * p001[i] + w101 * p101[i] + w011 * p011[i] + w111 * p111[i];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Returns the tensor matrix to use at pos, voxel being its index. When
+// interpolated, the matrix is computed in pBuffer (9 floats), otherwise the
+// stored matrix is returned directly.
+///////////////////////////////////////////////////////////////////////////
+const float *PackedTensorField::getMatrix( const Vector &pos, size_t voxel, bool interpolated, float *pBuffer ) const
+{
+    if( interpolated )
+    {
+        interpolate( pos.x, pos.y, pos.z, pBuffer );
+        return pBuffer;
+    }
+    return at( voxel ) + MATRIX;
+}
@@ -0,0 +1,60 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            PackedTensorField.h
+//
+// Description: Flat, cache aligned copy of a tensor field, as used by the
+// real-time DTI tracking.
+//
+// Each voxel is stored in one cache line: the 3x3 tensor matrix (row major,
+// as built by Tensors::setTensorInfo), the FA and the eigen values sorted in
+// ascending order. Lookups and interpolations write into caller-provided
+// arrays, so tracking a step never allocates.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef PACKEDTENSORFIELD_H_
+#define PACKEDTENSORFIELD_H_
+
+#include "../misc/Fantom/FMatrix.h"
+#include "../misc/Fantom/FVector.h"
+#include "../misc/IsoSurface/Vector.h"
+
+#include <cstddef>
+#include <vector>
+
+class PackedTensorField
+{
+public:
+    // Layout of a voxel, in floats.
+    static const unsigned int MATRIX      = 0;
+    static const unsigned int FA          = 9;
+    static const unsigned int EIGENVALUES = 10;
+    static const unsigned int STRIDE      = 16;
+
+    PackedTensorField();
+
+    void build( const std::vector< FMatrix > &matrices, const std::vector< float > &fa, const std::vector< F::FVector > &eigenValues,
+                int columns, int rows, int frames, float voxelX, float voxelY, float voxelZ );
+    void clear();
+
+    size_t       size() const                  { return m_nbVoxels; }
+    const float *at( size_t voxel ) const      { return m_pData + voxel * STRIDE; }
+
+    void         interpolate( float fx, float fy, float fz, float *pMatrix ) const;
+    const float *getMatrix( const Vector &pos, size_t voxel, bool interpolated, float *pBuffer ) const;
+
+private:
+    // Not copyable, m_pData points inside m_storage.
+    PackedTensorField( const PackedTensorField & );
+    PackedTensorField &operator=( const PackedTensorField & );
+
+    std::vector< float > m_storage;
+    float  *m_pData;
+    size_t  m_nbVoxels;
+
+    int   m_columns;
+    int   m_rows;
+    int   m_frames;
+    float m_invVoxelX;
+    float m_invVoxelY;
+    float m_invVoxelZ;
+};
+
+#endif /* PACKEDTENSORFIELD_H_ */
@@ -17,15 +17,27 @@
 #include "../gui/MainFrame.h"
 #include "../misc/IsoSurface/CIsoSurface.h"
 #include "../misc/IsoSurface/TriangleMesh.h"
+#include "../misc/Profiler.h"
 
 
 #include <algorithm>
 using std::sort;
 
+#include <map>
+
 #include <vector>
 using std::vector;
 #include "../main.h"
 
+#include <wx/stopwatch.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Number of seeds handed at once to a tracking thread.
+static const size_t SEEDS_PER_CHUNK = 32;
+
 //////////////////////////////////////////
 //Constructor
 //////////////////////////////////////////
@@ -45,17 +57,17 @@ RTTFibers::RTTFibers()
 	m_alpha( 1.0f ),
     m_currentSeedBoxID( 0 ),
     m_isHARDI( false ),
-    m_countGMstep( 0 ),
-	m_stop( false ),
-    m_and( true ),
     m_pExcludeInfo( NULL ),
     m_pIncludeInfo( NULL ),
     m_pSeedMapInfo( NULL ),
     m_pGMInfo( NULL ),
-    m_render( true ),
-    m_steppedOnceInsideChildBox( false ),
-    m_steppedOnceIntoAND( false ),
-    m_prune(true)
+    m_and( true ),
+    m_nbThreads( 0 ),
+    m_nextSeed( 0 ),
+    m_uploadedPoints( 0 ),
+    m_uploadedColors( 0 ),
+    m_capacityPoints( 0 ),
+    m_capacityColors( 0 )
 {
     m_bufferObjectsRTT = new GLuint[2];
 }
@@ -104,6 +116,14 @@ Vector RTTFibers::generateRandomSeed( const Vector &min, const Vector &max )
 
     return Vector( seedX, seedY, seedZ );
 }
+
+///////////////////////////////////////////////////////////////////////////
+// Draws the random value used by pickDirection for one seed.
+///////////////////////////////////////////////////////////////////////////
+float RTTFibers::generateRandomDraft()
+{
+    return ( (float) rand() ) / (float) RAND_MAX;
+}
 ///////////////////////////////////////////////////////////////////////////
 // Returns the nb of vertices for shell seeding
 ///////////////////////////////////////////////////////////////////////////
@@ -147,8 +167,6 @@ void RTTFibers::clearFibersRTT()
     m_streamlinesColors.clear();
     m_streamlinesPoints.clear();
 
-    m_storedDir.clear();
-
     if( SceneManager::getInstance()->isUsingVBO() )
     {
         glDeleteBuffers( 2, m_bufferObjectsRTT );
@@ -159,15 +177,155 @@ void RTTFibers::clearFibersRTT()
     m_lines = 0;
     m_linePointer.clear();
     m_linePointer.push_back(0);
+
+    m_pendingSeeds.clear();
+    m_nextSeed = 0;
+    m_uploadedPoints = 0;
+    m_uploadedColors = 0;
+    m_capacityPoints = 0;
+    m_capacityColors = 0;
 }
 ///////////////////////////////////////////////////////////////////////////
 // Generate seeds and tracks
 ///////////////////////////////////////////////////////////////////////////
 void RTTFibers::seed()
+{
+    track();
+
+    renderRTTFibers(true, false, false);
+	
+	RTTrackingHelper::getInstance()->setRTTDirty( false );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Generates the seeds and tracks all of them, without any rendering.
+///////////////////////////////////////////////////////////////////////////
+void RTTFibers::track()
+{
+    PROFILE_SCOPE( "RTTFibers::track" );
+
+    clearFibersRTT();
+
+    std::vector< RTTSeed > seeds;
+    generateSeeds( seeds );
+
+    wxStopWatch watch;
+    trackSeeds( seeds, 0, seeds.size() );
+    long elapsed = watch.Time();
+
+    // Every stored point is one tracking step.
+    unsigned int nbSteps = m_streamlinesPoints.size() / 3;
+    PROFILE_COUNT( "RTT steps", nbSteps );
+    Logger::getInstance()->print( wxString::Format( wxT( "RTT: %u steps in %ld ms (%.0f steps/s)" ), nbSteps, elapsed, elapsed > 0 ? 1000.0 * nbSteps / elapsed : 0.0 ), LOGLEVEL_DEBUG );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Starts an incremental tracking: the seeds are generated now and tracked
+// by trackNextBatch(), a few at a time, during the following frames.
+///////////////////////////////////////////////////////////////////////////
+void RTTFibers::startProgressiveSeed()
 {
     clearFibersRTT();
-    int previousLinePointer = 0;
-	 
+
+    generateSeeds( m_pendingSeeds );
+
+    if( SceneManager::getInstance()->isUsingVBO() )
+    {
+        glGenBuffers( 2, m_bufferObjectsRTT );
+        RTTrackingHelper::getInstance()->setBufferID( m_bufferObjectsRTT[0] );
+    }
+
+    RTTrackingHelper::getInstance()->setRTTDirty( false );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Drops the seeds that are not tracked yet. The streamlines already tracked
+// are kept.
+///////////////////////////////////////////////////////////////////////////
+void RTTFibers::stopProgressiveSeed()
+{
+    m_pendingSeeds.clear();
+    m_nextSeed = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Tracks pending seeds until the time budget (in ms) is spent, then appends
+// the new streamlines to the VBOs, if they are used. At least one round of
+// seeds is tracked per call so the tracking always progresses.
+//
+// Returns true if seeds are still pending.
+///////////////////////////////////////////////////////////////////////////
+bool RTTFibers::trackNextBatch( long budget )
+{
+    PROFILE_SCOPE( "RTTFibers::trackNextBatch" );
+
+    if( !isTrackingInProgress() )
+    {
+        return false;
+    }
+
+    // One round keeps every thread busy with one chunk.
+    const size_t roundSize = getNbTrackingThreads() * SEEDS_PER_CHUNK;
+
+    wxStopWatch watch;
+    long lastRoundTime = 0;
+    while( m_nextSeed < m_pendingSeeds.size() && watch.Time() + lastRoundTime <= budget )
+    {
+        long roundStart = watch.Time();
+        size_t last = std::min( m_nextSeed + roundSize, m_pendingSeeds.size() );
+        trackSeeds( m_pendingSeeds, m_nextSeed, last );
+        m_nextSeed = last;
+        lastRoundTime = watch.Time() - roundStart;
+    }
+
+    if( SceneManager::getInstance()->isUsingVBO() )
+    {
+        appendToBuffer( m_bufferObjectsRTT[0], m_streamlinesPoints, m_uploadedPoints, m_capacityPoints );
+        appendToBuffer( m_bufferObjectsRTT[1], m_streamlinesColors, m_uploadedColors, m_capacityColors );
+    }
+
+    if( !isTrackingInProgress() )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "RTT: %u streamlines tracked from %u seeds" ), (unsigned int)m_lines, (unsigned int)m_pendingSeeds.size() ), LOGLEVEL_DEBUG );
+        m_pendingSeeds.clear();
+        m_nextSeed = 0;
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Uploads the part of data that is not yet in the buffer object. The buffer
+// grows geometrically, in which case its whole content is uploaded again.
+///////////////////////////////////////////////////////////////////////////
+void RTTFibers::appendToBuffer( GLuint bufferId, const std::vector< float > &data, size_t &uploaded, size_t &capacity )
+{
+    if( data.size() == uploaded )
+    {
+        return;
+    }
+
+    glBindBuffer( GL_ARRAY_BUFFER, bufferId );
+    if( data.size() > capacity )
+    {
+        capacity = std::max( data.size(), capacity * 2 );
+        glBufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * capacity, NULL, GL_DYNAMIC_DRAW );
+        glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof( GLfloat ) * data.size(), &data[0] );
+    }
+    else
+    {
+        glBufferSubData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * uploaded, sizeof( GLfloat ) * ( data.size() - uploaded ), &data[uploaded] );
+    }
+    uploaded = data.size();
+
+    Logger::getInstance()->printIfGLError( wxT( "RTTFibers::appendToBuffer" ) );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Generates the seeds for the current seeding mode.
+///////////////////////////////////////////////////////////////////////////
+void RTTFibers::generateSeeds( std::vector< RTTSeed > &seeds )
+{
     float xVoxel = DatasetManager::getInstance()->getVoxelX();
     float yVoxel = DatasetManager::getInstance()->getVoxelY();
     float zVoxel = DatasetManager::getInstance()->getVoxelZ();
@@ -177,6 +335,10 @@ void RTTFibers::seed()
 
     //test to optim
     float invertNbSeed = 1.0f / float( m_nbSeed - 1.0f ); 
+
+    // Seeds are generated first, in the order the serial tracking used to visit them.
+    // Random values are drawn here so that the tracking itself is deterministic.
+    bool randomInit = RTTrackingHelper::getInstance()->isRandomInit();
     
 	//Evenly distanced seeds
 	if( !RTTrackingHelper::getInstance()->isShellSeeds() && !RTTrackingHelper::getInstance()->isSeedMap() && !RTTrackingHelper::getInstance()->isSeedFromfMRI())
@@ -207,79 +369,12 @@ void RTTFibers::seed()
 				{
 					for( float z = minCorner.z; z < maxCorner.z + zstep*0.5f; z+= zstep )
 					{
-						vector<float> pointsF;
-                        vector<float> pointsB;
-                        vector<float> colorF;
-                        vector<float> colorB;
-
-                        bool draw;
-						m_stop = false;
-                        
-                        if(m_isHARDI)
-                        {
-                            Vector seed(x,y,z);
-                            if(RTTrackingHelper::getInstance()->isRandomInit())
-                            {
-                                seed = generateRandomSeed(minCorner,maxCorner);
-                            }
-						    //Track both sides
-							performHARDIRTT( seed,  1, pointsF, colorF); //First pass
-                            draw = m_render && m_and;
-						    performHARDIRTT( seed, -1, pointsB, colorB); //Second pass
-                        }
-                        else
+                        Vector seed(x,y,z);
+                        if( m_isHARDI && randomInit )
                         {
-						    //Track both sides
-						    performDTIRTT( Vector(x,y,z),  1, pointsF, colorF); //First pass
-						    performDTIRTT( Vector(x,y,z), -1, pointsB, colorB); //Second pass
+                            seed = generateRandomSeed(minCorner,maxCorner);
                         }
-                        
-						if( (pointsF.size() + pointsB.size())/3 * getStep() > getMinFiberLength() && (pointsF.size() + pointsB.size())/3 * getStep() < getMaxFiberLength() && (m_render || draw )&& (draw || m_and))
-						{
-                            bool keepRight = false;
-                            bool keepLeft = false;
-                            //Insert strategically for drawArray methods.
-                            if(pointsF.size() != 0)
-                            {
-                                m_nbPtsPerLine.push_back(pointsF.size()/3);
-                                m_linePointer.push_back(previousLinePointer + pointsF.size()/3);
-                                previousLinePointer = m_linePointer[m_lines+1];
-                                m_lines++;
-
-                                m_streamlinesPoints.insert(m_streamlinesPoints.end(), pointsF.begin(), pointsF.end());
-                                m_streamlinesColors.insert(m_streamlinesColors.end(), colorF.begin(), colorF.end());
-                                keepRight = true;
-                            }
-                            
-                            if(pointsB.size() != 0)
-                            {
-                                m_nbPtsPerLine.push_back(pointsB.size()/3);
-                                m_linePointer.push_back(previousLinePointer + pointsB.size()/3);
-                                previousLinePointer = m_linePointer[m_lines+1];
-                                m_lines++;
-
-                                m_streamlinesPoints.insert(m_streamlinesPoints.end(), pointsB.begin(), pointsB.end());
-                                m_streamlinesColors.insert(m_streamlinesColors.end(), colorB.begin(), colorB.end());
-                                keepLeft = true;
-                            }
-
-                            if(keepLeft && keepRight)
-                            {
-                                m_LeftRightVector.push_back(true);
-                                m_LeftRightVector.push_back(true);
-                            }
-                            else if(keepLeft || keepRight)
-                            {
-                                m_LeftRightVector.push_back(false);
-                            }
-
-                            if(RTTrackingHelper::getInstance()->isTractoDrivenRSN())
-                            {
-                                insertPointsForTractoDriven(pointsF, pointsB);
-                            }
-                            m_steppedOnceInsideChildBox = false;
-                            m_steppedOnceIntoAND = false;
-						}
+                        seeds.push_back( RTTSeed( seed, m_currentSeedBoxID, generateRandomDraft() ) );
 					}
 				}
 			}
@@ -309,80 +404,12 @@ void RTTFibers::seed()
 				{
 					for( float z = minCorner.z; z < maxCorner.z + zstep/2.0f; z+= zstep )
 					{
-						vector<float> pointsF;
-                        vector<float> pointsB;
-                        vector<float> colorF;
-                        vector<float> colorB;
-
-                        bool draw;
-						m_stop = false;
-                        
-                        if(m_isHARDI)
+                        Vector seed(x,y,z);
+                        if( m_isHARDI && randomInit )
                         {
-                            Vector seed(x,y,z);
-                            if(RTTrackingHelper::getInstance()->isRandomInit())
-                            {
-                                seed = generateRandomSeed(minCorner,maxCorner);
-                            }
-						    //Track both sides
-							performHARDIRTT( seed,  1, pointsF, colorF); //First pass
-                            draw = m_render && m_and;
-						    performHARDIRTT( seed, -1, pointsB, colorB); //Second pass
+                            seed = generateRandomSeed(minCorner,maxCorner);
                         }
-                        else
-                        {
-						    //Track both sides
-						    performDTIRTT( Vector(x,y,z),  1, pointsF, colorF); //First pass
-						    performDTIRTT( Vector(x,y,z), -1, pointsB, colorB); //Second pass
-                        }
-                        
-						if( (pointsF.size() + pointsB.size())/3 * getStep() > getMinFiberLength() && (pointsF.size() + pointsB.size())/3 * getStep() < getMaxFiberLength() && (m_render || draw )&& (draw || m_and))
-						{
-                            bool keepRight = false;
-                            bool keepLeft = false;
-                            //Insert strategically for drawArray methods.
-                            if(pointsF.size() != 0)
-                            {
-                                m_nbPtsPerLine.push_back(pointsF.size()/3);
-                                m_linePointer.push_back(previousLinePointer + pointsF.size()/3);
-                                previousLinePointer = m_linePointer[m_lines+1];
-                                m_lines++;
-
-                                m_streamlinesPoints.insert(m_streamlinesPoints.end(), pointsF.begin(), pointsF.end());
-                                m_streamlinesColors.insert(m_streamlinesColors.end(), colorF.begin(), colorF.end());
-                                keepRight = true;
-                            }
-                            
-                            if(pointsB.size() != 0)
-                            {
-                                m_nbPtsPerLine.push_back(pointsB.size()/3);
-                                m_linePointer.push_back(previousLinePointer + pointsB.size()/3);
-                                previousLinePointer = m_linePointer[m_lines+1];
-                                m_lines++;
-
-                                
-                                m_streamlinesPoints.insert(m_streamlinesPoints.end(), pointsB.begin(), pointsB.end());
-                                m_streamlinesColors.insert(m_streamlinesColors.end(), colorB.begin(), colorB.end());
-                                keepLeft = true;
-                            }
-
-                            if(keepLeft && keepRight)
-                            {
-                                m_LeftRightVector.push_back(true);
-                                m_LeftRightVector.push_back(true);
-                            }
-                            else if(keepLeft || keepRight)
-                            {
-                                m_LeftRightVector.push_back(false);
-                            }
-
-                            if(RTTrackingHelper::getInstance()->isTractoDrivenRSN())
-                            {
-                                insertPointsForTractoDriven(pointsF, pointsB);
-                            }
-                            m_steppedOnceInsideChildBox = false;
-                            m_steppedOnceIntoAND = false;
-						}
+                        seeds.push_back( RTTSeed( seed, m_currentSeedBoxID, generateRandomDraft() ) );
 					}
 				}
 			}
@@ -411,80 +438,12 @@ void RTTFibers::seed()
 				{
 					for( float z = zz - zVoxel; z < zz + zVoxel + zstep/2.0f; z+= zstep )
 					{
-                        vector<float> pointsF;
-                        vector<float> pointsB;
-                        vector<float> colorF;
-                        vector<float> colorB;
-
-                        bool draw;
-						m_stop = false;
-                        
-						if(m_isHARDI)
-						{
-                            Vector seed(x,y,z);
-                            if(RTTrackingHelper::getInstance()->isRandomInit())
-                            {
-                                seed = generateRandomSeed(minCorner,maxCorner);
-                            }
-						    //Track both sides
-							performHARDIRTT( seed,  1, pointsF, colorF); //First pass
-                            draw = m_render && m_and;
-						    performHARDIRTT( seed, -1, pointsB, colorB); //Second pass
-						}
-						else
-						{
-							//Track both sides
-							performDTIRTT( Vector(x,y,z),  1, pointsF, colorF); //First pass
-							performDTIRTT( Vector(x,y,z), -1, pointsB, colorB); //Second pass
-						}
-                        
-						if( (pointsF.size() + pointsB.size())/3 * getStep() > getMinFiberLength() && (pointsF.size() + pointsB.size())/3 * getStep() < getMaxFiberLength() && (m_render || draw ) && (draw || m_and))
-						{
-                            bool keepRight = false;
-                            bool keepLeft = false;
-                            //Insert strategically for drawArray methods.
-                            if(pointsF.size() != 0)
-                            {
-                                m_nbPtsPerLine.push_back(pointsF.size()/3);
-                                m_linePointer.push_back(previousLinePointer + pointsF.size()/3);
-                                previousLinePointer = m_linePointer[m_lines+1];
-                                m_lines++;
-
-                                m_streamlinesPoints.insert(m_streamlinesPoints.end(), pointsF.begin(), pointsF.end());
-                                m_streamlinesColors.insert(m_streamlinesColors.end(), colorF.begin(), colorF.end());
-                                keepRight = true;
-                            }
-                            
-                            if(pointsB.size() != 0)
-                            {
-                                m_nbPtsPerLine.push_back(pointsB.size()/3);
-                                m_linePointer.push_back(previousLinePointer + pointsB.size()/3);
-                                previousLinePointer = m_linePointer[m_lines+1];
-                                m_lines++;
-
-                                
-                                m_streamlinesPoints.insert(m_streamlinesPoints.end(), pointsB.begin(), pointsB.end());
-                                m_streamlinesColors.insert(m_streamlinesColors.end(), colorB.begin(), colorB.end());
-                                keepLeft = true;
-                            }
-
-                            if(keepLeft && keepRight)
-                            {
-                                m_LeftRightVector.push_back(true);
-                                m_LeftRightVector.push_back(true);
-                            }
-                            else if(keepLeft || keepRight)
-                            {
-                                m_LeftRightVector.push_back(false);
-                            }
-
-                            if(RTTrackingHelper::getInstance()->isTractoDrivenRSN())
-                            {
-                                insertPointsForTractoDriven(pointsF, pointsB);
-                            }
-                            m_steppedOnceInsideChildBox = false;
-                            m_steppedOnceIntoAND = false;
-						}
+                        Vector seed(x,y,z);
+                        if( m_isHARDI && randomInit )
+                        {
+                            seed = generateRandomSeed(minCorner,maxCorner);
+                        }
+                        seeds.push_back( RTTSeed( seed, m_currentSeedBoxID, generateRandomDraft() ) );
 					}
 				}
 			}
@@ -502,89 +461,176 @@ void RTTFibers::seed()
 
             for ( size_t k = 0; k < positions.size(); ++k )
             {
-                vector<float> pointsF;
-                vector<float> pointsB;
-                vector<float> colorF;
-                vector<float> colorB;
+                seeds.push_back( RTTSeed( Vector(positions[k].x,positions[k].y,positions[k].z), m_currentSeedBoxID, generateRandomDraft() ) );
+            }
+        }
+	}
+}
 
-                bool draw;
-				m_stop = false;
-                        
-                if(m_isHARDI)
-                {
-					//Track both sides
-					performHARDIRTT( Vector(positions[k].x,positions[k].y,positions[k].z),  1, pointsF, colorF); //First pass
-                    draw = m_render && m_and;
-					performHARDIRTT( Vector(positions[k].x,positions[k].y,positions[k].z), -1, pointsB, colorB); //Second pass
-                }
-                else
-                {
-					//Track both sides
-					performDTIRTT( Vector(positions[k].x,positions[k].y,positions[k].z),  1, pointsF, colorF); //First pass
-					performDTIRTT( Vector(positions[k].x,positions[k].y,positions[k].z), -1, pointsB, colorB); //Second pass
-                }
-                        
-				if( (pointsF.size() + pointsB.size())/3 * getStep() > getMinFiberLength() && (pointsF.size() + pointsB.size())/3 * getStep() < getMaxFiberLength() && (m_render || draw) && (draw || m_and))
-				{
-                    bool keepRight = false;
-                    bool keepLeft = false;
-                    //Insert strategically for drawArray methods.
-                    if(pointsF.size() != 0)
-                    {
-                        m_nbPtsPerLine.push_back(pointsF.size()/3);
-                        m_linePointer.push_back(previousLinePointer + pointsF.size()/3);
-                        previousLinePointer = m_linePointer[m_lines+1];
-                        m_lines++;
-
-                        m_streamlinesPoints.insert(m_streamlinesPoints.end(), pointsF.begin(), pointsF.end());
-                        m_streamlinesColors.insert(m_streamlinesColors.end(), colorF.begin(), colorF.end());
-                        keepRight = true;
-                    }
-                            
-                    if(pointsB.size() != 0)
-                    {
-                        m_nbPtsPerLine.push_back(pointsB.size()/3);
-                        m_linePointer.push_back(previousLinePointer + pointsB.size()/3);
-                        previousLinePointer = m_linePointer[m_lines+1];
-                        m_lines++;
-
-                        m_streamlinesPoints.insert(m_streamlinesPoints.end(), pointsB.begin(), pointsB.end());
-                        m_streamlinesColors.insert(m_streamlinesColors.end(), colorB.begin(), colorB.end());
-                        keepLeft = true;
-                    }
+///////////////////////////////////////////////////////////////////////////
+// Number of threads effectively used to track the seeds.
+///////////////////////////////////////////////////////////////////////////
+int RTTFibers::getNbTrackingThreads() const
+{
+#ifdef _OPENMP
+    return m_nbThreads > 0 ? m_nbThreads : omp_get_num_procs();
+#else
+    return 1;
+#endif
+}
 
-                    if(keepLeft && keepRight)
-                    {
-                        m_LeftRightVector.push_back(true);
-                        m_LeftRightVector.push_back(true);
-                    }
-                    else if(keepLeft || keepRight)
-                    {
-                        m_LeftRightVector.push_back(false);
-                    }
+///////////////////////////////////////////////////////////////////////////
+// Tracks the seeds in [first, last) and appends the accepted streamlines
+// to the buffers.
+//
+// Seeds are grouped in fixed size chunks that are handed to the threads on
+// demand, since the streamline lengths vary a lot from one seed to another.
+// Each chunk is filled by a single thread, and chunks are merged back in seed
+// order, so the result does not depend on the number of threads used.
+///////////////////////////////////////////////////////////////////////////
+void RTTFibers::trackSeeds( const std::vector< RTTSeed > &seeds, size_t first, size_t last )
+{
+    // The selection tree is not safe to query from the tracking threads,
+    // fetch the children of every seed box once.
+    std::map< int, std::vector< SelectionObject* > > childrenPerBox;
+    for( size_t i = first; i < last; ++i )
+    {
+        int boxId = seeds[i].m_seedBoxId;
+        if( boxId != 0 && childrenPerBox.find( boxId ) == childrenPerBox.end() )
+        {
+            childrenPerBox[boxId] = SceneManager::getInstance()->getSelectionTree().getDirectChildrenObjects( boxId );
+        }
+    }
 
-                    if(RTTrackingHelper::getInstance()->isTractoDrivenRSN())
-                    {
-                        insertPointsForTractoDriven(pointsF, pointsB);
-                    }
-                    m_steppedOnceInsideChildBox = false;
-                    m_steppedOnceIntoAND = false;
-				}
+    const int nbChunks = static_cast<int>( ( last - first + SEEDS_PER_CHUNK - 1 ) / SEEDS_PER_CHUNK );
+    std::vector< SeedChunk > chunks( nbChunks );
+
+#ifdef _OPENMP
+    #pragma omp parallel num_threads( getNbTrackingThreads() )
+#endif
+    {
+        // Per thread scratch buffers, reused from one seed to the next.
+        SeedScratch scratch;
+        RTTTrackState state;
+
+#ifdef _OPENMP
+        #pragma omp for schedule( dynamic, 1 )
+#endif
+        for( int c = 0; c < nbChunks; ++c )
+        {
+            size_t chunkFirst = first + static_cast<size_t>( c ) * SEEDS_PER_CHUNK;
+            size_t chunkLast  = std::min( chunkFirst + SEEDS_PER_CHUNK, last );
+
+            for( size_t s = chunkFirst; s < chunkLast; ++s )
+            {
+                std::map< int, std::vector< SelectionObject* > >::const_iterator it = childrenPerBox.find( seeds[s].m_seedBoxId );
+                state.reset( m_and, seeds[s].m_random, it != childrenPerBox.end() ? &it->second : NULL );
+                trackSeed( seeds[s], state, scratch, chunks[c] );
             }
         }
-	}
-    renderRTTFibers(true, false, false);
-	
-	RTTrackingHelper::getInstance()->setRTTDirty( false );
+    }
+
+    // Merge the chunks, in order. No exact reserve here: the progressive
+    // tracking merges every batch, and the vectors must keep growing geometrically.
+    int previousLinePointer = m_linePointer.back();
+    for( int c = 0; c < nbChunks; ++c )
+    {
+        const SeedChunk &chunk = chunks[c];
+        for( size_t l = 0; l < chunk.m_nbPtsPerLine.size(); ++l )
+        {
+            m_nbPtsPerLine.push_back( chunk.m_nbPtsPerLine[l] );
+            m_linePointer.push_back( previousLinePointer + chunk.m_nbPtsPerLine[l] );
+            previousLinePointer = m_linePointer[m_lines+1];
+            m_lines++;
+        }
+        m_streamlinesPoints.insert( m_streamlinesPoints.end(), chunk.m_points.begin(), chunk.m_points.end() );
+        m_streamlinesColors.insert( m_streamlinesColors.end(), chunk.m_colors.begin(), chunk.m_colors.end() );
+        m_LeftRightVector.insert( m_LeftRightVector.end(), chunk.m_leftRight.begin(), chunk.m_leftRight.end() );
+
+        for( size_t l = 0; l < chunk.m_tractoDrivenF.size(); ++l )
+        {
+            insertPointsForTractoDriven( chunk.m_tractoDrivenF[l], chunk.m_tractoDrivenB[l] );
+        }
+    }
 }
 
-    
+///////////////////////////////////////////////////////////////////////////
+// Tracks a single seed in both directions and appends the resulting
+// streamline to the chunk if it is accepted.
+///////////////////////////////////////////////////////////////////////////
+void RTTFibers::trackSeed( const RTTSeed &seed, RTTTrackState &state, SeedScratch &scratch, SeedChunk &chunk )
+{
+    vector<float> &pointsF = scratch.m_pointsF;
+    vector<float> &pointsB = scratch.m_pointsB;
+    vector<float> &colorF  = scratch.m_colorF;
+    vector<float> &colorB  = scratch.m_colorB;
+    pointsF.clear();
+    pointsB.clear();
+    colorF.clear();
+    colorB.clear();
+
+    bool draw = true;
+
+    if(m_isHARDI)
+    {
+        //Track both sides
+        performHARDIRTT( seed.m_pos,  1, pointsF, colorF, state ); //First pass
+        draw = state.m_render && state.m_and;
+        performHARDIRTT( seed.m_pos, -1, pointsB, colorB, state ); //Second pass
+    }
+    else
+    {
+        //Track both sides
+        performDTIRTT( seed.m_pos,  1, pointsF, colorF ); //First pass
+        performDTIRTT( seed.m_pos, -1, pointsB, colorB ); //Second pass
+    }
+
+    if( (pointsF.size() + pointsB.size())/3 * getStep() > getMinFiberLength() && (pointsF.size() + pointsB.size())/3 * getStep() < getMaxFiberLength() && (state.m_render || draw ) && (draw || state.m_and))
+    {
+        bool keepRight = false;
+        bool keepLeft = false;
+        //Insert strategically for drawArray methods.
+        if(pointsF.size() != 0)
+        {
+            chunk.m_nbPtsPerLine.push_back(pointsF.size()/3);
+            chunk.m_points.insert(chunk.m_points.end(), pointsF.begin(), pointsF.end());
+            chunk.m_colors.insert(chunk.m_colors.end(), colorF.begin(), colorF.end());
+            keepRight = true;
+        }
+
+        if(pointsB.size() != 0)
+        {
+            chunk.m_nbPtsPerLine.push_back(pointsB.size()/3);
+            chunk.m_points.insert(chunk.m_points.end(), pointsB.begin(), pointsB.end());
+            chunk.m_colors.insert(chunk.m_colors.end(), colorB.begin(), colorB.end());
+            keepLeft = true;
+        }
+
+        if(keepLeft && keepRight)
+        {
+            chunk.m_leftRight.push_back(true);
+            chunk.m_leftRight.push_back(true);
+        }
+        else if(keepLeft || keepRight)
+        {
+            chunk.m_leftRight.push_back(false);
+        }
+
+        if(RTTrackingHelper::getInstance()->isTractoDrivenRSN())
+        {
+            chunk.m_tractoDrivenF.push_back( pointsF );
+            chunk.m_tractoDrivenB.push_back( pointsB );
+        }
+    }
+}
 
 ///////////////////////////////////////////////////////////////////////////
 //Rendering stage
 ///////////////////////////////////////////////////////////////////////////
 void RTTFibers::renderRTTFibers(bool bindBuffers, bool isAnimate, bool changeAlpha)
 {
+    PROFILE_SCOPE( "RTTFibers::renderRTTFibers" );
+
     if(m_streamlinesPoints.size() != 0)
     {
         if(changeAlpha)
@@ -595,9 +641,10 @@ void RTTFibers::renderRTTFibers(bool bindBuffers, bool isAnimate, bool changeAlp
             }
         }
 
-        bool isOK = true;
+        // Without VBOs, the streamlines are drawn from the client arrays.
+        bool isOK = SceneManager::getInstance()->isUsingVBO();
         //TODO: Redo animate.
-        if(bindBuffers)
+        if( bindBuffers && isOK )
         {
 
             glGenBuffers( 2, m_bufferObjectsRTT );
@@ -614,6 +661,10 @@ void RTTFibers::renderRTTFibers(bool bindBuffers, bool isAnimate, bool changeAlp
                 glBufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * m_streamlinesColors.size(), &m_streamlinesColors[0], GL_STATIC_DRAW );
                 isOK = !Logger::getInstance()->printIfGLError( wxT( "initialize vbo colors" ) );
             }
+
+            // Progressive tracking appends after what is now in the buffers.
+            m_uploadedPoints = m_capacityPoints = m_streamlinesPoints.size();
+            m_uploadedColors = m_capacityColors = m_streamlinesColors.size();
         }
 
         glEnableClientState( GL_VERTEX_ARRAY );
@@ -662,70 +713,15 @@ void RTTFibers::renderRTTFibers(bool bindBuffers, bool isAnimate, bool changeAlp
     }
 }
 
-///////////////////////////////////////////////////////////////////////////
-// Trilinear interpolation for realtime tracking (tensors)
-///////////////////////////////////////////////////////////////////////////
-FMatrix RTTFibers::trilinearInterp( float fx, float fy, float fz )
-{
-
-    using std::min;
-    using std::max;
-
-    int columns = DatasetManager::getInstance()->getColumns();
-    int rows    = DatasetManager::getInstance()->getRows();
-    int frames  = DatasetManager::getInstance()->getFrames();
-
-    const int x = (unsigned int) min( (int)std::floor(fx / DatasetManager::getInstance()->getVoxelX() ), columns-1 );
-    const int y = (unsigned int) min( (int)std::floor(fy / DatasetManager::getInstance()->getVoxelY() ), rows-1 );
-    const int z = (unsigned int) min( (int)std::floor(fz / DatasetManager::getInstance()->getVoxelZ() ), frames-1 );
-
-    const float dx = ( fx / DatasetManager::getInstance()->getVoxelX() )-x;
-    const float dy = ( fy / DatasetManager::getInstance()->getVoxelY() )-y;
-    const float dz = ( fz / DatasetManager::getInstance()->getVoxelZ() )-z;
-
-    const int nx = dx > 0.0 ? min( max(x+1,0), columns-1 ) : min( max(x,0), columns-1 );
-    const int ny = dy > 0.0 ? min( max(y+1,0), rows-1 ) : min( max(y,0), rows-1 );
-    const int nz = dz > 0.0 ? min( max(z+1,0), frames-1 ) : min( max(z,0), frames-1 );
-
-    // Compute interpolated value at (fx,fy,fz)
-    //Corresponding tensor number
-    int tensor_xyz = z * columns * rows + y * columns + x;
-
-    int tensor_nxyz = z * columns * rows + y * columns + nx;
-
-    int tensor_xnyz = z * columns * rows + ny * columns + x;
-
-    int tensor_nxnyz = z * columns * rows + ny * columns + nx;
-
-    int tensor_xynz = nz * columns * rows + y * columns + x;
-
-    int tensor_nxynz = nz * columns * rows + y * columns + nx;
-
-    int tensor_xnynz = nz * columns * rows + ny * columns + x;
-
-    int tensor_nxnynz = nz * columns * rows + ny * columns + nx;
-
-    FMatrix valx0 = (1-dx) * m_pTensorsInfo->getTensorsMatrix()->at(tensor_xyz)  + (dx) * m_pTensorsInfo->getTensorsMatrix()->at(tensor_nxyz);
-    FMatrix valx1 = (1-dx) * m_pTensorsInfo->getTensorsMatrix()->at(tensor_xnyz) + (dx) * m_pTensorsInfo->getTensorsMatrix()->at(tensor_nxnyz);
-
-    const FMatrix valy0 = (1-dy) * valx0 + (dy) * valx1;
-    valx0 = (1-dx) * m_pTensorsInfo->getTensorsMatrix()->at(tensor_xynz)  + (dx) * m_pTensorsInfo->getTensorsMatrix()->at(tensor_nxynz);
-    valx1 = (1-dx) * m_pTensorsInfo->getTensorsMatrix()->at(tensor_xnynz) + (dx) * m_pTensorsInfo->getTensorsMatrix()->at(tensor_nxnynz);
-
-    const FMatrix valy1 = (1-dy) * valx0 + (dy) * valx1;
-
-    return (1-dz) * valy0 + (dz) * valy1;
-}
-
 /////////////////////////////////////////////////////////////////////
 // Advection integration
 // Returns the next direction for RTT
 ////////////////////////////////////////////////////////////////////
-Vector RTTFibers::advecIntegrate( Vector vin, const FMatrix &tensor, Vector e1, Vector e2, Vector e3, float t_number ) 
+Vector RTTFibers::advecIntegrate( Vector vin, const float *tensor, Vector e1, Vector e2, Vector e3, const float *pVoxel ) 
 {
     Vector vout, vprop, ee1, ee2, ee3;
     float dp1, dp2, dp3;
-    float cl = m_pTensorsInfo->getTensorsFA()->at(t_number);
+    float cl = pVoxel[PackedTensorField::FA];
     float puncture = getPuncture();
 
     GLfloat flippedAxes[3];
@@ -734,41 +730,41 @@ Vector RTTFibers::advecIntegrate( Vector vin, const FMatrix &tensor, Vector e1,
     m_pTensorsInfo->isAxisFlipped(Z_AXIS) ? flippedAxes[2] = -1.0f : flippedAxes[2] = 1.0f;
 
     // Unit vectors of local basis (e1 > e2 > e3)
-    ee1.x = flippedAxes[0] * (tensor(0,0) * e1.x + 
-            tensor(0,1) * e1.y + 
-            tensor(0,2) * e1.z);
+    ee1.x = flippedAxes[0] * (tensor[0] * e1.x + 
+            tensor[1] * e1.y + 
+            tensor[2] * e1.z);
 
-    ee1.y = flippedAxes[1] * (tensor(1,0) * e1.x + 
-            tensor(1,1) * e1.y + 
-            tensor(1,2) * e1.z);
+    ee1.y = flippedAxes[1] * (tensor[3] * e1.x + 
+            tensor[4] * e1.y + 
+            tensor[5] * e1.z);
 
-    ee1.z = flippedAxes[2] * (tensor(2,0) * e1.x +
-            tensor(2,1) * e1.y + 
-            tensor(2,2) * e1.z);
+    ee1.z = flippedAxes[2] * (tensor[6] * e1.x +
+            tensor[7] * e1.y + 
+            tensor[8] * e1.z);
     //e2
-    ee2.x = flippedAxes[0] * (tensor(0,0) * e2.x + 
-            tensor(0,1) * e2.y + 
-            tensor(0,2) * e2.z);
+    ee2.x = flippedAxes[0] * (tensor[0] * e2.x + 
+            tensor[1] * e2.y + 
+            tensor[2] * e2.z);
 
-    ee2.y = flippedAxes[1] * (tensor(1,0) * e2.x + 
-            tensor(1,1) * e2.y + 
-            tensor(1,2) * e2.z);
+    ee2.y = flippedAxes[1] * (tensor[3] * e2.x + 
+            tensor[4] * e2.y + 
+            tensor[5] * e2.z);
 
-    ee2.z = flippedAxes[2] * (tensor(2,0) * e2.x +
-            tensor(2,1) * e2.y + 
-            tensor(2,2) * e2.z);
+    ee2.z = flippedAxes[2] * (tensor[6] * e2.x +
+            tensor[7] * e2.y + 
+            tensor[8] * e2.z);
     //e3
-    ee3.x = flippedAxes[0] * (tensor(0,0) * e3.x + 
-            tensor(0,1) * e3.y + 
-            tensor(0,2) * e3.z);
+    ee3.x = flippedAxes[0] * (tensor[0] * e3.x + 
+            tensor[1] * e3.y + 
+            tensor[2] * e3.z);
 
-    ee3.y = flippedAxes[1] * (tensor(1,0) * e3.x + 
-            tensor(1,1) * e3.y + 
-            tensor(1,2) * e3.z);
+    ee3.y = flippedAxes[1] * (tensor[3] * e3.x + 
+            tensor[4] * e3.y + 
+            tensor[5] * e3.z);
 
-    ee3.z = flippedAxes[2] * (tensor(2,0) * e3.x +
-            tensor(2,1) * e3.y + 
-            tensor(2,2) * e3.z);
+    ee3.z = flippedAxes[2] * (tensor[6] * e3.x +
+            tensor[7] * e3.y + 
+            tensor[8] * e3.z);
 
     if( vin.Dot(ee1) < 0.0 )
     {
@@ -784,9 +780,8 @@ Vector RTTFibers::advecIntegrate( Vector vin, const FMatrix &tensor, Vector e1,
     dp2 = vin.Dot(ee2);
     dp3 = vin.Dot(ee3);
 
-    //Sort eigen values
-    float eValues[] = { m_pTensorsInfo->getTensorsEV()->at(t_number)[0], m_pTensorsInfo->getTensorsEV()->at(t_number)[1], m_pTensorsInfo->getTensorsEV()->at(t_number)[2] };
-    sort( eValues, eValues+3 );
+    //Eigen values, already sorted
+    const float *eValues = pVoxel + PackedTensorField::EIGENVALUES;
 
     // Compute vout
     vout = dp1 * eValues[0] * ee1 + dp2 * eValues[1] * ee2 + dp3 * eValues[2] * ee3;
@@ -800,7 +795,7 @@ Vector RTTFibers::advecIntegrate( Vector vin, const FMatrix &tensor, Vector e1,
     return vprop;
 }
 
-Vector RTTFibers::advecIntegrateHARDI( Vector vin, const std::vector<float> &sticks, float s_number, Vector pos ) 
+Vector RTTFibers::advecIntegrateHARDI( Vector vin, const PeakSpan &sticks, unsigned int s_number, Vector pos ) 
 {
     Vector vOut(0,0,0);
     Vector vMagnet(0,0,0);
@@ -867,7 +862,7 @@ Vector RTTFibers::advecIntegrateHARDI( Vector vin, const std::vector<float> &sti
     return res;
 }
 
-Vector RTTFibers::magneticField(Vector vin, const std::vector<float> &sticks, float s_number, Vector pos, Vector& vOut, float& F, float& G) 
+Vector RTTFibers::magneticField(Vector vin, const PeakSpan &sticks, unsigned int s_number, Vector pos, Vector& vOut, float& F, float& G) 
 {
     Vector final = vin;
     bool alreadyAffected = false;
@@ -969,7 +964,7 @@ Vector RTTFibers::magneticField(Vector vin, const std::vector<float> &sticks, fl
 /////////////////////////////////////////////////////////////////////
 // Classify (1 or 0) the 3 eigenVecs within Axis-Aligned vecs e1 > e2 > e3
 ////////////////////////////////////////////////////////////////////
-void RTTFibers::setDiffusionAxis( const FMatrix &tensor, Vector& e1, Vector& e2, Vector& e3 )
+void RTTFibers::setDiffusionAxis( const float *tensor, Vector& e1, Vector& e2, Vector& e3 )
 {
     float lvx,lvy,lvz;
 
@@ -979,17 +974,17 @@ void RTTFibers::setDiffusionAxis( const FMatrix &tensor, Vector& e1, Vector& e2,
     m_pTensorsInfo->isAxisFlipped(Z_AXIS) ? flippedAxes[2] = -1.0f : flippedAxes[2] = 1.0f;
 
     //Find the 3 axes
-    lvx = flippedAxes[0] * (tensor(0,0) * tensor(0,0)
-        + tensor(1,0) * tensor(1,0) 
-        + tensor(2,0) * tensor(2,0));
+    lvx = flippedAxes[0] * (tensor[0] * tensor[0]
+        + tensor[3] * tensor[3] 
+        + tensor[6] * tensor[6]);
 
-    lvy = flippedAxes[1] * (tensor(0,1) * tensor(0,1)
-        + tensor(1,1) * tensor(1,1) 
-        + tensor(2,1) * tensor(2,1));
+    lvy = flippedAxes[1] * (tensor[1] * tensor[1]
+        + tensor[4] * tensor[4] 
+        + tensor[7] * tensor[7]);
 
-    lvz = flippedAxes[2] * (tensor(0,2) * tensor(0,2)
-        + tensor(1,2) * tensor(1,2) 
-        + tensor(2,2) * tensor(2,2));
+    lvz = flippedAxes[2] * (tensor[2] * tensor[2]
+        + tensor[5] * tensor[5] 
+        + tensor[8] * tensor[8]);
 
 
     if ( lvx > lvy && lvx > lvz ) 
@@ -1068,7 +1063,11 @@ void RTTFibers::performDTIRTT(Vector seed, int bwdfwd, vector<float>& points, ve
     float yVoxel = DatasetManager::getInstance()->getVoxelY();
     float zVoxel = DatasetManager::getInstance()->getVoxelZ();
 
-    FMatrix tensor;
+    const PackedTensorField *pField = m_pTensorsInfo->getPackedField();
+    bool isInterpolated = RTTrackingHelper::getInstance()->isTensorsInterpolated();
+
+    float interpolated[9]; //Storage for the interpolated tensor
+    const float *tensor;
 
     //Get the seed voxel
     currVoxelx = (int)( floor(currPosition.x / xVoxel) );
@@ -1078,33 +1077,25 @@ void RTTFibers::performDTIRTT(Vector seed, int bwdfwd, vector<float>& points, ve
     //Corresponding tensor number
     tensorNumber = currVoxelz * columns * rows + currVoxely *columns + currVoxelx;
 
-    if( tensorNumber < m_pTensorsInfo->getTensorsMatrix()->size() )
+    if( tensorNumber < pField->size() )
     {
-        //Use Interpolation
-        if( RTTrackingHelper::getInstance()->isTensorsInterpolated() )
-        {
-            tensor = trilinearInterp( currPosition.x, currPosition.y, currPosition.z );
-        }
-        else
-        {
-            tensor = m_pTensorsInfo->getTensorsMatrix()->at(tensorNumber); 
-        }
+        tensor = pField->getMatrix( currPosition, tensorNumber, isInterpolated, interpolated );
 
         //Find the MAIN axis
         setDiffusionAxis( tensor, e1, e2, e3 );
 
         //Align the main direction my mult AxisAlign * tensorMatrix
-        currDirection.x = flippedAxes[0] * (tensor(0,0) * e1.x + 
-                          tensor(0,1) * e1.y + 
-                          tensor(0,2) * e1.z);
+        currDirection.x = flippedAxes[0] * (tensor[0] * e1.x + 
+                          tensor[1] * e1.y + 
+                          tensor[2] * e1.z);
 
-        currDirection.y = flippedAxes[1] * (tensor(1,0) * e1.x + 
-                          tensor(1,1) * e1.y + 
-                          tensor(1,2) * e1.z);
+        currDirection.y = flippedAxes[1] * (tensor[3] * e1.x + 
+                          tensor[4] * e1.y + 
+                          tensor[5] * e1.z);
 
-        currDirection.z = flippedAxes[2] * (tensor(2,0) * e1.x +
-                          tensor(2,1) * e1.y + 
-                          tensor(2,2) * e1.z);
+        currDirection.z = flippedAxes[2] * (tensor[6] * e1.x +
+                          tensor[7] * e1.y + 
+                          tensor[8] * e1.z);
 
         //Direction for seeding (forward or backward)
         currDirection.normalize();
@@ -1121,17 +1112,9 @@ void RTTFibers::performDTIRTT(Vector seed, int bwdfwd, vector<float>& points, ve
         //Corresponding tensor number
         tensorNumber = currVoxelz * columns * rows + currVoxely * columns + currVoxelx;
 
-        if( tensorNumber < m_pTensorsInfo->getTensorsMatrix()->size() )
+        if( tensorNumber < pField->size() )
         {
-            //Use interpolation
-            if( RTTrackingHelper::getInstance()->isTensorsInterpolated() )
-            {
-                tensor = trilinearInterp( nextPosition.x, nextPosition.y, nextPosition.z );
-            }
-            else
-            {
-                tensor = m_pTensorsInfo->getTensorsMatrix()->at(tensorNumber);
-            }
+            tensor = pField->getMatrix( nextPosition, tensorNumber, isInterpolated, interpolated );
 
             //Find the main diffusion axis
             e1.zero();
@@ -1140,7 +1123,7 @@ void RTTFibers::performDTIRTT(Vector seed, int bwdfwd, vector<float>& points, ve
             setDiffusionAxis( tensor, e1, e2, e3 );
 
             //Advection next direction
-            nextDirection = advecIntegrate( currDirection, tensor, e1, e2, e3, tensorNumber );
+            nextDirection = advecIntegrate( currDirection, tensor, e1, e2, e3, pField->at( tensorNumber ) );
 
             //Direction of seeding
             nextDirection.normalize();
@@ -1152,7 +1135,7 @@ void RTTFibers::performDTIRTT(Vector seed, int bwdfwd, vector<float>& points, ve
             }
 
             //FA value
-            FAvalue = m_pTensorsInfo->getTensorsFA()->at(tensorNumber);
+            FAvalue = pField->at( tensorNumber )[PackedTensorField::FA];
 
             //Angle value
             angle = 180 * std::acos( currDirection.Dot(nextDirection) ) / M_PI;
@@ -1189,20 +1172,12 @@ void RTTFibers::performDTIRTT(Vector seed, int bwdfwd, vector<float>& points, ve
                 //Corresponding tensor number
                 tensorNumber = currVoxelz * columns * rows + currVoxely * columns + currVoxelx;
 
-                if( tensorNumber > m_pTensorsInfo->getTensorsMatrix()->size() ) //Out of anatomy
+                if( tensorNumber >= pField->size() ) //Out of anatomy
                 {
                     break;
                 }
 
-                //Use interpolation
-                if( RTTrackingHelper::getInstance()->isTensorsInterpolated() )
-                {
-                    tensor = trilinearInterp( nextPosition.x, nextPosition.y, nextPosition.z );
-                }
-                else
-                {
-                    tensor = m_pTensorsInfo->getTensorsMatrix()->at(tensorNumber);
-                }
+                tensor = pField->getMatrix( nextPosition, tensorNumber, isInterpolated, interpolated );
 
                 //Find the MAIN axis
                 e1.zero();
@@ -1211,7 +1186,7 @@ void RTTFibers::performDTIRTT(Vector seed, int bwdfwd, vector<float>& points, ve
                 setDiffusionAxis( tensor, e1, e2, e3 );
 
                 //Advection next direction
-                nextDirection = advecIntegrate( currDirection, tensor, e1, e2, e3, tensorNumber );
+                nextDirection = advecIntegrate( currDirection, tensor, e1, e2, e3, pField->at( tensorNumber ) );
 
                 //Direction of seeding (backward of forward)
                 nextDirection.normalize();
@@ -1222,7 +1197,7 @@ void RTTFibers::performDTIRTT(Vector seed, int bwdfwd, vector<float>& points, ve
                 }
 
                 //FA value
-                FAvalue = m_pTensorsInfo->getTensorsFA()->at(tensorNumber);
+                FAvalue = pField->at( tensorNumber )[PackedTensorField::FA];
 
                 //Angle value
                 angle = 180 * std::acos( currDirection.Dot(nextDirection) ) / M_PI;
@@ -1238,54 +1213,48 @@ void RTTFibers::performDTIRTT(Vector seed, int bwdfwd, vector<float>& points, ve
 ///////////////////////////////////////////////////////////////////////////
 // Draft a direction to start the tracking process using a probabilistic random
 // [0 --- |v1| --- |v2| --- |v3|]
+// The drafted peak (3 floats) is written in pDrafted.
 ///////////////////////////////////////////////////////////////////////////
-std::vector<float> RTTFibers::pickDirection(std::vector<float> initialPeaks, bool initWithDir, Vector currPos)
+void RTTFibers::pickDirection( const PeakSpan &initialPeaks, bool initWithDir, float random, float *pDrafted )
 {
-    std::vector<float> draftedPeak;
+    unsigned int nbPeaks = initialPeaks.nbPeaks();
     if(!initWithDir)
     {
-	    unsigned int nbPeaks = initialPeaks.size()/3;
-	    std::vector<float> norms;
 	    float sum = 0.0f;
 
 	    for(unsigned int i=0; i < nbPeaks; i++)
         {
             Vector v1(initialPeaks[i*3],initialPeaks[i*3+1], initialPeaks[i*3+2]);
-            norms.push_back(v1.getLength());
-		    sum += norms[i];
+		    sum += v1.getLength();
 	    }
     
-	    float random = ( (float) rand() ) / (float) RAND_MAX;
         float weight = ( random * sum );
 
-	    if(weight < norms[0])
-	    {
-		    draftedPeak.push_back(initialPeaks[0]);
-		    draftedPeak.push_back(initialPeaks[1]);
-		    draftedPeak.push_back(initialPeaks[2]);
-	    }
-	    else if(weight < norms[0] + norms[1])
-	    {
-		    draftedPeak.push_back(initialPeaks[3]);
-		    draftedPeak.push_back(initialPeaks[4]);
-		    draftedPeak.push_back(initialPeaks[5]);
-	    }
-	    else
-	    {
-		    draftedPeak.push_back(initialPeaks[6]);
-		    draftedPeak.push_back(initialPeaks[7]);
-		    draftedPeak.push_back(initialPeaks[8]);
-	    }
+        //The last peak is picked when the weight falls past all the others
+        unsigned int drafted = nbPeaks - 1;
+        float cumulated = 0.0f;
+	    for(unsigned int i=0; i + 1 < nbPeaks; i++)
+        {
+            Vector v1(initialPeaks[i*3],initialPeaks[i*3+1], initialPeaks[i*3+2]);
+            cumulated += v1.getLength();
+            if(weight < cumulated)
+            {
+                drafted = i;
+                break;
+            }
+        }
+
+        pDrafted[0] = initialPeaks[drafted*3];
+        pDrafted[1] = initialPeaks[drafted*3+1];
+        pDrafted[2] = initialPeaks[drafted*3+2];
     }
     else
     {
         Vector vOut(0,0,0);
         float angleMin = 360.0f;
         float angle = 0.0f;
-        float puncture = m_vinvout;
-	     
 
-        for(unsigned int i=0; i < initialPeaks.size()/3; i++)
+        for(unsigned int i=0; i < nbPeaks; i++)
         {
             Vector v1(initialPeaks[i*3],initialPeaks[i*3+1], initialPeaks[i*3+2]);
             v1.normalize();
@@ -1307,26 +1276,30 @@ std::vector<float> RTTFibers::pickDirection(std::vector<float> initialPeaks, boo
                 vOut = v1;
             }     
         }
-        draftedPeak.push_back(vOut.x);
-        draftedPeak.push_back(vOut.y);
-        draftedPeak.push_back(vOut.z);
+        pDrafted[0] = vOut.x;
+        pDrafted[1] = vOut.y;
+        pDrafted[2] = vOut.z;
     }
+}
 
-   /* bool isMagnetOn = RTTrackingHelper::getInstance()->isMagnetOn();
-    if(isMagnetOn)
+///////////////////////////////////////////////////////////////////////////
+// Copies the peaks in buffer with the maximas flips applied. The buffer is
+// reused from one step to the next, so this does not allocate once it has
+// grown to the number of bands.
+///////////////////////////////////////////////////////////////////////////
+PeakSpan RTTFibers::flipPeaks( const PeakSpan &peaks, const Vector &flip, std::vector< float > &buffer ) const
+{
+    buffer.resize( peaks.size() );
+    for( unsigned int i = 0; i < peaks.nbPeaks(); ++i )
     {
-        Vector def(0,0,0);
-        float F = 0;
-        Vector res = magneticField(def, initialPeaks, 0, currPos, def, F); 
-        draftedPeak[0] = res.x;
-        draftedPeak[1] = res.y;
-        draftedPeak[2] = res.z;
-    }*/
-		
-	return draftedPeak;
+        buffer[i*3]   = flip.x * peaks[i*3];
+        buffer[i*3+1] = flip.y * peaks[i*3+1];
+        buffer[i*3+2] = flip.z * peaks[i*3+2];
+    }
+    return PeakSpan( &buffer[0], buffer.size() );
 }
 
-bool RTTFibers::checkExclude( unsigned int sticksNumber)
+bool RTTFibers::checkExclude( unsigned int sticksNumber, RTTTrackState &state )
 {
 	bool res = true;
 
@@ -1335,18 +1308,18 @@ bool RTTFibers::checkExclude( unsigned int sticksNumber)
 		if(m_pExcludeInfo->at(sticksNumber) != 0)
 		{
 			res = false;
-			m_stop = true;
+			state.m_stop = true;
 		}
 	}
 
     if(m_pIncludeInfo != NULL && RTTrackingHelper::getInstance()->isAndMapOn())
     {
-        if(!m_steppedOnceIntoAND)
-            m_and = false;
+        if(!state.m_steppedOnceIntoAND)
+            state.m_and = false;
         if(m_pIncludeInfo->at(sticksNumber) != 0)
         {
-            m_and = true;
-            m_steppedOnceIntoAND = true;
+            state.m_and = true;
+            state.m_steppedOnceIntoAND = true;
         }
     }
 
@@ -1356,7 +1329,7 @@ bool RTTFibers::checkExclude( unsigned int sticksNumber)
 ///////////////////////////////////////////////////////////////////////////
 // Returns true if no anatomy is loaded for thresholding or if above the threshold
 ///////////////////////////////////////////////////////////////////////////
-bool RTTFibers::withinMapThreshold(unsigned int sticksNumber, Vector pos)
+bool RTTFibers::withinMapThreshold(unsigned int sticksNumber, Vector pos, RTTTrackState &state)
 {
     if(sticksNumber > m_pMaskInfo->getSize())
     {
@@ -1374,27 +1347,27 @@ bool RTTFibers::withinMapThreshold(unsigned int sticksNumber, Vector pos)
             gmVal = m_pGMInfo->at(sticksNumber);
 	        if(gmVal > 0)
             {
-                m_countGMstep++;
+                state.m_countGMstep++;
             }
             else
             {
-                m_countGMstep = 0;
+                state.m_countGMstep = 0;
             }   
         }
     }
 
     //Child (Only works for 1 inclusion or 1 exclusion child so far.)
-    if(m_currentSeedBoxID != 0 )
+    if(state.m_pChildren != NULL )
     {
-        std::vector< SelectionObject* >child = SceneManager::getInstance()->getSelectionTree().getDirectChildrenObjects(m_currentSeedBoxID);
+        const std::vector< SelectionObject* > &child = *state.m_pChildren;
 
         for( unsigned int b = 0; b < child.size(); b++ )
 	    {
             //   //NOT SELECTION
             if(child[ b ]->getIsActive())
             {
-                if(!m_steppedOnceInsideChildBox)
-                    m_render = false;
+                if(!state.m_steppedOnceInsideChildBox)
+                    state.m_render = false;
 
                 Vector minCorner;
                 Vector maxCorner;
@@ -1427,34 +1400,34 @@ bool RTTFibers::withinMapThreshold(unsigned int sticksNumber, Vector pos)
                     inside = pos.x <= maxCorner.x && pos.x >= minCorner.x && pos.y <= maxCorner.y && pos.y >= minCorner.y && pos.z <= maxCorner.z && pos.z >= minCorner.z;
                 }
             
-                if(inside && !m_steppedOnceInsideChildBox) //For selecting or removing
+                if(inside && !state.m_steppedOnceInsideChildBox) //For selecting or removing
                 {
-                    m_steppedOnceInsideChildBox = true; //steped once, to be rendered at the end of the propagation stage
-                    m_render = true;
+                    state.m_steppedOnceInsideChildBox = true; //steped once, to be rendered at the end of the propagation stage
+                    state.m_render = true;
                 } 
                 if( child[ b ]->getIsNOT()) //For pruning
                 {
                     insideNotBox = inside;
-                    m_prune = !child[b]->getIsRemove();
-                    if(m_prune)
+                    bool prune = !child[b]->getIsRemove();
+                    if(prune)
                     {
-                        m_render = true;
+                        state.m_render = true;
                     }
-                    else if(inside && !m_prune && m_steppedOnceInsideChildBox)
+                    else if(inside && !prune && state.m_steppedOnceInsideChildBox)
                     {
-                        m_render = false;
+                        state.m_render = false;
                     }
                 }
              
             }
             else
             {
-                m_render = true; //Always show
+                state.m_render = true; //Always show
             }    
         }
     }
 
-	if((m_pMaskInfo->at(sticksNumber) > m_FAThreshold || gmVal > m_FAThreshold) && checkExclude(sticksNumber) && m_countGMstep <= m_GMstep && !insideNotBox) //for pruning
+	if((m_pMaskInfo->at(sticksNumber) > m_FAThreshold || gmVal > m_FAThreshold) && checkExclude(sticksNumber, state) && state.m_countGMstep <= m_GMstep && !insideNotBox) //for pruning
     {
         isOk = true;
     }
@@ -1465,7 +1438,7 @@ bool RTTFibers::withinMapThreshold(unsigned int sticksNumber, Vector pos)
 ///////////////////////////////////////////////////////////////////////////
 // Performs realtime HARDI fiber tracking along direction bwdfwd (backward, forward)
 ///////////////////////////////////////////////////////////////////////////
-void RTTFibers::performHARDIRTT(Vector seed, int bwdfwd, vector<float>& points, vector<float>& color)
+void RTTFibers::performHARDIRTT(Vector seed, int bwdfwd, vector<float>& points, vector<float>& color, RTTTrackState &state)
 { 
     //Vars
     Vector currPosition(seed); //Current PIXEL position
@@ -1492,31 +1465,31 @@ void RTTFibers::performHARDIRTT(Vector seed, int bwdfwd, vector<float>& points,
 
     //Corresponding stick number
     sticksNumber = currVoxelz * columns * rows + currVoxely *columns + currVoxelx;
-    std::vector<float> sticks;
+    unsigned int nbVoxels = m_pMaximasInfo->getNbPeakVoxels();
 
-    m_countGMstep = 0;
-    if( sticksNumber < m_pMaximasInfo->getMainDirData()->size() )
+    state.m_countGMstep = 0;
+    if( sticksNumber < nbVoxels )
     {
-        absPeak = std::abs(m_pMaximasInfo->getMainDirData()->at(sticksNumber)[0] + m_pMaximasInfo->getMainDirData()->at(sticksNumber)[1] + m_pMaximasInfo->getMainDirData()->at(sticksNumber)[2]);
+        PeakSpan peaks = m_pMaximasInfo->getPeaks( sticksNumber );
+        absPeak = std::abs( peaks[0] + peaks[1] + peaks[2] );
 
-        if( withinMapThreshold(sticksNumber, currPosition) && !m_stop && absPeak != 0)
+        if( withinMapThreshold(sticksNumber, currPosition, state) && !state.m_stop && absPeak != 0)
         {
             bool initWithDir = RTTrackingHelper::getInstance()->isInitSeed();
 
             if(bwdfwd != -1)
             {
-                sticks = pickDirection(m_pMaximasInfo->getMainDirData()->at(sticksNumber), initWithDir, currPosition); 
-                m_storedDir = sticks;
+                pickDirection( peaks, initWithDir, state.m_random, state.m_storedDir );
+                state.m_hasStoredDir = true;
             }
-            else
-            { 
-                sticks = m_storedDir;
+            else if( !state.m_hasStoredDir )
+            {
+                return;
             }
 
-
-            currDirection.x = flippedAxes.x * sticks[0];
-            currDirection.y = flippedAxes.y * sticks[1];
-            currDirection.z = flippedAxes.z * sticks[2];
+            currDirection.x = flippedAxes.x * state.m_storedDir[0];
+            currDirection.y = flippedAxes.y * state.m_storedDir[1];
+            currDirection.z = flippedAxes.z * state.m_storedDir[2];
 
             //Direction for seeding (forward or backward)
             currDirection.normalize();
@@ -1532,23 +1505,14 @@ void RTTFibers::performHARDIRTT(Vector seed, int bwdfwd, vector<float>& points,
 
             //Corresponding stick number
             sticksNumber = currVoxelz * columns * rows + currVoxely * columns + currVoxelx;
-            if( sticksNumber < m_pMaximasInfo->getMainDirData()->size())
+            if( sticksNumber < nbVoxels )
             {
-                absPeak = std::abs(m_pMaximasInfo->getMainDirData()->at(sticksNumber)[0] + m_pMaximasInfo->getMainDirData()->at(sticksNumber)[1] + m_pMaximasInfo->getMainDirData()->at(sticksNumber)[2]);
+                peaks = m_pMaximasInfo->getPeaks( sticksNumber );
+                absPeak = std::abs( peaks[0] + peaks[1] + peaks[2] );
 
-                if( absPeak != 0 && withinMapThreshold(sticksNumber, nextPosition))
+                if( absPeak != 0 && withinMapThreshold(sticksNumber, nextPosition, state))
                 {
-
-                    sticks = m_pMaximasInfo->getMainDirData()->at(sticksNumber); 
-                    sticks[0] *= flippedAxes.x;
-                    sticks[1] *= flippedAxes.y;
-                    sticks[2] *= flippedAxes.z;
-                    sticks[3] *= flippedAxes.x;
-                    sticks[4] *= flippedAxes.y;
-                    sticks[5] *= flippedAxes.z;
-                    sticks[6] *= flippedAxes.x;
-                    sticks[7] *= flippedAxes.y;
-                    sticks[8] *= flippedAxes.z;
+                    PeakSpan sticks = flipPeaks( peaks, flippedAxes, state.m_sticks );
 
                     //Advection next direction
                     nextDirection = advecIntegrateHARDI( currDirection, sticks, sticksNumber, nextPosition );
@@ -1572,7 +1536,7 @@ void RTTFibers::performHARDIRTT(Vector seed, int bwdfwd, vector<float>& points,
                     //////////////////////////
                     float it = 2;
                     bool insideBox = false;
-                    while( angle <= m_angleThreshold && withinMapThreshold(sticksNumber, nextPosition) && !m_stop)
+                    while( angle <= m_angleThreshold && withinMapThreshold(sticksNumber, nextPosition, state) && !state.m_stop)
                     {
                         //Insert point to be rendered
                         points.push_back( currPosition.x );
@@ -1597,25 +1561,17 @@ void RTTFibers::performHARDIRTT(Vector seed, int bwdfwd, vector<float>& points,
 
                         //Corresponding tensor number
                         sticksNumber = currVoxelz * columns * rows + currVoxely * columns + currVoxelx;
-                        if( sticksNumber < m_pMaximasInfo->getMainDirData()->size())
+                        if( sticksNumber < nbVoxels )
                         {
-                            absPeak = std::abs(m_pMaximasInfo->getMainDirData()->at(sticksNumber)[0] + m_pMaximasInfo->getMainDirData()->at(sticksNumber)[1] + m_pMaximasInfo->getMainDirData()->at(sticksNumber)[2]);
+                            peaks = m_pMaximasInfo->getPeaks( sticksNumber );
+                            absPeak = std::abs( peaks[0] + peaks[1] + peaks[2] );
 
                             if( absPeak == 0 || m_step*it > m_maxFiberLength) //Out of anatomy
                             {
                                 break;
                             }
                 
-                            sticks = m_pMaximasInfo->getMainDirData()->at(sticksNumber);
-                            sticks[0] *= flippedAxes.x;
-                            sticks[1] *= flippedAxes.y;
-                            sticks[2] *= flippedAxes.z;
-                            sticks[3] *= flippedAxes.x;
-                            sticks[4] *= flippedAxes.y;
-                            sticks[5] *= flippedAxes.z;
-                            sticks[6] *= flippedAxes.x;
-                            sticks[7] *= flippedAxes.y;
-                            sticks[8] *= flippedAxes.z;
+                            sticks = flipPeaks( peaks, flippedAxes, state.m_sticks );
 
                             //Advection next direction
                             nextDirection = advecIntegrateHARDI( currDirection, sticks, sticksNumber, nextPosition );
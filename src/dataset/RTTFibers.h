@@ -16,6 +16,62 @@
 #include <GL/glew.h>
 #include <vector>
 
+///////////////////////////////////////////////////////////////////////////
+// A seed position to be tracked, as generated by RTTFibers::seed().
+///////////////////////////////////////////////////////////////////////////
+struct RTTSeed
+{
+    RTTSeed( const Vector &pos, int seedBoxId, float random )
+    :   m_pos( pos ),
+        m_seedBoxId( seedBoxId ),
+        m_random( random )
+    {
+    }
+
+    Vector m_pos;
+    int    m_seedBoxId; // Id of the seed box in the selection tree, 0 if none.
+    float  m_random;    // Random draft used to pick the initial HARDI direction.
+};
+
+///////////////////////////////////////////////////////////////////////////
+// State carried along a single streamline while it is tracked.
+// Every seed starts from a fresh state so seeds can be tracked in any order.
+// The serial loop used before kept the AND and render flags of the previous
+// seed, so a streamline may be accepted or rejected differently than it was.
+///////////////////////////////////////////////////////////////////////////
+struct RTTTrackState
+{
+    RTTTrackState()
+    {
+        reset( true, 0.0f, NULL );
+    }
+
+    void reset( bool andInit, float random, const std::vector< SelectionObject* > *pChildren )
+    {
+        m_stop                      = false;
+        m_render                    = true;
+        m_and                       = andInit;
+        m_steppedOnceInsideChildBox = false;
+        m_steppedOnceIntoAND        = false;
+        m_countGMstep               = 0;
+        m_random                    = random;
+        m_pChildren                 = pChildren;
+        m_hasStoredDir              = false;
+    }
+
+    bool  m_stop;
+    bool  m_render;
+    bool  m_and;
+    bool  m_steppedOnceInsideChildBox;
+    bool  m_steppedOnceIntoAND;
+    float m_countGMstep;
+    float m_random;
+    const std::vector< SelectionObject* > *m_pChildren; // Children of the seed box, NULL if none.
+    bool  m_hasStoredDir;
+    float m_storedDir[3]; // Initial direction, shared by the forward and backward passes.
+    std::vector< float > m_sticks; // Flipped peaks of the current voxel, reused from step to step.
+};
+
 class RTTFibers 
 {
 public:
@@ -24,18 +80,23 @@ public:
 
     //RTT functions
     void seed();
+    void track();
+    void startProgressiveSeed();
+    void stopProgressiveSeed();
+    bool trackNextBatch( long budget );
+    bool isTrackingInProgress() const            { return m_nextSeed < m_pendingSeeds.size(); }
     void renderRTTFibers(bool bindBuffers, bool isPlaying, bool changeAlpha);
     void performDTIRTT( Vector seed, int bwdfwd, std::vector<float>& points, std::vector<float>& color );
-    void performHARDIRTT( Vector seed, int bwdfwd, std::vector<float>& points, std::vector<float>& color );
-    void setDiffusionAxis( const FMatrix &tensor, Vector& e1, Vector& e2, Vector& e3 );
-	std::vector<float> pickDirection(std::vector<float> initialPeaks, bool initWithDir, Vector currPos);
-    bool withinMapThreshold(unsigned int sticksNumber, Vector pos);
+    void performHARDIRTT( Vector seed, int bwdfwd, std::vector<float>& points, std::vector<float>& color, RTTTrackState &state );
+    void setDiffusionAxis( const float *tensor, Vector& e1, Vector& e2, Vector& e3 );
+    void pickDirection( const PeakSpan &initialPeaks, bool initWithDir, float random, float *pDrafted );
+    bool withinMapThreshold(unsigned int sticksNumber, Vector pos, RTTTrackState &state);
 
     Vector generateRandomSeed( const Vector &min, const Vector &max );
-    FMatrix trilinearInterp( float fx, float fy, float fz );
-    Vector advecIntegrate( Vector vin, const FMatrix &tensor, Vector e1, Vector e2, Vector e3, float tensorNumber );
-    Vector advecIntegrateHARDI( Vector vin, const std::vector<float> &sticks, float peaksNumber, Vector pos );
-    Vector magneticField( Vector vin, const std::vector<float> &sticks, float peaksNumber, Vector pos, Vector& vOut, float& F, float& G);
+    float generateRandomDraft();
+    Vector advecIntegrate( Vector vin, const float *tensor, Vector e1, Vector e2, Vector e3, const float *pVoxel );
+    Vector advecIntegrateHARDI( Vector vin, const PeakSpan &sticks, unsigned int peaksNumber, Vector pos );
+    Vector magneticField( Vector vin, const PeakSpan &sticks, unsigned int peaksNumber, Vector pos, Vector& vOut, float& F, float& G);
     
     void clearFibersRTT();
 
@@ -67,9 +128,14 @@ public:
 
 	void setExcludeInfo( Anatomy* info )                              { m_pExcludeInfo = info; }
     void setIncludeInfo( Anatomy* info )                              { m_pIncludeInfo = info; }
-	bool checkExclude(unsigned int sticksNumber);						  
+	bool checkExclude(unsigned int sticksNumber, RTTTrackState &state);
     void setAnd(bool val) { m_and = val;}
 
+    // Number of threads used to track the seeds, 0 uses all the available cores.
+    void setNbThreads( int nbThreads )           { m_nbThreads = nbThreads; }
+    int  getNbThreads()                          { return m_nbThreads; }
+    int  getNbTrackingThreads() const;  // Threads effectively used, all the processors when m_nbThreads is 0.
+
     float getFAThreshold()                       { return m_FAThreshold; }
     float getAngleThreshold()                    { return m_angleThreshold; }
     float getStep()                              { return m_step; }
@@ -102,6 +168,33 @@ public:
 	float m_timerStep;
 	std::vector<Vector> m_pSeedMap;
 	
+private:
+    // Streamlines produced by a contiguous range of seeds, filled by a single thread.
+    struct SeedChunk
+    {
+        std::vector< float > m_points;
+        std::vector< float > m_colors;
+        std::vector< int >   m_nbPtsPerLine;
+        std::vector< bool >  m_leftRight;
+        std::vector< std::vector< float > > m_tractoDrivenF; // Accepted streamlines, in seed order,
+        std::vector< std::vector< float > > m_tractoDrivenB; // for the tracto-driven resting-state network.
+    };
+
+    // Buffers reused by a thread from one seed to the next.
+    struct SeedScratch
+    {
+        std::vector< float > m_pointsF;
+        std::vector< float > m_pointsB;
+        std::vector< float > m_colorF;
+        std::vector< float > m_colorB;
+    };
+
+    void generateSeeds( std::vector< RTTSeed > &seeds );
+    void trackSeeds( const std::vector< RTTSeed > &seeds, size_t first, size_t last );
+    void trackSeed( const RTTSeed &seed, RTTTrackState &state, SeedScratch &scratch, SeedChunk &chunk );
+    void appendToBuffer( GLuint bufferId, const std::vector< float > &data, size_t &uploaded, size_t &capacity );
+    PeakSpan flipPeaks( const PeakSpan &peaks, const Vector &flip, std::vector< float > &buffer ) const;
+
 private:
     float       m_FAThreshold;
     float       m_angleThreshold;
@@ -114,7 +207,6 @@ private:
     float       m_minFiberLength;
     float       m_maxFiberLength;
     bool        m_isHARDI;
-    float       m_countGMstep;
     Tensors     *m_pTensorsInfo;
     Maximas     *m_pMaximasInfo;
 	DatasetInfo *m_pShellInfo;
@@ -128,17 +220,18 @@ private:
     std::vector<float> m_streamlinesPoints; // Points to be rendered Forward
 	std::vector<float> m_streamlinesColors; //Color (local directions)Forward
 
-    std::vector<float> m_storedDir;
-    
-
 	float m_alpha;
     int m_currentSeedBoxID;
-	bool m_stop;
-    bool m_and;
-    bool m_render;
-    bool m_steppedOnceInsideChildBox;
-    bool m_steppedOnceIntoAND;
-    bool m_prune;
+    bool m_and;         // Initial AND state of every streamline, false when an AND map is used.
+    int  m_nbThreads;
+
+    // Progressive tracking
+    std::vector< RTTSeed > m_pendingSeeds;
+    size_t m_nextSeed;
+    size_t m_uploadedPoints;    // Number of floats already in the VBOs.
+    size_t m_uploadedColors;
+    size_t m_capacityPoints;    // Size of the VBOs, in floats.
+    size_t m_capacityColors;
     GLuint*     m_bufferObjectsRTT;
 
     std::vector< FMatrix > m_tensorsMatrix;
@@ -24,6 +24,8 @@ RTTrackingHelper::RTTrackingHelper()
 	m_id( 0 ),
     m_isSrcAlpha( true ),
     m_isRandomInit( true ),
+    m_isProgressive( false ),
+    m_frameBudget( 30 ),
     flippedAxes( 1, 1, 1),
     m_bufferID( 0 )
 {
@@ -33,6 +33,8 @@ public:
     bool isAndMapOn() const {return m_isAndMapOn;}
     bool isSrcAlpha() const { return m_isSrcAlpha; }
     bool isRandomInit() const { return m_isRandomInit; }
+    bool isProgressive() const { return m_isProgressive; }
+    long getFrameBudget() const { return m_frameBudget; }
 
     void setFileSelected( bool selected )     { m_isFileSelected = selected; }
     void setShellSeeds( bool shell )          { m_isShellSeeds = shell; }
@@ -40,6 +42,7 @@ public:
     void setRTTDirty( bool dirty )            { m_isRTTDirty = dirty; }
     void setRTTActive( bool active )          { m_isRTTActive = active; }
 	void setSeedFromfMRI( bool seedFromfMRI ) { m_isSeedFromfMRI = seedFromfMRI; }
+    void setFrameBudget( long budget )        { m_frameBudget = budget; }
     void setMaximaFlip( Vector flip)          { flippedAxes.x = flip.x; flippedAxes.y = flip.y; flippedAxes.z = flip.z; }
     Vector getMaximaFlip()          { return flippedAxes; }
 
@@ -52,6 +55,7 @@ public:
     bool toggleMagnet()             { return m_isMagnetOn = !m_isMagnetOn; }
     bool toggleSrcAlpha()           { return m_isSrcAlpha = !m_isSrcAlpha; }
     bool toggleRandomInit()         { return m_isRandomInit = !m_isRandomInit; }
+    bool toggleProgressive()        { return m_isProgressive = !m_isProgressive; }
     bool toggleNotMap()             { return m_isNotMapOn = !m_isNotMapOn;}
     bool toggleAndMap()             { return m_isAndMapOn = !m_isAndMapOn;}
     
@@ -108,6 +112,8 @@ private:
 	int m_id;
     bool m_isSrcAlpha;
     bool m_isRandomInit;
+    bool m_isProgressive;
+    long m_frameBudget; // Time (ms) given to progressive tracking at each frame.
     Vector flippedAxes;
     GLuint m_bufferID;
 
@@ -8,6 +8,7 @@
 
 #include "DatasetManager.h"
 #include "AnatomyHelper.h"
+#include "NiftiFile.h"
 #include "RTFMRIHelper.h"
 #include "RTTrackingHelper.h"
 #include "../Logger.h"
@@ -15,6 +16,9 @@
 #include "../gfx/TheScene.h"
 #include "../gui/MyListCtrl.h"
 #include "../gui/SceneManager.h"
+#include "../misc/Profiler.h"
+#include "../misc/Algorithms/BinaryMorphology.h"
+#include "../misc/Fantom/FMatrix.h"
 #include "../misc/nifti/nifti1_io.h"
 
 #include <GL/glew.h>
@@ -27,6 +31,11 @@
 #include <vector>
 #include <math.h>
 
+#if defined( __SSE__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 1 )
+    #define RSN_USE_SSE
+    #include <xmmintrin.h>
+#endif
+
 // TODO remove
 //#include "../gfx/Image.h"
 //#include "../gfx/BitmapHandling.h"
@@ -47,6 +56,9 @@ m_bands( 108 ),
 m_corrThreshold( 4.5f ),
 m_clusterLvlSliderValue( 20.0f ),
 m_boxMoving( false ),
+m_rank( 0 ),
+m_rankStride( 0 ),
+m_useLowRank( false ),
 m_originL(0,0,0),
 m_origin(0,0,0)
 {
@@ -113,26 +125,13 @@ bool RestingStateNetwork::load( nifti_image *pHeader, nifti_image *pBody )
 	{
 		short int* pData = (short int*)pBody->data;
 		//Prepare the data into a 1D vector, side by side
-		for( int i( 0 ); i < m_datasetSize; ++i )
-		{
-			for( int j( 0 ); j < m_bands; ++j )
-			{
-				fileFloatData[i * m_bands + j] = pData[j * m_datasetSize + i];
-			}
-		}
+		NiftiFile::interleaveBands( pData, m_datasetSize, m_bands, &fileFloatData[0] );
 	}
 	else
 	{
 		float* pData = (float*)pBody->data;
 		//Prepare the data into a 1D vector, side by side
-		for( int i( 0 ); i < m_datasetSize; ++i )
-		{
-			for( int j( 0 ); j < m_bands; ++j )
-			{
-				fileFloatData[i * m_bands + j] = pData[j * m_datasetSize + i];
-			}
-		}
-		
+		NiftiFile::interleaveBands( pData, m_datasetSize, m_bands, &fileFloatData[0] );
 	}
 
 	//Assign structure to a 2D vector of timelaps
@@ -240,9 +239,10 @@ void RestingStateNetwork::flipAnat( AxisType axe )
                         break;
                 }
 
-                std::vector<float> tmp = m_signalNormalized[curIndex];
-                m_signalNormalized[curIndex] = m_signalNormalized[flipIndex];
-                m_signalNormalized[flipIndex] = tmp;
+                std::swap_ranges( m_standardized.begin() + static_cast< size_t >( curIndex ) * m_stride,
+                                  m_standardized.begin() + static_cast< size_t >( curIndex + 1 ) * m_stride,
+                                  m_standardized.begin() + static_cast< size_t >( flipIndex ) * m_stride );
+                std::swap( m_meansAndSigmas[curIndex], m_meansAndSigmas[flipIndex] );
             }
         }
     }
@@ -251,58 +251,54 @@ void RestingStateNetwork::flipAnat( AxisType axe )
 
 //////////////////////////////////////////
 //Create structure
+//
+//The time series are rescaled to [0,1], then standardized (zero mean, unit
+//sigma) and stored voxel-major, each row padded with zeros to a multiple of
+//4 floats. The correlation of two voxels is then a dot product.
 //////////////////////////////////////////
 bool RestingStateNetwork::createStructure( std::vector< short int > &i_fileFloatData )
 {
 	int size = m_rows * m_columns * m_frames;
-    std::vector<std::vector<short int> >   m_signal(size); //2D containing the original data
-	m_signalNormalized.resize ( size );
-    vector< short int >::iterator it;
-    int i = 0;
 
-    //Fetching the directions
-    for( it = i_fileFloatData.begin(), i = 0; it != i_fileFloatData.end(); it += m_bands, ++i )
-    { 
-		m_signal[i].insert( m_signal[i].end(), it, it + m_bands );
-    }
-	
-	//Find min/max for normalization
-	vector<float> dataMax, dataMin;
-	dataMax.assign(size, -std::numeric_limits<float>::infinity());
-	dataMin.assign(size, std::numeric_limits<float>::infinity());
-    for( int s(0); s < size; ++s )
+	m_stride = ( m_bands + 3 ) / 4 * 4;
+	m_standardized.assign( static_cast< size_t >( size ) * m_stride, 0.0f );
+	m_meansAndSigmas.assign( size, std::pair< float, float >( 0.0f, 0.0f ) );
+	m_lowRankScores.clear();
+	m_lowRankComponents.clear();
+	m_rank = 0;
+	m_rankStride = 0;
+	m_useLowRank = false;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( static )
+#endif
+    for( int s = 0; s < size; ++s )
     {
-		for( int b(0); b < m_bands; ++b )
+		const short int *pSignal = &i_fileFloatData[static_cast< size_t >( s ) * m_bands];
+		float *pRow = &m_standardized[static_cast< size_t >( s ) * m_stride];
+
+		//Min max Rescale, constant signals stay at 0 to avoid dividing by 0.
+		const short int dataMin = *std::min_element( pSignal, pSignal + m_bands );
+		const short int dataMax = *std::max_element( pSignal, pSignal + m_bands );
+		if( dataMax == dataMin )
 		{
-			if (m_signal[s][b] > dataMax[s])
-			{
-				dataMax[s] = m_signal[s][b];
-			}
-			if (m_signal[s][b] < dataMin[s])
-			{
-				dataMin[s] = m_signal[s][b];
-			}
+			continue;
 		}
-    }
 
-	//Min max Rescale
-    for( int s(0); s < size; ++s )
-    {
+		const float range = dataMax - dataMin;
 		for( int b(0); b < m_bands; ++b )
 		{
-			if((m_signal[s][b] == 0 && dataMin[s] == 0) || (m_signal[s][b] == 16767 && dataMin[s] == 16767) || (dataMax[s] == dataMin[s])) //Ensure that we dont divide by 0.
-				m_signalNormalized[s].push_back(0);
-			else
-				m_signalNormalized[s].push_back ((m_signal[s][b] - dataMin[s]) / (dataMax[s] - dataMin[s]));
+			pRow[b] = ( pSignal[b] - dataMin ) / range;
 		}
-    }
 
-	m_volumes.resize(m_bands);
-	m_meansAndSigmas.resize(size);
-	//Transpose signal for easy acces of timelaps
-    for( int s(0); s < size; ++s )
-    {
-		calculateMeanAndSigma(m_signalNormalized[s], m_meansAndSigmas[s]);
+		std::pair< float, float > &params = m_meansAndSigmas[s];
+		calculateMeanAndSigma( pRow, m_bands, params );
+
+		const float sigmaInvert = params.second > 0.0f ? 1.0f / params.second : 0.0f;
+		for( int b(0); b < m_bands; ++b )
+		{
+			pRow[b] = ( pRow[b] - params.first ) * sigmaInvert;
+		}
     }
 
 	//Create texture made of 1st timelaps
@@ -362,12 +358,12 @@ void RestingStateNetwork::SetTextureFromSlider(int sliderValue)
 
 					int tensor_nxnynz = nz * m_columns * m_rows + ny * m_columns + nx;
 
-					float valx0 = (1-dx) * m_signalNormalized[tensor_xyz][sliderValue]  + (dx) * m_signalNormalized[tensor_nxyz][sliderValue];
-					float valx1 = (1-dx) * m_signalNormalized[tensor_xnyz][sliderValue] + (dx) * m_signalNormalized[tensor_nxnyz][sliderValue];
+					float valx0 = (1-dx) * getSignal(tensor_xyz, sliderValue)  + (dx) * getSignal(tensor_nxyz, sliderValue);
+					float valx1 = (1-dx) * getSignal(tensor_xnyz, sliderValue) + (dx) * getSignal(tensor_nxnyz, sliderValue);
 
 					const float valy0 = (1-dy) * valx0 + (dy) * valx1;
-					valx0 = (1-dx) * m_signalNormalized[tensor_xynz][sliderValue]  + (dx) * m_signalNormalized[tensor_nxynz][sliderValue];
-					valx1 = (1-dx) * m_signalNormalized[tensor_xnynz][sliderValue] + (dx) * m_signalNormalized[tensor_nxnynz][sliderValue];
+					valx0 = (1-dx) * getSignal(tensor_xynz, sliderValue)  + (dx) * getSignal(tensor_nxynz, sliderValue);
+					valx1 = (1-dx) * getSignal(tensor_xnynz, sliderValue) + (dx) * getSignal(tensor_nxnynz, sliderValue);
 
 					const float valy1 = (1-dy) * valx0 + (dy) * valx1;
 
@@ -429,6 +425,8 @@ void RestingStateNetwork::SetTextureFromNetwork()
 //////////////////////////////////////////////////////////////////////////////////////////
 void RestingStateNetwork::seedBased()
 {
+    PROFILE_SCOPE( "RestingStateNetwork::seedBased" );
+
 	m_3Dpoints.clear();
 	m_smallt.assign(m_datasetSize*3,0.0f);
 
@@ -536,6 +534,8 @@ private:
 //////////////////////////////////////////////////////////////////////////////////////////
 void RestingStateNetwork::render3D(bool recalculateTexture)
 {
+    PROFILE_SCOPE( "RestingStateNetwork::render3D" );
+
 	if( m_3Dpoints.size() > 0 )
     {
 		std::vector<float> texture(m_datasetSizeL*3, 0.0f);
@@ -630,132 +630,352 @@ void RestingStateNetwork::render3D(bool recalculateTexture)
 }
 
 
+namespace
+{
+// Dot product of two rows of the standardized matrix, whose length is a
+// multiple of 4.
+float dotProduct( const float *pA, const float *pB, int length )
+{
+#ifdef RSN_USE_SSE
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    int j( 0 );
+    for( ; j + 8 <= length; j += 8 )
+    {
+        sum0 = _mm_add_ps( sum0, _mm_mul_ps( _mm_loadu_ps( pA + j ), _mm_loadu_ps( pB + j ) ) );
+        sum1 = _mm_add_ps( sum1, _mm_mul_ps( _mm_loadu_ps( pA + j + 4 ), _mm_loadu_ps( pB + j + 4 ) ) );
+    }
+    for( ; j < length; j += 4 )
+    {
+        sum0 = _mm_add_ps( sum0, _mm_mul_ps( _mm_loadu_ps( pA + j ), _mm_loadu_ps( pB + j ) ) );
+    }
+
+    float partial[4];
+    _mm_storeu_ps( partial, _mm_add_ps( sum0, sum1 ) );
+    return ( partial[0] + partial[1] ) + ( partial[2] + partial[3] );
+#else
+    float partial[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for( int j( 0 ); j < length; j += 4 )
+    {
+        partial[0] += pA[j]     * pB[j];
+        partial[1] += pA[j + 1] * pB[j + 1];
+        partial[2] += pA[j + 2] * pB[j + 2];
+        partial[3] += pA[j + 3] * pB[j + 3];
+    }
+    return ( partial[0] + partial[1] ) + ( partial[2] + partial[3] );
+#endif
+}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//Low rank approximation of the standardized time series
+//
+//The principal components of the standardized rows are computed from their
+//bands x bands covariance matrix. Each voxel is then represented by its
+//projection on the first components, which keep 95% of the variance. A seed
+//query only needs to project its reference signal on those components, so
+//the correlation pass reads m_rankStride floats per voxel instead of m_stride.
+//////////////////////////////////////////////////////////////////////////////////////////
+void RestingStateNetwork::buildLowRank()
+{
+    PROFILE_SCOPE( "RestingStateNetwork::buildLowRank" );
+
+	const int bands = m_bands;
+	std::vector<double> covariance( bands * bands, 0.0 );
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+	{
+		std::vector<double> localCovariance( bands * bands, 0.0 );
+
+#ifdef _OPENMP
+    #pragma omp for schedule( static )
+#endif
+		for( int i = 0; i < m_datasetSize; i++ )
+		{
+			if( m_meansAndSigmas[i].second == 0.0f )
+			{
+				continue;
+			}
+			const float *pRow = &m_standardized[static_cast< size_t >( i ) * m_stride];
+			for( int a(0); a < bands; a++ )
+			{
+				const double za = pRow[a];
+				double *pCov = &localCovariance[a * bands];
+				for( int b(a); b < bands; b++ )
+				{
+					pCov[b] += za * pRow[b];
+				}
+			}
+		}
+
+#ifdef _OPENMP
+    #pragma omp critical( rsnCovariance )
+#endif
+		for( size_t k(0); k < covariance.size(); k++ )
+		{
+			covariance[k] += localCovariance[k];
+		}
+	}
+
+	FMatrix covMatrix( bands, bands );
+	for( int a(0); a < bands; a++ )
+	{
+		for( int b(a); b < bands; b++ )
+		{
+			covMatrix( a, b ) = covariance[a * bands + b];
+			covMatrix( b, a ) = covariance[a * bands + b];
+		}
+	}
+
+	F::FVector eigenValues;
+	std::vector<F::FVector> eigenVectors;
+	covMatrix.getEigenSystem( eigenValues, eigenVectors );
+
+	//Sort components by decreasing variance.
+	std::vector<std::pair<double, int> > order( bands );
+	double totalVariance = 0.0;
+	for( int k(0); k < bands; k++ )
+	{
+		order[k] = std::make_pair( -eigenValues[k], k );
+		totalVariance += std::max( 0.0, eigenValues[k] );
+	}
+	std::sort( order.begin(), order.end() );
+
+	//Keep 95% of the variance, between 4 and 32 components, rounded up to a
+	//multiple of 4.
+	int rank( 0 );
+	double keptVariance = 0.0;
+	while( rank < bands && rank < 32 && ( rank < 4 || keptVariance < 0.95 * totalVariance ) )
+	{
+		keptVariance += std::max( 0.0, -order[rank].first );
+		rank++;
+	}
+	for( ; rank % 4 != 0 && rank < bands; rank++ )
+	{
+		keptVariance += std::max( 0.0, -order[rank].first );
+	}
+
+	m_rank = rank;
+	m_rankStride = ( rank + 3 ) / 4 * 4;
+	m_lowRankComponents.assign( static_cast< size_t >( m_rank ) * m_stride, 0.0f );
+	for( int k(0); k < m_rank; k++ )
+	{
+		const F::FVector &v = eigenVectors[order[k].second];
+		for( int b(0); b < bands; b++ )
+		{
+			m_lowRankComponents[static_cast< size_t >( k ) * m_stride + b] = v[b];
+		}
+	}
+
+	m_lowRankScores.assign( static_cast< size_t >( m_datasetSize ) * m_rankStride, 0.0f );
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( static )
+#endif
+	for( int i = 0; i < m_datasetSize; i++ )
+	{
+		const float *pRow = &m_standardized[static_cast< size_t >( i ) * m_stride];
+		float *pScores = &m_lowRankScores[static_cast< size_t >( i ) * m_rankStride];
+		for( int k(0); k < m_rank; k++ )
+		{
+			pScores[k] = dotProduct( pRow, &m_lowRankComponents[static_cast< size_t >( k ) * m_stride], m_stride );
+		}
+	}
+
+	Logger::getInstance()->print( wxString::Format( wxT( "Resting state low rank model: %d components, %.1f%% of the variance." ),
+	                                                 m_rank, totalVariance > 0.0 ? 100.0 * keptVariance / totalVariance : 0.0 ), LOGLEVEL_MESSAGE );
+}
+
+//////////////////////////////////////////
+//Switch correlate() between the exact and the low rank correlations. The low
+//rank model is built on first use and kept until the next load.
+//////////////////////////////////////////
+void RestingStateNetwork::setUseLowRank( bool useLowRank )
+{
+	if( useLowRank && m_lowRankScores.empty() && !m_standardized.empty() )
+	{
+		buildLowRank();
+	}
+	m_useLowRank = useLowRank && !m_lowRankScores.empty();
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 //Correlation function given a position, with all other time series
+//
+//The Pearson correlation of a voxel with the mean signal of the seed is the
+//dot product of their standardized time series, divided by bands - 1. The
+//z-scores of the correlations are thresholded in the same pass. With the low
+//rank model, the reference is projected on the principal components first.
 //////////////////////////////////////////////////////////////////////////////////////////
 void RestingStateNetwork::correlate(std::vector<float>& positions)
 {
+    PROFILE_SCOPE( "RestingStateNetwork::correlate" );
+
+	if( positions.empty() )
+	{
+		return;
+	}
+
 	//Mean signal inside box
-	std::vector<float> meanSignal;
+	std::vector<float> meanSignal( m_bands, 0.0f );
+	for(unsigned int j=0; j < positions.size(); j++)
+	{	
+		int idx = positions[j];
+		for(int i=0; i < m_bands; i++)
+		{
+			meanSignal[i] += getSignal( idx, i );
+		}
+	}
 	for(int i=0; i < m_bands; i++)
 	{
-		float sum = 0;
-		for(unsigned int j=0; j < positions.size(); j++)
-		{	
-			int idx = positions[j];
-			sum += m_signalNormalized[idx][i];
-		}
-		sum /= positions.size();
-		meanSignal.push_back( sum );
+		meanSignal[i] /= positions.size();
 	}
 
-	//Get mean and sigma of it
+	//Get mean and sigma of it, and standardize it, 1 / (bands - 1) included.
 	std::pair<float, float> RefMeanAndSigma;
-	calculateMeanAndSigma(meanSignal, RefMeanAndSigma);
-	std::vector<float> corrFactors;
-	corrFactors.assign(m_datasetSize, 0.0f);
-	float corrSum = 0.0f;
-	int nb = 0;
+	calculateMeanAndSigma(&meanSignal[0], m_bands, RefMeanAndSigma);
 
-    //test optim
-    float m_bandInvert = 1.0f / (m_bands-1);
+	std::vector<float> reference( m_stride, 0.0f );
+	if( RefMeanAndSigma.second > 0.0f )
+	{
+		const float scale = 1.0f / ( RefMeanAndSigma.second * (m_bands-1) );
+		for(int i=0; i < m_bands; i++)
+		{
+			reference[i] = ( meanSignal[i] - RefMeanAndSigma.first ) * scale;
+		}
+	}
 
-	//Correlate with rest of the brain, i.e find corr factors
-	for( float x = 0; x < m_columns; x++)
+	const float *pRows = &m_standardized[0];
+	const float *pReference = &reference[0];
+	int rowStride = m_stride;
+	std::vector<float> projection;
+	if( m_useLowRank )
 	{
-		for( float y = 0; y < m_rows; y++)
+		projection.assign( m_rankStride, 0.0f );
+		for( int k(0); k < m_rank; k++ )
 		{
-			for( float z = 0; z < m_frames; z++)
-			{
-				int i = z * m_columns * m_rows + y *m_columns + x;
-				float value = 0.0f;
-				if(m_meansAndSigmas[i].first != 0)
-				{
-					float num = 0.0f;
-					float denum = 0.0f;
-					
-					for(int j = 0; j < m_bands; j++)
-					{
-						num += (meanSignal[j] - RefMeanAndSigma.first) * ( m_signalNormalized[i][j] - m_meansAndSigmas[i].first);
-					}
-					value = num / ( RefMeanAndSigma.second * m_meansAndSigmas[i].second);
-					value *= m_bandInvert;
-				}
-				nb++;
-				corrFactors[i] = value;
-				corrSum+=value;
-			}		
+			projection[k] = dotProduct( &m_lowRankComponents[static_cast< size_t >( k ) * m_stride], &reference[0], m_stride );
 		}
+		pRows = &m_lowRankScores[0];
+		pReference = &projection[0];
+		rowStride = m_rankStride;
 	}
 
-	//Find mean and sigma of all corr factors.
-	float meanCorr = corrSum / nb;
-	float sigma = 0.0f;
-	for( float x = 0; x < m_columns; x++)
+	//Correlate with rest of the brain, i.e find corr factors
+	std::vector<float> corrFactors( m_datasetSize, 0.0f );
+	double corrSum = 0.0;
+	double corrSquaredSum = 0.0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( static ) reduction( +: corrSum, corrSquaredSum )
+#endif
+	for( int i = 0; i < m_datasetSize; i++ )
 	{
-		for( float y = 0; y < m_rows; y++)
+		if(m_meansAndSigmas[i].first != 0)
 		{
-			for( float z = 0; z < m_frames; z++)
-			{
-				int i = z * m_columns * m_rows + y *m_columns + x;
-				sigma += (corrFactors[i] - meanCorr)*(corrFactors[i] - meanCorr);		
-			}
+			const float value = dotProduct( pRows + static_cast< size_t >( i ) * rowStride, pReference, rowStride );
+			corrFactors[i] = value;
+			corrSum += value;
+			corrSquaredSum += value * value;
 		}
 	}
 
-	//Calculate z-scores, and save them.
-	sigma /= nb-1;
-	sigma = sqrt(sigma);
-    float sigmaInvert = 1.0f/sigma;
+	//Find mean and sigma of all corr factors.
+	const int nb = m_datasetSize;
+	const double meanCorr = corrSum / nb;
+	const double variance = nb > 1 ? std::max( 0.0, ( corrSquaredSum - nb * meanCorr * meanCorr ) / ( nb - 1 ) ) : 0.0;
+	const float sigmaInvert = variance > 0.0 ? 1.0f / sqrt( variance ) : 0.0f;
 
+	//Calculate z-scores, and save them.
 	vector<float> zErode(m_datasetSize, 0);
-	vector<bool> binErode(m_datasetSize, false);
+	vector<char> aboveThreshold(m_datasetSize, 0);
+	float zMin = m_zMin;
+	float zMax = m_zMax;
 
-	for( float x = 0; x < m_columns; x++)
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
 	{
-		for( float y = 0; y < m_rows; y++)
+		float localZMin = zMin;
+		float localZMax = zMax;
+
+#ifdef _OPENMP
+    #pragma omp for schedule( static )
+#endif
+		for( int i = 0; i < m_datasetSize; i++ )
 		{
-			for( float z = 0; z < m_frames; z++)
+			if(corrFactors[i] > 0)
 			{
-				int i = z * m_columns * m_rows + y *m_columns + x;
-				
-				if(m_corrThreshold == 0.0f && corrFactors[i] != 0)
-				{	
-					m_3Dpoints.push_back(std::pair<Vector,float>(Vector(x,y,z),0.0f));
+				float zScore = (corrFactors[i] - meanCorr) * sigmaInvert;
+				if(zScore < localZMin && zScore > 0.0f)
+					localZMin = zScore;
+				if(zScore > localZMax)
+					localZMax = zScore;
+				if(zScore > m_corrThreshold)
+				{
+					zErode[i] = zScore;
+					aboveThreshold[i] = 1;
 				}
+			}
+		}
+
+#ifdef _OPENMP
+    #pragma omp critical( rsnZRange )
+#endif
+		{
+			zMin = std::min( zMin, localZMin );
+			zMax = std::max( zMax, localZMax );
+		}
+	}
+
+	m_zMin = zMin;
+	m_zMax = zMax;
 
-				if(corrFactors[i] > 0)
+	if(m_corrThreshold == 0.0f)
+	{
+		for( int x = 0; x < m_columns; x++)
+		{
+			for( int y = 0; y < m_rows; y++)
+			{
+				for( int z = 0; z < m_frames; z++)
 				{
-					float zScore = (corrFactors[i] - meanCorr) * sigmaInvert;
-					if(zScore < m_zMin && zScore > 0.0f)
-						m_zMin = zScore;
-					if(zScore > m_zMax)
-						m_zMax = zScore;
-					if(zScore > m_corrThreshold)
-					{
-						zErode[i] = zScore;
-						binErode[i] = 1;
+					int i = z * m_columns * m_rows + y *m_columns + x;
+					if(corrFactors[i] != 0)
+					{	
+						m_3Dpoints.push_back(std::pair<Vector,float>(Vector(x,y,z),0.0f));
 					}
 				}
 			}
 		}
 	}
 
-	//vector<int> eroded = erode(toErode);
-	vector<bool> tmp(m_datasetSize, false);
-	for( float x = 1; x < m_columns-1; x++)
+	//Keep the clusters of voxels above threshold that are large enough.
+	BinaryVolume clusters( m_columns, m_rows, m_frames );
+	for( int z = 0; z < m_frames; z++)
 	{
-		for( float y = 1; y < m_rows-1; y++)
+		for( int y = 0; y < m_rows; y++)
 		{
-			for( float z = 1; z < m_frames-1; z++)
+			for( int x = 0; x < m_columns; x++)
 			{
-				int i = z * m_columns * m_rows + y *m_columns + x;
-				if(binErode[i] && !tmp[i])
+				if(aboveThreshold[z * m_columns * m_rows + y * m_columns + x])
 				{
-					erode(tmp,binErode,x,y,z);
+					clusters.set( x, y, z, true );
 				}
+			}
+		}
+	}
+	BinaryMorphology::removeSmallComponents( clusters, StructuringElement( StructuringElement::SHAPE_FACES ), static_cast< int >( ceil( m_clusterLvlSliderValue ) ) );
 
-				if(tmp[i])
+	for( int x = 1; x < m_columns-1; x++)
+	{
+		for( int y = 1; y < m_rows-1; y++)
+		{
+			for( int z = 1; z < m_frames-1; z++)
+			{
+				int i = z * m_columns * m_rows + y *m_columns + x;
+				if(clusters.get( x, y, z ))
 				{
 					m_3Dpoints.push_back(std::pair<Vector,float>(Vector(x,y,z),zErode[i]));
 				}
@@ -971,115 +1191,28 @@ vector<vector<float>* > RestingStateNetwork::getClusters()
     return clusters;
 }
 
-void RestingStateNetwork::erode(std::vector<bool> &tmp, const std::vector<bool> &inMap, int xx, int yy, int zz)
-{
-
-	float nbConnectedVoxels = 1;
-	std::vector<bool> temp(tmp);
-    
-    std::list<Vector> toVisit;
-    int north, south, east, west, front, back, x, y, z;
-    bool NorthV, EastV, SouthV, WestV, FrontV, BackV;
-    bool resultNorth, resultEast, resultSouth, resultWest, resultFront, resultBack;
-
-	toVisit.push_front(Vector(xx,yy,zz));
-
-	while(!toVisit.empty())
-    {
-		x = toVisit.front()[0];
-        y = toVisit.front()[1];
-        z = toVisit.front()[2];
-        toVisit.pop_front();
-		int curIndex = x + y * m_columns + z * m_rows * m_columns;
-
-        tmp.at( curIndex ) = true; //Mark as read
-
-        north = std::max( 0, y - 1 );
-        south = std::min( m_rows - 1, y + 1 );
-        east  = std::min( m_columns - 1, x + 1 );
-        west  = std::max( 0, x - 1 );
-        front = std::max( 0, z - 1 );
-        back  = std::min( m_frames - 1, z + 1 );
-
-        NorthV =inMap[x + ( north * m_columns ) + ( z * m_rows * m_columns ) ];
-        SouthV = inMap[x+ ( south * m_columns ) + ( z * m_rows * m_columns ) ];
-        EastV = inMap[east+ ( y * m_columns ) + ( z * m_rows * m_columns ) ];
-        WestV = inMap[west+ ( south * m_columns ) + ( z * m_rows * m_columns ) ];
-        FrontV = inMap[x+ ( y * m_columns ) + ( front * m_rows * m_columns ) ];
-        BackV = inMap[x+ ( y * m_columns ) + ( back * m_rows * m_columns ) ];
-
-        resultNorth =tmp[x + ( north * m_columns ) + ( z * m_rows * m_columns ) ];
-        resultSouth = tmp[x+ ( south * m_columns ) + ( z * m_rows * m_columns ) ];
-        resultEast = tmp[east+ ( y * m_columns ) + ( z * m_rows * m_columns ) ];
-        resultWest = tmp[west+ ( south * m_columns ) + ( z * m_rows * m_columns ) ];
-        resultFront = tmp[x+ ( y * m_columns ) + ( front * m_rows * m_columns ) ];
-        resultBack = tmp[x+ ( y * m_columns ) + ( back * m_rows * m_columns ) ];
-
-        if(NorthV && !resultNorth) //North
-        {
-            toVisit.push_front(Vector(x,north,z));
-			nbConnectedVoxels++;
-        }
-
-        if(SouthV && !resultSouth) //South
-        {
-            toVisit.push_front(Vector(x,south,z));
-			nbConnectedVoxels++;
-        }
-
-        if(EastV  && !resultEast) //East
-        {
-            toVisit.push_front(Vector(east,y,z));
-			nbConnectedVoxels++;
-        }
-
-        if(WestV && !resultWest) //West
-        {
-            toVisit.push_front(Vector(west,y,z));
-			nbConnectedVoxels++;
-        }
-
-        if(FrontV && !resultFront) //Front
-        {
-            toVisit.push_front(Vector(x,y,front));
-			nbConnectedVoxels++;
-        }
-
-        if(BackV && !resultBack) //Back
-        {
-            toVisit.push_front(Vector(x,y,back));
-			nbConnectedVoxels++;
-        }			
-    }
-
-	if(nbConnectedVoxels < m_clusterLvlSliderValue)
-	{
-		tmp = temp;
-	}
-}
-
 //////////////////////////////////////////////////////////////////////////////////////////
 //Calculate Mean and Sigma for the signal inside the box
 //////////////////////////////////////////////////////////////////////////////////////////
-void RestingStateNetwork::calculateMeanAndSigma(std::vector<float> signal, std::pair<float, float>& params)
+void RestingStateNetwork::calculateMeanAndSigma(const float *pSignal, int size, std::pair<float, float>& params)
 {
 	float mean = 0.0f;
 	float sigma = 0.0f;
 	
 	//mean
-	for(unsigned int i=0; i < signal.size(); i++)
+	for(int i=0; i < size; i++)
 	{
-		mean+=signal[i];
+		mean+=pSignal[i];
 	}
-	mean /= signal.size();
+	mean /= size;
 
 	//sigma
-    for(unsigned int i = 0; i < signal.size(); i++)
+    for(int i = 0; i < size; i++)
     {
-         sigma += (signal[i] - mean) * (signal[i] - mean) ;
+         sigma += (pSignal[i] - mean) * (pSignal[i] - mean) ;
     }
-    sigma /= signal.size();
+    sigma /= size;
 
 	params.first = mean;
 	params.second = sqrt(sigma);
-}
\ No newline at end of file
+}
@@ -30,6 +30,9 @@ public:
 
 	void render3D(bool recalculateTexture);
 	void seedBased();
+	void correlate(std::vector< float >& position);
+	void setUseLowRank( bool useLowRank );
+	bool isUsingLowRank() const                    { return m_useLowRank; }
 	size_t getSize()                               { return m_3Dpoints.size(); }
 	void clear3DPoints()                           { m_3Dpoints.clear(); }
 	void setBoxMoving(bool move)				   { m_boxMoving = move; }
@@ -50,15 +53,17 @@ public:
 	
 private:
     bool createStructure  ( std::vector< short int > &i_fileFloatData );
-	void correlate(std::vector< float >& position);
-	void calculateMeanAndSigma(std::vector<float> signal, std::pair<float, float>& params);
+	void calculateMeanAndSigma(const float *pSignal, int size, std::pair<float, float>& params);
+	void buildLowRank();
+	//Rescaled signal, before standardization
+	float getSignal( int voxel, int band ) const { return m_standardized[static_cast< size_t >( voxel ) * m_stride + band] * m_meansAndSigmas[voxel].second + m_meansAndSigmas[voxel].first; }
 	std::vector<int> get3DIndexes(int x, int y, int z);
-	void erode(std::vector<bool> &tmp, const std::vector<bool> &inMap, int x, int y, int z);
 	
     
-	std::vector<std::vector<float> >   m_signalNormalized; //2D containing the data normalized
-	std::vector<std::vector<float> >   m_volumes; //2D containing the data normalized volume-wise aligned
-	std::vector<std::pair< float, float > > m_meansAndSigmas; 
+	std::vector<float> m_standardized; //Standardized time series, voxel-major, m_stride floats per voxel
+	std::vector<std::pair< float, float > > m_meansAndSigmas; //Of the rescaled time series
+	std::vector<float> m_lowRankScores; //Projection of each standardized row on the principal components, m_rankStride floats per voxel
+	std::vector<float> m_lowRankComponents; //Principal components of the standardized rows, m_stride floats each
 	std::vector<std::pair<Vector,float> > m_3Dpoints; //3D points and their positions
 	std::vector<float> m_smallt; //3x3x3 RGB values
 	std::vector<float> m_zMap; //1x1x1 zscores
@@ -76,6 +81,10 @@ private:
 	int m_columns;
 	int m_frames;
 	int m_bands;
+	int m_stride;
+	int m_rank;
+	int m_rankStride;
+	bool m_useLowRank;
 	int m_datasetSize;
 	float m_voxelSizeX;
     float m_voxelSizeY;
@@ -0,0 +1,154 @@
+#include "SelectionQuery.h"
+
+#include "DatasetManager.h"
+#include "../gui/SelectionObject.h"
+#include "../gui/SelectionVOI.h"
+
+#include <cstddef>
+
+///////////////////////////////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////////////////////////////
+SelectionQuery::SelectionQuery()
+:   m_type( QUERY_BOX ),
+    m_pVOI( NULL )
+{
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        m_min[axis]    = 0.0f;
+        m_max[axis]    = 0.0f;
+        m_center[axis] = 0.0f;
+        m_radius[axis] = 0.0f;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Takes the shape and extents of a selection object.
+///////////////////////////////////////////////////////////////////////////
+void SelectionQuery::setObject( SelectionObject *pSelObj )
+{
+    Vector l_center = pSelObj->getCenter();
+    Vector l_size   = pSelObj->getSize();
+
+    const double center[3]    = { l_center.x, l_center.y, l_center.z };
+    const double size[3]      = { l_size.x, l_size.y, l_size.z };
+    const float  voxelSize[3] = { DatasetManager::getInstance()->getVoxelX(),
+                                  DatasetManager::getInstance()->getVoxelY(),
+                                  DatasetManager::getInstance()->getVoxelZ() };
+
+    // A VOI keeps the box as its bounds.
+    setShape( pSelObj->getSelectionType() == ELLIPSOID_TYPE, center, size, voxelSize );
+
+    if( pSelObj->getSelectionType() != BOX_TYPE && pSelObj->getSelectionType() != ELLIPSOID_TYPE )
+    {
+        m_type = QUERY_VOI;
+        m_pVOI = (SelectionVOI*)pSelObj;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Also used by the BatchProcessor, with the objects read from a scene.
+///////////////////////////////////////////////////////////////////////////
+void SelectionQuery::setShape( bool isEllipsoid, const double *pCenter, const double *pSize, const float *pVoxelSize )
+{
+    float min[3];
+    float max[3];
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        min[axis] = pCenter[axis] - pSize[axis] / 2 * pVoxelSize[axis];
+        max[axis] = pCenter[axis] + pSize[axis] / 2 * pVoxelSize[axis];
+    }
+
+    if( isEllipsoid )
+    {
+        setEllipsoid( min, max );
+    }
+    else
+    {
+        setBox( min, max );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Axis aligned box, in mm.
+///////////////////////////////////////////////////////////////////////////
+void SelectionQuery::setBox( const float *pMin, const float *pMax )
+{
+    m_type = QUERY_BOX;
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        m_min[axis] = pMin[axis];
+        m_max[axis] = pMax[axis];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Ellipsoid inscribed in an axis aligned box, in mm.
+///////////////////////////////////////////////////////////////////////////
+void SelectionQuery::setEllipsoid( const float *pMin, const float *pMax )
+{
+    m_type = QUERY_ELLIPSOID;
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        m_min[axis]    = pMin[axis];
+        m_max[axis]    = pMax[axis];
+        m_radius[axis] = ( m_max[axis] - m_min[axis] ) / 2.0f;
+        m_center[axis] = m_max[axis] - m_radius[axis];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+bool SelectionQuery::overlaps( const float *pMin, const float *pMax ) const
+{
+    return m_min[0] <= pMax[0] && m_max[0] >= pMin[0] &&
+           m_min[1] <= pMax[1] && m_max[1] >= pMin[1] &&
+           m_min[2] <= pMax[2] && m_max[2] >= pMin[2];
+}
+
+///////////////////////////////////////////////////////////////////////////
+bool SelectionQuery::contains( const float *pMin, const float *pMax ) const
+{
+    switch( m_type )
+    {
+        case QUERY_BOX:
+            return pMin[0] >= m_min[0] && pMax[0] <= m_max[0] &&
+                   pMin[1] >= m_min[1] && pMax[1] <= m_max[1] &&
+                   pMin[2] >= m_min[2] && pMax[2] <= m_max[2];
+
+        case QUERY_ELLIPSOID:
+            //The ellipsoid is convex: the box is inside if its 8 corners are.
+            for( int o = 0; o < 8; ++o )
+            {
+                if( !contains( ( o & 1 ) ? pMax[0] : pMin[0], 
+                               ( o & 2 ) ? pMax[1] : pMin[1], 
+                               ( o & 4 ) ? pMax[2] : pMin[2] ) )
+                {
+                    return false;
+                }
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+bool SelectionQuery::contains( float posX, float posY, float posZ ) const
+{
+    switch( m_type )
+    {
+        case QUERY_BOX:
+            return posX <= m_max[0] && posX >= m_min[0] && 
+                   posY <= m_max[1] && posY >= m_min[1] &&
+                   posZ <= m_max[2] && posZ >= m_min[2];
+
+        case QUERY_ELLIPSOID:
+            return (posX - m_center[0])*(posX - m_center[0]) / ( m_radius[0] * m_radius[0] ) + 
+                   (posY - m_center[1])*(posY - m_center[1]) / ( m_radius[1] * m_radius[1] ) + 
+                   (posZ - m_center[2])*(posZ - m_center[2]) / ( m_radius[2] * m_radius[2] ) <= 1.0f;
+
+        default:
+            return m_pVOI->isPointInside( posX, posY, posZ );
+    }
+}
@@ -0,0 +1,45 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            SelectionQuery.h
+//
+// Description: Geometry of a selection object (box, ellipsoid or VOI), as
+// tested by the spatial indices of the fibers (Octree, FiberBVH).
+/////////////////////////////////////////////////////////////////////////////
+#ifndef SELECTIONQUERY_H_
+#define SELECTIONQUERY_H_
+
+class SelectionObject;
+class SelectionVOI;
+
+class SelectionQuery
+{
+public:
+    SelectionQuery();
+
+    void setObject( SelectionObject *pSelObj );
+    // Box or ellipsoid as kept by the selection objects: center in mm and
+    // size in voxels.
+    void setShape( bool isEllipsoid, const double *pCenter, const double *pSize, const float *pVoxelSize );
+    void setBox( const float *pMin, const float *pMax );
+    void setEllipsoid( const float *pMin, const float *pMax );
+
+    const float * getMin() const { return m_min; }
+    const float * getMax() const { return m_max; }
+
+    // Both bounds inclusive.
+    bool overlaps( const float *pMin, const float *pMax ) const;
+    // True when the whole box is inside the selection. Always false for VOIs.
+    bool contains( const float *pMin, const float *pMax ) const;
+    bool contains( float posX, float posY, float posZ ) const;
+
+private:
+    enum QueryType { QUERY_BOX, QUERY_ELLIPSOID, QUERY_VOI };
+
+    QueryType m_type;
+    float m_min[3];    //Bounding box of the selection
+    float m_max[3];
+    float m_center[3]; //Ellipsoid
+    float m_radius[3];
+    SelectionVOI *m_pVOI;
+};
+
+#endif /* SELECTIONQUERY_H_ */
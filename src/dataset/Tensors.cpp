@@ -12,6 +12,7 @@
 #include "Tensors.h"
 
 #include "DatasetManager.h"
+#include "NiftiFile.h"
 #include "../Logger.h"
 #include "../gfx/ShaderHelper.h"
 #include "../gui/MainFrame.h"
@@ -114,9 +115,7 @@ bool Tensors::load( nifti_image *pHeader, nifti_image *pBody )
     vector< float > l_fileFloatData( l_nSize * m_bands );
 
     // We need to do a bit of moving around with the data in order to have it like we want.
-    for( int i = 0; i < l_nSize; ++i )
-        for( int j = 0; j < m_bands; ++j )
-            l_fileFloatData[i * m_bands + j] = l_data[(j * l_nSize) + i];
+    NiftiFile::interleaveBands( l_data, l_nSize, m_bands, &l_fileFloatData[0] );
 
     // Once the file has been read successfully, we need to create the structure 
     // that will contain all the sphere points representing the tensors.
@@ -274,6 +273,9 @@ void Tensors::normalize()
         m_tensorsMatrix[i]( 2, 2 ) /= correction;
     }
     m_isNormalized = !m_isNormalized;
+
+    // Also called right after loading, so this is where the packed copy gets built.
+    m_packedField.build( m_tensorsMatrix, m_tensorsFA, m_tensorsEigenValues, m_columns, m_rows, m_frames, m_voxelSizeX, m_voxelSizeY, m_voxelSizeZ );
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -13,6 +13,7 @@
 
 #include "DatasetInfo.h"
 #include "Glyph.h"
+#include "PackedTensorField.h"
 #include "../misc/Fantom/FVector.h"
 #include "../misc/lic/TensorField.h"
 #include "../misc/nifti/nifti1_io.h"
@@ -30,6 +31,7 @@ public:
     std::vector< FMatrix > *getTensorsMatrix()                       { return &m_tensorsMatrix;           };
     std::vector< float   > *getTensorsFA()                           { return &m_tensorsFA;               };
     std::vector< F::FVector > *getTensorsEV()                        { return &m_tensorsEigenValues;      };
+    const PackedTensorField *getPackedField() const                  { return &m_packedField;             };
         
     void draw(); // From DatasetInfo
 
@@ -51,6 +53,7 @@ private:
     std::vector< FMatrix >  m_tensorsMatrix;    // All the tensors's matrix.
     std::vector< float   >  m_tensorsFA;        // All the tensors's FA values.
     std::vector< F::FVector >  m_tensorsEigenValues;// All the tensors's eigen values
+    PackedTensorField       m_packedField;      // Packed copy of the above, used by the RTT.
     bool m_isNormalized;
     static const int VISUALIZATION_FACTOR = 600;
 };
@@ -0,0 +1,271 @@
+#include "TractogramFile.h"
+
+#include "../Logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    const char MAGIC[8] = { 'F', 'N', 'T', 'R', 'A', 'C', 'T', '\0' };
+
+    wxUint64 alignUp( wxUint64 offset )
+    {
+        return ( offset + TractogramFile::ALIGNMENT - 1 ) / TractogramFile::ALIGNMENT * TractogramFile::ALIGNMENT;
+    }
+
+    // Writes 4 bytes values in little-endian order.
+    void writeWords( std::ofstream &file, const void *pData, std::size_t count )
+    {
+        if( TractogramFile::isHostLittleEndian() )
+        {
+            file.write( static_cast< const char * >( pData ), count * 4 );
+            return;
+        }
+
+        const char *pBytes = static_cast< const char * >( pData );
+        for( std::size_t i = 0; i < count; ++i )
+        {
+            char word[4] = { pBytes[i * 4 + 3], pBytes[i * 4 + 2], pBytes[i * 4 + 1], pBytes[i * 4] };
+            file.write( word, 4 );
+        }
+    }
+
+    void writePadding( std::ofstream &file, wxUint64 offset )
+    {
+        static const char zeros[TractogramFile::ALIGNMENT] = { 0 };
+        file.write( zeros, alignUp( offset ) - offset );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+bool TractogramFile::isHostLittleEndian()
+{
+    const wxUint32 one = 1;
+    return *reinterpret_cast< const char * >( &one ) == 1;
+}
+
+///////////////////////////////////////////////////////////////////////////
+bool TractogramFile::open( const wxString &filename )
+{
+    close();
+
+    if( !m_file.open( filename ) )
+    {
+        Logger::getInstance()->print( wxT( "Cannot map " ) + filename, LOGLEVEL_ERROR );
+        return false;
+    }
+
+    if( m_file.getSize() < sizeof( Header ) )
+    {
+        Logger::getInstance()->print( wxT( "Fibers file is too small for its header" ), LOGLEVEL_ERROR );
+        close();
+        return false;
+    }
+
+    memcpy( &m_header, m_file.getData(), sizeof( Header ) );
+
+    if( !isHostLittleEndian() )
+    {
+        // Swap the fields after the magic in place.
+        char *pFields = reinterpret_cast< char * >( &m_header.m_version );
+        for( int i = 0; i < 4; ++i )
+        {
+            std::reverse( pFields + i * 4, pFields + i * 4 + 4 );
+        }
+        pFields = reinterpret_cast< char * >( &m_header.m_pointsOffset );
+        for( int i = 0; i < 3; ++i )
+        {
+            std::reverse( pFields + i * 8, pFields + i * 8 + 8 );
+        }
+    }
+
+    if( memcmp( m_header.m_magic, MAGIC, sizeof( MAGIC ) ) != 0 || m_header.m_version != VERSION )
+    {
+        Logger::getInstance()->print( wxT( "Not a supported binary fibers file" ), LOGLEVEL_ERROR );
+        close();
+        return false;
+    }
+
+    const wxUint64 size = m_file.getSize();
+    const wxUint64 pointsEnd = m_header.m_pointsOffset + wxUint64( m_header.m_countPoints ) * 12;
+    const wxUint64 linesEnd  = m_header.m_linePointersOffset + ( wxUint64( m_header.m_countLines ) + 1 ) * 4;
+    const wxUint64 colorsEnd = m_header.m_colorsOffset + wxUint64( m_header.m_countPoints ) * 3;
+
+    const bool hasColors = ( m_header.m_flags & HAS_COLORS ) != 0;
+
+    bool valid = m_header.m_pointsOffset >= sizeof( Header )
+              && m_header.m_pointsOffset % ALIGNMENT == 0 && m_header.m_linePointersOffset % ALIGNMENT == 0
+              && ( !hasColors || m_header.m_colorsOffset % ALIGNMENT == 0 )
+              && pointsEnd <= size && linesEnd <= size 
+              && ( !hasColors || colorsEnd <= size );
+
+    if( !valid )
+    {
+        Logger::getInstance()->print( wxT( "Binary fibers file is truncated or corrupted" ), LOGLEVEL_ERROR );
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void TractogramFile::close()
+{
+    m_file.close();
+    memset( &m_header, 0, sizeof( Header ) );
+}
+
+const float * TractogramFile::getPoints() const
+{
+    return reinterpret_cast< const float * >( m_file.getData() + m_header.m_pointsOffset );
+}
+
+const wxInt32 * TractogramFile::getLinePointers() const
+{
+    return reinterpret_cast< const wxInt32 * >( m_file.getData() + m_header.m_linePointersOffset );
+}
+
+const wxUint8 * TractogramFile::getColors() const
+{
+    if( !( m_header.m_flags & HAS_COLORS ) )
+    {
+        return NULL;
+    }
+    return reinterpret_cast< const wxUint8 * >( m_file.getData() + m_header.m_colorsOffset );
+}
+
+///////////////////////////////////////////////////////////////////////////
+bool TractogramFile::read( const wxString &filename,
+                           std::vector< float > &o_points,
+                           std::vector< int > &o_linePointers,
+                           std::vector< wxUint8 > &o_colors )
+{
+    TractogramFile file;
+    if( !file.open( filename ) )
+    {
+        return false;
+    }
+
+    const Header &header  = file.getHeader();
+    const int countLines  = header.m_countLines;
+    const int countPoints = header.m_countPoints;
+
+    const float *pPoints = file.getPoints();
+    o_points.assign( pPoints, pPoints + countPoints * 3 );
+
+    const wxInt32 *pLinePointers = file.getLinePointers();
+    o_linePointers.assign( pLinePointers, pLinePointers + countLines + 1 );
+
+    if( !isHostLittleEndian() )
+    {
+        for( unsigned int i = 0; i < o_points.size(); ++i )
+        {
+            char *pBytes = reinterpret_cast< char * >( &o_points[i] );
+            std::reverse( pBytes, pBytes + 4 );
+        }
+        for( unsigned int i = 0; i < o_linePointers.size(); ++i )
+        {
+            char *pBytes = reinterpret_cast< char * >( &o_linePointers[i] );
+            std::reverse( pBytes, pBytes + 4 );
+        }
+    }
+
+    bool validLines = o_linePointers[0] == 0 && o_linePointers[countLines] == countPoints;
+    for( int i = 0; validLines && i < countLines; ++i )
+    {
+        validLines = o_linePointers[i] <= o_linePointers[i + 1];
+    }
+
+    if( !validLines )
+    {
+        Logger::getInstance()->print( wxT( "Invalid line pointers in binary fibers file" ), LOGLEVEL_ERROR );
+        o_points.clear();
+        o_linePointers.clear();
+        return false;
+    }
+
+    const wxUint8 *pColors = file.getColors();
+    if( pColors != NULL )
+    {
+        o_colors.assign( pColors, pColors + countPoints * 3 );
+    }
+    else
+    {
+        o_colors.clear();
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// linePointers holds countLines + 1 entries, the last one being the number
+// of points. colors may be empty.
+///////////////////////////////////////////////////////////////////////////
+bool TractogramFile::write( const wxString &filename, 
+                            const std::vector< float > &points, 
+                            const std::vector< int > &linePointers, 
+                            const std::vector< wxUint8 > &colors )
+{
+    if( linePointers.empty() )
+    {
+        return false;
+    }
+
+    Header header;
+    memset( &header, 0, sizeof( Header ) );
+    memcpy( header.m_magic, MAGIC, sizeof( MAGIC ) );
+    header.m_version            = VERSION;
+    header.m_flags              = colors.empty() ? 0 : HAS_COLORS;
+    header.m_countLines         = linePointers.size() - 1;
+    header.m_countPoints        = points.size() / 3;
+    header.m_pointsOffset       = alignUp( sizeof( Header ) );
+    header.m_linePointersOffset = alignUp( header.m_pointsOffset + wxUint64( points.size() ) * 4 );
+    header.m_colorsOffset       = colors.empty() ? 0 : alignUp( header.m_linePointersOffset + wxUint64( linePointers.size() ) * 4 );
+
+    std::ofstream file( filename.fn_str(), std::ios::binary );
+    if( !file )
+    {
+        Logger::getInstance()->print( wxT( "Cannot write " ) + filename, LOGLEVEL_ERROR );
+        return false;
+    }
+
+    file.write( header.m_magic, sizeof( header.m_magic ) );
+    writeWords( file, &header.m_version, 4 );
+    if( isHostLittleEndian() )
+    {
+        file.write( reinterpret_cast< const char * >( &header.m_pointsOffset ), 3 * 8 );
+    }
+    else
+    {
+        const wxUint64 *pOffsets = &header.m_pointsOffset;
+        for( int i = 0; i < 3; ++i )
+        {
+            char bytes[8];
+            for( int b = 0; b < 8; ++b )
+            {
+                bytes[b] = static_cast< char >( pOffsets[i] >> ( 8 * b ) );
+            }
+            file.write( bytes, 8 );
+        }
+    }
+    file.write( reinterpret_cast< const char * >( header.m_reserved ), sizeof( header.m_reserved ) );
+    writePadding( file, sizeof( Header ) );
+
+    if( !points.empty() )
+    {
+        writeWords( file, &points[0], points.size() );
+    }
+    writePadding( file, header.m_pointsOffset + wxUint64( points.size() ) * 4 );
+
+    writeWords( file, &linePointers[0], linePointers.size() );
+
+    if( !colors.empty() )
+    {
+        writePadding( file, header.m_linePointersOffset + wxUint64( linePointers.size() ) * 4 );
+        file.write( reinterpret_cast< const char * >( &colors[0] ), colors.size() );
+    }
+
+    return file.good();
+}
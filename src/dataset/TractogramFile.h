@@ -0,0 +1,76 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            TractogramFile.h
+//
+// Description: Native binary fibers format (.fbt), made to be memory mapped.
+//
+// Layout, all little-endian, every block starting on a 64 bytes boundary:
+//     Header        64 bytes
+//     Points        countPoints * 3 float (x, y, z)
+//     Line pointers (countLines + 1) int32, first point of each line
+//     Colors        countPoints * 3 uint8 (r, g, b), only with HAS_COLORS
+// The points are stored in the space used by the navigator, as they are in
+// Fibers::m_pointArray, so loading them needs no transformation. Fibers
+// copies them out of the mapping (see read()), it does not keep the file
+// mapped. Other formats are converted by saving loaded fibers, from the
+// save dialog or without any window (-c on the command line).
+/////////////////////////////////////////////////////////////////////////////
+#ifndef TRACTOGRAMFILE_H_
+#define TRACTOGRAMFILE_H_
+
+#include "../misc/MappedFile.h"
+
+#include <wx/defs.h>
+#include <wx/string.h>
+
+#include <vector>
+
+class TractogramFile
+{
+public:
+    static const wxUint32 VERSION    = 1;
+    static const wxUint32 HAS_COLORS = 1;
+    static const wxUint32 ALIGNMENT  = 64;
+
+    struct Header
+    {
+        char     m_magic[8];
+        wxUint32 m_version;
+        wxUint32 m_flags;
+        wxUint32 m_countLines;
+        wxUint32 m_countPoints;
+        wxUint64 m_pointsOffset;
+        wxUint64 m_linePointersOffset;
+        wxUint64 m_colorsOffset;
+        wxUint8  m_reserved[16];
+    };
+
+    // Maps the file and checks that the header and the blocks are consistent.
+    bool open( const wxString &filename );
+    void close();
+
+    const Header &   getHeader() const { return m_header; }
+    const float *    getPoints() const;
+    const wxInt32 *  getLinePointers() const;
+    const wxUint8 *  getColors() const;    // NULL if the file has no colors.
+
+    // Copies the whole file, in host byte order. The line pointers are
+    // checked, so they can be trusted, but empty lines are allowed. o_colors
+    // is empty if the file has none.
+    static bool read( const wxString &filename,
+                      std::vector< float > &o_points,
+                      std::vector< int > &o_linePointers,
+                      std::vector< wxUint8 > &o_colors );
+
+    static bool write( const wxString &filename, 
+                       const std::vector< float > &points, 
+                       const std::vector< int > &linePointers, 
+                       const std::vector< wxUint8 > &colors );
+
+    static bool isHostLittleEndian();
+
+private:
+    MappedFile m_file;
+    Header     m_header;
+};
+
+#endif //TRACTOGRAMFILE_H_
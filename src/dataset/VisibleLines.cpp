@@ -0,0 +1,27 @@
+#include "VisibleLines.h"
+
+///////////////////////////////////////////////////////////////////////////
+
+void compactVisibleLines( const std::vector< int >  &linePointers,
+                          const std::vector< bool > &selected,
+                          const std::vector< bool > &filtered,
+                          bool                       activateAllSelObj,
+                          std::vector< int >        &o_firsts,
+                          std::vector< int >        &o_counts )
+{
+    const int countLines = linePointers.empty() ? 0 : static_cast< int >( linePointers.size() ) - 1;
+
+    o_firsts.reserve( countLines );
+    o_counts.reserve( countLines );
+    o_firsts.clear();
+    o_counts.clear();
+
+    for( int i = 0; i < countLines; ++i )
+    {
+        if( ( selected[i] || !activateAllSelObj ) && !filtered[i] )
+        {
+            o_firsts.push_back( linePointers[i] );
+            o_counts.push_back( linePointers[i + 1] - linePointers[i] );
+        }
+    }
+}
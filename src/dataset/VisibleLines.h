@@ -0,0 +1,23 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            VisibleLines.h
+//
+// Description: Start index and point count of the fibers to draw, compacted
+// so that they can be sent in a single glMultiDrawArrays call.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef VISIBLELINES_H_
+#define VISIBLELINES_H_
+
+#include <vector>
+
+// Line i goes from point linePointers[i] to linePointers[i + 1]. It is drawn
+// if it is not filtered, and if it is selected or activateAllSelObj is false.
+// The outputs are cleared first, their capacity is kept at the number of
+// lines so that they are never reallocated when the selection grows.
+void compactVisibleLines( const std::vector< int >  &linePointers,
+                          const std::vector< bool > &selected,
+                          const std::vector< bool > &filtered,
+                          bool                       activateAllSelObj,
+                          std::vector< int >        &o_firsts,
+                          std::vector< int >        &o_counts );
+
+#endif /* VISIBLELINES_H_ */
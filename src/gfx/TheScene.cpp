@@ -33,6 +33,7 @@
 #include "../gui/SelectionTree.h"
 #include "../gui/SelectionVOI.h"
 #include "../misc/IsoSurface/CIsoSurface.h"
+#include "../misc/Profiler.h"
 
 #include <algorithm>
 #include <vector>
@@ -249,6 +250,8 @@ void TheScene::bindTextures()
 ///////////////////////////////////////////////////////////////////////////
 void TheScene::renderScene()
 {
+    PROFILE_SCOPE( "TheScene::renderScene" );
+
     Logger::getInstance()->printIfGLError( wxT( "Error before renderScene" ) );
     // This will put the frustum information up to date for any render that needs it. 
     extractFrustum();
@@ -359,10 +362,30 @@ void TheScene::renderScene()
     }
 
     //Real-time Fiber Tractography
-    if( RTTrackingHelper::getInstance()->isRTTDirty() && RTTrackingHelper::getInstance()->isRTTReady() )
+    bool isRTTDirty = RTTrackingHelper::getInstance()->isRTTDirty() && RTTrackingHelper::getInstance()->isRTTReady();
+    if( !RTTrackingHelper::getInstance()->isRTTReady() && m_pRealTimeFibers->isTrackingInProgress() )
+    {
+        // The tracking was switched off while seeds were still pending.
+        m_pRealTimeFibers->stopProgressiveSeed();
+    }
+    if( isRTTDirty && !RTTrackingHelper::getInstance()->isProgressive() )
     {	
 		m_pRealTimeFibers->seed();
     }
+    else if( isRTTDirty || m_pRealTimeFibers->isTrackingInProgress() )
+    {
+        // Moving the selection restarts the progressive tracking, dropping the pending seeds.
+        if( isRTTDirty )
+        {
+            m_pRealTimeFibers->startProgressiveSeed();
+        }
+
+        if( m_pRealTimeFibers->trackNextBatch( RTTrackingHelper::getInstance()->getFrameBudget() ) )
+        {
+            MyApp::frame->m_pMainGL->Refresh( false );
+        }
+        m_pRealTimeFibers->renderRTTFibers( false, false, false );
+    }
     else if(m_pRealTimeFibers->getSize() > 0)
     {
         if(!RTTrackingHelper::getInstance()->isTrackActionPlaying())
@@ -535,6 +558,8 @@ void TheScene::extractFrustum()
 
 void TheScene::renderSlices()
 {
+    PROFILE_SCOPE( "TheScene::renderSlices" );
+
     glPushAttrib( GL_ALL_ATTRIB_BITS );
 
     if( SceneManager::getInstance()->isAlphaBlend() )
@@ -574,6 +599,8 @@ void TheScene::renderSlices()
 ///////////////////////////////////////////////////////////////////////////
 void TheScene::renderMesh()
 {
+    PROFILE_SCOPE( "TheScene::renderMesh" );
+
     glPushAttrib( GL_ALL_ATTRIB_BITS );
 
     if( SceneManager::getInstance()->isLightingActive() )
@@ -664,6 +691,8 @@ void TheScene::renderMeshInternal(  DatasetInfo *pDsInfo )
 ///////////////////////////////////////////////////////////////////////////
 void TheScene::renderFibers()
 {
+    PROFILE_SCOPE( "TheScene::renderFibers" );
+
     glPushAttrib( GL_ALL_ATTRIB_BITS );
 
     for( int i = 0; i < MyApp::frame->m_pListCtrl->GetItemCount(); ++i )
@@ -719,6 +748,8 @@ void TheScene::renderFibers()
 ///////////////////////////////////////////////////////////////////////////
 void TheScene::renderTensors()
 {
+    PROFILE_SCOPE( "TheScene::renderTensors" );
+
     glPushAttrib( GL_ALL_ATTRIB_BITS );
 
     // This will check if we are suppose to draw the tensor using GL_LINE or GL_FILL.
@@ -747,6 +778,8 @@ void TheScene::renderTensors()
 ///////////////////////////////////////////////////////////////////////////
 void TheScene::renderODFs()
 {
+    PROFILE_SCOPE( "TheScene::renderODFs" );
+
     glPushAttrib( GL_ALL_ATTRIB_BITS );
 
     // This will check if we are suppose to draw the odfs using GL_LINE or GL_FILL.
@@ -842,6 +875,8 @@ void TheScene::drawSphere( float xPos, float yPos, float zPos, float ray )
 ///////////////////////////////////////////////////////////////////////////
 void TheScene::drawSelectionObjects()
 {
+    PROFILE_SCOPE( "TheScene::drawSelectionObjects" );
+
     SelectionTree::SelectionObjectVector selectionObjects = SceneManager::getInstance()->getSelectionTree().getAllObjects();
     
     // TODO do all the processing only if there is at least one selection object
@@ -962,6 +997,8 @@ void TheScene::drawColorMapLegend()
 ///////////////////////////////////////////////////////////////////////////
 void TheScene::drawVectors()
 {
+    PROFILE_SCOPE( "TheScene::drawVectors" );
+
     glPushAttrib( GL_ALL_ATTRIB_BITS );
 
     glEnable( GL_BLEND );
@@ -1274,6 +1311,8 @@ void TheScene::drawVectors()
 
 void TheScene::drawMaximas()
 {
+    PROFILE_SCOPE( "TheScene::drawMaximas" );
+
     glPushAttrib( GL_ALL_ATTRIB_BITS );
 
     vector<Maximas *> v = DatasetManager::getInstance()->getMaximas();
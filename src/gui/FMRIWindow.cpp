@@ -43,9 +43,14 @@ FMRIWindow::FMRIWindow( wxWindow *pParent, MainFrame *pMf, wxWindowID id, const
     Connect( m_pBtnStart->GetId(), wxEVT_COMMAND_TOGGLEBUTTON_CLICKED, wxCommandEventHandler(FMRIWindow::OnStartRTFMRI) );
     m_pBtnStart->Enable(false);
 
+	m_pChkLowRank = new wxCheckBox( this, wxID_ANY, wxT("Fast correlation (PCA)"), wxDefaultPosition, wxSize(230, -1) );
+	Connect( m_pChkLowRank->GetId(), wxEVT_COMMAND_CHECKBOX_CLICKED, wxCommandEventHandler(FMRIWindow::onToggleLowRank) );
+	m_pChkLowRank->Enable(false);
+
 	wxBoxSizer *pBoxRow1 = new wxBoxSizer( wxVERTICAL );
 	pBoxRow1->Add( m_pBtnSelectFMRI, 0, wxALIGN_CENTER | wxALL, 1 );
 	pBoxRow1->Add( m_pBtnStart, 0, wxALIGN_CENTER | wxALL, 1 );
+	pBoxRow1->Add( m_pChkLowRank, 0, wxALIGN_CENTER | wxALL, 1 );
 	m_pFMRISizer->Add( pBoxRow1, 0, wxFIXED_MINSIZE | wxEXPAND, 0 );
 
 	m_pTextDisplayMode = new wxStaticText( this, wxID_ANY, wxT( "Display:" ), wxDefaultPosition, wxSize(200, -1) );
@@ -155,6 +160,14 @@ wxSizer* FMRIWindow::getWindowSizer()
     return m_pFMRISizer;
 }
 
+void FMRIWindow::SetStartButton()
+{
+	m_pBtnStart->Enable( true );
+	m_pBtnStart->SetBackgroundColour(wxColour( 147, 255, 239 ));
+	m_pChkLowRank->Enable( true );
+	m_pChkLowRank->SetValue( false );
+}
+
 void FMRIWindow::SetSelectButton()
 {
 	DatasetIndex indx = DatasetManager::getInstance()->m_pRestingStateNetwork->getIndex();
@@ -307,6 +320,15 @@ void FMRIWindow::onInitiateTractography( wxCommandEvent& WXUNUSED(event) )
 		RTTrackingHelper::getInstance()->setSeedFromfMRI(false);
 }
 
+void FMRIWindow::onToggleLowRank( wxCommandEvent& WXUNUSED(event) )
+{
+	//Building the low rank model takes a few seconds on a full brain.
+	wxBusyCursor wait;
+	DatasetManager::getInstance()->m_pRestingStateNetwork->setUseLowRank( m_pChkLowRank->GetValue() );
+	m_pChkLowRank->SetValue( DatasetManager::getInstance()->m_pRestingStateNetwork->isUsingLowRank() );
+	RTFMRIHelper::getInstance()->setRTFMRIDirty( true );
+}
+
 void FMRIWindow::OnStartRTFMRI( wxCommandEvent& WXUNUSED(event) )
 {
 	RTFMRIHelper::getInstance()->toggleRTFMRIReady();
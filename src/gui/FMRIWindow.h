@@ -20,6 +20,7 @@
 
 class MainFrame;
 class wxToggleButton;
+class wxCheckBox;
 
 class FMRIWindow: public wxScrolledWindow
 {
@@ -32,7 +33,7 @@ public:
     void OnSize( wxSizeEvent &event );
     wxSizer* getWindowSizer();
 	void SetSelectButton(); 
-	void SetStartButton(){ m_pBtnStart->Enable( true ); m_pBtnStart->SetBackgroundColour(wxColour( 147, 255, 239 ));}
+	void SetStartButton();
 	void setInitiateTractoBtn(){ m_pBtnTractofMRI->Enable ( true ); } 
 
 public:
@@ -40,6 +41,7 @@ public:
 	void onSwitchViewNet					   ( wxCommandEvent& event );
 	void OnSliderRestMoved                     ( wxCommandEvent& event );
 	void OnStartRTFMRI					       ( wxCommandEvent& event );
+	void onToggleLowRank					   ( wxCommandEvent& event );
 	void OnSliderCorrThreshMoved			   ( wxCommandEvent& event );
 	void OnSliderClusterLevelMoved			   ( wxCommandEvent& event );
 	void OnSliderSizePMoved					   ( wxCommandEvent& event );
@@ -61,6 +63,7 @@ private:
 	wxStaticText        *m_pTextDisplayMode;
 	wxBoxSizer          *m_pBoxDisplayRadios;
 	wxToggleButton      *m_pBtnStart;
+	wxCheckBox          *m_pChkLowRank;
 	wxSlider            *m_pSliderCorrThreshold;
 	wxTextCtrl          *m_pTxtCorrThreshBox;
     wxStaticText        *m_pTextCorrThreshold;
@@ -13,6 +13,7 @@
 #include "../dataset/RTFMRIHelper.h"
 #include "../dataset/Tensors.h"
 #include "../gfx/ShaderHelper.h"
+#include "../misc/Profiler.h"
 #include "../misc/lic/FgeOffscreen.h"
 
 #include <wx/math.h>
@@ -48,7 +49,10 @@ const wxPoint& i_pos,const wxSize & i_size, long i_style, const wxString& i_name
 #endif
     m_isDragging( false ),
     m_isrDragging( false ),
-    m_ismDragging( false )
+    m_ismDragging( false ),
+    m_frameTimeTotal( 0 ),
+    m_frameTimeMax( 0 ),
+    m_frameCount( 0 )
 {
     m_init = false;
     m_view = i_view;
@@ -129,7 +133,16 @@ void MainCanvas::changeOrthoSize()
 
 void MainCanvas::OnPaint( wxPaintEvent& WXUNUSED(event) )
 {
-    render();
+    {
+        PROFILE_SCOPE( "MainCanvas::render" );
+        render();
+    }
+
+    // A profiler frame ends with each render of the main view.
+    if( m_view == MAIN_VIEW && Profiler::isEnabled() )
+    {
+        Profiler::getInstance()->endFrame();
+    }
 }
 
 void MainCanvas::OnSize( wxSizeEvent& evt )
@@ -654,6 +667,11 @@ void MainCanvas::render()
     glGetError();
     wxPaintDC dc( this );
 
+    if( m_view == MAIN_VIEW )
+    {
+        m_frameWatch.Start();
+    }
+
     SetCurrent(*SceneManager::getInstance()->getScene()->getMainGLContext());
 
     int w, h;
@@ -802,6 +820,33 @@ void MainCanvas::render()
     }    
     //glFlush();
     SwapBuffers(); 
+
+    if( m_view == MAIN_VIEW )
+    {
+        logFrameTime();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Accumulates the time spent rendering the main view, swap included, and
+// prints the mean and worst frame time every FRAME_TIME_INTERVAL frames.
+///////////////////////////////////////////////////////////////////////////
+void MainCanvas::logFrameTime()
+{
+    static const int FRAME_TIME_INTERVAL = 100;
+
+    long elapsed = m_frameWatch.Time();
+    m_frameTimeTotal += elapsed;
+    m_frameTimeMax = std::max( m_frameTimeMax, elapsed );
+
+    if( ++m_frameCount >= FRAME_TIME_INTERVAL )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "Main view: %.2f ms/frame (max %ld ms) over %d frames" ),
+                                                        (double)m_frameTimeTotal / m_frameCount, m_frameTimeMax, m_frameCount ), LOGLEVEL_DEBUG );
+        m_frameTimeTotal = 0;
+        m_frameTimeMax = 0;
+        m_frameCount = 0;
+    }
 }
 
 void MainCanvas::renderRulerDisplay()
@@ -1315,7 +1360,7 @@ void MainCanvas::KMeans(float means[2],float stddev[2],float apriori[2], std::ve
 }
 
 //Floodfill method using a threshold range
-void MainCanvas::floodFill(std::vector<float>* src, std::vector<float>* result, Vector click, float threshold)
+void MainCanvas::floodFill(const Anatomy *pSource, std::vector<float>* result, Vector click, float threshold)
 {
     //Get the user clicked voxel
     int xClick = floor( click[0] / DatasetManager::getInstance()->getVoxelX() );
@@ -1329,7 +1374,7 @@ void MainCanvas::floodFill(std::vector<float>* src, std::vector<float>* result,
     Logger::getInstance()->print( wxT( "Floodfill" ), LOGLEVEL_MESSAGE );
 
     //Intensity of the current voxel
-    float val = getElement( xClick, yClick, zClick, src );
+    float val = pSource->at( xClick + yClick * columns + zClick * rows * columns );
     float upBracket = val + threshold;
     float downBracket = val - threshold;
 
@@ -1358,12 +1403,12 @@ void MainCanvas::floodFill(std::vector<float>* src, std::vector<float>* result,
         front = std::max( 0, z - 1 );
         back  = std::min( frames - 1, z + 1 );
 
-        NorthV = getElement( x, north, z, src );
-        SouthV = getElement( x, south, z, src );
-        EastV = getElement( east, y, z, src );
-        WestV = getElement( west, y, z, src );
-        FrontV = getElement( x, y, front, src );
-        BackV = getElement( x, y, back, src );
+        NorthV = pSource->at( x + north * columns + z * rows * columns );
+        SouthV = pSource->at( x + south * columns + z * rows * columns );
+        EastV = pSource->at( east + y * columns + z * rows * columns );
+        WestV = pSource->at( west + y * columns + z * rows * columns );
+        FrontV = pSource->at( x + y * columns + front * rows * columns );
+        BackV = pSource->at( x + y * columns + back * rows * columns );
 
         resultNorth = getElement( x, north, z, result );
         resultSouth = getElement( x, south, z, result );
@@ -1416,8 +1461,6 @@ void MainCanvas::segment()
     long index = MyApp::frame->getCurrentListIndex();
     Anatomy *l_info = (Anatomy *)DatasetManager::getInstance()->getDataset( MyApp::frame->m_pListCtrl->GetItem( index ) );
 
-    //1D vector with the normalized brightness ( 0 to 1 )
-    std::vector<float>* sourceData = l_info->getFloatDataset();
     std::vector<float>* resultData = new std::vector<float>;
     resultData->resize( dataLength );
 
@@ -1427,7 +1470,7 @@ void MainCanvas::segment()
         {
             float threshold = l_info->getFloodThreshold();
             Logger::getInstance()->print( wxString::Format( wxT( "Segment method: Floodfill (%f, %f, %f)" ), m_hitPts[0], m_hitPts[1], m_hitPts[2] ), LOGLEVEL_DEBUG );
-            floodFill( sourceData, resultData, m_hitPts, threshold );
+            floodFill( l_info, resultData, m_hitPts, threshold );
             break;
         }
         case GRAPHCUT:
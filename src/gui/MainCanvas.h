@@ -13,12 +13,14 @@
 
 #include <wx/glcanvas.h>
 #include <wx/math.h>
+#include <wx/stopwatch.h>
 
 #include <deque>
 #include <stdlib.h>
 #include <time.h>
 #include <vector>
 
+class Anatomy;
 class RTTFibers;
 
 class MainCanvas: public wxGLCanvas
@@ -59,7 +61,7 @@ public:
     void segment();
     // TODO: Change definition and pass a reference to the vectors instead of pointers
     void KMeans(float i_means[2],float i_stddev[2],float i_apriori[2],std::vector<float>*,std::vector<float>*);
-    void floodFill(std::vector<float>*, std::vector<float>*, Vector, float);
+    void floodFill(const Anatomy*, std::vector<float>*, Vector, float);
     void graphCut(std::vector<float>*, std::vector<float>*, float);
     float getElement(int,int,int,std::vector<float>*);
 
@@ -114,6 +116,14 @@ private:
     bool  m_isDragging;
     bool  m_isrDragging;
     bool  m_ismDragging;
+
+    // Frame time counter of the main view, logged every FRAME_TIME_INTERVAL frames.
+    void logFrameTime();
+
+    wxStopWatch m_frameWatch;
+    long        m_frameTimeTotal;
+    long        m_frameTimeMax;
+    int         m_frameCount;
 };
 
 #endif /*MAINCANVAS_H_*/
@@ -6,6 +6,7 @@
 
 #include "MainCanvas.h"
 #include "MenuBar.h"
+#include "ProfilerWindow.h"
 #include "PropertiesWindow.h"
 #include "SelectionBox.h"
 #include "SelectionEllipsoid.h"
@@ -28,6 +29,7 @@
 #include "../gfx/TheScene.h"
 #include "../gui/SceneManager.h"
 #include "../misc/IsoSurface/CIsoSurface.h"
+#include "../misc/Profiler.h"
 #include "../version/VersionString.h"
 
 #include "wx/wxprec.h"
@@ -191,6 +193,7 @@ MainFrame::MainFrame( const wxString     &title,
 //     m_lastSelectedListItem( -1 ),
     m_lastPath( MyApp::respath + _T( "data" ) ),
     m_pTimer( NULL ),
+    m_pProfilerWindow( NULL ),
     m_isDrawerToolActive( false ),
     m_drawSize( 2 ),
     m_drawRound( true ),
@@ -364,7 +367,7 @@ void MainFrame::initLayout()
     this->SetSizer( pBoxMain );
 }
 
-const std::string EXTENSIONS[] = { "*.nii", "*.nii.gz", "*.mesh", "*.surf", "*.dip", "*.fib", "*.bundlesdata", "*.trk" , "*.tck", "*.vtk", "*.scn" };
+const std::string EXTENSIONS[] = { "*.nii", "*.nii.gz", "*.mesh", "*.surf", "*.dip", "*.fib", "*.bundlesdata", "*.trk" , "*.tck", "*.vtk", "*.fbt", "*.scn" };
 const int NB_EXTENSIONS = sizeof( EXTENSIONS ) / sizeof( std::string );
 
 int compareInputFile( const wxString &first, const wxString &second )
@@ -391,7 +394,7 @@ void MainFrame::onLoad( wxCommandEvent& WXUNUSED(event) )
 {
     wxArrayString l_fileNames;
     wxString l_caption          = wxT( "Choose a file" );
-    wxString l_wildcard         = wxT( "*.*|*.*|Nifti (*.nii)|*.nii*|Mesh files (*.mesh)|*.mesh|Mesh files (*.surf)|*.surf|Mesh files (*.dip)|*.dip|Fibers VTK/DMRI (*.fib)|*.fib|Fibers VTK(*.vtk)|*.vtk|Fibers PTK (*.bundlesdata)|*.bundlesdata|Fibers TrackVis (*.trk)|*.trk|Fibers MRtrix (*.tck)|*.tck|Scene Files (*.scn)|*.scn|Tensor files (*.nii*)|*.nii|ODF files (*.nii)|*.nii*" );
+    wxString l_wildcard         = wxT( "*.*|*.*|Nifti (*.nii)|*.nii*|Mesh files (*.mesh)|*.mesh|Mesh files (*.surf)|*.surf|Mesh files (*.dip)|*.dip|Fibers VTK/DMRI (*.fib)|*.fib|Fibers VTK(*.vtk)|*.vtk|Fibers PTK (*.bundlesdata)|*.bundlesdata|Fibers TrackVis (*.trk)|*.trk|Fibers MRtrix (*.tck)|*.tck|Fibers binary (*.fbt)|*.fbt|Scene Files (*.scn)|*.scn|Tensor files (*.nii*)|*.nii|ODF files (*.nii)|*.nii*" );
     wxString l_defaultDir       = wxEmptyString;
     wxString l_defaultFileName  = wxEmptyString;
     wxFileDialog dialog( this, l_caption, l_defaultDir, l_defaultFileName, l_wildcard, wxFD_OPEN | wxFD_MULTIPLE );
@@ -593,7 +596,7 @@ void MainFrame::onSaveFibers( wxCommandEvent& WXUNUSED(event) )
     }
  
     wxString caption         = wxT( "Choose a file" );
-    wxString wildcard        = wxT( "VTK fiber files (*.vtk)|*.vtk|VTK fiber files (*.fib)|*.fib|DMRI fiber files (*.fib)|*.fib|*.*|*.*" );
+    wxString wildcard        = wxT( "VTK fiber files (*.vtk)|*.vtk|VTK fiber files (*.fib)|*.fib|DMRI fiber files (*.fib)|*.fib|Binary fiber files (*.fbt)|*.fbt|*.*|*.*" );
     wxString defaultDir      = wxEmptyString;
     wxString defaultFilename = wxEmptyString;
     wxFileDialog dialog( this, caption, defaultDir, defaultFilename, wildcard, wxFD_SAVE );
@@ -619,6 +622,10 @@ void MainFrame::onSaveFibers( wxCommandEvent& WXUNUSED(event) )
                         {
                             pFibers->saveDMRI( dialog.GetPath() );
                         }
+                        else if (dialog.GetFilterIndex()==3)
+                        {
+                            pFibers->saveBinary( dialog.GetPath() );
+                        }
                         else
                         {
                             pFibers->save( dialog.GetPath(), dialog.GetFilterIndex() );
@@ -634,6 +641,10 @@ void MainFrame::onSaveFibers( wxCommandEvent& WXUNUSED(event) )
                 {
                     l_fibersGroup->saveDMRI( dialog.GetPath() );
                 }
+                else if (dialog.GetFilterIndex()==3)
+                {
+                    Logger::getInstance()->print( wxT( "The binary format can only save one fibers dataset at a time" ), LOGLEVEL_WARNING );
+                }
                 else
                 {
                     l_fibersGroup->save( dialog.GetPath(), dialog.GetFilterIndex() );
@@ -1132,7 +1143,6 @@ void MainFrame::createCutDataset()
             z1 = std::max( 0, std::min( z1, frames ) );
             z2 = std::max( 0, std::min( z2, frames ) );
 
-            std::vector< float >* l_src = l_anatomy->getFloatDataset();
             std::vector< float >* l_dst = pNewAnatomy->getFloatDataset();
 
             for( int b = z1; b < z2; ++b )
@@ -1141,7 +1151,7 @@ void MainFrame::createCutDataset()
                 {
                     for( int c = x1; c < x2; ++c )
                     {
-                        l_dst->at( b * rows * columns + r * columns + c ) = l_src->at( b * rows * columns + r * columns + c );
+                        l_dst->at( b * rows * columns + r * columns + c ) = l_anatomy->at( b * rows * columns + r * columns + c );
                     }
                 }
             }
@@ -1902,6 +1912,23 @@ void MainFrame::onWarningsInformations( wxCommandEvent& WXUNUSED(event) )
         wxT("Warnings Informations about Fibers Group functionalities"));
 }
 
+void MainFrame::onToggleProfiler( wxCommandEvent& WXUNUSED(event) )
+{
+    if( NULL == m_pProfilerWindow )
+    {
+        m_pProfilerWindow = new ProfilerWindow( this );
+    }
+
+    if( Profiler::isEnabled() )
+    {
+        m_pProfilerWindow->stop();
+    }
+    else
+    {
+        m_pProfilerWindow->start();
+    }
+}
+
 void MainFrame::onScreenshot( wxCommandEvent& WXUNUSED(event) )
 {
     wxString l_caption         = wxT( "Choose a file" );
@@ -2042,7 +2069,7 @@ void MainFrame::updateStatusBar()
                     }
                 }
                 //Denormalize
-                value = (* ( pAnat->getFloatDataset() ) )[ind] * maxValue;
+                value = pAnat->at( ind ) * maxValue;
             }
             //Equalized dataset
             else
@@ -24,6 +24,7 @@ class SelectionObject;
 class SelectionTree;
 class TrackingWindow;
 class FMRIWindow;
+class ProfilerWindow;
 
 enum DrawMode
 {
@@ -39,6 +40,7 @@ class MainFrame : public wxFrame
     friend class PropertiesWindow;
     friend class TrackingWindow;
     friend class FMRIWindow;
+    friend class ProfilerWindow;
 
 public:
     MainFrame( const wxString &title, const wxPoint &pos, const wxSize &size );
@@ -177,6 +179,7 @@ private:
     void onShortcuts                        ( wxCommandEvent& evt );
     void onScreenshot                       ( wxCommandEvent& evt );
     void onWarningsInformations             ( wxCommandEvent& evt );
+    void onToggleProfiler                   ( wxCommandEvent& evt );
 
     // List widget event functions     
     void onActivateListItem                 ( wxListEvent&    evt );
@@ -236,6 +239,7 @@ private:
     wxString            m_lastPath;
 
     wxTimer             *m_pTimer;
+    ProfilerWindow      *m_pProfilerWindow;
 
     bool     m_isDrawerToolActive;
     DrawMode m_drawMode;
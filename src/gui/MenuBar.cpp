@@ -16,6 +16,7 @@
 #include "../dataset/DatasetManager.h"
 #include "../dataset/Fibers.h"
 #include "../dataset/FibersGroup.h"
+#include "../misc/Profiler.h"
 
 #include <vector>
 using std::vector;
@@ -146,6 +147,7 @@ MenuBar::MenuBar()
     m_itemKeyboardShortcuts = m_menuHelp->Append(wxID_ANY, wxT("Keyboard Shortcut"));
     m_itemScreenShot = m_menuHelp->Append(wxID_ANY, wxT("ScreenShot"));
     m_itemWarningsInfo = m_menuHelp->Append(wxID_ANY, wxT("Warnings Informations"));
+    m_itemToggleProfiler = m_menuHelp->AppendCheckItem(wxID_ANY, wxT("Profiler"));
     m_menuHelp->AppendSeparator();
     m_itemAbout = m_menuHelp->Append(wxID_ABOUT, wxT("About"));
 
@@ -259,6 +261,7 @@ void MenuBar::initMenuBar( MainFrame *mf )
     mf->Connect(m_itemKeyboardShortcuts->GetId(), wxEVT_COMMAND_TOOL_CLICKED, wxCommandEventHandler(MainFrame::onShortcuts));
     mf->Connect(m_itemScreenShot->GetId(), wxEVT_COMMAND_TOOL_CLICKED, wxCommandEventHandler(MainFrame::onScreenshot));
     mf->Connect(m_itemWarningsInfo->GetId(), wxEVT_COMMAND_TOOL_CLICKED, wxCommandEventHandler(MainFrame::onWarningsInformations));
+    mf->Connect(m_itemToggleProfiler->GetId(), wxEVT_COMMAND_TOOL_CLICKED, wxCommandEventHandler(MainFrame::onToggleProfiler));
     mf->Connect(m_itemRotateZ->GetId(), wxEVT_COMMAND_TOOL_CLICKED, wxCommandEventHandler(MainFrame::onRotateZ));
     mf->Connect(m_itemRotateY->GetId(), wxEVT_COMMAND_TOOL_CLICKED, wxCommandEventHandler(MainFrame::onRotateY));
     mf->Connect(m_itemRotateX->GetId(), wxEVT_COMMAND_TOOL_CLICKED, wxCommandEventHandler(MainFrame::onRotateX));
@@ -268,6 +271,7 @@ void MenuBar::initMenuBar( MainFrame *mf )
 void MenuBar::updateMenuBar( MainFrame *mf )
 {
     m_itemToggleLighting->Check( SceneManager::getInstance()->isLightingActive() );
+    m_itemToggleProfiler->Check( Profiler::isEnabled() );
 
 #if !_USE_LIGHT_GUI
     m_itemToggleRuler->Check( SceneManager::getInstance()->isRulerActive() );
@@ -117,6 +117,7 @@ public:
         wxMenuItem  *m_itemKeyboardShortcuts;
         wxMenuItem  *m_itemScreenShot;
         wxMenuItem  *m_itemWarningsInfo;
+        wxMenuItem  *m_itemToggleProfiler;
 };
 
 #endif
\ No newline at end of file
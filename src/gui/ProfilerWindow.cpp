@@ -0,0 +1,95 @@
+#include "ProfilerWindow.h"
+
+#include "MainFrame.h"
+#include "../misc/Profiler.h"
+
+#include <wx/button.h>
+#include <wx/filedlg.h>
+#include <wx/font.h>
+#include <wx/sizer.h>
+
+BEGIN_EVENT_TABLE( ProfilerWindow, wxFrame )
+EVT_TIMER( -1,      ProfilerWindow::onTimerEvent )
+EVT_CLOSE(          ProfilerWindow::onClose )
+END_EVENT_TABLE()
+
+ProfilerWindow::ProfilerWindow( MainFrame *pMf )
+:   wxFrame( pMf, wxID_ANY, wxT( "Profiler" ), wxDefaultPosition, wxSize( 520, 480 ), wxDEFAULT_FRAME_STYLE | wxFRAME_TOOL_WINDOW | wxFRAME_FLOAT_ON_PARENT ),
+    m_pMainFrame( pMf ),
+    m_pTxtBreakdown( NULL ),
+    m_pTimer( NULL )
+{
+    wxBoxSizer *pSizer = new wxBoxSizer( wxVERTICAL );
+
+    m_pTxtBreakdown = new wxTextCtrl( this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_MULTILINE | wxTE_READONLY | wxTE_DONTWRAP );
+    m_pTxtBreakdown->SetFont( wxFont( 9, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL ) );
+    pSizer->Add( m_pTxtBreakdown, 1, wxEXPAND | wxALL, 2 );
+
+    wxButton *pBtnSaveTrace = new wxButton( this, wxID_ANY, wxT( "Save Trace..." ) );
+    Connect( pBtnSaveTrace->GetId(), wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler( ProfilerWindow::onSaveTrace ) );
+    pSizer->Add( pBtnSaveTrace, 0, wxALIGN_RIGHT | wxALL, 2 );
+
+    SetSizer( pSizer );
+
+    m_pTimer = new wxTimer( this );
+}
+
+ProfilerWindow::~ProfilerWindow()
+{
+    m_pTimer->Stop();
+    delete m_pTimer;
+    m_pTimer = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ProfilerWindow::start()
+{
+    Profiler::getInstance()->setEnabled( true );
+    m_pTxtBreakdown->SetValue( Profiler::getInstance()->getFrameBreakdown() );
+    m_pTimer->Start( 500 );
+    Show();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// The recorded trace is kept, it can still be saved.
+//////////////////////////////////////////////////////////////////////////
+void ProfilerWindow::stop()
+{
+    m_pTimer->Stop();
+    Profiler::getInstance()->setEnabled( false );
+    Hide();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ProfilerWindow::onTimerEvent( wxTimerEvent& WXUNUSED(event) )
+{
+    m_pTxtBreakdown->ChangeValue( Profiler::getInstance()->getFrameBreakdown() );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ProfilerWindow::onSaveTrace( wxCommandEvent& WXUNUSED(event) )
+{
+    wxFileDialog dialog( this, wxT( "Save trace" ), wxEmptyString, wxT( "trace.json" ), wxT( "Chrome trace (*.json)|*.json|*.*|*.*" ), wxFD_SAVE | wxFD_OVERWRITE_PROMPT );
+    if( dialog.ShowModal() == wxID_OK )
+    {
+        Profiler::getInstance()->writeChromeTrace( dialog.GetPath() );
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// The window is only hidden, it belongs to the main frame.
+//////////////////////////////////////////////////////////////////////////
+void ProfilerWindow::onClose( wxCloseEvent& evt )
+{
+    if( !evt.CanVeto() )
+    {
+        evt.Skip();
+        return;
+    }
+
+    stop();
+    m_pMainFrame->updateMenus();
+}
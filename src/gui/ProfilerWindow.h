@@ -0,0 +1,38 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            ProfilerWindow.h
+//
+// Description: Window of the rolling per-frame breakdown of the profiler,
+// refreshed twice per second. The profiler runs while it is shown.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef PROFILERWINDOW_H_
+#define PROFILERWINDOW_H_
+
+#include <wx/frame.h>
+#include <wx/textctrl.h>
+#include <wx/timer.h>
+
+class MainFrame;
+
+class ProfilerWindow : public wxFrame
+{
+public:
+    ProfilerWindow( MainFrame *pMf );
+    ~ProfilerWindow();
+
+    void start();
+    void stop();
+
+private:
+    void onTimerEvent   ( wxTimerEvent&   evt );
+    void onSaveTrace    ( wxCommandEvent& evt );
+    void onClose        ( wxCloseEvent&   evt );
+
+    MainFrame   *m_pMainFrame;
+    wxTextCtrl  *m_pTxtBreakdown;
+    wxTimer     *m_pTimer;
+
+DECLARE_EVENT_TABLE()
+};
+
+#endif /*PROFILERWINDOW_H_*/
@@ -19,9 +19,11 @@
 #include "../dataset/DatasetManager.h"
 #include "../dataset/Fibers.h"
 #include "../dataset/RTTrackingHelper.h"
+#include "../dataset/SelectionQuery.h"
 #include "../gui/MainFrame.h"
 #include "../misc/Algorithms/ConvexGrahamHull.h"
 #include "../misc/Algorithms/ConvexHullIncremental.h"
+#include "../misc/Algorithms/DistanceTransform.h"
 #include "../misc/Algorithms/Helper.h"
 // TODO selection remove.
 #include "../misc/IsoSurface/CIsoSurface.h"
@@ -31,6 +33,8 @@
 #include <wx/textctrl.h>
 #include <wx/tglbtn.h>
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <list>
@@ -88,6 +92,7 @@ void SelectionObject::doBasicInit()
     
     //Distance coloring
     m_DistColoring          = false;
+    m_distanceFieldNeedsUpdating = true;
 
 }
 
@@ -438,9 +443,13 @@ void SelectionObject::select()
 ///////////////////////////////////////////////////////////////////////////
 void SelectionObject::update()
 {
-    updateStatusBar();
+    // There is no main frame when running headless (benchmark).
+    if( MyApp::frame != NULL )
+    {
+        updateStatusBar();
+        MyApp::frame->refreshAllGLWidgets();
+    }
     SceneManager::getInstance()->setSelBoxChanged( true );
-    MyApp::frame->refreshAllGLWidgets();
 
     float voxelX = DatasetManager::getInstance()->getVoxelX();
     float voxelY = DatasetManager::getInstance()->getVoxelY();
@@ -988,7 +997,7 @@ vector< int > SelectionObject::getSelectedFibersIndexes( Fibers *pFibers )
     
     SelectionState &curState = getState( pFibers->getDatasetIndex() );
     
-    vector< bool > branchToUse;
+    FiberBitset branchToUse;
     SelectionTree &selTree( SceneManager::getInstance()->getSelectionTree() );
     
     if( selTree.getActiveChildrenObjectsCount( this ) > 0 )
@@ -1002,31 +1011,21 @@ vector< int > SelectionObject::getSelectedFibersIndexes( Fibers *pFibers )
         
         if( pParentObj != NULL )
         {
-            // OPTIM: this could be optimized
             SelectionState &parentState = pParentObj->getState( pFibers->getDatasetIndex() );
-            branchToUse.assign( curState.m_inBranch.size(), false );
+            branchToUse = parentState.m_inBox;
             
-            bool parentIsNot( pParentObj->getIsNOT() );
-            bool currentIsNot( getIsNOT() );
+            if( pParentObj->getIsNOT() )
+            {
+                branchToUse.flip();
+            }
             
-            for( unsigned int fiberIdx( 0 ); fiberIdx < curState.m_inBox.size(); ++fiberIdx )
+            if( getIsNOT() )
             {
-                if( !parentIsNot && !currentIsNot )
-                {
-                    branchToUse[ fiberIdx ] = parentState.m_inBox[ fiberIdx ] & curState.m_inBox[ fiberIdx ];
-                }
-                else if( !parentIsNot && currentIsNot )
-                {
-                    branchToUse[ fiberIdx ] = parentState.m_inBox[ fiberIdx ] & !curState.m_inBox[ fiberIdx ];
-                }
-                else if( parentIsNot && !currentIsNot )
-                {
-                    branchToUse[ fiberIdx ] = !parentState.m_inBox[ fiberIdx ] & curState.m_inBox[ fiberIdx ];
-                }
-                else // parentIsNot && currentIsNot
-                {
-                    branchToUse[ fiberIdx ] = !parentState.m_inBox[ fiberIdx ] & !curState.m_inBox[ fiberIdx ];
-                }
+                branchToUse.andNotWith( curState.m_inBox );
+            }
+            else
+            {
+                branchToUse.andWith( curState.m_inBox );
             }
         }
         else // No parent, so this is a root object with no child.
@@ -1039,7 +1038,7 @@ vector< int > SelectionObject::getSelectedFibersIndexes( Fibers *pFibers )
     
     for( unsigned int fiberIdx = 0; fiberIdx < branchToUse.size(); ++fiberIdx )
     {
-        if( branchToUse[fiberIdx] && !filteredFiber[fiberIdx] )
+        if( branchToUse.test( fiberIdx ) && !filteredFiber[fiberIdx] )
         {
             selectedIndexes.push_back( fiberIdx );
         }
@@ -1340,7 +1339,7 @@ bool SelectionObject::getMeanFiberValue( const vector< vector< Vector > > &fiber
             
             for (int i(0); i < pCurrentAnatomy->getBands(); i++)
             {
-                computedMeanValue += (* ( pCurrentAnatomy->getFloatDataset() ) )[datasetPos + i];
+                computedMeanValue += pCurrentAnatomy->at( datasetPos + i );
             }
 
             ++pointsCount;
@@ -2000,13 +1999,100 @@ void SelectionObject::notifyInBoxNeedsUpdating()
         // Always update in branch at the same time, since an
         // update to the inBox will always influence the inBranch.
         stateIt->second.m_inBoxNeedsUpdating = true;
+        stateIt->second.m_inBranchNeedsUpdating = true;
     }
 
+    m_distanceFieldNeedsUpdating = true;
+
     SceneManager::getInstance()->getSelectionTree().notifyStatsNeedUpdating( this );    
 }
 
 void SelectionObject::notifyInBranchNeedsUpdating()
 {
+    for( map< FiberIdType, SelectionState >::iterator stateIt( m_selectionStates.begin() );
+        stateIt != m_selectionStates.end(); ++stateIt )
+    {
+        stateIt->second.m_inBranchNeedsUpdating = true;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The voxels whose center is inside the object are the seeds of an exact
+// distance transform, in millimeters. The result is normalized like the
+// distance maps created from an anatomy.
+///////////////////////////////////////////////////////////////////////////
+const vector< float > & SelectionObject::getDistanceField()
+{
+    if( !m_distanceFieldNeedsUpdating )
+    {
+        return m_distanceField;
+    }
+
+    const int   columns = DatasetManager::getInstance()->getColumns();
+    const int   rows    = DatasetManager::getInstance()->getRows();
+    const int   frames  = DatasetManager::getInstance()->getFrames();
+    const float voxelX  = DatasetManager::getInstance()->getVoxelX();
+    const float voxelY  = DatasetManager::getInstance()->getVoxelY();
+    const float voxelZ  = DatasetManager::getInstance()->getVoxelZ();
+
+    SelectionQuery query;
+    query.setObject( this );
+
+    m_distanceField.assign( columns * rows * frames, DistanceTransform::getInfinity() );
+    if( m_distanceField.empty() )
+    {
+        return m_distanceField;
+    }
+
+    // Only the voxels in the bounding box of the object can be inside it.
+    const int minX = std::max( 0,           (int)std::floor( query.getMin()[0] / voxelX ) );
+    const int maxX = std::min( columns - 1, (int)std::floor( query.getMax()[0] / voxelX ) );
+    const int minY = std::max( 0,           (int)std::floor( query.getMin()[1] / voxelY ) );
+    const int maxY = std::min( rows - 1,    (int)std::floor( query.getMax()[1] / voxelY ) );
+    const int minZ = std::max( 0,           (int)std::floor( query.getMin()[2] / voxelZ ) );
+    const int maxZ = std::min( frames - 1,  (int)std::floor( query.getMax()[2] / voxelZ ) );
+
+    bool isEmpty( true );
+    for( int z = minZ; z <= maxZ; ++z )
+    {
+        for( int y = minY; y <= maxY; ++y )
+        {
+            for( int x = minX; x <= maxX; ++x )
+            {
+                if( query.contains( ( x + 0.5f ) * voxelX, ( y + 0.5f ) * voxelY, ( z + 0.5f ) * voxelZ ) )
+                {
+                    m_distanceField[x + y * columns + z * rows * columns] = 0.0f;
+                    isEmpty = false;
+                }
+            }
+        }
+    }
+
+    // An object smaller than a voxel still has the voxel of its center.
+    if( isEmpty )
+    {
+        const int x = std::min( columns - 1, std::max( 0, (int)( m_center.x / voxelX ) ) );
+        const int y = std::min( rows - 1,    std::max( 0, (int)( m_center.y / voxelY ) ) );
+        const int z = std::min( frames - 1,  std::max( 0, (int)( m_center.z / voxelZ ) ) );
+        m_distanceField[x + y * columns + z * rows * columns] = 0.0f;
+    }
+
+    DistanceTransform::computeSquared( m_distanceField, columns, rows, frames, voxelX, voxelY, voxelZ );
+
+    const int nbVoxels = static_cast< int >( m_distanceField.size() );
+    const float maxSquared = *std::max_element( m_distanceField.begin(), m_distanceField.end() );
+    const float factor = maxSquared > 0.0f ? 1.0f / std::sqrt( maxSquared ) : 1.0f;
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for( int i = 0; i < nbVoxels; ++i )
+    {
+        m_distanceField[i] = std::sqrt( m_distanceField[i] ) * factor;
+    }
+
+    m_distanceFieldNeedsUpdating = false;
+    return m_distanceField;
 }
 
 ///////////////////////////////////////////////////////////////////////////
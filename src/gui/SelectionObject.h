@@ -11,6 +11,7 @@
 #include "SceneObject.h"
 
 #include "../dataset/DatasetIndex.h"
+#include "../dataset/FiberBitset.h"
 #include "../misc/Algorithms/Face3D.h"
 #include "../misc/IsoSurface/Vector.h"
 
@@ -175,17 +176,29 @@ public :
     {
         public: 
             SelectionState()
-            : m_inBoxNeedsUpdating( true )
+            : m_inBoxNeedsUpdating( true ),
+              m_inBranchNeedsUpdating( true ),
+              m_hitCountsGeneration( 0 )
             {};
             
-            vector< bool > m_inBranch;
-            vector< bool > m_inBox;
-            bool           m_inBoxNeedsUpdating;
+            FiberBitset m_inBranch;
+            FiberBitset m_inBox;
+            bool        m_inBoxNeedsUpdating;
+            bool        m_inBranchNeedsUpdating;
+            
+            // Number of points of each fiber inside a box object, and the extent
+            // they were counted for, so that moving the box only looks at the
+            // space entering and leaving it.
+            vector< unsigned int > m_hitCounts;
+            unsigned int           m_hitCountsGeneration;
+            float                  m_hitCountsMin[3];
+            float                  m_hitCountsMax[3];
     };
     
     bool            addFiberDataset(    const FiberIdType &fiberId, const int fiberCount );
     void            removeFiberDataset( const FiberIdType &fiberId );
     SelectionState& getState(           const FiberIdType &fiberId );
+    void            notifyInBranchNeedsUpdating();
     
     // Methods related to saving and loading.
     virtual bool populateXMLNode( wxXmlNode *pCurNode, const wxString &rootPath );
@@ -195,6 +208,9 @@ public :
     //Distance coloring setup
     bool        IsUsedForDistanceColoring() const;
     void        UseForDistanceColoring(bool aUse);
+    // Distance from every voxel of the dataset to the object, divided by
+    // the largest one. Computed again on first use after the object changed.
+    const std::vector< float > & getDistanceField();
 
     //Normal flips
     // Do not flip for generic selection objects.
@@ -238,6 +254,8 @@ protected :
 
     //Distance coloring switch
     bool            m_DistColoring;
+    std::vector< float > m_distanceField;
+    bool            m_distanceFieldNeedsUpdating;
 
     wxColour m_convexHullColor;
     float    m_convexHullOpacity; //Between 0 and 1
@@ -263,7 +281,6 @@ protected :
     std::map< FiberIdType, SelectionState > m_selectionStates;
     
     void notifyInBoxNeedsUpdating();
-    void notifyInBranchNeedsUpdating();
     
     SelectionObject();
 
@@ -8,10 +8,13 @@
 
 #include "../Logger.h"
 #include "../dataset/Fibers.h"
+#include "../dataset/FiberBVH.h"
 #include "../dataset/Octree.h"
+#include "../dataset/SelectionQuery.h"
 #include "../gui/SelectionBox.h"
 #include "../gui/SelectionEllipsoid.h"
 #include "../gui/SelectionVOI.h"
+#include "../misc/Profiler.h"
 
 #include <algorithm>
 #include <utility>
@@ -19,32 +22,24 @@ using std::pair;
 
 // Anonymous namespace
 namespace {
-    void combineBoolVectors( vector< bool > &dest, const vector< bool > &source, const bool negateSrc, const bool useAnd )
+    float boxVolume( const float *pMin, const float *pMax )
     {
-        if( dest.size() != source.size() )
+        float volume( 1.0f );
+        for( int axis( 0 ); axis < 3; ++axis )
         {
-            return;
+            volume *= std::max( pMax[axis] - pMin[axis], 0.0f );
         }
+        return volume;
+    }
 
-        for( unsigned int elemIdx( 0 ); elemIdx < dest.size(); ++elemIdx )
+    float overlapVolume( const float *pMinA, const float *pMaxA, const float *pMinB, const float *pMaxB )
+    {
+        float volume( 1.0f );
+        for( int axis( 0 ); axis < 3; ++axis )
         {
-            if( !negateSrc && !useAnd )
-            {
-                dest[elemIdx] = dest[elemIdx] | source[elemIdx];
-            }
-            else if( !negateSrc && useAnd )
-            {
-                dest[elemIdx] = dest[elemIdx] & source[elemIdx];
-            }
-            else if( negateSrc && useAnd )
-            {
-                dest[elemIdx] = dest[elemIdx] & !source[elemIdx];
-            }
-            else // Negate and use Or
-            {
-                dest[elemIdx] = dest[elemIdx] | !source[elemIdx];
-            }
+            volume *= std::max( std::min( pMaxA[axis], pMaxB[axis] ) - std::max( pMinA[axis], pMinB[axis] ), 0.0f );
         }
+        return volume;
     }
 };
 
@@ -132,6 +127,7 @@ int SelectionTree::SelectionTreeNode::getActiveDirectChildrenCount() const
 void SelectionTree::SelectionTreeNode::addChildren( SelectionTreeNode *pNode )
 {
     m_children.push_back( pNode );
+    notifyInBranchNeedsUpdating();
 }
 
 bool SelectionTree::SelectionTreeNode::removeChildren( const int nodeId )
@@ -146,6 +142,7 @@ bool SelectionTree::SelectionTreeNode::removeChildren( const int nodeId )
         *foundPos = NULL;
         
         m_children.erase( foundPos );
+        notifyInBranchNeedsUpdating();
         
         return true;
     }
@@ -164,6 +161,16 @@ void SelectionTree::SelectionTreeNode::removeAllChildren()
     }
     
     m_children.clear();
+    notifyInBranchNeedsUpdating();
+}
+
+// Children were added or removed, so the inBranch of this object changed.
+void SelectionTree::SelectionTreeNode::notifyInBranchNeedsUpdating()
+{
+    if( m_pSelObject != NULL )
+    {
+        m_pSelObject->notifyInBranchNeedsUpdating();
+    }
 }
 
 bool SelectionTree::SelectionTreeNode::hasChildren() const
@@ -236,7 +243,7 @@ SelectionTree::SelectionTreeNode * const
     return NULL;
 }
 
-void SelectionTree::SelectionTreeNode::updateInObjectRecur( const int fibersCount, Octree *pCurOctree, const vector< int > &reverseIdx, const SelectionObject::FiberIdType &fiberId )
+void SelectionTree::SelectionTreeNode::updateInObjectRecur( const Fibers *pFibers, const SelectionObject::FiberIdType &fiberId )
 {
     if( m_pSelObject != NULL )
     {
@@ -244,14 +251,16 @@ void SelectionTree::SelectionTreeNode::updateInObjectRecur( const int fibersCoun
         
         if( curState.m_inBoxNeedsUpdating )
         {
-            vector< int > pointsInsideObject = pCurOctree->getPointsInside( m_pSelObject );
-            
-            curState.m_inBox.assign( fibersCount, false );
-            
-            for( unsigned int ptIdx( 0 ); ptIdx < pointsInsideObject.size(); ++ptIdx )
+            if( m_pSelObject->getSelectionType() == BOX_TYPE )
             {
-                curState.m_inBox[ reverseIdx[ pointsInsideObject[ ptIdx ] ] ] = true;
+                updateInBoxByDelta( pFibers, curState );
             }
+            else
+            {
+                curState.m_hitCounts.clear();
+                pFibers->getFiberBVH()->getFibersInside( m_pSelObject, curState.m_inBox );
+            }
+            curState.m_inBranchNeedsUpdating = true;
         }
         
         curState.m_inBoxNeedsUpdating = false;
@@ -260,113 +269,152 @@ void SelectionTree::SelectionTreeNode::updateInObjectRecur( const int fibersCoun
     // Call this recursively for all children.
     for( unsigned int childIdx( 0 ); childIdx < m_children.size(); ++childIdx )
     {
-        m_children[ childIdx ]->updateInObjectRecur( fibersCount, pCurOctree, reverseIdx, fiberId );
+        m_children[ childIdx ]->updateInObjectRecur( pFibers, fiberId );
     }
 }
 
-void SelectionTree::SelectionTreeNode::updateInBranchRecur( const int fibersCount,
-                                                            const SelectionObject::FiberIdType &fiberId )
+///////////////////////////////////////////////////////////////////////////
+// Boxes keep the number of points of each fiber they contain. When a box
+// moved or was resized by less than its own volume, only the points of the
+// slabs that left and entered it are visited, and a fiber is in the box as
+// long as its count is not 0. Otherwise, the counts are rebuilt from scratch
+// with the BVH of the fibers.
+///////////////////////////////////////////////////////////////////////////
+void SelectionTree::SelectionTreeNode::updateInBoxByDelta( const Fibers *pFibers, SelectionObject::SelectionState &state )
 {
-    // OPTIM: If we ever encounter a case / dataset where selection is really, really 
-    // slow, this should be the first method to be optimized, using a 
-    // m_inBranchNeedsUpdating mecanism on the SelectionStates.
-
-    bool atLeastOneActiveIncludeChild( false );
-    bool atLeastOneActiveExcludeChild( false );
-    vector< bool > childIncludedFibers( fibersCount, false );
-    vector< bool > childExcludedFibers( fibersCount, false );
+    SelectionQuery query;
+    query.setObject( m_pSelObject );
+    const float *pMin = query.getMin();
+    const float *pMax = query.getMax();
     
-    for( unsigned int childIdx( 0 ); childIdx < m_children.size(); ++childIdx )
+    Octree *pOctree = pFibers->getOctree();
+    const vector< int > &reverseIdx = pFibers->getReverseIdx();
+    const unsigned int fibersCount( pFibers->getFibersCount() );
+    
+    bool useDelta = state.m_hitCounts.size() == fibersCount 
+                 && state.m_inBox.size() == fibersCount 
+                 && state.m_hitCountsGeneration == pOctree->getGeneration();
+    
+    if( useDelta )
     {
-        m_children[ childIdx ]->updateInBranchRecur( fibersCount, fiberId );
-        
-        if( m_children[ childIdx ]->m_pSelObject->getIsActive() )
-        {
-            SelectionObject::SelectionState &curChildState = m_children[ childIdx ]->m_pSelObject->getState( fiberId );
-            
-            if( !m_children[ childIdx ]->m_pSelObject->getIsNOT() )
-            {
-                atLeastOneActiveIncludeChild = true;
-                
-                // Merge in inclusion child vector.
-                for( unsigned int elemIdx( 0 ); elemIdx < curChildState.m_inBox.size(); ++elemIdx )
-                {
-                    childIncludedFibers[ elemIdx ] = childIncludedFibers[ elemIdx ] | curChildState.m_inBranch[ elemIdx ];
-                }
-            }
-            else
-            {
-                atLeastOneActiveExcludeChild = true;
-                
-                // Merge in exclusion child vector
-                for( unsigned int elemIdx( 0 ); elemIdx < curChildState.m_inBox.size(); ++elemIdx )
-                {
-                    childExcludedFibers[ elemIdx ] = childExcludedFibers[ elemIdx ] | curChildState.m_inBranch[ elemIdx ];
-                }
-            }
-        }
-        
+        float deltaVolume = boxVolume( state.m_hitCountsMin, state.m_hitCountsMax ) + boxVolume( pMin, pMax )
+                          - 2.0f * overlapVolume( state.m_hitCountsMin, state.m_hitCountsMax, pMin, pMax );
+        useDelta = deltaVolume < boxVolume( pMin, pMax );
     }
     
-    // Update self state, if we have a selection object.
-    if( m_pSelObject != NULL )
+    if( useDelta )
     {
-        SelectionObject::SelectionState &curState = m_pSelObject->getState( fiberId );
-        
-        if( curState.m_inBranch.empty() )
+        // Points that left the box.
+        pOctree->getPointsInBoxDifference( state.m_hitCountsMin, state.m_hitCountsMax, pMin, pMax, m_deltaPoints );
+        for( unsigned int i( 0 ); i < m_deltaPoints.size(); ++i )
         {
-            curState.m_inBranch.assign( fibersCount, false );
+            const int fiberIdx = reverseIdx[ m_deltaPoints[i] ];
+            if( --state.m_hitCounts[ fiberIdx ] == 0 )
+            {
+                state.m_inBox.reset( fiberIdx );
+            }
         }
         
-        // Basic update of the inBranch of this object.
-        // If no (active) child object, it will simply be the inBox.
-        std::copy( curState.m_inBox.begin(), curState.m_inBox.end(), curState.m_inBranch.begin() );
-
-        if( atLeastOneActiveIncludeChild )
+        // Points that entered it.
+        pOctree->getPointsInBoxDifference( pMin, pMax, state.m_hitCountsMin, state.m_hitCountsMax, m_deltaPoints );
+        for( unsigned int i( 0 ); i < m_deltaPoints.size(); ++i )
         {
-            // TODO what do we do if not active.
-            // Combine the child state with the current.
-            for( unsigned int elemIdx( 0 ); elemIdx < curState.m_inBox.size(); ++elemIdx )
+            const int fiberIdx = reverseIdx[ m_deltaPoints[i] ];
+            if( state.m_hitCounts[ fiberIdx ]++ == 0 )
             {
-                curState.m_inBranch[ elemIdx ] = curState.m_inBranch[ elemIdx ] & childIncludedFibers[ elemIdx ];
+                state.m_inBox.set( fiberIdx );
             }
         }
+    }
+    else
+    {
+        pFibers->getFiberBVH()->countPointsInside( query, state.m_hitCounts );
         
-        if( atLeastOneActiveExcludeChild )
+        state.m_inBox.assign( fibersCount, false );
+        for( unsigned int fiberIdx( 0 ); fiberIdx < fibersCount; ++fiberIdx )
         {
-            for( unsigned int elemIdx( 0 ); elemIdx < curState.m_inBox.size(); ++elemIdx )
+            if( state.m_hitCounts[ fiberIdx ] != 0 )
             {
-                curState.m_inBranch[ elemIdx ] = curState.m_inBranch[ elemIdx ] & !childExcludedFibers[ elemIdx ];
+                state.m_inBox.set( fiberIdx );
             }
         }
+        
+        state.m_hitCountsGeneration = pOctree->getGeneration();
+    }
+    
+    for( int axis( 0 ); axis < 3; ++axis )
+    {
+        state.m_hitCountsMin[axis] = pMin[axis];
+        state.m_hitCountsMax[axis] = pMax[axis];
     }
 }
 
-vector< bool > SelectionTree::SelectionTreeNode::combineChildrenFiberStates(const SelectionObject::FiberIdType &fiberId ) const
+///////////////////////////////////////////////////////////////////////////
+// Recomputes the inBranch of the objects that were flagged, and of the
+// objects above them. Returns true if the inBranch of this node changed.
+///////////////////////////////////////////////////////////////////////////
+bool SelectionTree::SelectionTreeNode::updateInBranchRecur( const int fibersCount,
+                                                            const SelectionObject::FiberIdType &fiberId )
 {
-    vector< bool > combinedStates;
+    bool childChanged( false );
+    
+    for( unsigned int childIdx( 0 ); childIdx < m_children.size(); ++childIdx )
+    {
+        if( m_children[ childIdx ]->updateInBranchRecur( fibersCount, fiberId ) )
+        {
+            childChanged = true;
+        }
+    }
+    
+    // The root has no selection object, it is combined in combineChildrenFiberStates.
+    if( m_pSelObject == NULL )
+    {
+        return true;
+    }
+    
+    SelectionObject::SelectionState &curState = m_pSelObject->getState( fiberId );
+    
+    if( !curState.m_inBranchNeedsUpdating && !childChanged && curState.m_inBranch.size() == static_cast< unsigned int >( fibersCount ) )
+    {
+        return false;
+    }
+    
+    m_childCombiner.reset();
     
-    if( m_children.empty() )
+    for( unsigned int childIdx( 0 ); childIdx < m_children.size(); ++childIdx )
     {
-        return combinedStates;
+        if( m_children[ childIdx ]->m_pSelObject->getIsActive() )
+        {
+            SelectionObject::SelectionState &curChildState = m_children[ childIdx ]->m_pSelObject->getState( fiberId );
+            m_childCombiner.addChild( curChildState.m_inBranch, m_children[ childIdx ]->m_pSelObject->getIsNOT() );
+        }
     }
     
-    SelectionObject::SelectionState tempChildState = m_children[0]->m_pSelObject->getState( fiberId );
+    // Basic update of the inBranch of this object.
+    // If no (active) child object, it will simply be the inBox.
+    curState.m_inBranch = curState.m_inBox;
+    m_childCombiner.applyTo( curState.m_inBranch );
+    
+    curState.m_inBranchNeedsUpdating = false;
+    
+    return true;
+}
 
-    combinedStates.assign( tempChildState.m_inBox.size(), false );
+void SelectionTree::SelectionTreeNode::combineChildrenFiberStates( const int fibersCount,
+                                                                   const SelectionObject::FiberIdType &fiberId,
+                                                                   FiberBitset &o_combinedStates ) const
+{
+    o_combinedStates.assign( fibersCount, false );
     
     for( unsigned int childIdx( 0 ); childIdx < m_children.size(); ++childIdx )
     {
         if( m_children[ childIdx ]->m_pSelObject->getIsActive() )
         {
             // Get the inBranch and the state, and combine.
-            // First false probably not needed.
             SelectionObject::SelectionState &curChildState = m_children[childIdx]->m_pSelObject->getState( fiberId );
-            combineBoolVectors( combinedStates, curChildState.m_inBranch, false, false );
+            o_combinedStates.orWith( curChildState.m_inBranch );
         }
     }
-    
-    return combinedStates;
 }
 
 int SelectionTree::SelectionTreeNode::getId() const
@@ -738,6 +786,8 @@ void SelectionTree::notifyAllObjectsNeedUpdating()
 
 vector< bool > SelectionTree::getSelectedFibers( const Fibers* const pFibers )
 {
+    PROFILE_SCOPE( "SelectionTree::getSelectedFibers" );
+
     if( pFibers == NULL )
     {
         // TODO determine what we do
@@ -752,15 +802,11 @@ vector< bool > SelectionTree::getSelectedFibers( const Fibers* const pFibers )
         return vector< bool >( fibersCount, true );
     }
     
-    const vector< int > reverseIndex( pFibers->getReverseIdx() );
-    
-    Octree *pCurOctree( pFibers->getOctree() );
-    
     SelectionObject::FiberIdType fiberId = pFibers->getDatasetIndex();
     
     // Update all selection objects to make sure that each of them knows which 
     // fibers is in it.
-    m_pRootNode->updateInObjectRecur( fibersCount, pCurOctree, reverseIndex, fiberId );
+    m_pRootNode->updateInObjectRecur( pFibers, fiberId );
     
     // Update all selection objects to make sure they take into account their state
     // and the selected fibers of its children.
@@ -768,9 +814,13 @@ vector< bool > SelectionTree::getSelectedFibers( const Fibers* const pFibers )
     
     // Since the root does not have a selection object, we need to combine each of its
     // children to get the selected fibers.
-    m_rootSelectionStatus[ fiberId ] = m_pRootNode->combineChildrenFiberStates( fiberId );
+    FiberBitset &rootSel = m_rootSelectionStatus[ fiberId ];
+    m_pRootNode->combineChildrenFiberStates( fibersCount, fiberId, rootSel );
+    
+    vector< bool > selectedFibers;
+    rootSel.toBoolVector( selectedFibers );
     
-    return m_rootSelectionStatus[ fiberId ];
+    return selectedFibers;
 }
 
 vector< bool > SelectionTree::getSelectedFibersInBranch( const Fibers *const pFibers, SelectionObject *pSelObj )
@@ -789,26 +839,21 @@ vector< bool > SelectionTree::getSelectedFibersInBranch( const Fibers *const pFi
     // inBranch.
     SelectionObject::FiberIdType fiberId = pFibers->getDatasetIndex();
     SelectionObject::SelectionState &childState = pSelObj->getState( fiberId );
-    vector< bool > &rootSel = m_rootSelectionStatus[ fiberId ];
-    
-    vector< bool > selInter( pFibers->getFibersCount(), false );
+    FiberBitset selInter( m_rootSelectionStatus[ fiberId ] );
     
     if( !pSelObj->getIsNOT() )
     {
-        for( int fibIdx( 0 ); fibIdx < pFibers->getFibersCount(); ++fibIdx )
-        {
-            selInter[ fibIdx ] = rootSel[ fibIdx ] & childState.m_inBranch[ fibIdx ];
-        }
+        selInter.andWith( childState.m_inBranch );
     }
     else
     {
-        for( int fibIdx( 0 ); fibIdx < pFibers->getFibersCount(); ++fibIdx )
-        {
-            selInter[ fibIdx ] = rootSel[ fibIdx ] & !childState.m_inBranch[ fibIdx ];
-        }
+        selInter.andNotWith( childState.m_inBranch );
     }
     
-    return selInter;
+    vector< bool > selectedFibers;
+    selInter.toBoolVector( selectedFibers );
+    
+    return selectedFibers;
 }
 
 bool SelectionTree::addFiberDataset( const SelectionObject::FiberIdType &fiberId, const int fibersCount )
@@ -820,7 +865,7 @@ bool SelectionTree::addFiberDataset( const SelectionObject::FiberIdType &fiberId
         (*objIt)->addFiberDataset( fiberId, fibersCount );
     }
     
-    m_rootSelectionStatus.insert( pair< SelectionObject::FiberIdType, vector< bool > >( fiberId, vector< bool >( fibersCount, false ) ) );
+    m_rootSelectionStatus.insert( pair< SelectionObject::FiberIdType, FiberBitset >( fiberId, FiberBitset( fibersCount, false ) ) );
     
     return ( m_fibersIdAndCount.insert( pair< SelectionObject::FiberIdType, int >( fiberId, fibersCount ) ) ).second;
 }
@@ -845,10 +890,12 @@ void SelectionTree::notifyStatsNeedUpdating( SelectionObject *pSelObject )
 {
     vector< SelectionObject* > genealogy = findGenealogy( pSelObject );
     
+    // The state of an object also changes the inBranch of all its ancestors.
     for( vector< SelectionObject* >::iterator nodeIt( genealogy.begin() );
         nodeIt != genealogy.end(); ++nodeIt )
     {
         (*nodeIt)->notifyStatsNeedUpdating();
+        (*nodeIt)->notifyInBranchNeedsUpdating();
     }
 }
 
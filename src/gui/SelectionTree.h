@@ -16,7 +16,6 @@ using std::map;
 using std::vector;
 
 class Fibers;
-class Octree;
 
 class SelectionTree
 {
@@ -104,11 +103,12 @@ private:
         
         //vector< SelectionTreeNode * const > findGenealogy( SelectionObject *pSelObj );
         
-        void updateInObjectRecur( const int fibersCount, Octree *pCurOctree, 
-                                 const vector< int > &reverseIdx, const SelectionObject::FiberIdType &fiberId );
-        void updateInBranchRecur( const int fibersCount, const SelectionObject::FiberIdType &fiberId );
+        void updateInObjectRecur( const Fibers *pFibers, const SelectionObject::FiberIdType &fiberId );
+        bool updateInBranchRecur( const int fibersCount, const SelectionObject::FiberIdType &fiberId );
         
-        vector< bool > combineChildrenFiberStates( const SelectionObject::FiberIdType &fiberId ) const;
+        void combineChildrenFiberStates( const int fibersCount,
+                                         const SelectionObject::FiberIdType &fiberId,
+                                         FiberBitset &o_combinedStates ) const;
         
         int getId() const;
         
@@ -120,10 +120,19 @@ private:
     private:
         SelectionTreeNode();    // Disable default constructor.
         
+        void notifyInBranchNeedsUpdating();
+        void updateInBoxByDelta( const Fibers *pFibers, SelectionObject::SelectionState &state );
+        
     private:
         int m_nodeId;
         SelectionObject *m_pSelObject;
         vector< SelectionTreeNode* > m_children;
+        
+        // Merged inBranch of the children, kept to reuse their memory.
+        FiberBranchCombiner m_childCombiner;
+        
+        // Points visited by the last box update, kept to reuse their memory.
+        vector< int > m_deltaPoints;
     };
     
     // Structure used with the find_if algorithm.
@@ -153,7 +162,7 @@ private:
     
     map< SelectionObject::FiberIdType, int > m_fibersIdAndCount;
     
-    map< SelectionObject::FiberIdType, vector< bool > > m_rootSelectionStatus;
+    map< SelectionObject::FiberIdType, FiberBitset > m_rootSelectionStatus;
 };
 
 
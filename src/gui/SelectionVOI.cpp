@@ -95,40 +95,47 @@ SelectionVOI::SelectionVOI( const wxXmlNode selObjNode, const wxString &rootPath
     }
 }
 
+namespace
+{
+    // Reads the anatomy through at(), so that byte and short anatomies are
+    // not converted to float.
+    template< typename Compare >
+    void thresholdVoxels( const Anatomy *pAnatomy, Compare compare, float threshold, vector< bool > &o_included )
+    {
+        for( unsigned int i( 0 ); i < o_included.size(); ++i )
+        {
+            o_included[i] = compare( pAnatomy->at( i ), threshold );
+        }
+    }
+}
+
 void SelectionVOI::buildSurface( Anatomy *pSourceAnatomy )
 {
     m_nbRows   = pSourceAnatomy->getRows();
     m_nbCols   = pSourceAnatomy->getColumns();
     m_nbFrames = pSourceAnatomy->getFrames();
     
-    vector< float > * const pAnatDataset = pSourceAnatomy->getFloatDataset();
-    
-    m_includedVoxels.assign( pAnatDataset->size(), false );
+    m_includedVoxels.assign( pSourceAnatomy->getSize(), false );
     
     if( m_thresType == THRESHOLD_EQUAL )
     {
-        std::transform( pAnatDataset->begin(), pAnatDataset->end(),
-                       m_includedVoxels.begin(), bind2nd( std::equal_to< float >(), m_generationThreshold ) );
+        thresholdVoxels( pSourceAnatomy, std::equal_to< float >(), m_generationThreshold, m_includedVoxels );
     }
     else if( m_thresType == THRESHOLD_GREATER )
     {
-        std::transform( pAnatDataset->begin(), pAnatDataset->end(),
-                       m_includedVoxels.begin(), bind2nd( std::greater< float >(), m_generationThreshold ) );
+        thresholdVoxels( pSourceAnatomy, std::greater< float >(), m_generationThreshold, m_includedVoxels );
     }
     else if( m_thresType == THRESHOLD_GREATER_EQUAL )
     {
-        std::transform( pAnatDataset->begin(), pAnatDataset->end(),
-                       m_includedVoxels.begin(), bind2nd( std::greater_equal< float >(), m_generationThreshold ) );
+        thresholdVoxels( pSourceAnatomy, std::greater_equal< float >(), m_generationThreshold, m_includedVoxels );
     }
     else if( m_thresType == THRESHOLD_SMALLER )
     {
-        std::transform( pAnatDataset->begin(), pAnatDataset->end(),
-                       m_includedVoxels.begin(), bind2nd( std::less< float >(), m_generationThreshold ) );
+        thresholdVoxels( pSourceAnatomy, std::less< float >(), m_generationThreshold, m_includedVoxels );
     }
     else if( m_thresType == THRESHOLD_SMALLER_EQUAL )
     {
-        std::transform( pAnatDataset->begin(), pAnatDataset->end(),
-                       m_includedVoxels.begin(), bind2nd( std::less_equal< float >(), m_generationThreshold ) );
+        thresholdVoxels( pSourceAnatomy, std::less_equal< float >(), m_generationThreshold, m_includedVoxels );
     }
     
     m_pIsoSurface = new CBoolIsoSurface( m_includedVoxels );
@@ -19,8 +19,11 @@
 #include <wx/checkbox.h>
 #include <wx/grid.h>
 #include <wx/tglbtn.h>
+#include <wx/thread.h>
 #include <wx/treectrl.h>
 
+#include <algorithm>
+
 
 IMPLEMENT_DYNAMIC_CLASS( TrackingWindow, wxScrolledWindow )
 
@@ -102,10 +105,28 @@ TrackingWindow::TrackingWindow( wxWindow *pParent, MainFrame *pMf, wxWindowID id
     wxStaticText *m_pTextTotalSeedNb = new wxStaticText( this, wxID_ANY, wxT("Number of current seeds"), wxPoint(7,270), wxSize(150, -1), wxALIGN_LEFT );
     RTTrackingHelper::getInstance()->m_pTxtTotalSeedNbBox = new wxTextCtrl( this, wxID_ANY, wxT("1000"), wxPoint(190,270), wxSize(55, -1), wxTE_CENTRE | wxTE_READONLY );
 
-	m_pBtnConvert = new wxButton( this, wxID_ANY,wxT("Convert Fibers"), wxPoint(50,300), wxSize(140, 30) );
+    int nbThreads = SceneManager::getInstance()->getScene()->getRTTfibers()->getNbTrackingThreads();
+    int maxThreads = std::max( nbThreads, wxThread::GetCPUCount() );
+    wxStaticText *m_pTextThreads = new wxStaticText( this, wxID_ANY, wxT("Threads"), wxPoint(0,300), wxSize(60, -1), wxALIGN_CENTER );
+    m_pSliderThreads = new MySlider( this, wxID_ANY, 0, 1, maxThreads, wxPoint(60,300), wxSize(130, -1), wxSL_HORIZONTAL | wxSL_AUTOTICKS );
+    m_pSliderThreads->SetValue( nbThreads );
+    Connect( m_pSliderThreads->GetId(), wxEVT_COMMAND_SLIDER_UPDATED, wxCommandEventHandler(TrackingWindow::OnSliderThreadsMoved) );
+    m_pTxtThreadsBox = new wxTextCtrl( this, wxID_ANY, wxString::Format( wxT( "%i"), nbThreads ), wxPoint(190,300), wxSize(55, -1), wxTE_CENTRE | wxTE_READONLY );
+
+    m_pToggleProgressive = new wxToggleButton( this, wxID_ANY,wxT("Progressive tracking OFF"), wxPoint(10,330), wxSize(230, -1) );
+    Connect( m_pToggleProgressive->GetId(), wxEVT_COMMAND_TOGGLEBUTTON_CLICKED, wxCommandEventHandler(TrackingWindow::OnToggleProgressive) );
+
+    wxStaticText *m_pTextBudget = new wxStaticText( this, wxID_ANY, wxT("Budget"), wxPoint(0,360), wxSize(60, -1), wxALIGN_CENTER );
+    m_pSliderBudget = new MySlider( this, wxID_ANY, 0, 5, 100, wxPoint(60,360), wxSize(130, -1), wxSL_HORIZONTAL | wxSL_AUTOTICKS );
+    m_pSliderBudget->SetValue( RTTrackingHelper::getInstance()->getFrameBudget() );
+    Connect( m_pSliderBudget->GetId(), wxEVT_COMMAND_SLIDER_UPDATED, wxCommandEventHandler(TrackingWindow::OnSliderBudgetMoved) );
+    m_pTxtBudgetBox = new wxTextCtrl( this, wxID_ANY, wxString::Format( wxT( "%i ms"), (int)RTTrackingHelper::getInstance()->getFrameBudget() ), wxPoint(190,360), wxSize(55, -1), wxTE_CENTRE | wxTE_READONLY );
+    m_pSliderBudget->Enable( false );
+
+	m_pBtnConvert = new wxButton( this, wxID_ANY,wxT("Convert Fibers"), wxPoint(50,390), wxSize(140, 30) );
 	Connect( m_pBtnConvert->GetId(), wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler(TrackingWindow::OnConvertToFibers) );
 
-    wxTextCtrl *deprecated = new wxTextCtrl( this, wxID_ANY, wxT("Not maintained anymore."), wxPoint(10,330), wxSize(230, -1), wxTE_CENTER | wxTE_READONLY );
+    wxTextCtrl *deprecated = new wxTextCtrl( this, wxID_ANY, wxT("Not maintained anymore."), wxPoint(10,420), wxSize(230, -1), wxTE_CENTER | wxTE_READONLY );
     deprecated->SetBackgroundColour( *wxLIGHT_GREY );
     wxFont deprec_font = deprecated->GetFont();
     deprec_font.SetPointSize( 10 );
@@ -337,6 +358,37 @@ TrackingWindow::TrackingWindow( wxWindow *pParent, MainFrame *pMf, wxWindowID id
 	pBoxRow12->Add( RTTrackingHelper::getInstance()->m_pTxtTotalSeedNbBox,   0, wxALIGN_LEFT | wxALL, 1);
 	m_pTrackingSizer->Add( pBoxRow12, 0, wxFIXED_MINSIZE | wxEXPAND, 0 );
 
+    int nbThreads = SceneManager::getInstance()->getScene()->getRTTfibers()->getNbTrackingThreads();
+    int maxThreads = std::max( nbThreads, wxThread::GetCPUCount() );
+    wxStaticText *m_pTextThreads = new wxStaticText( this, wxID_ANY, wxT("Threads"), wxDefaultPosition, wxSize(70, -1), wxALIGN_CENTER );
+    m_pSliderThreads = new MySlider( this, wxID_ANY, 0, 1, maxThreads, wxDefaultPosition, wxSize(100, -1), wxSL_HORIZONTAL | wxSL_AUTOTICKS );
+    m_pSliderThreads->SetValue( nbThreads );
+    Connect( m_pSliderThreads->GetId(), wxEVT_COMMAND_SLIDER_UPDATED, wxCommandEventHandler(TrackingWindow::OnSliderThreadsMoved) );
+    m_pTxtThreadsBox = new wxTextCtrl( this, wxID_ANY, wxString::Format( wxT( "%i"), nbThreads ), wxDefaultPosition, wxSize(55, -1), wxTE_CENTRE | wxTE_READONLY );
+
+	wxBoxSizer *pBoxRowThreads = new wxBoxSizer( wxHORIZONTAL );
+    pBoxRowThreads->Add( m_pTextThreads, 0, wxALIGN_RIGHT | wxALIGN_CENTER_VERTICAL | wxALL, 1 );
+    pBoxRowThreads->Add( m_pSliderThreads,   0, wxALIGN_LEFT | wxEXPAND | wxALL, 1);
+	pBoxRowThreads->Add( m_pTxtThreadsBox,   0, wxALIGN_LEFT | wxALL, 1);
+	m_pTrackingSizer->Add( pBoxRowThreads, 0, wxFIXED_MINSIZE | wxEXPAND, 0 );
+
+    m_pToggleProgressive = new wxToggleButton( this, wxID_ANY,wxT("Progressive tracking OFF"), wxDefaultPosition, wxSize(230, -1) );
+    Connect( m_pToggleProgressive->GetId(), wxEVT_COMMAND_TOGGLEBUTTON_CLICKED, wxCommandEventHandler(TrackingWindow::OnToggleProgressive) );
+    m_pTrackingSizer->Add( m_pToggleProgressive, 0, wxALL, 2 );
+
+    wxStaticText *m_pTextBudget = new wxStaticText( this, wxID_ANY, wxT("Budget"), wxDefaultPosition, wxSize(70, -1), wxALIGN_CENTER );
+    m_pSliderBudget = new MySlider( this, wxID_ANY, 0, 5, 100, wxDefaultPosition, wxSize(100, -1), wxSL_HORIZONTAL | wxSL_AUTOTICKS );
+    m_pSliderBudget->SetValue( RTTrackingHelper::getInstance()->getFrameBudget() );
+    Connect( m_pSliderBudget->GetId(), wxEVT_COMMAND_SLIDER_UPDATED, wxCommandEventHandler(TrackingWindow::OnSliderBudgetMoved) );
+    m_pTxtBudgetBox = new wxTextCtrl( this, wxID_ANY, wxString::Format( wxT( "%i ms"), (int)RTTrackingHelper::getInstance()->getFrameBudget() ), wxDefaultPosition, wxSize(55, -1), wxTE_CENTRE | wxTE_READONLY );
+    m_pSliderBudget->Enable( false );
+
+	wxBoxSizer *pBoxRowBudget = new wxBoxSizer( wxHORIZONTAL );
+    pBoxRowBudget->Add( m_pTextBudget, 0, wxALIGN_RIGHT | wxALIGN_CENTER_VERTICAL | wxALL, 1 );
+    pBoxRowBudget->Add( m_pSliderBudget,   0, wxALIGN_LEFT | wxEXPAND | wxALL, 1);
+	pBoxRowBudget->Add( m_pTxtBudgetBox,   0, wxALIGN_LEFT | wxALL, 1);
+	m_pTrackingSizer->Add( pBoxRowBudget, 0, wxFIXED_MINSIZE | wxEXPAND, 0 );
+
 	wxStaticText *m_pTextOpacity = new wxStaticText( this, wxID_ANY, wxT("Opacity"), wxDefaultPosition, wxSize(70, -1), wxALIGN_CENTER );
     m_pSliderOpacity = new MySlider( this, wxID_ANY, 0, 0, 100, wxDefaultPosition, wxSize(100, -1), wxSL_HORIZONTAL | wxSL_AUTOTICKS );
     m_pSliderOpacity->SetValue( 100 );
@@ -935,6 +987,44 @@ void TrackingWindow::OnRandomSeeding( wxCommandEvent& WXUNUSED(event) )
     }
 }
 
+void TrackingWindow::OnToggleProgressive( wxCommandEvent& WXUNUSED(event) )
+{
+    RTTrackingHelper::getInstance()->toggleProgressive();
+    RTTrackingHelper::getInstance()->setRTTDirty( true );
+
+    // The DTI and HARDI panels share the setting.
+    updateProgressive();
+    TrackingWindow *pOther = ( this == m_pMainFrame->m_pTrackingWindow ) ? m_pMainFrame->m_pTrackingWindowHardi : m_pMainFrame->m_pTrackingWindow;
+    if( pOther != NULL )
+    {
+        pOther->updateProgressive();
+    }
+}
+
+void TrackingWindow::OnSliderBudgetMoved( wxCommandEvent& WXUNUSED(event) )
+{
+    int sliderValue = m_pSliderBudget->GetValue();
+    m_pTxtBudgetBox->SetValue( wxString::Format( wxT( "%i ms"), sliderValue ) );
+    RTTrackingHelper::getInstance()->setFrameBudget( sliderValue );
+
+    // The DTI and HARDI panels share the setting.
+    TrackingWindow *pOther = ( this == m_pMainFrame->m_pTrackingWindow ) ? m_pMainFrame->m_pTrackingWindowHardi : m_pMainFrame->m_pTrackingWindow;
+    if( pOther != NULL )
+    {
+        pOther->m_pSliderBudget->SetValue( sliderValue );
+        pOther->m_pTxtBudgetBox->SetValue( wxString::Format( wxT( "%i ms"), sliderValue ) );
+    }
+}
+
+// Shows the progressive tracking state of RTTrackingHelper.
+void TrackingWindow::updateProgressive()
+{
+    bool isProgressive = RTTrackingHelper::getInstance()->isProgressive();
+    m_pToggleProgressive->SetValue( isProgressive );
+    m_pToggleProgressive->SetLabel( isProgressive ? wxT( "Progressive tracking ON") : wxT( "Progressive tracking OFF") );
+    m_pSliderBudget->Enable( isProgressive );
+}
+
 //Deprecated
 void TrackingWindow::OnInterpolate( wxCommandEvent& WXUNUSED(event) )
 {
@@ -965,6 +1055,22 @@ void TrackingWindow::OnSliderAxisSeedNbMoved( wxCommandEvent& WXUNUSED(event) )
     RTTrackingHelper::getInstance()->setRTTDirty( true );
 }
 
+void TrackingWindow::OnSliderThreadsMoved( wxCommandEvent& WXUNUSED(event) )
+{
+    int sliderValue = m_pSliderThreads->GetValue();
+    m_pTxtThreadsBox->SetValue( wxString::Format( wxT( "%i"), sliderValue ) );
+    // The result does not depend on the number of threads, no need to track again.
+    SceneManager::getInstance()->getScene()->getRTTfibers()->setNbThreads( sliderValue );
+
+    // The DTI and HARDI panels share the setting.
+    TrackingWindow *pOther = ( this == m_pMainFrame->m_pTrackingWindow ) ? m_pMainFrame->m_pTrackingWindowHardi : m_pMainFrame->m_pTrackingWindow;
+    if( pOther != NULL )
+    {
+        pOther->m_pSliderThreads->SetValue( sliderValue );
+        pOther->m_pTxtThreadsBox->SetValue( wxString::Format( wxT( "%i"), sliderValue ) );
+    }
+}
+
 void TrackingWindow::OnConvertToFibers( wxCommandEvent& WXUNUSED(event) )
 {
     if(!SceneManager::getInstance()->getScene()->getRTTfibers()->getRTTFibers()->empty())
@@ -60,6 +60,9 @@ public:
     void OnSliderMaxLengthMoved                ( wxCommandEvent& event );
 	void OnConvertToFibers					   ( wxCommandEvent& event );
     void OnSliderAxisSeedNbMoved               ( wxCommandEvent& event );
+    void OnSliderThreadsMoved                  ( wxCommandEvent& event );
+    void OnToggleProgressive                   ( wxCommandEvent& event );
+    void OnSliderBudgetMoved                   ( wxCommandEvent& event );
 	void OnMapSeeding                          ( wxCommandEvent& event );
 	void OnSelectSeedMap                       ( wxCommandEvent& event );
 	void OnSliderOpacityMoved				   ( wxCommandEvent& event );
@@ -79,6 +82,8 @@ public:
     
 
 private:
+    void updateProgressive();
+
     MainFrame           *m_pMainFrame;
     wxSlider            *m_pSliderFA;
     wxTextCtrl          *m_pTxtFABox;
@@ -121,6 +126,11 @@ private:
     //wxStaticText        *m_pTextMaxLength;
     wxTextCtrl          *m_pTxtMaxLengthBox;
 	wxButton			*m_pBtnConvert;
+    wxSlider            *m_pSliderThreads;
+    wxTextCtrl          *m_pTxtThreadsBox;
+    wxToggleButton      *m_pToggleProgressive;
+    wxSlider            *m_pSliderBudget;
+    wxTextCtrl          *m_pTxtBudgetBox;
     wxToggleButton      *m_pToggleRandomInit;
     
     //wxStaticText        *m_pTextAxisSeedNb;
@@ -8,6 +8,7 @@
 #include "main.h"
 
 #include "Logger.h"
+#include "dataset/BatchProcessor.h"
 #include "dataset/DatasetManager.h"
 #include "dataset/Loader.h"
 #include "gfx/RenderManager.h"
@@ -27,7 +28,9 @@
 #include <wx/mdi.h>
 #include <wx/wxprec.h>
 
+#include <cstring>
 #include <exception>
+#include <vector>
 
 #ifdef __WXMAC__
     #import <CoreFoundation/CoreFoundation.h>
@@ -41,7 +44,14 @@ MainFrame * MyApp::frame = NULL;
 const wxString MyApp::APP_NAME   = wxT( "Fibernavigator" );
 const wxString MyApp::APP_VENDOR = wxT( "The Fibernavigator team." );
 
+// Outside of Windows, main is ours so that the batch mode can run without
+// initializing the GUI toolkit, e.g. on a cluster without display. The
+// benchmark executable brings its own main (benchmark/BenchmarkMain.cpp).
+#if defined( __WXMSW__ ) && !defined( FN_BENCHMARK )
 wxIMPLEMENT_APP( MyApp );
+#else
+wxIMPLEMENT_APP_NO_MAIN( MyApp );
+#endif
 
 static const wxCmdLineEntryDesc desc[] =
 {
@@ -50,10 +60,79 @@ static const wxCmdLineEntryDesc desc[] =
     { wxCMD_LINE_SWITCH, "d", "dmap", "create a distance map on the first loaded dataset" },
     { wxCMD_LINE_SWITCH, "m", "maximize", "maximize window on startup" },
     { wxCMD_LINE_SWITCH, "e", "exit", "exit after executing the command line" },
-    { wxCMD_LINE_PARAM, NULL, NULL, "scene file", wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_PARAM_MULTIPLE },
+    { wxCMD_LINE_SWITCH, "b", "batch", "process the scene files without any window and exit" },
+    { wxCMD_LINE_SWITCH, "c", "convert", "convert the fibers files to the binary format (.fbt) without any window and exit" },
+    { wxCMD_LINE_OPTION, "a", "anatomy", "anatomy giving the grid of the fibers to convert", wxCMD_LINE_VAL_STRING },
+    { wxCMD_LINE_OPTION, "o", "output", "output directory of the batch mode and of the conversion", wxCMD_LINE_VAL_STRING },
+    { wxCMD_LINE_PARAM, NULL, NULL, "scene or fibers file", wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_PARAM_MULTIPLE },
     { wxCMD_LINE_NONE } 
 };
 
+/////////////////////////////////////////////////////////////////////////////
+// Returns the exit code of the application.
+
+static int runBatch( wxCmdLineParser &cmdParser )
+{
+    std::vector< wxString > files;
+    for ( size_t i = 0; i < cmdParser.GetParamCount(); ++i )
+    {
+        wxFileName fName( cmdParser.GetParam( i ) );
+        fName.Normalize( wxPATH_NORM_LONG | wxPATH_NORM_DOTS | wxPATH_NORM_TILDE | wxPATH_NORM_ABSOLUTE );
+        files.push_back( fName.GetFullPath() );
+    }
+
+    wxString outputDir = wxGetCwd();
+    if ( cmdParser.Found( _T( "o" ), &outputDir ) )
+    {
+        wxFileName dirName = wxFileName::DirName( outputDir );
+        dirName.Normalize( wxPATH_NORM_LONG | wxPATH_NORM_DOTS | wxPATH_NORM_TILDE | wxPATH_NORM_ABSOLUTE );
+        outputDir = dirName.GetPath();
+    }
+
+    if ( cmdParser.Found( _T( "c" ) ) )
+    {
+        wxString anatomyPath;
+        if ( !cmdParser.Found( _T( "a" ), &anatomyPath ) )
+        {
+            Logger::getInstance()->print( wxT( "The conversion needs an anatomy (-a) giving the grid of the fibers" ), LOGLEVEL_ERROR );
+            return EXIT_FAILURE;
+        }
+        return BatchProcessor::convert( files, anatomyPath, outputDir ) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    return BatchProcessor::run( files, outputDir ) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#if !defined( __WXMSW__ ) && !defined( FN_BENCHMARK )
+int main( int argc, char **argv )
+{
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( 0 == strcmp( argv[i], "-b" ) || 0 == strcmp( argv[i], "--batch" ) ||
+             0 == strcmp( argv[i], "-c" ) || 0 == strcmp( argv[i], "--convert" ) )
+        {
+            // Without initializer function, wxWidgets creates a console
+            // application and never connects to the display.
+            wxApp::SetInitializerFunction( NULL );
+            wxInitializer initializer( argc, argv );
+            if ( !initializer.IsOk() )
+            {
+                return EXIT_FAILURE;
+            }
+
+            wxCmdLineParser cmdParser( desc, argc, argv );
+            if ( cmdParser.Parse() != 0 )
+            {
+                return EXIT_FAILURE;
+            }
+            return runBatch( cmdParser );
+        }
+    }
+
+    return wxEntry( argc, argv );
+}
+#endif
+
 MyApp::MyApp()
 {
 }
@@ -116,6 +195,17 @@ bool MyApp::OnInit( void )
 
 #endif
 
+#ifdef __WXMSW__
+        {
+            wxCmdLineParser batchParser( desc, argc, argv );
+            batchParser.Parse( false );
+            if ( batchParser.Found( _T( "b" ) ) || batchParser.Found( _T( "c" ) ) )
+            {
+                exit( runBatch( batchParser ) );
+            }
+        }
+#endif
+
         Logger::getInstance()->print( wxT( "Warning: This version of Fibernavigator is debug compiled." ), LOGLEVEL_DEBUG );
         Logger::getInstance()->print( wxT( "For better performance please compile a Release version."), LOGLEVEL_DEBUG );
         Logger::getInstance()->print( wxString::Format( wxT( "respath: %s" ), respath.c_str() ), LOGLEVEL_DEBUG );
@@ -0,0 +1,310 @@
+#include "BinaryMorphology.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Mask of the bits of the last word of a row that hold voxels.
+    wxUint64 getLastWordMask( int columns )
+    {
+        const int used = columns & 63;
+        return used == 0 ? ~wxUint64( 0 ) : ( wxUint64( 1 ) << used ) - 1;
+    }
+
+    // Row y, z of io_dst is the union (dilation) or the intersection
+    // (erosion) of the rows of src at the offsets of the element, each one
+    // shifted along x.
+    template< bool isDilation >
+    void combineRows( const BinaryVolume &src, const StructuringElement &element, BinaryVolume &io_dst, int y, int z )
+    {
+        const int words = src.getWordsPerRow();
+        wxUint64 *pDst = io_dst.getRow( y, z );
+        std::fill( pDst, pDst + words, isDilation ? wxUint64( 0 ) : ~wxUint64( 0 ) );
+
+        for( int dz = -1; dz <= 1; ++dz )
+        {
+            for( int dy = -1; dy <= 1; ++dy )
+            {
+                const unsigned int mask = element.getRowMask( dy, dz );
+                if( mask == 0 )
+                {
+                    continue;
+                }
+
+                const int yy = y + dy;
+                const int zz = z + dz;
+                if( yy < 0 || yy >= src.getRows() || zz < 0 || zz >= src.getFrames() )
+                {
+                    if( isDilation )
+                    {
+                        continue;
+                    }
+                    std::fill( pDst, pDst + words, wxUint64( 0 ) );
+                    return;
+                }
+
+                const wxUint64 *pSrc = src.getRow( yy, zz );
+                for( int w = 0; w < words; ++w )
+                {
+                    const wxUint64 prev    = w > 0         ? pSrc[w - 1] : 0;
+                    const wxUint64 next    = w + 1 < words ? pSrc[w + 1] : 0;
+                    const wxUint64 left    = ( pSrc[w] << 1 ) | ( prev >> 63 );   // Voxel x - 1.
+                    const wxUint64 right   = ( pSrc[w] >> 1 ) | ( next << 63 );   // Voxel x + 1.
+
+                    wxUint64 value = isDilation ? 0 : ~wxUint64( 0 );
+                    if( mask & 1 )
+                    {
+                        value = isDilation ? value | left : value & left;
+                    }
+                    if( mask & 2 )
+                    {
+                        value = isDilation ? value | pSrc[w] : value & pSrc[w];
+                    }
+                    if( mask & 4 )
+                    {
+                        value = isDilation ? value | right : value & right;
+                    }
+
+                    pDst[w] = isDilation ? pDst[w] | value : pDst[w] & value;
+                }
+            }
+        }
+
+        pDst[words - 1] &= getLastWordMask( src.getColumns() );
+    }
+
+    template< bool isDilation >
+    void apply( BinaryVolume &io_volume, const StructuringElement &element, int iterations )
+    {
+        if( io_volume.getWordsPerRow() == 0 )
+        {
+            return;
+        }
+
+        const int rows   = io_volume.getRows();
+        const int frames = io_volume.getFrames();
+        BinaryVolume result( io_volume.getColumns(), rows, frames );
+
+        for( int i = 0; i < iterations; ++i )
+        {
+#ifdef _OPENMP
+            #pragma omp parallel for schedule( static )
+#endif
+            for( int z = 0; z < frames; ++z )
+            {
+                for( int y = 0; y < rows; ++y )
+                {
+                    combineRows< isDilation >( io_volume, element, result, y, z );
+                }
+            }
+
+            io_volume.swap( result );
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+BinaryVolume::BinaryVolume()
+:   m_columns( 0 ),
+    m_rows( 0 ),
+    m_frames( 0 ),
+    m_wordsPerRow( 0 )
+{
+}
+
+BinaryVolume::BinaryVolume( int columns, int rows, int frames )
+:   m_columns( columns ),
+    m_rows( rows ),
+    m_frames( frames ),
+    m_wordsPerRow( ( columns + 63 ) / 64 ),
+    m_words( static_cast< size_t >( m_wordsPerRow ) * rows * frames, 0 )
+{
+}
+
+void BinaryVolume::set( int x, int y, int z, bool value )
+{
+    const wxUint64 bit = wxUint64( 1 ) << ( x & 63 );
+    if( value )
+    {
+        m_words[getWordIndex( x, y, z )] |= bit;
+    }
+    else
+    {
+        m_words[getWordIndex( x, y, z )] &= ~bit;
+    }
+}
+
+void BinaryVolume::clear()
+{
+    std::fill( m_words.begin(), m_words.end(), wxUint64( 0 ) );
+}
+
+void BinaryVolume::swap( BinaryVolume &other )
+{
+    std::swap( m_columns, other.m_columns );
+    std::swap( m_rows, other.m_rows );
+    std::swap( m_frames, other.m_frames );
+    std::swap( m_wordsPerRow, other.m_wordsPerRow );
+    m_words.swap( other.m_words );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+StructuringElement::StructuringElement( Shape shape )
+{
+    std::fill( &m_rowMasks[0][0], &m_rowMasks[0][0] + 9, 0u );
+
+    for( int dz = -1; dz <= 1; ++dz )
+    {
+        for( int dy = -1; dy <= 1; ++dy )
+        {
+            for( int dx = -1; dx <= 1; ++dx )
+            {
+                // Number of axes along which the offset moves.
+                const int order = ( dx != 0 ) + ( dy != 0 ) + ( dz != 0 );
+                const int maxOrder = shape == SHAPE_FACES ? 1 : ( shape == SHAPE_EDGES ? 2 : 3 );
+                set( dx, dy, dz, order <= maxOrder );
+            }
+        }
+    }
+}
+
+void StructuringElement::set( int dx, int dy, int dz, bool value )
+{
+    const unsigned int bit = 1u << ( dx + 1 );
+    if( value )
+    {
+        m_rowMasks[dz + 1][dy + 1] |= bit;
+    }
+    else
+    {
+        m_rowMasks[dz + 1][dy + 1] &= ~bit;
+    }
+}
+
+StructuringElement StructuringElement::getReflection() const
+{
+    StructuringElement reflection( *this );
+    for( int dz = -1; dz <= 1; ++dz )
+    {
+        for( int dy = -1; dy <= 1; ++dy )
+        {
+            for( int dx = -1; dx <= 1; ++dx )
+            {
+                reflection.set( dx, dy, dz, contains( -dx, -dy, -dz ) );
+            }
+        }
+    }
+    return reflection;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// A voxel is reached by the element centered on p when it lies at p + e,
+// that is when p lies at the voxel minus e: the rows are gathered through
+// the reflected element.
+///////////////////////////////////////////////////////////////////////////
+void BinaryMorphology::dilate( BinaryVolume &io_volume, const StructuringElement &element, int iterations )
+{
+    apply< true >( io_volume, element.getReflection(), iterations );
+}
+
+void BinaryMorphology::erode( BinaryVolume &io_volume, const StructuringElement &element, int iterations )
+{
+    apply< false >( io_volume, element, iterations );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Flood fill from each voxel not visited yet. The empty words are skipped
+// without looking at their bits.
+///////////////////////////////////////////////////////////////////////////
+void BinaryMorphology::removeSmallComponents( BinaryVolume &io_volume, const StructuringElement &element, int minSize )
+{
+    const int columns = io_volume.getColumns();
+    const int rows    = io_volume.getRows();
+    const int frames  = io_volume.getFrames();
+    const int words   = io_volume.getWordsPerRow();
+
+    std::vector< int > offsets;
+    for( int dz = -1; dz <= 1; ++dz )
+    {
+        for( int dy = -1; dy <= 1; ++dy )
+        {
+            for( int dx = -1; dx <= 1; ++dx )
+            {
+                if( ( dx != 0 || dy != 0 || dz != 0 ) && element.contains( dx, dy, dz ) )
+                {
+                    offsets.push_back( dx );
+                    offsets.push_back( dy );
+                    offsets.push_back( dz );
+                }
+            }
+        }
+    }
+
+    BinaryVolume visited( columns, rows, frames );
+    std::vector< int > toVisit;
+    std::vector< int > component;   // x, y, z of each voxel.
+
+    for( int z = 0; z < frames; ++z )
+    {
+        for( int y = 0; y < rows; ++y )
+        {
+            const wxUint64 *pRow = io_volume.getRow( y, z );
+            for( int w = 0; w < words; ++w )
+            {
+                wxUint64 bits = pRow[w] & ~visited.getRow( y, z )[w];
+                for( int b = 0; bits != 0; ++b, bits >>= 1 )
+                {
+                    const int x = w * 64 + b;
+                    if( ( bits & 1 ) == 0 || visited.get( x, y, z ) )
+                    {
+                        continue;
+                    }
+
+                    visited.set( x, y, z, true );
+                    toVisit.push_back( x );
+                    toVisit.push_back( y );
+                    toVisit.push_back( z );
+                    component.clear();
+
+                    while( !toVisit.empty() )
+                    {
+                        const int cz = toVisit.back(); toVisit.pop_back();
+                        const int cy = toVisit.back(); toVisit.pop_back();
+                        const int cx = toVisit.back(); toVisit.pop_back();
+                        component.push_back( cx );
+                        component.push_back( cy );
+                        component.push_back( cz );
+
+                        for( size_t o = 0; o < offsets.size(); o += 3 )
+                        {
+                            const int nx = cx + offsets[o];
+                            const int ny = cy + offsets[o + 1];
+                            const int nz = cz + offsets[o + 2];
+                            if( nx < 0 || nx >= columns || ny < 0 || ny >= rows || nz < 0 || nz >= frames )
+                            {
+                                continue;
+                            }
+                            if( io_volume.get( nx, ny, nz ) && !visited.get( nx, ny, nz ) )
+                            {
+                                visited.set( nx, ny, nz, true );
+                                toVisit.push_back( nx );
+                                toVisit.push_back( ny );
+                                toVisit.push_back( nz );
+                            }
+                        }
+                    }
+
+                    if( static_cast< int >( component.size() / 3 ) < minSize )
+                    {
+                        for( size_t i = 0; i < component.size(); i += 3 )
+                        {
+                            io_volume.set( component[i], component[i + 1], component[i + 2], false );
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,102 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            BinaryMorphology.h
+//
+// Description: Dilation, erosion and connected components of binary volumes.
+//
+// The volumes hold one bit per voxel, each row packed in 64 bit words, so
+// that a row is shifted by one voxel along x with a few word operations.
+// The rows of neighbouring lines and slices are then combined word by word,
+// the slices of the result being computed in parallel.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef BINARYMORPHOLOGY_H_
+#define BINARYMORPHOLOGY_H_
+
+#include <wx/defs.h>
+
+#include <cstddef>
+#include <vector>
+
+class BinaryVolume
+{
+public:
+    BinaryVolume();
+    BinaryVolume( int columns, int rows, int frames );
+
+    int getColumns() const      { return m_columns; }
+    int getRows() const         { return m_rows; }
+    int getFrames() const       { return m_frames; }
+    int getWordsPerRow() const  { return m_wordsPerRow; }
+
+    bool get( int x, int y, int z ) const
+    {
+        return ( m_words[getWordIndex( x, y, z )] >> ( x & 63 ) ) & 1;
+    }
+
+    void set( int x, int y, int z, bool value );
+    void clear();
+    void swap( BinaryVolume &other );
+
+    // Bit x & 63 of word x / 64 is the voxel x of the row. The bits past the
+    // last column are always 0.
+    wxUint64 *       getRow( int y, int z )         { return &m_words[( static_cast< size_t >( z ) * m_rows + y ) * m_wordsPerRow]; }
+    const wxUint64 * getRow( int y, int z ) const   { return &m_words[( static_cast< size_t >( z ) * m_rows + y ) * m_wordsPerRow]; }
+
+private:
+    size_t getWordIndex( int x, int y, int z ) const
+    {
+        return ( static_cast< size_t >( z ) * m_rows + y ) * m_wordsPerRow + ( x >> 6 );
+    }
+
+    int m_columns;
+    int m_rows;
+    int m_frames;
+    int m_wordsPerRow;
+    std::vector< wxUint64 > m_words;
+};
+
+// Offsets of a structuring element, within the 3x3x3 neighbourhood of a voxel.
+class StructuringElement
+{
+public:
+    enum Shape
+    {
+        SHAPE_FACES,    // The voxel and its 6 face neighbours.
+        SHAPE_EDGES,    // The voxel and its 18 face and edge neighbours.
+        SHAPE_CUBE      // The whole 3x3x3 cube.
+    };
+
+    explicit StructuringElement( Shape shape );
+
+    bool contains( int dx, int dy, int dz ) const   { return ( m_rowMasks[dz + 1][dy + 1] >> ( dx + 1 ) ) & 1; }
+    void set( int dx, int dy, int dz, bool value );
+
+    // Offsets along x of the row at ( dy, dz ), bit dx + 1.
+    unsigned int getRowMask( int dy, int dz ) const { return m_rowMasks[dz + 1][dy + 1]; }
+
+    // Element holding the opposite offsets.
+    StructuringElement getReflection() const;
+
+private:
+    unsigned int m_rowMasks[3][3];
+};
+
+class BinaryMorphology
+{
+private:
+    BinaryMorphology(){};
+    ~BinaryMorphology(){};
+
+public:
+    // Adds every voxel covered by the element centered on a voxel of the volume.
+    static void dilate( BinaryVolume &io_volume, const StructuringElement &element, int iterations = 1 );
+
+    // Keeps the voxels where the whole element lies inside the volume. The
+    // voxels outside the grid count as background.
+    static void erode( BinaryVolume &io_volume, const StructuringElement &element, int iterations = 1 );
+
+    // Clears the components of less than minSize voxels, the voxels of a
+    // component being connected through the offsets of the element.
+    static void removeSmallComponents( BinaryVolume &io_volume, const StructuringElement &element, int minSize );
+};
+
+#endif /* BINARYMORPHOLOGY_H_ */
@@ -0,0 +1,127 @@
+#include "DistanceTransform.h"
+
+#include <limits>
+
+namespace
+{
+    // Lower envelope of the parabolas y = ( spacing * ( x - p ) )^2 + f( p ),
+    // written back to f. Samples at infinity do not add any parabola.
+    // pSites, pValues and pBounds are scratch arrays of n, n and n + 1 elements.
+    void transformLine( float *pF, int n, double spacing, int *pSites, float *pValues, double *pBounds )
+    {
+        const double spacing2 = spacing * spacing;
+        const float  infinity = DistanceTransform::getInfinity();
+
+        int k = -1;
+        for( int q = 0; q < n; ++q )
+        {
+            if( pF[q] == infinity )
+            {
+                continue;
+            }
+
+            // Position where the parabola of q gets below the rightmost one of the envelope.
+            double s = 0.0;
+            while( k >= 0 )
+            {
+                const int p = pSites[k];
+                s = ( ( pF[q] + spacing2 * q * q ) - ( pF[p] + spacing2 * p * p ) ) / ( 2.0 * spacing2 * ( q - p ) );
+                if( s > pBounds[k] )
+                {
+                    break;
+                }
+                --k;
+            }
+
+            ++k;
+            pSites[k]      = q;
+            pBounds[k]     = k == 0 ? -std::numeric_limits< double >::max() : s;
+            pBounds[k + 1] = std::numeric_limits< double >::max();
+        }
+
+        if( k < 0 )
+        {
+            return;
+        }
+
+        // The envelope is copied aside, so f can be overwritten in place.
+        for( int j = 0; j <= k; ++j )
+        {
+            pValues[j] = pF[pSites[j]];
+        }
+
+        int j = 0;
+        for( int q = 0; q < n; ++q )
+        {
+            while( pBounds[j + 1] < q )
+            {
+                ++j;
+            }
+            const double dx = spacing * ( q - pSites[j] );
+            pF[q] = static_cast< float >( dx * dx + pValues[j] );
+        }
+    }
+}
+
+float DistanceTransform::getInfinity()
+{
+    return std::numeric_limits< float >::infinity();
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Each pass gathers a line of the volume in a buffer local to the thread,
+// transforms it and writes it back.
+///////////////////////////////////////////////////////////////////////////
+void DistanceTransform::computeSquared( std::vector< float > &io_values,
+                                        int   columns, int   rows,    int   frames,
+                                        float voxelX,  float voxelY,  float voxelZ )
+{
+    const int dims[3]      = { columns, rows, frames };
+    const double sizes[3]  = { voxelX, voxelY, voxelZ };
+    const long strides[3]  = { 1, columns, static_cast< long >( columns ) * rows };
+
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        // The lines are numbered along the other two axes, lowest stride
+        // first, so that neighbouring lines share cache lines.
+        const int axisU = axis == 0 ? 1 : 0;
+        const int axisV = axis == 2 ? 1 : 2;
+        const int n = dims[axis];
+        const int u = dims[axisU];
+        const int v = dims[axisV];
+        const long stride  = strides[axis];
+        const long strideU = strides[axisU];
+        const long strideV = strides[axisV];
+        const int nbLines  = u * v;
+
+#ifdef _OPENMP
+        #pragma omp parallel
+#endif
+        {
+            std::vector< float >  line( n );
+            std::vector< int >    sites( n );
+            std::vector< float >  values( n );
+            std::vector< double > bounds( n + 1 );
+
+#ifdef _OPENMP
+            #pragma omp for schedule( static )
+#endif
+            for( int l = 0; l < nbLines; ++l )
+            {
+                float *pStart = &io_values[( l % u ) * strideU + ( l / u ) * strideV];
+
+                for( int i = 0; i < n; ++i )
+                {
+                    line[i] = pStart[i * stride];
+                }
+
+                transformLine( &line[0], n, sizes[axis], &sites[0], &values[0], &bounds[0] );
+
+                for( int i = 0; i < n; ++i )
+                {
+                    pStart[i * stride] = line[i];
+                }
+            }
+        }
+    }
+}
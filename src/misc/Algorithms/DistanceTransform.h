@@ -0,0 +1,35 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            DistanceTransform.h
+//
+// Description: Exact euclidean distance transform of a volume.
+//
+// The transform is separable: the lower envelope of the parabolas rooted at
+// each voxel is computed along x, then y, then z (Felzenszwalb and
+// Huttenlocher, "Distance Transforms of Sampled Functions"). Each pass is
+// linear in the number of voxels and its lines are processed in parallel.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef DISTANCETRANSFORM_H_
+#define DISTANCETRANSFORM_H_
+
+#include <vector>
+
+class DistanceTransform
+{
+private:
+    DistanceTransform(){};
+    ~DistanceTransform(){};
+
+public:
+    // On input, io_values holds 0 at the feature voxels and
+    // getInfinity() everywhere else (x varies fastest, then y, then z).
+    // On output, it holds the squared distance to the nearest feature voxel,
+    // in the units of the voxel sizes. A volume without any feature voxel is
+    // left untouched.
+    static void computeSquared( std::vector< float > &io_values,
+                                int   columns, int   rows,    int   frames,
+                                float voxelX,  float voxelY,  float voxelZ );
+
+    static float getInfinity();
+};
+
+#endif /* DISTANCETRANSFORM_H_ */
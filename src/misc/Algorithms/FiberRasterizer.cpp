@@ -0,0 +1,414 @@
+#include "FiberRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+    // Tiles are cubes of TILE_SIZE voxels per side.
+    const int TILE_SHIFT      = 4;
+    const int TILE_SIZE       = 1 << TILE_SHIFT;
+    const int TILE_MASK       = TILE_SIZE - 1;
+    const int TILE_VOXELS     = TILE_SIZE * TILE_SIZE * TILE_SIZE;
+
+    // Values kept for each voxel of a tile.
+    enum { CELL_DENSITY, CELL_ENDPOINTS, CELL_DIR_X, CELL_DIR_Y, CELL_DIR_Z, CELL_SIZE };
+
+    const int LINES_PER_BLOCK = 256;
+
+    // Tiles a thread may hold before adding them to the output, about 5 MB.
+    // A line can go over the limit by the tiles it crosses.
+    const size_t MAX_TILES_PER_THREAD = 64;
+}
+
+// Tiles of the grid touched by one thread, allocated on first use.
+struct FiberRasterizer::TileSet
+{
+    std::vector< std::vector< float > > m_tiles;
+    std::vector< int >                  m_allocated;
+};
+
+FiberRasterizer::FiberRasterizer( int   columns, int   rows,    int   frames,
+                                  float voxelX,  float voxelY,  float voxelZ )
+: m_columns( columns ),
+  m_rows( rows ),
+  m_frames( frames ),
+  m_voxelX( voxelX ),
+  m_voxelY( voxelY ),
+  m_voxelZ( voxelZ ),
+  m_tilesX( ( columns + TILE_MASK ) >> TILE_SHIFT ),
+  m_tilesY( ( rows    + TILE_MASK ) >> TILE_SHIFT ),
+  m_tilesZ( ( frames  + TILE_MASK ) >> TILE_SHIFT ),
+  m_density( columns * rows * frames, 0.0f ),
+  m_directionSum( columns * rows * frames * 3, 0.0f ),
+  m_endpoints( columns * rows * frames, 0.0f )
+{
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Lines are handed to the threads in blocks. Each thread writes to its own
+// tiles; only the flushes of full tile sets into the output are serialised.
+///////////////////////////////////////////////////////////////////////////
+void FiberRasterizer::add( const float *pPoints, const std::vector< int > &linePointers, const std::vector< bool > *pMask )
+{
+    const int countLines = static_cast< int >( linePointers.size() ) - 1;
+    if( countLines <= 0 || getVoxelCount() == 0 )
+    {
+        return;
+    }
+
+#ifdef _OPENMP
+    const int nbThreads = omp_get_max_threads();
+#else
+    const int nbThreads = 1;
+#endif
+
+    std::vector< TileSet > threadTiles( nbThreads );
+    for( int t = 0; t < nbThreads; ++t )
+    {
+        threadTiles[t].m_tiles.resize( m_tilesX * m_tilesY * m_tilesZ );
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+#ifdef _OPENMP
+        TileSet &tiles = threadTiles[omp_get_thread_num()];
+#else
+        TileSet &tiles = threadTiles[0];
+#endif
+        std::vector< int > visited;
+
+#ifdef _OPENMP
+        #pragma omp for schedule( dynamic, LINES_PER_BLOCK )
+#endif
+        for( int l = 0; l < countLines; ++l )
+        {
+            if( pMask != NULL && !( *pMask )[l] )
+            {
+                continue;
+            }
+
+            const int first = linePointers[l];
+            const int count = linePointers[l + 1] - first;
+            if( count > 0 )
+            {
+                rasterizeLine( pPoints, first, count, tiles, visited );
+            }
+
+            if( tiles.m_allocated.size() >= MAX_TILES_PER_THREAD )
+            {
+                flush( tiles );
+            }
+        }
+    }
+
+    reduce( threadTiles );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void FiberRasterizer::getDirection( std::vector< float > &o_direction ) const
+{
+    o_direction.assign( m_directionSum.size(), 0.0f );
+    const int nbVoxels = getVoxelCount();
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( static )
+#endif
+    for( int i = 0; i < nbVoxels; ++i )
+    {
+        const float *pSum = &m_directionSum[i * 3];
+        const float norm = std::sqrt( pSum[0] * pSum[0] + pSum[1] * pSum[1] + pSum[2] * pSum[2] );
+        if( norm > 0.0f )
+        {
+            o_direction[i * 3]     = pSum[0] / norm;
+            o_direction[i * 3 + 1] = pSum[1] / norm;
+            o_direction[i * 3 + 2] = pSum[2] / norm;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// A line adds one to the density of every voxel it goes through, however
+// many of its segments do.
+///////////////////////////////////////////////////////////////////////////
+void FiberRasterizer::rasterizeLine( const float *pPoints, int first, int count, TileSet &tiles, std::vector< int > &visited ) const
+{
+    visited.clear();
+
+    const float *pFirst = &pPoints[first * 3];
+    const float *pLast  = &pPoints[( first + count - 1 ) * 3];
+
+    if( count == 1 )
+    {
+        traverseSegment( pFirst, pFirst, tiles, visited );
+    }
+    for( const float *pA = pFirst; pA < pLast; pA += 3 )
+    {
+        traverseSegment( pA, pA + 3, tiles, visited );
+    }
+
+    std::sort( visited.begin(), visited.end() );
+    visited.erase( std::unique( visited.begin(), visited.end() ), visited.end() );
+
+    const int sliceSize = m_columns * m_rows;
+    for( std::vector< int >::const_iterator it = visited.begin(); it != visited.end(); ++it )
+    {
+        const int z = *it / sliceSize;
+        const int y = ( *it - z * sliceSize ) / m_columns;
+        const int x = *it - z * sliceSize - y * m_columns;
+        getCell( tiles, x, y, z )[CELL_DENSITY] += 1.0f;
+    }
+
+    int x, y, z;
+    if( toVoxel( pFirst, x, y, z ) )
+    {
+        getCell( tiles, x, y, z )[CELL_ENDPOINTS] += 1.0f;
+    }
+    if( count > 1 && toVoxel( pLast, x, y, z ) )
+    {
+        getCell( tiles, x, y, z )[CELL_ENDPOINTS] += 1.0f;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The segment is clipped to the grid, then followed from one voxel boundary
+// to the next. Each voxel receives the direction of the segment weighted by
+// the length of the part inside it.
+///////////////////////////////////////////////////////////////////////////
+void FiberRasterizer::traverseSegment( const float *pA, const float *pB, TileSet &tiles, std::vector< int > &visited ) const
+{
+    const int    dims[3]  = { m_columns, m_rows, m_frames };
+    const double sizes[3] = { m_voxelX, m_voxelY, m_voxelZ };
+
+    double start[3];
+    double delta[3];
+    double direction[3];
+    double length = 0.0;
+
+    for( int i = 0; i < 3; ++i )
+    {
+        start[i]     = pA[i] / sizes[i];
+        delta[i]     = ( pB[i] - pA[i] ) / sizes[i];
+        direction[i] = std::abs( pB[i] - pA[i] );
+        length      += direction[i] * direction[i];
+    }
+    length = std::sqrt( length );
+
+    // Part of the segment inside [0, dims).
+    double tEnter = 0.0;
+    double tExit  = 1.0;
+    for( int i = 0; i < 3; ++i )
+    {
+        if( delta[i] == 0.0 )
+        {
+            if( start[i] < 0.0 || start[i] >= dims[i] )
+            {
+                return;
+            }
+        }
+        else
+        {
+            double t0 = -start[i] / delta[i];
+            double t1 = ( dims[i] - start[i] ) / delta[i];
+            if( t0 > t1 )
+            {
+                std::swap( t0, t1 );
+            }
+            tEnter = std::max( tEnter, t0 );
+            tExit  = std::min( tExit,  t1 );
+        }
+    }
+    if( tEnter > tExit )
+    {
+        return;
+    }
+
+    int    voxel[3];
+    int    step[3];
+    double tNextBoundary[3];
+    double tBetweenBoundaries[3];
+
+    for( int i = 0; i < 3; ++i )
+    {
+        const double entry = start[i] + tEnter * delta[i];
+        voxel[i] = std::min( dims[i] - 1, std::max( 0, static_cast< int >( std::floor( entry ) ) ) );
+
+        if( delta[i] > 0.0 )
+        {
+            step[i]               = 1;
+            tNextBoundary[i]      = ( voxel[i] + 1 - start[i] ) / delta[i];
+            tBetweenBoundaries[i] = 1.0 / delta[i];
+        }
+        else if( delta[i] < 0.0 )
+        {
+            step[i]               = -1;
+            tNextBoundary[i]      = ( voxel[i] - start[i] ) / delta[i];
+            tBetweenBoundaries[i] = -1.0 / delta[i];
+        }
+        else
+        {
+            step[i]               = 0;
+            tNextBoundary[i]      = std::numeric_limits< double >::max();
+            tBetweenBoundaries[i] = 0.0;
+        }
+    }
+
+    double t = tEnter;
+    for( ;; )
+    {
+        const double tNext = std::min( tExit, std::min( tNextBoundary[0], std::min( tNextBoundary[1], tNextBoundary[2] ) ) );
+
+        visited.push_back( voxel[0] + ( voxel[1] + voxel[2] * m_rows ) * m_columns );
+
+        const double inside = ( tNext - t );
+        if( inside > 0.0 )
+        {
+            float *pCell = getCell( tiles, voxel[0], voxel[1], voxel[2] );
+            pCell[CELL_DIR_X] += static_cast< float >( direction[0] * inside );
+            pCell[CELL_DIR_Y] += static_cast< float >( direction[1] * inside );
+            pCell[CELL_DIR_Z] += static_cast< float >( direction[2] * inside );
+        }
+
+        if( tNext >= tExit )
+        {
+            break;
+        }
+        t = tNext;
+
+        // Crossing an edge or a corner moves along several axes at once.
+        bool leftGrid = false;
+        for( int i = 0; i < 3; ++i )
+        {
+            if( tNextBoundary[i] == tNext )
+            {
+                voxel[i]         += step[i];
+                tNextBoundary[i] += tBetweenBoundaries[i];
+                leftGrid = leftGrid || voxel[i] < 0 || voxel[i] >= dims[i];
+            }
+        }
+        if( leftGrid )
+        {
+            break;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+bool FiberRasterizer::toVoxel( const float *pPoint, int &o_x, int &o_y, int &o_z ) const
+{
+    const double x = std::floor( pPoint[0] / m_voxelX );
+    const double y = std::floor( pPoint[1] / m_voxelY );
+    const double z = std::floor( pPoint[2] / m_voxelZ );
+
+    if( x < 0.0 || y < 0.0 || z < 0.0 || x >= m_columns || y >= m_rows || z >= m_frames )
+    {
+        return false;
+    }
+
+    o_x = static_cast< int >( x );
+    o_y = static_cast< int >( y );
+    o_z = static_cast< int >( z );
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+float* FiberRasterizer::getCell( TileSet &tiles, int x, int y, int z ) const
+{
+    const int tile = ( x >> TILE_SHIFT ) + ( ( y >> TILE_SHIFT ) + ( z >> TILE_SHIFT ) * m_tilesY ) * m_tilesX;
+    std::vector< float > &cells = tiles.m_tiles[tile];
+    if( cells.empty() )
+    {
+        cells.resize( TILE_VOXELS * CELL_SIZE, 0.0f );
+        tiles.m_allocated.push_back( tile );
+    }
+
+    const int local = ( x & TILE_MASK ) + ( ( y & TILE_MASK ) + ( z & TILE_MASK ) * TILE_SIZE ) * TILE_SIZE;
+    return &cells[local * CELL_SIZE];
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Adds the tiles of a thread to the output and releases them.
+///////////////////////////////////////////////////////////////////////////
+void FiberRasterizer::flush( TileSet &tiles )
+{
+#ifdef _OPENMP
+    #pragma omp critical( FiberRasterizerFlush )
+#endif
+    {
+        for( std::vector< int >::const_iterator it = tiles.m_allocated.begin(); it != tiles.m_allocated.end(); ++it )
+        {
+            accumulateTile( tiles.m_tiles[*it], *it );
+        }
+    }
+
+    for( std::vector< int >::const_iterator it = tiles.m_allocated.begin(); it != tiles.m_allocated.end(); ++it )
+    {
+        std::vector< float >().swap( tiles.m_tiles[*it] );
+    }
+    tiles.m_allocated.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void FiberRasterizer::accumulateTile( const std::vector< float > &cells, int tile )
+{
+    const int tileX = ( tile % m_tilesX ) << TILE_SHIFT;
+    const int tileY = ( ( tile / m_tilesX ) % m_tilesY ) << TILE_SHIFT;
+    const int tileZ = ( tile / ( m_tilesX * m_tilesY ) ) << TILE_SHIFT;
+    const int endX  = std::min( m_columns, tileX + TILE_SIZE );
+    const int endY  = std::min( m_rows,    tileY + TILE_SIZE );
+    const int endZ  = std::min( m_frames,  tileZ + TILE_SIZE );
+
+    for( int z = tileZ; z < endZ; ++z )
+    {
+        for( int y = tileY; y < endY; ++y )
+        {
+            for( int x = tileX; x < endX; ++x )
+            {
+                const int local = ( x - tileX ) + ( ( y - tileY ) + ( z - tileZ ) * TILE_SIZE ) * TILE_SIZE;
+                const float *pCell = &cells[local * CELL_SIZE];
+                const int voxel = x + ( y + z * m_rows ) * m_columns;
+
+                m_density[voxel]              += pCell[CELL_DENSITY];
+                m_endpoints[voxel]            += pCell[CELL_ENDPOINTS];
+                m_directionSum[voxel * 3]     += pCell[CELL_DIR_X];
+                m_directionSum[voxel * 3 + 1] += pCell[CELL_DIR_Y];
+                m_directionSum[voxel * 3 + 2] += pCell[CELL_DIR_Z];
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The tiles left after the last flushes are summed in parallel. The counts
+// are integers, so the density and endpoint maps do not depend on how the
+// lines were scheduled nor on when the tiles were flushed.
+///////////////////////////////////////////////////////////////////////////
+void FiberRasterizer::reduce( const std::vector< TileSet > &threadTiles )
+{
+    const int nbTiles = m_tilesX * m_tilesY * m_tilesZ;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule( dynamic )
+#endif
+    for( int tile = 0; tile < nbTiles; ++tile )
+    {
+        for( size_t t = 0; t < threadTiles.size(); ++t )
+        {
+            if( !threadTiles[t].m_tiles[tile].empty() )
+            {
+                accumulateTile( threadTiles[t].m_tiles[tile], tile );
+            }
+        }
+    }
+}
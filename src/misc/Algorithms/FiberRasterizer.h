@@ -0,0 +1,70 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            FiberRasterizer.h
+//
+// Description: Accumulates streamlines into voxel maps without any GL context.
+//
+// Every segment is walked voxel by voxel (Amanatides and Woo, "A Fast Voxel
+// Traversal Algorithm for Ray Tracing"), so a voxel crossed between two
+// points is counted as well. Threads accumulate into their own sparse tiles
+// of the output grid. A thread holds a bounded number of tiles: they are added
+// to the output whenever that bound is reached, and once all lines are done.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FIBERRASTERIZER_H_
+#define FIBERRASTERIZER_H_
+
+#include <cstddef>
+#include <vector>
+
+class FiberRasterizer
+{
+public:
+    // The output grid, which does not need to match any loaded dataset.
+    FiberRasterizer( int   columns, int   rows,    int   frames,
+                     float voxelX,  float voxelY,  float voxelZ );
+
+    // Adds the lines of pPoints (x, y, z triplets in mm). linePointers holds the
+    // index of the first point of each line, followed by the total point count.
+    // Lines whose entry in pMask is false are skipped. Results of successive
+    // calls are summed.
+    void add( const float *pPoints, const std::vector< int > &linePointers, const std::vector< bool > *pMask = NULL );
+
+    // Number of lines going through each voxel.
+    const std::vector< float >& getDensity() const   { return m_density;   };
+
+    // Number of line extremities in each voxel.
+    const std::vector< float >& getEndpoints() const { return m_endpoints; };
+
+    // Mean absolute direction of the lines in each voxel, weighted by their
+    // length inside it, as unit vectors (3 bands, zero where nothing passes).
+    void getDirection( std::vector< float > &o_direction ) const;
+
+    int getVoxelCount() const                        { return m_columns * m_rows * m_frames; };
+
+private:
+    struct TileSet;
+
+    void rasterizeLine( const float *pPoints, int first, int count, TileSet &tiles, std::vector< int > &visited ) const;
+    void traverseSegment( const float *pA, const float *pB, TileSet &tiles, std::vector< int > &visited ) const;
+    bool toVoxel( const float *pPoint, int &o_x, int &o_y, int &o_z ) const;
+    float* getCell( TileSet &tiles, int x, int y, int z ) const;
+    void flush( TileSet &tiles );
+    void accumulateTile( const std::vector< float > &cells, int tile );
+    void reduce( const std::vector< TileSet > &threadTiles );
+
+    int   m_columns;
+    int   m_rows;
+    int   m_frames;
+    float m_voxelX;
+    float m_voxelY;
+    float m_voxelZ;
+
+    int   m_tilesX;
+    int   m_tilesY;
+    int   m_tilesZ;
+
+    std::vector< float > m_density;
+    std::vector< float > m_directionSum;
+    std::vector< float > m_endpoints;
+};
+
+#endif /* FIBERRASTERIZER_H_ */
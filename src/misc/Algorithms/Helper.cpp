@@ -14,6 +14,7 @@
 #include "misc/Algorithms/BSpline.h"
 
 #include <math.h>
+#include <algorithm>
 #include <cassert>
 
 #ifndef M_PI
@@ -362,6 +363,112 @@ double Helper::getFAFromEigenValues( double i_eigenValue1, double i_eigenValue2,
         return pow( 3.0f / 2.0f, 0.5f ) * l_numerator / l_denominator;
 }
 
+/////////////////////////////////////////////////////////////////////////// 
+// Computes the eigen values of a symmetric 3x3 matrix, and the eigen vector
+// of the largest one, in closed form (trigonometric solution of the
+// characteristic polynomial). Nothing is allocated, so it can be called for
+// every fiber from parallel loops.
+//
+// i_matrix           : The upper triangle of the matrix: xx, xy, xz, yy, yz, zz.
+// o_eigenValues      : The eigen values, sorted from the largest to the smallest.
+// o_mainEigenVector  : The normalized eigen vector of o_eigenValues[0].
+///////////////////////////////////////////////////////////////////////////
+void Helper::getSymmetricEigenSystem( const double i_matrix[6], double o_eigenValues[3], double o_mainEigenVector[3] )
+{
+    const double a00 = i_matrix[0], a01 = i_matrix[1], a02 = i_matrix[2];
+    const double a11 = i_matrix[3], a12 = i_matrix[4], a22 = i_matrix[5];
+
+    const double offDiagonal = a01 * a01 + a02 * a02 + a12 * a12;
+    const double q = ( a00 + a11 + a22 ) / 3.0;
+
+    if( offDiagonal == 0.0 )
+    {
+        // Diagonal matrix.
+        double values[3] = { a00, a11, a22 };
+        int order[3] = { 0, 1, 2 };
+        for( int i = 0; i < 2; ++i )
+        {
+            for( int j = i + 1; j < 3; ++j )
+            {
+                if( values[order[j]] > values[order[i]] )
+                {
+                    std::swap( order[i], order[j] );
+                }
+            }
+        }
+        for( int i = 0; i < 3; ++i )
+        {
+            o_eigenValues[i] = values[order[i]];
+            o_mainEigenVector[i] = i == order[0] ? 1.0 : 0.0;
+        }
+        return;
+    }
+
+    const double b00 = a00 - q, b11 = a11 - q, b22 = a22 - q;
+    const double p = sqrt( ( b00 * b00 + b11 * b11 + b22 * b22 + 2.0 * offDiagonal ) / 6.0 );
+
+    // Half of the determinant of ( A - qI ) / p.
+    double r = ( b00 * ( b11 * b22 - a12 * a12 ) - a01 * ( a01 * b22 - a12 * a02 ) + a02 * ( a01 * a12 - b11 * a02 ) ) / ( 2.0 * p * p * p );
+    r = std::max( -1.0, std::min( 1.0, r ) );
+
+    const double phi = acos( r ) / 3.0;
+    o_eigenValues[0] = q + 2.0 * p * cos( phi );
+    o_eigenValues[2] = q + 2.0 * p * cos( phi + 2.0 * M_PI / 3.0 );
+    o_eigenValues[1] = 3.0 * q - o_eigenValues[0] - o_eigenValues[2];
+
+    // The eigen vector is orthogonal to the rows of A - l0 I, so it is the
+    // largest cross product of two of them.
+    const double rows[3][3] = { { a00 - o_eigenValues[0], a01, a02 },
+                                { a01, a11 - o_eigenValues[0], a12 },
+                                { a02, a12, a22 - o_eigenValues[0] } };
+    double best = 0.0;
+    for( int i = 0; i < 3; ++i )
+    {
+        const double *u = rows[i];
+        const double *v = rows[( i + 1 ) % 3];
+        const double cross[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+        const double norm = cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2];
+        if( norm > best )
+        {
+            best = norm;
+            for( int k = 0; k < 3; ++k )
+            {
+                o_mainEigenVector[k] = cross[k];
+            }
+        }
+    }
+
+    if( best <= 1e-24 * ( p * p * p * p ) )
+    {
+        // The largest eigen value is double: any vector orthogonal to the
+        // remaining row of A - l0 I will do.
+        int largest = 0;
+        double largestNorm = 0.0;
+        for( int i = 0; i < 3; ++i )
+        {
+            const double norm = rows[i][0] * rows[i][0] + rows[i][1] * rows[i][1] + rows[i][2] * rows[i][2];
+            if( norm > largestNorm )
+            {
+                largestNorm = norm;
+                largest = i;
+            }
+        }
+        const double *u = rows[largest];
+        const int axis = fabs( u[0] ) < fabs( u[1] ) ? ( fabs( u[0] ) < fabs( u[2] ) ? 0 : 2 ) : ( fabs( u[1] ) < fabs( u[2] ) ? 1 : 2 );
+        const double e[3] = { axis == 0 ? 1.0 : 0.0, axis == 1 ? 1.0 : 0.0, axis == 2 ? 1.0 : 0.0 };
+        o_mainEigenVector[0] = u[1] * e[2] - u[2] * e[1];
+        o_mainEigenVector[1] = u[2] * e[0] - u[0] * e[2];
+        o_mainEigenVector[2] = u[0] * e[1] - u[1] * e[0];
+        best = o_mainEigenVector[0] * o_mainEigenVector[0] + o_mainEigenVector[1] * o_mainEigenVector[1] + o_mainEigenVector[2] * o_mainEigenVector[2];
+    }
+
+    const double norm = sqrt( best );
+    for( int k = 0; k < 3; ++k )
+    {
+        o_mainEigenVector[k] /= norm;
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // This function will fill up o_spherePoints with the calculated points of 
 // a sphere with i_latsFullSphere laterals and i_longsFullSphere longitudinal.
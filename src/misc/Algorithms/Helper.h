@@ -227,6 +227,7 @@ public:
     static double   getLegendrePlm           ( int i_m, double i_x );
     static float    getFactorial             ( int i_n );
     static double   getFAFromEigenValues     ( double i_eigenValue1, double i_eigenValue2, double i_eigenValue3 ); 
+    static void     getSymmetricEigenSystem  ( const double i_matrix[6], double o_eigenValues[3], double o_mainEigenVector[3] );
 
     // Comparaison functions
     template< class T >
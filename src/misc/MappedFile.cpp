@@ -0,0 +1,118 @@
+#include "MappedFile.h"
+
+#ifdef __WXMSW__
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+:   m_pData( NULL ),
+    m_size( 0 )
+#ifdef __WXMSW__
+    , m_fileHandle( INVALID_HANDLE_VALUE ),
+    m_mappingHandle( NULL )
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open( const wxString &filename )
+{
+    close();
+
+#ifdef __WXMSW__
+    m_fileHandle = CreateFileW( filename.wc_str(), GENERIC_READ, FILE_SHARE_READ, NULL, 
+                                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if( m_fileHandle == INVALID_HANDLE_VALUE )
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if( !GetFileSizeEx( m_fileHandle, &fileSize ) || fileSize.QuadPart == 0 )
+    {
+        close();
+        return false;
+    }
+
+    m_mappingHandle = CreateFileMappingW( m_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( m_mappingHandle == NULL )
+    {
+        close();
+        return false;
+    }
+
+    m_pData = static_cast< const char * >( MapViewOfFile( m_mappingHandle, FILE_MAP_READ, 0, 0, 0 ) );
+    if( m_pData == NULL )
+    {
+        close();
+        return false;
+    }
+    m_size = static_cast< std::size_t >( fileSize.QuadPart );
+#else
+    int fd = ::open( filename.fn_str(), O_RDONLY );
+    if( fd < 0 )
+    {
+        return false;
+    }
+
+    struct stat fileStat;
+    if( fstat( fd, &fileStat ) != 0 || fileStat.st_size == 0 )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    void *pMap = mmap( NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd ); // The mapping keeps its own reference to the file.
+
+    if( pMap == MAP_FAILED )
+    {
+        return false;
+    }
+
+    // The file is mostly read front to back.
+    madvise( pMap, fileStat.st_size, MADV_SEQUENTIAL );
+
+    m_pData = static_cast< const char * >( pMap );
+    m_size  = static_cast< std::size_t >( fileStat.st_size );
+#endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef __WXMSW__
+    if( m_pData != NULL )
+    {
+        UnmapViewOfFile( m_pData );
+    }
+    if( m_mappingHandle != NULL )
+    {
+        CloseHandle( m_mappingHandle );
+        m_mappingHandle = NULL;
+    }
+    if( m_fileHandle != INVALID_HANDLE_VALUE )
+    {
+        CloseHandle( m_fileHandle );
+        m_fileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if( m_pData != NULL )
+    {
+        munmap( const_cast< char * >( m_pData ), m_size );
+    }
+#endif
+
+    m_pData = NULL;
+    m_size  = 0;
+}
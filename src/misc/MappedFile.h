@@ -0,0 +1,43 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            MappedFile.h
+//
+// Description: Read-only memory mapping of a whole file.
+//
+// The pages are loaded by the system on first access and can be dropped
+// under memory pressure, so reading a large file through the mapping does
+// not need a heap buffer of the size of the file.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <wx/string.h>
+
+#include <cstddef>
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open( const wxString &filename );
+    void close();
+
+    bool          isOpen() const  { return m_pData != NULL; }
+    const char *  getData() const { return m_pData; }
+    std::size_t   getSize() const { return m_size; }
+
+private:
+    MappedFile( const MappedFile & );             // Not copyable
+    MappedFile & operator=( const MappedFile & );
+
+    const char *m_pData;
+    std::size_t m_size;
+
+#ifdef __WXMSW__
+    void *m_fileHandle;
+    void *m_mappingHandle;
+#endif
+};
+
+#endif //MAPPEDFILE_H_
@@ -0,0 +1,262 @@
+#include "Profiler.h"
+
+#include "../Logger.h"
+
+#include <algorithm>
+#include <fstream>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+namespace
+{
+// Frames of the rolling breakdown.
+const size_t FRAME_HISTORY = 60;
+
+// About 40 MB of trace, a few minutes of interaction.
+const size_t MAX_TRACE_EVENTS = 1000000;
+
+bool isLongerSection( const std::pair< std::string, double > &lhs, const std::pair< std::string, double > &rhs )
+{
+    return lhs.second > rhs.second;
+}
+}
+
+Profiler * Profiler::m_pInstance = NULL;
+bool       Profiler::m_enabled   = false;
+
+Profiler::Profiler()
+:   m_isTraceFull( false ),
+    m_frameStart( 0.0 )
+{
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+Profiler::~Profiler()
+{
+    m_pInstance = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+Profiler * Profiler::getInstance()
+{
+#ifdef _OPENMP
+    #pragma omp critical( profiler )
+#endif
+    {
+        if( NULL == m_pInstance )
+        {
+            m_pInstance = new Profiler();
+        }
+    }
+    return m_pInstance;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Every activation starts a new recording: the trace and the breakdown
+// only cover the time since the profiler was enabled.
+///////////////////////////////////////////////////////////////////////////
+void Profiler::setEnabled( bool enabled )
+{
+    if( enabled && !m_enabled )
+    {
+        m_events.clear();
+        m_isTraceFull = false;
+        m_currentFrame = Frame();
+        m_frames.clear();
+        m_frameStart = getTime();
+    }
+    m_enabled = enabled;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void Profiler::addSection( const char *name, double start, double duration )
+{
+    Event event;
+    event.m_name     = name;
+    event.m_start    = start;
+    event.m_duration = duration;
+    event.m_value    = 0.0;
+    addEvent( event );
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void Profiler::addCount( const char *name, double value )
+{
+    Event event;
+    event.m_name     = name;
+    event.m_start    = getTime();
+    event.m_duration = -1.0;
+    event.m_value    = value;
+    addEvent( event );
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Sections can be closed by the threads of a parallel region.
+///////////////////////////////////////////////////////////////////////////
+void Profiler::addEvent( const Event &event )
+{
+    Event tracedEvent( event );
+#ifdef _OPENMP
+    tracedEvent.m_thread = omp_get_thread_num();
+#else
+    tracedEvent.m_thread = 0;
+#endif
+
+#ifdef _OPENMP
+    #pragma omp critical( profiler )
+#endif
+    {
+        if( event.m_duration < 0.0 )
+        {
+            m_currentFrame.m_counters[event.m_name] += event.m_value;
+        }
+        else
+        {
+            Section &section = m_currentFrame.m_sections[event.m_name];
+            section.m_time += event.m_duration / 1000.0;
+            section.m_calls++;
+        }
+
+        if( m_events.size() < MAX_TRACE_EVENTS )
+        {
+            m_events.push_back( tracedEvent );
+        }
+        else if( !m_isTraceFull )
+        {
+            m_isTraceFull = true;
+            Logger::getInstance()->print( wxT( "Profiler trace is full, the next events are only in the frame breakdown" ), LOGLEVEL_WARNING );
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void Profiler::endFrame()
+{
+    if( !m_enabled )
+    {
+        return;
+    }
+
+    const double now = getTime();
+    m_currentFrame.m_duration = ( now - m_frameStart ) / 1000.0;
+    m_frameStart = now;
+
+    m_frames.push_back( m_currentFrame );
+    if( m_frames.size() > FRAME_HISTORY )
+    {
+        m_frames.pop_front();
+    }
+    m_currentFrame = Frame();
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Mean time per frame of every section over the last frames, longest
+// first. Sections are nested, their times add up to more than a frame.
+///////////////////////////////////////////////////////////////////////////
+wxString Profiler::getFrameBreakdown() const
+{
+    if( m_frames.empty() )
+    {
+        return m_enabled ? wxT( "Waiting for a frame..." ) : wxT( "Profiler disabled." );
+    }
+
+    double frameTime( 0.0 );
+    std::map< std::string, Section > sections;
+    std::map< std::string, double >  counters;
+    for( std::deque< Frame >::const_iterator itFrame = m_frames.begin(); itFrame != m_frames.end(); ++itFrame )
+    {
+        frameTime += itFrame->m_duration;
+        for( std::map< std::string, Section >::const_iterator it = itFrame->m_sections.begin(); it != itFrame->m_sections.end(); ++it )
+        {
+            sections[it->first].m_time  += it->second.m_time;
+            sections[it->first].m_calls += it->second.m_calls;
+        }
+        for( std::map< std::string, double >::const_iterator it = itFrame->m_counters.begin(); it != itFrame->m_counters.end(); ++it )
+        {
+            counters[it->first] += it->second;
+        }
+    }
+
+    const double nbFrames = m_frames.size();
+
+    std::vector< std::pair< std::string, double > > sorted;
+    for( std::map< std::string, Section >::const_iterator it = sections.begin(); it != sections.end(); ++it )
+    {
+        sorted.push_back( std::make_pair( it->first, it->second.m_time ) );
+    }
+    std::sort( sorted.begin(), sorted.end(), isLongerSection );
+
+    wxString breakdown = wxString::Format( wxT( "Mean of the last %d frames: %.2f ms per frame (%.1f fps)\n\n" ),
+                                           static_cast< int >( m_frames.size() ), frameTime / nbFrames, 
+                                           frameTime > 0.0 ? 1000.0 * nbFrames / frameTime : 0.0 );
+    breakdown += wxString::Format( wxT( "%-40s %10s %8s\n" ), wxT( "Section" ), wxT( "ms/frame" ), wxT( "calls" ) );
+    for( size_t i = 0; i < sorted.size(); ++i )
+    {
+        const Section &section = sections[sorted[i].first];
+        breakdown += wxString::Format( wxT( "%-40s %10.3f %8.1f\n" ), wxString::FromAscii( sorted[i].first.c_str() ).c_str(), 
+                                       section.m_time / nbFrames, section.m_calls / nbFrames );
+    }
+
+    if( !counters.empty() )
+    {
+        breakdown += wxString::Format( wxT( "\n%-40s %10s\n" ), wxT( "Counter" ), wxT( "per frame" ) );
+        for( std::map< std::string, double >::const_iterator it = counters.begin(); it != counters.end(); ++it )
+        {
+            breakdown += wxString::Format( wxT( "%-40s %10.1f\n" ), wxString::FromAscii( it->first.c_str() ).c_str(), it->second / nbFrames );
+        }
+    }
+
+    return breakdown;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Complete events ("X") for the sections and counter events ("C"), in
+// microseconds, one row per OpenMP thread.
+///////////////////////////////////////////////////////////////////////////
+bool Profiler::writeChromeTrace( const wxString &filename ) const
+{
+    std::ofstream file( filename.fn_str() );
+    if( !file )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "Cannot open \"%s\"" ), filename.c_str() ), LOGLEVEL_ERROR );
+        return false;
+    }
+
+    file.setf( std::ios::fixed );
+    file.precision( 3 );
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    for( size_t i = 0; i < m_events.size(); ++i )
+    {
+        const Event &event = m_events[i];
+        file << ( i == 0 ? "\n" : ",\n" );
+        if( event.m_duration < 0.0 )
+        {
+            file << "{\"name\":\"" << event.m_name << "\",\"ph\":\"C\",\"ts\":" << event.m_start
+                 << ",\"pid\":1,\"tid\":" << event.m_thread << ",\"args\":{\"value\":" << event.m_value << "}}";
+        }
+        else
+        {
+            file << "{\"name\":\"" << event.m_name << "\",\"ph\":\"X\",\"ts\":" << event.m_start << ",\"dur\":" << event.m_duration
+                 << ",\"pid\":1,\"tid\":" << event.m_thread << "}";
+        }
+    }
+
+    file << "\n]}\n";
+
+    if( !file )
+    {
+        Logger::getInstance()->print( wxString::Format( wxT( "Cannot write \"%s\"" ), filename.c_str() ), LOGLEVEL_ERROR );
+        return false;
+    }
+
+    Logger::getInstance()->print( wxString::Format( wxT( "Profiler trace of %d events saved in \"%s\"" ), static_cast< int >( m_events.size() ), filename.c_str() ), LOGLEVEL_MESSAGE );
+    return true;
+}
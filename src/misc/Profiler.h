@@ -0,0 +1,135 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:            Profiler.h
+//
+// Description: Timing of the hot paths.
+//
+// PROFILE_SCOPE( "name" ) times the enclosing scope and PROFILE_COUNT adds
+// a value to a per-frame counter. Nothing is recorded until the profiler
+// is enabled (Help menu): the disabled cost is the test of a static flag.
+// Building with FN_NO_PROFILER removes the instrumentation completely.
+//
+// The recorded sections are kept for a rolling per-frame breakdown, where
+// MainCanvas ends a frame after each render of the main view, and for a
+// trace that can be saved in the Chrome trace format (chrome://tracing).
+/////////////////////////////////////////////////////////////////////////////
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <wx/stopwatch.h>
+#include <wx/string.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+class Profiler
+{
+public:
+    ~Profiler();
+
+    static Profiler * getInstance();
+
+    static bool isEnabled()     { return m_enabled; }
+    void setEnabled( bool enabled );
+
+    // Microseconds since the profiler was created. Before wxWidgets 2.9.3,
+    // the stop watch only counts milliseconds.
+#if wxCHECK_VERSION( 2, 9, 3 )
+    double getTime() const      { return m_clock.TimeInMicro().ToDouble(); }
+#else
+    double getTime() const      { return m_clock.Time() * 1000.0; }
+#endif
+
+    void addSection( const char *name, double start, double duration );
+    void addCount( const char *name, double value );
+    void endFrame();
+
+    wxString getFrameBreakdown() const;
+    bool writeChromeTrace( const wxString &filename ) const;
+
+private:
+    Profiler();
+
+    struct Event
+    {
+        const char *m_name;
+        double      m_start;
+        double      m_duration;     // Negative for a counter
+        double      m_value;
+        int         m_thread;
+    };
+
+    struct Section
+    {
+        Section() : m_time( 0.0 ), m_calls( 0 ) {}
+        double m_time;
+        long   m_calls;
+    };
+
+    struct Frame
+    {
+        Frame() : m_duration( 0.0 ) {}
+        double                              m_duration;
+        std::map< std::string, Section >    m_sections;
+        std::map< std::string, double >     m_counters;
+    };
+
+    void addEvent( const Event &event );
+
+    static Profiler *m_pInstance;
+    static bool     m_enabled;
+
+    wxStopWatch         m_clock;
+    std::vector< Event > m_events;
+    bool                m_isTraceFull;
+    Frame               m_currentFrame;
+    double              m_frameStart;
+    std::deque< Frame > m_frames;
+};
+
+///////////////////////////////////////////////////////////////////////////
+// Records the time between its creation and its destruction. The name must
+// outlive the profiler, use a string literal.
+///////////////////////////////////////////////////////////////////////////
+class ProfileScope
+{
+public:
+    explicit ProfileScope( const char *name )
+    :   m_name( name ),
+        m_start( -1.0 )
+    {
+        if( Profiler::isEnabled() )
+        {
+            m_start = Profiler::getInstance()->getTime();
+        }
+    }
+
+    ~ProfileScope()
+    {
+        if( m_start >= 0.0 )
+        {
+            Profiler *pProfiler = Profiler::getInstance();
+            pProfiler->addSection( m_name, m_start, pProfiler->getTime() - m_start );
+        }
+    }
+
+private:
+    ProfileScope( const ProfileScope & );             // Not copyable
+    ProfileScope & operator=( const ProfileScope & );
+
+    const char *m_name;
+    double      m_start;
+};
+
+#ifdef FN_NO_PROFILER
+    #define PROFILE_SCOPE( name )
+    #define PROFILE_COUNT( name, value )
+#else
+    #define PROFILE_SCOPE_JOIN( a, b ) a##b
+    #define PROFILE_SCOPE_NAME( line ) PROFILE_SCOPE_JOIN( profileScope, line )
+    #define PROFILE_SCOPE( name ) ProfileScope PROFILE_SCOPE_NAME( __LINE__ )( name )
+    #define PROFILE_COUNT( name, value ) do { if( Profiler::isEnabled() ) Profiler::getInstance()->addCount( name, value ); } while( false )
+#endif
+
+#endif //PROFILER_H_